@@ -3,6 +3,9 @@
 #include <iostream>
 using namespace std;
 
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <stdint.h>
 #include "ALSAManager.h"
 
 /// Define the size of our secondary buffer in bytes.
@@ -10,6 +13,11 @@ using namespace std;
 #define CAPTURE_CHUNK_SIZE 1400
 /// Used for resampling calculations and buffer info.
 #define MAX_SAMPLE_RATE 44100
+/// Longest the run() loop will block with nothing to do, in milliseconds.  This bounds how long
+/// messages posted to the thread wait to be handled.
+#define IDLE_POLL_TIMEOUT 100
+/// Poll timeout used while a PCM is being brought into the running state, in milliseconds.
+#define PENDING_POLL_TIMEOUT 1
 
 /**
      @brief     Constructor, sets initial values for internal data.
@@ -30,9 +38,20 @@ ALSAManager::ALSAManager(int numBuffers)
   _playbackByteAlign = BYTES_PER_WORD;
   /// Used to keep track of the number of frames in our playback buffer.
   _playbackFrames = 0;
-  /// We kind of pulled this number out of thin air - 20 chunks of data in our record buffer.
-  _recordBufferLength = (int)(_captureSampleRate * _bufferLatency * BYTES_PER_WORD * 20);
-  _captureBuffer = new char[_recordBufferLength];
+  _playbackFull = false;
+  _playbackAvailMin = 0;
+  /// Zero lets ALSA pick the period geometry.  See SetPeriodGeometry().
+  _requestedPeriodFrames = 0;
+  _requestedPeriods = 0;
+  _periodFrames = 0;
+  _numPeriods = 0;
+  _captureFrames = 0;
+  _capturePeriodFrames = 0;
+  _captureAvailMin = 0;
+  /// Read/write access unless SetMmapMode() asks otherwise.
+  _mmapRequested = false;
+  _playbackMmap = false;
+  _captureMmap = false;
   int count;
   /// Create volume and pan values.
   for( count = 0; count < _numBuffers; count++ )
@@ -40,14 +59,22 @@ ALSAManager::ALSAManager(int numBuffers)
       _secondaryBuffers.push_back( new SecondaryBuffer );
       _secondaryBuffers[count]->_volume = 0;
       _secondaryBuffers[count]->_pan = 0;
-      _secondaryBuffers[count]->_isPlaying = false;
       _secondaryBuffers[count]->_bytesPerSample = BYTES_PER_WORD;
+      _secondaryBuffers[count]->_channels = MONO;
       _secondaryBuffers[count]->_mutex = new DSSystem::CriticalSection;
       _secondaryBuffers[count]->_bufferData = new DSUtil::RingBuffer( SECONDARY_BUFFER_SIZE );
       _secondaryBuffers[count]->_sampleRate = 44100;
-      _secondaryBuffers[count]->_chunkSize = _bufferLatency * _secondaryBuffers[count]->_sampleRate * _secondaryBuffers[count]->_bytesPerSample;
-      /// Chunk size MUST be an even number of bytes.
-      _secondaryBuffers[count]->_chunkSize &= ~1;
+      _secondaryBuffers[count]->UpdateChunkSize( _bufferLatency );
+    }
+  /// Tracks which channels are playing for IsBufferPlaying().  The mixer keeps its own list,
+  /// updated through commands, so the audio thread never touches this one.
+  _activeChannels = new ActiveChannelList( _numBuffers );
+  _mixer = new Mixer( &_secondaryBuffers );
+  /// Written by Wake() so that run() returns from poll() when something changes.
+  _wakeFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+  if( _wakeFd < 0 )
+    {
+      cout << "ALSAManager: Cannot create wake event, falling back to timed polling." << endl;
     }
 	/// Higher thread priority in order to watch the sound buffers better.
 	setPriorityAboveNormal();
@@ -73,7 +100,12 @@ ALSAManager::~ALSAManager()
       delete _secondaryBuffers[count]->_mutex;
       delete _secondaryBuffers[count];
     }
-  delete[] _captureBuffer;
+  delete _mixer;
+  delete _activeChannels;
+  if( _wakeFd >= 0 )
+    {
+      close( _wakeFd );
+    }
   //cout << "~ALSAManager: Done deleting channel-related data" << endl;
 }
 
@@ -192,7 +224,8 @@ bool ALSAManager::Init(void *parentWindow, int* soundCard, const char *name)
   }
 	
   //cout << "Init: snd_pcm_hw_params_set_access" << endl;
-  if ((err = snd_pcm_hw_params_set_access (_playbackHandle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0)
+  _playbackMmap = SetAccess( _playbackHandle, hw_params, "Init" );
+  if( !_playbackMmap && (err = snd_pcm_hw_params_set_access (_playbackHandle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0)
   {
       cout << "Init: cannot set access type (" << snd_strerror (err) << ")" << endl;
       return false;
@@ -226,24 +259,12 @@ bool ALSAManager::Init(void *parentWindow, int* soundCard, const char *name)
            << " acquired)" << endl;
   }
 
-  /// Setting the period and buffer size may be completely unnecessary.  Since it doesn't actually work, we'll bypass
-  /// it for now.
-
-  //cout << "snd_pcm_hw_params_set_period_size" << endl;
-  //if(( err = snd_pcm_hw_params_set_period_size( _captureHandle, hw_params, _recordChunkSize, 0 )) < 0 )
-  //{
-  //        fprintf( stderr, "cannot set period size (%s)\n", snd_strerror(err));
-  //        return false;
-  //}
-
-
-  /// Playback buffer same size as capture buffer.
-  //snd_pcm_uframes_t numFrames = _recordChunkSize * _recordChunkTotal;
-  //if(( err = snd_pcm_hw_params_set_buffer_size( _playbackHandle, hw_params, numFrames )) < 0 )
-  //{
-  //        fprintf( stderr, "cannot set buffer size (%s)\n", snd_strerror(err));
-  //        return false;
-  //}
+  /// Ask for the period geometry set with SetPeriodGeometry(), if any.  The _near calls
+  /// settle on the closest the hardware supports.
+  if( !SetHardwareGeometry( _playbackHandle, hw_params, "Init" ) )
+  {
+      return false;
+  }
 	
   //cout << "Init: snd_pcm_hw_params" << endl;
   if ((err = snd_pcm_hw_params (_playbackHandle, hw_params)) < 0)
@@ -253,13 +274,46 @@ bool ALSAManager::Init(void *parentWindow, int* soundCard, const char *name)
   }
 
   snd_pcm_uframes_t bufferSize;
+  snd_pcm_uframes_t periodSize;
+  unsigned int periods;
+  int dir = 0;
   snd_pcm_hw_params_get_buffer_size( hw_params, &bufferSize );
-  cout << "Init: Buffer size = " << bufferSize << " frames." << endl;
+  snd_pcm_hw_params_get_period_size( hw_params, &periodSize, &dir );
+  snd_pcm_hw_params_get_periods( hw_params, &periods, &dir );
   _playbackFrames = bufferSize;
+  _periodFrames = periodSize;
+  _numPeriods = periods;
+  cout << "Init: Buffer size = " << bufferSize << " frames in " << periods << " periods of " << periodSize << " frames ("
+       << GetPlaybackLatency() * 1000.0 << " ms)." << endl;
   cout << "Init: Significant bits for linear samples = " << snd_pcm_hw_params_get_sbits(hw_params) << endl;
 
   //cout << "Init: snd_pcm_hw_params_free" << endl;
   snd_pcm_hw_params_free (hw_params);
+
+  /// In low-latency mode the mixer works one period at a time, so each block written is
+  /// exactly what the card has room for.
+  if( _requestedPeriodFrames > 0 )
+  {
+      _bufferLatency = (double)_periodFrames / _playbackSampleRate;
+      int channel;
+      for( channel = 0; channel < _numBuffers; channel++ )
+	{
+	  _secondaryBuffers[channel]->_mutex->lock();
+	  _secondaryBuffers[channel]->UpdateChunkSize( _bufferLatency );
+	  _secondaryBuffers[channel]->_mutex->unlock();
+	}
+  }
+
+  /// Size our mixing scratch space now so the audio thread never has to allocate.
+  AllocateMixArena();
+
+  /// Wake up once a block can be written without going past the buffer latency, and start
+  /// as soon as the first period is queued.
+  _playbackAvailMin = GetPlaybackAvailMin();
+  if( !SetSoftwareParams( _playbackHandle, _playbackAvailMin, _periodFrames, "Init" ) )
+  {
+      return false;
+  }
 	
   //cout << "Init: snd_pcm_prepare" << endl;
   if ((err = snd_pcm_prepare (_playbackHandle)) < 0)
@@ -288,16 +342,19 @@ bool ALSAManager::Init(void *parentWindow, int* soundCard, const char *name)
 */
 bool ALSAManager::UnInit()
 {
-  snd_pcm_close (_playbackHandle);
   _inited = false;
+  _capturing = false;
+  StopCaptureThread();
+  snd_pcm_close (_playbackHandle);
+  /// Don't leave run() waiting on descriptors that no longer exist.
+  Wake();
   return true;
 }
 
 /**
      @brief     Mixes secondary buffers into main playback buffer.
-     This function mixes data from the secondary buffers into a main stereo buffer,
-	 including resampling and calculations for pan and volume settings, and then
-	 writes it to the soundcard.  This is the real workhorse of ALSAManager.
+     This function keeps the primary buffer running and, when it has room, has the Mixer
+	 build a block of stereo data from the secondary buffers and writes it to the soundcard.
      @return
      returns false if the sound has not been initialized or is not playing.
 */
@@ -305,15 +362,9 @@ bool ALSAManager::ProcessSoundBuffer( void )
 {
   /// Error checking variable.
   int err = 0;
-  /// Write positions of the buffer.
-  int writePos = 0;
-  bool playing = false;
   /// Samples avaialble.
   int pcmreturn = 0;
-  /// Channel iterator.
-  int channel = 0;
-  /// Data iterator.
-  int counter = 0;
+  _playbackFull = false;
 
   /// Check to see whether we actually have anything to do.
   if( !_inited )
@@ -324,17 +375,7 @@ bool ALSAManager::ProcessSoundBuffer( void )
 
   /// We only need to monitor the buffer if one of our sound streams is playing.  If it is not,
   /// then we can safely ignore it.
-  for( channel = 0; channel < _numBuffers; channel++ )
-  {
-      _secondaryBuffers[channel]->_mutex->lock();
-      if( _secondaryBuffers[channel]->_isPlaying == true )
-	{
-	  playing = true;
-	}
-      _secondaryBuffers[channel]->_mutex->unlock();
-  }
-  /// If we have nothing to monitor, we bail.
-  if( playing == false )
+  if( _mixer->GetPlayingCount() == 0 )
   {
       return false;
   }
@@ -358,13 +399,12 @@ bool ALSAManager::ProcessSoundBuffer( void )
       {
 	/// Fill our primary buffer with a bit of silence so give us room to fill it.
 	/// Sample rate (44100) * buffer latency (0.05) * 2 (channels) * 2 (bytes per sample)
-	int bytesRequired = (int)(_playbackSampleRate * _bufferLatency * STEREO * _playbackByteAlign);
+	int bytesRequired = (int)(_playbackSampleRate * _mixer->GetBufferLatency() * STEREO * _playbackByteAlign);
         /// The amount of bytes being put into the playback buffer has to be an even multiple of 4.
         bytesRequired &= ~3;
 	//cout << "ProcessSoundBuffer: Filling primary buffer with " << _bufferLatency << " seconds [" << bytesRequired << "bytes] of silence: " << endl;
-	unsigned char *silence = new unsigned char[bytesRequired];
-	snd_pcm_writei( _playbackHandle, silence, ( bytesRequired / 4 ));
-	delete[] silence;
+	/// The mixer's silence block is always at least one stereo chunk long.
+	WriteSilence( bytesRequired / 4 );
 	//cout << "ProcessSoundBuffer: Primary buffer filled with silence.  calling snd_pcm_start" << endl;
 	snd_pcm_start( _playbackHandle );
 	cout << "ProcessSoundBuffer: snd_pcm_start called." << endl;
@@ -378,14 +418,13 @@ bool ALSAManager::ProcessSoundBuffer( void )
     case SND_PCM_STATE_XRUN:
       {
 	cout << "ProcessSoundBuffer: snd_pcm_state_xrun - attempting to recover by calling snd_pcm_prepare." << endl;
+	_latencyControl.ReportUnderrun();
 	snd_pcm_prepare( _playbackHandle );
-	int bytesRequired = (int)(_playbackSampleRate * _bufferLatency * STEREO * _playbackByteAlign);
+	int bytesRequired = (int)(_playbackSampleRate * _mixer->GetBufferLatency() * STEREO * _playbackByteAlign);
         /// The amount of bytes being written to the playback buffer must be an even multiple of 4.
         bytesRequired &= ~3;
 	//cout << "ProcessSoundBuffer: Filling primary buffer with " << _bufferLatency << " seconds [" << bytesRequired << "bytes] of silence: " << endl;
-	unsigned char *silence = new unsigned char[bytesRequired];
-	snd_pcm_writei( _playbackHandle, silence, ( bytesRequired / 4 ) );
-	delete[] silence;
+	WriteSilence( bytesRequired / 4 );
 	//cout << "ProcessSoundBuffer: Primary buffer filled with silence.  calling snd_pcm_start" << endl;
 	snd_pcm_start( _playbackHandle );
 	/// Sure, we had a glitch, but it's still running, right?
@@ -426,176 +465,53 @@ bool ALSAManager::ProcessSoundBuffer( void )
       //cout <<  "ProcessSoundBuffer: returned " << pcmreturn << " samples in playback buffer" << endl;
       /// Note that _bufferLatency is used for both capture and playback buffers.  We may want
       /// separate variables in the future.
-      if( ( _playbackFrames - pcmreturn ) >= (int)(_playbackSampleRate * _bufferLatency * _playbackByteAlign) )
+      if( ( _playbackFrames - pcmreturn ) >= GetFillTargetFrames() ||
+	  pcmreturn < _mixer->GetBlockFrames() )
       {
 	  /// Sound buffer has enough data for now, nothing else to do./
 	  //cout << "ProcessSoundBuffer: No need to write data.  Returning." << endl;
+	  _playbackFull = true;
 	  return true;
       }
   }
 
   ///---------------------- STAGE TWO: LET THE REAL WORK BEGIN ---------------------------//
 
-  /// Right now we require that our secondary buffers match format with our primary buffer.
-  ///
-  /// At some point we're going to have to be able to support mixing different bit and sample
-  /// rates into our primary buffer.
-  //cout << "ProcessSoundBuffer: Creating variables for mixing" << endl;
-  /// Set using the maximum sample rate we can use so we can mix higher sample rates down into
-  /// lower sample rates, i.e. 48000 Hz into 22050 Hz.  This is for mono data.
-  int maxBufferSize = (int)(MAX_SAMPLE_RATE * _bufferLatency * _playbackByteAlign);
-  /// Full Length of copy buffer to be mixed into main playback buffer: samples x time [2205]
-  /// x bytes per sample [2] x number of channels [2].  This is for stereo data.
-  int fullLength = (int)(_playbackSampleRate * _bufferLatency * STEREO * _playbackByteAlign);
-  /// The full length of our buffer MUST be divisible by 4 (2 bytes per sample x 2 channels )
-  fullLength &= ~3;
-  /// copyBuffer:  temporary back-buffer for mixing that will be copied into audio stream.
-  unsigned char *copyBuffer = new unsigned char[fullLength];
-  memset( copyBuffer, 0, fullLength );
-  float* rightVolumeAdjustment = new float[_numBuffers];
-  float* leftVolumeAdjustment = new float[_numBuffers];
-  int bytesRead;
-  /// We will be using this to grab data that may be of a smaller or larger sample rate than the
-  /// playback buffer, but after we resample this buffer will be exactly half the size of "fullLength"
-  /// [a mono channel for mixing into stereo].
-  ///
-  /// This is used both for grabbing the data from the secondary buffer and also passing to the
-  /// Resample() function to be filled with interpolated data, thus the data size will vary based
-  /// on the sample rates that are being converted to and from but will never be larger than MAX_SAMPLE_RATE.
-  unsigned char* channelData = new unsigned char[maxBufferSize];
-  memset( channelData, 0, maxBufferSize );
-
-  //cout << "ProcessSoundBuffer: Setting up multipliers for volume and pan" << endl;
-  /// Set up our multipliers for each channel to make this run a little quicker.
-  for( channel = 0; channel < _numBuffers; channel++ )
+  /// In mmap mode the mixer renders into the card's buffer itself, going through the staging
+  /// buffer only when the block straddles the end of it.  See MmapWrite().
+  int numFrames = _mixer->GetBlockFrames();
+  if( _playbackMmap )
   {
-      /// We are using pan to attenuate the channel that we're panning away from, but we are not increasing
-      /// the volume on the channel we've panned toward.  Doing so would put us in danger of digital clipping
-      /// unless we limit the volume adjustment values to 1.0.
-      _secondaryBuffers[channel]->_mutex->lock();
-      if( _secondaryBuffers[channel]->_pan < 0 )
-      {
-	  leftVolumeAdjustment[channel] = ((_secondaryBuffers[channel]->_volume + 9600.0f) / 9600.0f) * ((_masterVolume + 9600.0f) / 9600.0f);
-	  rightVolumeAdjustment[channel] = ((_secondaryBuffers[channel]->_pan + 1000.0f) / 1000.0f) *
-	    ((_secondaryBuffers[channel]->_volume + 9600.0f) / 9600.0f) * ((_masterVolume + 9600.0f) / 9600.0f);
-          //cout << "ProcessSoundBuffer: pan > 0: " << _secondaryBuffers[channel]->_pan << ", rightVolumeAdjustment = " << rightVolumeAdjustment[channel] << endl;
-      }
-      else
-      {
-	  leftVolumeAdjustment[channel] = ((_secondaryBuffers[channel]->_pan * -1.0f + 1000.0f ) / 1000.0f) *
-	    ((_secondaryBuffers[channel]->_volume + 9600.0f) / 9600.0f ) * ((_masterVolume + 9600.0f) / 9600.0f);
-          //cout << "ProcessSoundBuffer: pan > 0: " << _secondaryBuffers[channel]->_pan << ", leftVolumeAdjustment = " << leftVolumeAdjustment[channel] << endl;
-	  rightVolumeAdjustment[channel] = ((_secondaryBuffers[channel]->_volume + 9600.0f) / 9600.0f) * ((_masterVolume + 9600.0f) / 9600.0f);
-      }
-      _secondaryBuffers[channel]->_mutex->unlock();
+      if( MmapWrite( numFrames, false ) < 0 )
+	{
+	  return false;
+	}
+      PublishPlaybackDelay();
+      return true;
   }
 
-  /// Get data from our secondary buffers and mix it all together.
-  //cout << "ProcessSoundBuffer: Getting data from secondary buffers and mixing it" << endl;
-  for( channel = 0; channel < _numBuffers; channel++ )
-  {
-      /// Don't mix it if it isn't playing.
-      //cout << "ProcessSoundBuffer: Checking whether buffer " << channel << " is playing" << endl;
-      _secondaryBuffers[channel]->_mutex->lock();
-      bool status = _secondaryBuffers[channel]->_isPlaying;
-      _secondaryBuffers[channel]->_mutex->unlock();
-      if( status == false )
-      {
-	  //cout << "ProcessSoundBuffer: Buffer is not playing.  Skipping it." << endl;
-	  continue;
-      }
-      //cout << "ProcessSoundBuffer: Buffer is playing - reading data from ring buffer for channel " << channel << endl;
-      _secondaryBuffers[channel]->_mutex->lock();
-      int bytesRequested = (int)(_secondaryBuffers[channel]->_sampleRate * _bufferLatency * _secondaryBuffers[channel]->_bytesPerSample );
-      /// Make sure we are requesting an even number of bytes.  Not doing so would hose every other packet.
-      bytesRequested &= ~1;
-      int bytesPerSample = _secondaryBuffers[channel]->_bytesPerSample;
-      bytesRead = (_secondaryBuffers[channel]->_bufferData)->Read( channelData, bytesRequested );
-      _secondaryBuffers[channel]->_mutex->unlock();
-      FILE* fp;
-      //if( (fp = fopen( "readbuffer.raw", "wb" ) ))
-      //{
-      //  fwrite( channelData, bytesRead, 1, fp );
-      //  fclose( fp );
-      //}
-      //cout << "ProcessSoundBuffer: Read " << bytesRead << " bytes." << endl;
-
-      /// Resample our secondary buffer's data to match our primary buffer's rate if necessary.  Note that normally we will
-      /// be resampling from lower to higher rates, but we may go the other way, i.e. from 48Khz to 44.1KHz.
-      //if( _secondaryBuffers[channel]->_sampleRate != _playbackSampleRate )
-      //cout << "ProcessSoundBuffer: Logging " << bytesRead << " bytes of data read from ring buffer to readbuffer_pre_resample.raw" << endl;
-
-      //if( (fp = fopen( "readbuffer_pre_resample.raw", "ab" ) ))
-      //{
-      //  fwrite( channelData, bytesRead, 1, fp );
-      //  fclose( fp );
-      //}
-
-      int targetSamples;
-      if( bytesRead == bytesRequested )
-      {
-         targetSamples = (int)(_playbackSampleRate * _bufferLatency);
-      }
-      else
-      {
-         targetSamples = (int)((_playbackSampleRate * _bufferLatency) * bytesRead / bytesRequested );
-      }
-      /// Make sure it is an even number.
-      targetSamples &= ~1;
-
-      /// Resample our secondary buffer's data to match our primary buffer's sample rate.
-      _secondaryBuffers[channel]->_resampler.Resample( channelData, (bytesRead / bytesPerSample), targetSamples, bytesPerSample );
-      /// [channeldata must be at least as large as resultingNumSamples * bytesPerSample]
-	
-      /// Add our result to the copy buffer.
-      ///
-      /// Note that with four channels being mixed down, it would be very easy to get some ugly
-      /// digital clipping/aliasing/etc.  If it sounds bad, turn down the volume on what you're putting
-      /// into the buffers in the first place.
-      ///
-      /// Adding a master volume control would make it easier to control any volume overloads.
-      ///
-      /// For this to not nuke the stack, our _recordChunkSize MUST be an even number.
-      //cout << "ProcessSoundBuffer: mixing channel " << channel << endl;
-      int count;
-      /// Cast these to two-byte shorts in order to allow ourselves to multiply each sample by a float without
-      /// breaking things.  Things will break if a short isn't two bytes.
-      short* shortChannelData = (short *)channelData;
-      short* shortCopyBuffer = (short *)copyBuffer;
-      for( count = 0; count < targetSamples; count++ )
-      {
-          writePos = count * 2;
-	  shortCopyBuffer[writePos  ] += (short)(shortChannelData[count] * leftVolumeAdjustment[channel]);
-          shortCopyBuffer[writePos+1] += (short)(shortChannelData[count] * rightVolumeAdjustment[channel]);
-      }
-      //cout << "ProcessSoundBuffer: finished mixing channel " << channel << " with readPos " << count << " and writePos " << writePos << endl;
-  } /// Cycle through channels.
-  //cout << "deleting leftVolumeAdjustment" << endl;
-  delete[] leftVolumeAdjustment;
-  //cout << "deleting rightVolumeAdjustment" << endl;
-  delete[] rightVolumeAdjustment;
-  //cout << "ProcessSoundBuffer: deleting channelData." << endl;
-  /// Deleting this makes everything explode if we've violated our buffer.
-  delete[] channelData;
+  /// The mixer reads, resamples, and pans every playing channel into one block of stereo frames.
+  /// Its scratch space was sized by Init() or SetBufferLatency(), so nothing on this path touches the heap.
+  short* copyBuffer = _mixer->GetBlockBuffer();
+  _mixer->MixBlock( copyBuffer, numFrames, _masterVolume );
 
   /// Put it in the buffer
   //cout << "ProcessSoundBuffer: Entering while loop for write to soundcard" << endl;
   while( 1 )
   {
-      //cout << "ProcessSoundBuffer: calling snd_pcm_writei, length: " << fullLength << ", frames: " << (fullLength / 4) << endl;
+      //cout << "ProcessSoundBuffer: calling snd_pcm_writei, frames: " << numFrames << endl;
       //cout << "ProcessSoundBuffer: _playbackByteAlign = " << _playbackByteAlign << endl;
-      /// We take the number of bytes of data in our mixing buffer and divide it by the two
-      /// bytes per sample we are using and two channels for the number of frames.
+      /// snd_pcm_writei takes its length in frames, which is what the mixer works in.
 //#ifdef _DEBUG
 //      // Log in debug mode only.
 //      FILE* fp;
 //      if( (fp = fopen( "snd_pcm_writei_16signed_stereo.raw", "ab" ) ))
 //      {
-//         fwrite( copyBuffer, fullLength, 1, fp );
+//         fwrite( copyBuffer, numFrames * 4, 1, fp );
 //         fclose( fp );
 //      }
 //#endif
-      err = snd_pcm_writei( _playbackHandle, copyBuffer, (fullLength / 4) );
+      err = snd_pcm_writei( _playbackHandle, copyBuffer, numFrames );
       //cout << "ProcessSoundBuffer: snd_pcm_writei has been called, checking err value" << endl;
       if( err )
 	{
@@ -606,7 +522,6 @@ bool ALSAManager::ProcessSoundBuffer( void )
 	  if( err == -EBADFD )
 	    {
 	      cout << "ProcessSoundBuffer: -EBADFD on snd_pcm_writei." << endl;
-	      delete[] copyBuffer;
 	      return false;
 	    }
 	  if( err < 0 )
@@ -615,7 +530,6 @@ bool ALSAManager::ProcessSoundBuffer( void )
 	      if( XrunRecover( _playbackHandle, err ) < 0 )
 		{
 		  cout << "ProcessSoundBuffer: write to audio interface failed. (" << snd_strerror(err) << ")\n" << endl;
-		  delete[] copyBuffer;
 		  return false;
 		}
 	    }
@@ -627,10 +541,7 @@ bool ALSAManager::ProcessSoundBuffer( void )
 	    }
 	}
   }
-
-  /// Free the buffer we were sending to snd_pcm_writei
-  //cout << "ProcessSoundBuffer: deleting copyBuffer" << endl;
-  delete[] copyBuffer;
+  PublishPlaybackDelay();
 
   //cout << "ProcessSoundBuffer:  End of function, returning true" << endl;
   return true;
@@ -688,6 +599,11 @@ bool ALSAManager::FillBufferSilence( int channel, int length )
 
   bool err;
   //cout << "FillBufferSilence called" << endl;
+  /// Use the mixer's silence whenever it is big enough to save an allocation.
+  if( length <= _mixer->GetSilenceSize() )
+  {
+      return FillBuffer( channel, _mixer->GetSilence(), length, _secondaryBuffers[channel]->_sampleRate );
+  }
   unsigned char *data = new unsigned char[length];
   memset(data, 0, length );
 
@@ -704,7 +620,8 @@ bool ALSAManager::FillBufferSilence( int channel, int length )
 /**
   @brief  Creates the capture buffer and initializes audio capture.
 */
-bool ALSAManager::CreateCaptureBuffer( AudioRecordingCallback * recordCallback, int* soundCard, const char *name )
+bool ALSAManager::CreateCaptureBuffer( AudioRecordingCallback * recordCallback, int* soundCard, const char *name,
+                                       int numChannels, int sampleFormat )
 {
   int i;
   int err;
@@ -719,12 +636,19 @@ bool ALSAManager::CreateCaptureBuffer( AudioRecordingCallback * recordCallback,
 
   /// Set our recording callback, even if the buffer is already created - this
   /// allows us to change which callback we are using.
-  _recordingCallback = recordCallback;
+  SetRecordingCallback( recordCallback );
 
-  /// Buffer already created - don't create again.
+  /// Buffer already created - don't create again.  The format can only be changed by
+  /// deleting the capture buffer first.
   if( _captureInited )
   {
-      return true;
+      return numChannels == _captureChannels && sampleFormat == _captureSampleFormat;
+  }
+
+  if( !SetCaptureFormat( numChannels, sampleFormat ) )
+  {
+      cout << "CreateCaptureBuffer: Unsupported capture format (" << numChannels << " channels, format " << sampleFormat << ")." << endl;
+      return false;
   }
 
   //cout << "CreateCaptureBuffer: snd_pcm_open" << endl;
@@ -770,14 +694,15 @@ bool ALSAManager::CreateCaptureBuffer( AudioRecordingCallback * recordCallback,
   }
 
   //cout << "CreateCaptureBuffer: snd_pcm_hw_params_set_access" << endl;
-  if ((err = snd_pcm_hw_params_set_access (_captureHandle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) 
+  _captureMmap = SetAccess( _captureHandle, hw_params, "CreateCaptureBuffer" );
+  if( !_captureMmap && (err = snd_pcm_hw_params_set_access (_captureHandle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) 
   {
       cout << "CreateCaptureBuffer: Cannot set access type (" << snd_strerror (err) << ")" << endl;
       return false;
   }
 
   //cout << "CreateCaptureBuffer: snd_pcm_hw_params_set_format" << endl;
-  if ((err = snd_pcm_hw_params_set_format (_captureHandle, hw_params, SND_PCM_FORMAT_S16)) < 0) 
+  if ((err = snd_pcm_hw_params_set_format (_captureHandle, hw_params, GetAlsaFormat( _captureSampleFormat ))) < 0) 
   //if ((err = snd_pcm_hw_params_set_format (_playbackHandle, hw_params, SND_PCM_FORMAT_U16)) < 0)
   //if ((err = snd_pcm_hw_params_set_format (_playbackHandle, hw_params, SND_PCM_FORMAT_S16_LE)) < 0)
   {
@@ -785,11 +710,12 @@ bool ALSAManager::CreateCaptureBuffer( AudioRecordingCallback * recordCallback,
       return false;
   }
 
-  /// Single channel: Mono record from microphone.
+  /// Mono from a microphone unless the caller asked for more.  All channels come interleaved
+  /// in one stream rather than as separate mono captures.
   //cout << "CreateCaptureBuffer: snd_pcm_hw_params_set_channels" << endl;
-  if ((err = snd_pcm_hw_params_set_channels (_captureHandle, hw_params, 1)) < 0) 
+  if ((err = snd_pcm_hw_params_set_channels (_captureHandle, hw_params, _captureChannels)) < 0) 
   {
-      cout << "CreateCaptureBuffer: Cannot set channel count to 1. (" << snd_strerror (err) << ")" << endl;
+      cout << "CreateCaptureBuffer: Cannot set channel count to " << _captureChannels << ". (" << snd_strerror (err) << ")" << endl;
       return false;
   }
 
@@ -800,29 +726,19 @@ bool ALSAManager::CreateCaptureBuffer( AudioRecordingCallback * recordCallback,
       cout << "CreateCaptureBuffer: Cannot set sample rate to " << _captureSampleRate << ". (" << snd_strerror (err) << ")" << endl;
       return false;
   }
-  if( actualRate < _captureSampleRate )
+  if( actualRate != _captureSampleRate )
   {
       cout << "CreateCaptureBuffer: Sample rate does not match requested rate. (" << _captureSampleRate << " requested, "
            << actualRate << " acquired)" << endl;
+      /// Captured data is no longer resampled, so tell the callback the rate it really gets.
+      _captureSampleRate = actualRate;
   }
 
-  /// Setting the period and buffer size may be completely unnecessary.  Since it doesn't actually work, we'll bypass
-  /// it for now.
-
-  //cout << "snd_pcm_hw_params_set_period_size" << endl;
-  //if(( err = snd_pcm_hw_params_set_period_size( _captureHandle, hw_params, _recordChunkSize, 0 )) < 0 )
-  //{
-  //        fprintf( stderr, "cannot set period size (%s)\n", snd_strerror(err));
-  //        return false;
-  //}
-
-  //cout << "snd_pcm_hw_params_set_buffer_size" << endl;
-  //snd_pcm_uframes_t numFrames = _recordChunkSize * _recordChunkTotal;
-  //if(( err = snd_pcm_hw_params_set_buffer_size( _captureHandle, hw_params, numFrames )) < 0 )
-  //{
-  //        fprintf( stderr, "cannot set buffer size (%s)\n", snd_strerror(err));
-  //        return false;
-  //}
+  /// Capture uses the same geometry as playback so that round trips stay short.
+  if( !SetHardwareGeometry( _captureHandle, hw_params, "CreateCaptureBuffer" ) )
+  {
+      return false;
+  }
 
   //cout << "CreateCaptureBuffer: snd_pcm_hw_params" << endl;
   if ((err = snd_pcm_hw_params (_captureHandle, hw_params)) < 0) 
@@ -831,9 +747,25 @@ bool ALSAManager::CreateCaptureBuffer( AudioRecordingCallback * recordCallback,
       return false;
   }
 
+  snd_pcm_uframes_t bufferSize;
+  snd_pcm_uframes_t periodSize;
+  int dir = 0;
+  snd_pcm_hw_params_get_buffer_size( hw_params, &bufferSize );
+  snd_pcm_hw_params_get_period_size( hw_params, &periodSize, &dir );
+  _captureFrames = bufferSize;
+  _capturePeriodFrames = periodSize;
+  cout << "CreateCaptureBuffer: Buffer size = " << bufferSize << " frames, period size = " << periodSize << " frames ("
+       << GetCaptureLatency() * 1000.0 << " ms)." << endl;
+
   //cout << "CreateCaptureBuffer: snd_pcm_hw_params_free" << endl;
   snd_pcm_hw_params_free (hw_params);
 
+  if( !AllocateCaptureRing() )
+  {
+      cout << "CreateCaptureBuffer: Cannot allocate the capture ring." << endl;
+      return false;
+  }
+
   _captureInited = true;
 
   return true;
@@ -844,6 +776,8 @@ bool ALSAManager::CreateCaptureBuffer( AudioRecordingCallback * recordCallback,
 */
 bool ALSAManager::DeleteCaptureBuffer()
 {
+  _capturing = false;
+  StopCaptureThread();
   snd_pcm_close( _captureHandle );
   _captureInited = false;
   return true;
@@ -889,15 +823,68 @@ bool ALSAManager::SetSampleRate( int channel, int frequency )
   }
   _secondaryBuffers[channel]->_mutex->lock();
 
-  _secondaryBuffers[channel]->_sampleRate = frequency;
+  /// The mixer keeps its own copy of the rate.  Posting under the mutex keeps the commands in
+  /// the same order as the changes made here.
+  bool result = _mixer->PostCommand( MIXER_COMMAND_SET_SAMPLE_RATE, channel, frequency );
+  if( result )
+    {
+      _secondaryBuffers[channel]->_sampleRate = frequency;
 
-  /// Changing our playback sample rate forces us to recalculate our chunk size.
-  _secondaryBuffers[channel]->_chunkSize = _bufferLatency * _secondaryBuffers[channel]->_sampleRate * _secondaryBuffers[channel]->_bytesPerSample;
-  /// Chunk size MUST be an even number of bytes.
-  _secondaryBuffers[channel]->_chunkSize &= ~1;
+      /// Changing our playback sample rate forces us to recalculate our chunk size.
+      _secondaryBuffers[channel]->UpdateChunkSize( _bufferLatency );
+    }
 
   _secondaryBuffers[channel]->_mutex->unlock();
-  return true;
+  return result;
+}
+
+/**
+  @brief  Sets the number of interleaved channels in each frame of a secondary buffer.
+  Data written with FillBuffer must then be whole interleaved frames.  Mono buffers are
+  panned, stereo buffers use pan as balance, and wider buffers are folded down to stereo.
+  @note
+  Fails while the channel is playing, and for up to a block after Stop() while the audio
+  thread lets go of it.  Anything still queued in the old layout is discarded.
+*/
+bool ALSAManager::SetChannelCount( int channel, int numChannels )
+{
+  if( channel < 0 || channel >= _numBuffers || numChannels < 1 || numChannels > MAX_SOURCE_CHANNELS )
+  {
+      return false;
+  }
+
+  _secondaryBuffers[channel]->_mutex->lock();
+  // Data already queued would be read with the wrong frame stride, so the mixer drops it, and
+  // that is only safe once the channel has stopped.
+  if( _activeChannels->Contains( channel ) )
+  {
+      _secondaryBuffers[channel]->_mutex->unlock();
+      return false;
+  }
+  bool result = _mixer->PostChannelCount( channel, numChannels );
+  if( result )
+    {
+      _secondaryBuffers[channel]->_channels = numChannels;
+      _secondaryBuffers[channel]->UpdateChunkSize( _bufferLatency );
+    }
+  _secondaryBuffers[channel]->_mutex->unlock();
+  return result;
+}
+
+/**
+  @brief  Returns the number of interleaved channels in a secondary buffer.
+*/
+int ALSAManager::GetChannelCount( int channel )
+{
+  if( channel < 0 || channel >= _numBuffers )
+  {
+      return 0;
+  }
+
+  _secondaryBuffers[channel]->_mutex->lock();
+  int numChannels = _secondaryBuffers[channel]->_channels;
+  _secondaryBuffers[channel]->_mutex->unlock();
+  return numChannels;
 }
 
 /**
@@ -941,7 +928,10 @@ void ALSAManager::SetVolume( int channel, int volume )
 
   //cout << "Setting volume for channel " << channel << " to " << volume << endl;
   _secondaryBuffers[channel]->_mutex->lock();
-  _secondaryBuffers[channel]->_volume = volume;
+  if( _mixer->PostCommand( MIXER_COMMAND_SET_VOLUME, channel, volume ) )
+    {
+      _secondaryBuffers[channel]->_volume = volume;
+    }
   _secondaryBuffers[channel]->_mutex->unlock();
 }
 
@@ -957,7 +947,10 @@ void ALSAManager::SetPan( int channel, int pan )
 
   //cout << "Setting pan for channel " << channel << " to " << pan << endl;
   _secondaryBuffers[channel]->_mutex->lock();
-  _secondaryBuffers[channel]->_pan = pan;
+  if( _mixer->PostCommand( MIXER_COMMAND_SET_PAN, channel, pan ) )
+    {
+      _secondaryBuffers[channel]->_pan = pan;
+    }
   _secondaryBuffers[channel]->_mutex->unlock();
 }
 
@@ -1011,8 +1004,16 @@ bool ALSAManager::Play( int channel )
   }
 
   _secondaryBuffers[channel]->_mutex->lock();
-  _secondaryBuffers[channel]->_isPlaying = true;
+  if( !_mixer->PostCommand( MIXER_COMMAND_PLAY, channel ) )
+    {
+      _secondaryBuffers[channel]->_mutex->unlock();
+      return false;
+    }
+  _activeChannels->Add( channel );
   _secondaryBuffers[channel]->_mutex->unlock();
+  /// run() may be waiting with the playback descriptors out of its poll set, and has to
+  /// pick up the command before it will mix the channel.
+  Wake();
 
   //cout << "ALSAManager::Play - Checking state of _playbackHandle:  ";
   switch( snd_pcm_state( _playbackHandle ) )
@@ -1087,15 +1088,19 @@ bool ALSAManager::Stop( int channel )
   }
 
   _secondaryBuffers[channel]->_mutex->lock();
-  _secondaryBuffers[channel]->_isPlaying = false;
+  bool result = _mixer->PostCommand( MIXER_COMMAND_STOP, channel );
+  if( result )
+    {
+      _activeChannels->Remove( channel );
+    }
   _secondaryBuffers[channel]->_mutex->unlock();
 
-  return true;
+  return result;
 }
 
 /**
-  @brief  Monitors the record buffer and processes data if necessary.
-  This is called continuously by the run() method.
+  @brief  Monitors the record buffer and reads it into the capture ring if necessary.
+  This is called continuously by the capture thread.
 */
 int ALSAManager::MonitorCaptureBuffer()
 {
@@ -1147,10 +1152,17 @@ int ALSAManager::MonitorCaptureBuffer()
   }
 
   /// Limit our capture chunk size to the largest size we can actually send out on the network.
-  int captureChunkSize = _captureSampleRate * _bufferLatency; // Calculated in samples.
-  if( captureChunkSize > (CAPTURE_CHUNK_SIZE / BYTES_PER_WORD ) ) // Compared in samples.
+  int frameBytes = GetCaptureFrameBytes();
+  int captureChunkSize = _captureSampleRate * _bufferLatency; // Calculated in frames.
+  if( captureChunkSize > (CAPTURE_CHUNK_SIZE / frameBytes ) ) // Compared in frames.
   {
-      captureChunkSize = (CAPTURE_CHUNK_SIZE / BYTES_PER_WORD ); // Calculated in samples.
+      captureChunkSize = (CAPTURE_CHUNK_SIZE / frameBytes ); // Calculated in frames.
+  }
+  /// The capture thread is woken once avail_min frames are ready.  Waiting for more than that
+  /// would leave poll() returning straight away until a whole chunk had arrived.
+  if( _captureAvailMin > 0 && captureChunkSize > _captureAvailMin )
+  {
+      captureChunkSize = _captureAvailMin;
   }
   /// snd_pcm_avail_update returns the number of samples available, NOT the number of bytes available.
   /// This is why we multiply the number of samples times our record bytes to get the number of
@@ -1178,44 +1190,65 @@ int ALSAManager::MonitorCaptureBuffer()
 	}
   }
 
-  if( _recordingCallback != NULL )
+  /// Take everything the device has.  The capture thread only comes back when avail_min
+  /// frames are ready again, so reading a single chunk per wake would fall behind.
+  int framesAvailable = (int)pcmreturn;
+
+  /// The next frame read was captured as long before the driver's last pointer update as the
+  /// frames that were waiting then take to play.  A timestamp that is missing, or on some
+  /// other clock, falls back to now and the frames waiting now.
+  snd_pcm_uframes_t stampAvail;
+  snd_htimestamp_t stamp;
+  long long stampTime = -1;
+  long long stampFrames = framesAvailable;
+  if( snd_pcm_htimestamp( _captureHandle, &stampAvail, &stamp ) == 0 )
+    {
+      long long deviceTime = (long long)stamp.tv_sec * 1000000000 + stamp.tv_nsec;
+      long long now = CaptureClock::Now();
+      if( deviceTime > 0 && deviceTime <= now && now - deviceTime < 1000000000 )
+	{
+	  stampTime = deviceTime;
+	  stampFrames = stampAvail;
+	}
+    }
+  StampCapture( stampFrames, stampTime );
+
+  /// The device is drained whether or not anyone is subscribed, so it never overruns while
+  /// callbacks come and go.
+  if( _captureMmap )
   {
-      //cout << "MonitorCaptureBuffer: Grabbing data to pass to recording callback.  Grabbing " << captureChunkSize << " samples of data at " 
-      //     << BYTES_PER_WORD << " bytes per sample." << endl;
-      unsigned char data[CAPTURE_CHUNK_SIZE];
-      memset( data, 0, CAPTURE_CHUNK_SIZE );
+      return MmapRead( framesAvailable );
+  }
 
+  /// The plug layer resamples to _captureSampleRate for us, so the device reads straight into
+  /// the capture ring.  The free space may wrap, in which case it takes two reads.
+  int framesToRead = framesAvailable;
+  while( framesToRead > 0 )
+    {
+      unsigned char* region;
+      int regionFrames = _captureRing.GetWriteRegion( &region, framesToRead * frameBytes ) / frameBytes;
+      if( regionFrames <= 0 )
+	{
+	  /// A subscriber is holding the space.  Leave the rest in the device for the next pass.
+	  break;
+	}
+      if( regionFrames > framesToRead )
+	{
+	  regionFrames = framesToRead;
+	}
       /// snd_pcm_readi takes size in frames, not bytes.
-      if(( err = snd_pcm_readi( _captureHandle, data, captureChunkSize )) < 0 )
-      {
+      if(( err = snd_pcm_readi( _captureHandle, region, regionFrames )) < 0 )
+	{
 	  cout << "MonitorCaptureBuffer: Read failed (" << snd_strerror( err ) << ")" << endl;
 	  return false;
-      }
-      else
-      {
-	  //cout << "MonitorCaptureBuffer: snd_pcm_readi returned value of " << err << " samples. " << endl;
-      }
-
-      int resampleTarget = captureChunkSize * _captureSampleRate / 44100;
-      cout << "MonitorCaptureBuffer: Sending data to resample with " << (captureChunkSize * BYTES_PER_WORD)
-           << " bytes of data to be turned into " << (resampleTarget * BYTES_PER_WORD ) << " bytes of data." << endl;
-      /*FILE *fp;
-      if( (fp = fopen( "record_data_pre_resample.raw", "ab" ) ))
-      {
-                        fwrite( data, (captureChunkSize * BYTES_PER_WORD), 1, fp );
-                        fclose( fp );
-      }*/
-
-      _recordResampler.Resample( data, captureChunkSize, resampleTarget, BYTES_PER_WORD );
-
-      //cout << "MonitorCaptureBuffer: Sending data to callback - ForwardRecordedData with " << (resampleTarget * BYTES_PER_WORD) << " bytes of data." << endl;
-      /*if( (fp = fopen( "forwarded_record_data.raw", "ab" ) ))
-      {
-                        fwrite( data, (resampleTarget * BYTES_PER_WORD), 1, fp );
-                        fclose( fp );
-      }*/
-      _recordingCallback->ForwardRecordedData( data, (resampleTarget * BYTES_PER_WORD), _captureSampleRate);
-  }
+	}
+      _captureRing.CommitWrite( err * frameBytes );
+      framesToRead -= err;
+      if( err < regionFrames )
+	{
+	  break;
+	}
+    }
 
   //cout << "MonitorCaptureBuffer: Returning true from MonitorCaptureBuffer." << endl;
   return true;
@@ -1228,13 +1261,15 @@ int ALSAManager::MonitorCaptureBuffer()
      @return
      This function should not only return when the class is terminated.
      @note
-     This function includes a half-millisecond microsleep call.
+     Between passes the thread blocks in WaitForEvents() until a period is ready or Wake()
+     is called, so an idle manager uses next to no CPU.
 */
 int ALSAManager::run()
 {
   int count;
   while(handleMessages())
     { 
+      _realtime.ApplyIfPending();
       // _current_time = timeGetTime();
       /// TODO: Re-enable this code with appropriate sound functions.
       /// Right now we turn off the light after 1 second.
@@ -1246,28 +1281,153 @@ int ALSAManager::run()
       //	}
       //}
 
-      /// Grab and process any captured data.
-
-      MonitorCaptureBuffer();
-
-      /// Call MonitorBuffer() here to make sure we fill the secondary buffers with
-      /// silence if nothing is being received.
+      /// Capture is read on its own thread.  See StartCapture().
 
-      MonitorBuffer();
+      /// Pick up any Play(), Stop(), volume, or other changes made since the last pass.
+      _mixer->ApplyCommands();
+      /// A new buffer latency moves the point at which the device should wake us.
+      UpdatePlaybackAvailMin();
 
       /// Now that we're sure we have something in our secondary buffers we can mix in
       /// some data if we need to.
 
       ProcessSoundBuffer();
 
-      /// Sleep for 0.5 milliseconds.  That should be enough to get us at least 32 bytes of data at 8khz 16 bit mono.
-      /// At 44.1 stereo we would get about 11 times that (352+).  Adjust if necessary for slower machines and/or
-      /// machines running many application.
-      usleep( 500 );
+      /// Block until the sound card has a period for us or we are woken up.
+      WaitForEvents();
     } 
   return 1;
 }
 
+/**
+     @brief     Wakes the run() loop.
+     Call this after changing state that the loop should act on right away, such as
+     starting a channel or posting a message to the thread.  Safe to call from any thread.
+*/
+void ALSAManager::Wake()
+{
+  if( _wakeFd >= 0 )
+    {
+      uint64_t value = 1;
+      if( write( _wakeFd, &value, sizeof(value) ) < 0 )
+	{
+	  /// The counter is already non-zero, so the loop is going to wake anyway.
+	}
+    }
+}
+
+/**
+     @brief     Adds a PCM's poll descriptors to fds.
+     @return
+     false if the PCM is not running.  The caller should come back soon rather than wait on it,
+     since the monitor functions still have to start or recover it.
+*/
+bool ALSAManager::AddPollDescriptors( snd_pcm_t* handle, std::vector<struct pollfd>& fds )
+{
+  if( snd_pcm_state( handle ) != SND_PCM_STATE_RUNNING )
+    {
+      return false;
+    }
+  int count = snd_pcm_poll_descriptors_count( handle );
+  if( count <= 0 )
+    {
+      return false;
+    }
+  int first = (int)fds.size();
+  fds.resize( first + count );
+  count = snd_pcm_poll_descriptors( handle, &fds[first], count );
+  fds.resize( first + ( count > 0 ? count : 0 ) );
+  return count > 0;
+}
+
+/**
+     @brief     Blocks until there is work for the run() loop.
+     Waits on the playback descriptors while channels are playing, and the wake event.  ALSA
+     signals the PCM descriptors once avail_min frames (see GetPlaybackAvailMin()) can be
+     written.  With nothing playing only the wake event is watched, and the timeout lets
+     handleMessages() run.  The capture descriptors belong to the capture thread.
+     If the last pass found the device already holding the buffer latency, the descriptors
+     may still be signalled, so polling them would return straight away and spin.  The wait
+     is then timed instead, for one mix block.
+*/
+void ALSAManager::WaitForEvents()
+{
+  int timeout = IDLE_POLL_TIMEOUT;
+  _pollFds.clear();
+  if( _wakeFd >= 0 )
+    {
+      struct pollfd wakeFd;
+      wakeFd.fd = _wakeFd;
+      wakeFd.events = POLLIN;
+      wakeFd.revents = 0;
+      _pollFds.push_back( wakeFd );
+    }
+
+  int playbackFirst = (int)_pollFds.size();
+  if( _inited && _mixer->GetPlayingCount() > 0 )
+    {
+      if( _playbackFull )
+	{
+	  timeout = _mixer->GetBlockFrames() * 1000 / _playbackSampleRate;
+	  if( timeout < PENDING_POLL_TIMEOUT )
+	    {
+	      timeout = PENDING_POLL_TIMEOUT;
+	    }
+	}
+      else if( !AddPollDescriptors( _playbackHandle, _pollFds ) )
+	{
+	  timeout = PENDING_POLL_TIMEOUT;
+	}
+    }
+  int playbackEnd = (int)_pollFds.size();
+
+  if( poll( _pollFds.empty() ? NULL : &_pollFds[0], _pollFds.size(), timeout ) <= 0 )
+    {
+      return;
+    }
+
+  if( _wakeFd >= 0 && ( _pollFds[0].revents & POLLIN ) )
+    {
+      uint64_t value;
+      if( read( _wakeFd, &value, sizeof(value) ) < 0 )
+	{
+	  /// Another pass already cleared it.
+	}
+    }
+  /// Let plugins such as dmix translate and clear their own events.  The monitor functions
+  /// check the buffers themselves, so the translated flags aren't needed here.
+  unsigned short revents;
+  if( playbackEnd > playbackFirst )
+    {
+      snd_pcm_poll_descriptors_revents( _playbackHandle, &_pollFds[playbackFirst], playbackEnd - playbackFirst, &revents );
+    }
+}
+
+/**
+     @brief     Blocks the capture thread until a capture period is ready.
+     While the PCM isn't running yet there is nothing to wait on, so this returns after a
+     millisecond and lets MonitorCaptureBuffer() start or recover it.
+*/
+void ALSAManager::WaitForCapture( int msec )
+{
+  _capturePollFds.clear();
+  if( !_captureInited || !_capturing )
+    {
+      usleep( msec * 1000 );
+      return;
+    }
+  if( !AddPollDescriptors( _captureHandle, _capturePollFds ) )
+    {
+      usleep( PENDING_POLL_TIMEOUT * 1000 );
+      return;
+    }
+  if( poll( &_capturePollFds[0], _capturePollFds.size(), msec ) > 0 )
+    {
+      unsigned short revents;
+      snd_pcm_poll_descriptors_revents( _captureHandle, &_capturePollFds[0], _capturePollFds.size(), &revents );
+    }
+}
+
 
 /**
      @brief     Starts recording audio from the sound card.
@@ -1285,40 +1445,16 @@ bool ALSAManager::StartCapture( )
       return false;
   }
 
-  snd_pcm_sw_params_t *sw_params;
   int err;
 
-  if(( err = snd_pcm_sw_params_malloc( &sw_params )) < 0 )
-  {
-      cout << "Cannot allocate software parameter structure (" << snd_strerror( err ) << ")." << endl;
-      return false;
-  }
-
-  if(( err = snd_pcm_sw_params_current( _captureHandle, sw_params )) < 0 )
-  {
-      cout << "Cannot initializa software parameter structure (" << snd_strerror( err ) << ")." << endl;
-      return false;
-  }
-
-  if(( err = snd_pcm_sw_params_set_avail_min( _captureHandle, sw_params, 4096 )) < 0 )
-  {
-      cout << "Cannot set minimum available count (" << snd_strerror( err ) << ")." << endl;
-      return false;
-  }
-
-  if(( err = snd_pcm_sw_params_set_start_threshold( _captureHandle, sw_params, 0U)) < 0 )
-  {
-      cout << "Cannot set start mode (" << snd_strerror( err ) << ")." << endl;
-      return false;
-  }
-
-  if(( err = snd_pcm_sw_params( _captureHandle, sw_params )) < 0 )
+  /// Without a requested geometry we keep the old behaviour of waking every 4096 frames.  In
+  /// low-latency mode we want every period as soon as it arrives.
+  int availMin = ( _requestedPeriodFrames > 0 ) ? _capturePeriodFrames : 4096;
+  if( !SetSoftwareParams( _captureHandle, availMin, 0, "StartCapture" ) )
   {
-      cout << "Cannot set software parameters (" << snd_strerror( err ) << ")." << endl;
       return false;
   }
-
-  snd_pcm_sw_params_free( sw_params );
+  _captureAvailMin = availMin;
 
   if ((err = snd_pcm_prepare (_captureHandle)) < 0) 
   {
@@ -1338,9 +1474,19 @@ bool ALSAManager::StartCapture( )
 
   _capturing = true;
 
-  return true;
-}
-
+  /// Capture is read on its own thread so that neither the mix nor the recording callback
+  /// can hold the other up.
+  if( !StartCaptureThread( _realtime.GetConfig() ) )
+  {
+      cout << "StartCapture: Cannot start the capture thread." << endl;
+      _capturing = false;
+      snd_pcm_drop( _captureHandle );
+      return false;
+  }
+
+  return true;
+}
+
 /**
      @brief     Stops capturing audio from the sound card.
      Stops capturing audio from the sound card.
@@ -1349,9 +1495,10 @@ bool ALSAManager::StartCapture( )
 */
 bool ALSAManager::StopCapture( )
 {
+  _capturing = false;
+  StopCaptureThread();
   cout << "StopCapture: calling snd_pcm_drop on capture handle." << endl;
   snd_pcm_drop(_captureHandle);
-  _capturing = false;
   return true;
 }
 
@@ -1364,11 +1511,7 @@ bool ALSAManager::IsBufferPlaying( int channel )
     {
       return false;
     }
-  _secondaryBuffers[channel]->_mutex->lock();
-  bool playing = _secondaryBuffers[channel]->_isPlaying;
-  _secondaryBuffers[channel]->_mutex->unlock();
-
-  return playing;
+  return _activeChannels->Contains( channel );
 }
 
 /**
@@ -1396,43 +1539,413 @@ bool ALSAManager::Play()
 }
 
 /**
-     @brief     Monitors secondary buffers and pads them with silence if necessary.
-     This function is here to monitor the secondary sound buffers and add silence ot them if
-     necessary in order to avoid underruns, which tend to sound like pops, clicks, and static.
-     It will keep at least one "chunk" of data in a secondary buffer, a chunk being the size
-     of a piece of data normally read to the primary buffer.
+     @brief     Requests the period size and count used for the playback and capture devices.
+     Pass periodFrames of zero to let ALSA choose, which is the default.  For sub-10 ms round
+     trips ask for something like two periods of 128 frames.  The mixer then works one
+     period at a time, replacing the block size set with SetBufferLatency().
      @return
-     No return values.
+     false if the geometry is out of range or the device is already open.
      @note
-     The amount of data that MonitorBuffer tries to keep in a secondary buffer is dependent upon
-     the buffer latency value.
+     Must be called before Init() and CreateCaptureBuffer().  The device may not support the
+     exact values; GetPeriodFrames(), GetNumPeriods(), and GetPlaybackLatency() report what
+     was actually set up.
 */
-void ALSAManager::MonitorBuffer()
+bool ALSAManager::SetPeriodGeometry( int periodFrames, int numPeriods )
 {
-  int count;
-  int readAvail;
-  int chunkSize;
-  for( count = 0; count < _numBuffers; count++ )
+  if( _inited || periodFrames < 0 || ( periodFrames > 0 && numPeriods < 2 ) )
+    {
+      return false;
+    }
+  _requestedPeriodFrames = periodFrames;
+  _requestedPeriods = numPeriods;
+  return true;
+}
+
+/**
+ @brief  Returns the number of frames in each playback period.
+*/
+int ALSAManager::GetPeriodFrames()
+{
+  return _periodFrames;
+}
+
+/**
+ @brief  Returns the number of periods in the playback buffer.
+*/
+int ALSAManager::GetNumPeriods()
+{
+  return _numPeriods;
+}
+
+/**
+ @brief  Returns the length of the playback device buffer in seconds.
+ This is the most output latency the device can add.
+*/
+double ALSAManager::GetPlaybackLatency()
+{
+  if( _playbackSampleRate == 0 )
+    {
+      return 0.0;
+    }
+  return (double)_playbackFrames / _playbackSampleRate;
+}
+
+/**
+ @brief  Returns the length of the capture device buffer in seconds.
+*/
+double ALSAManager::GetCaptureLatency()
+{
+  if( _captureSampleRate == 0 )
+    {
+      return 0.0;
+    }
+  return (double)_captureFrames / _captureSampleRate;
+}
+
+/**
+     @brief     Applies the requested period geometry to a set of hardware parameters.
+     @return
+     false if ALSA refused the geometry outright.  Settling on nearby values is not an error.
+*/
+bool ALSAManager::SetHardwareGeometry( snd_pcm_t* handle, snd_pcm_hw_params_t* hw_params, const char* caller )
+{
+  if( _requestedPeriodFrames <= 0 )
+    {
+      return true;
+    }
+
+  int err;
+  int dir = 0;
+  snd_pcm_uframes_t periodSize = _requestedPeriodFrames;
+  if(( err = snd_pcm_hw_params_set_period_size_near( handle, hw_params, &periodSize, &dir )) < 0 )
+    {
+      cout << caller << ": cannot set period size (" << snd_strerror( err ) << ")" << endl;
+      return false;
+    }
+  unsigned int periods = _requestedPeriods;
+  dir = 0;
+  if(( err = snd_pcm_hw_params_set_periods_near( handle, hw_params, &periods, &dir )) < 0 )
+    {
+      cout << caller << ": cannot set period count (" << snd_strerror( err ) << ")" << endl;
+      return false;
+    }
+  if( (int)periodSize != _requestedPeriodFrames || (int)periods != _requestedPeriods )
+    {
+      cout << caller << ": " << _requestedPeriods << " periods of " << _requestedPeriodFrames << " frames requested, "
+	   << periods << " periods of " << periodSize << " frames acquired." << endl;
+    }
+  return true;
+}
+
+/**
+     @brief     Sets when ALSA wakes us and when a stream starts on its own.
+     availMin is the number of frames that must be free (playback) or ready (capture) before
+     the poll descriptors signal.  startThreshold is the number of frames that makes a
+     prepared stream start on its own, without waiting for snd_pcm_start.
+*/
+bool ALSAManager::SetSoftwareParams( snd_pcm_t* handle, int availMin, int startThreshold, const char* caller )
+{
+  snd_pcm_sw_params_t *sw_params;
+  int err;
+
+  if(( err = snd_pcm_sw_params_malloc( &sw_params )) < 0 )
+  {
+      cout << caller << ": Cannot allocate software parameter structure (" << snd_strerror( err ) << ")." << endl;
+      return false;
+  }
+
+  if(( err = snd_pcm_sw_params_current( handle, sw_params )) < 0 )
+  {
+      cout << caller << ": Cannot initialize software parameter structure (" << snd_strerror( err ) << ")." << endl;
+      snd_pcm_sw_params_free( sw_params );
+      return false;
+  }
+
+  if(( err = snd_pcm_sw_params_set_avail_min( handle, sw_params, availMin )) < 0 )
+  {
+      cout << caller << ": Cannot set minimum available count (" << snd_strerror( err ) << ")." << endl;
+      snd_pcm_sw_params_free( sw_params );
+      return false;
+  }
+
+  if(( err = snd_pcm_sw_params_set_start_threshold( handle, sw_params, startThreshold )) < 0 )
+  {
+      cout << caller << ": Cannot set start mode (" << snd_strerror( err ) << ")." << endl;
+      snd_pcm_sw_params_free( sw_params );
+      return false;
+  }
+
+  /// Have the driver timestamp each pointer update, on the monotonic clock that
+  /// std::chrono::steady_clock reads.  Capture times come from these.  Without them the
+  /// capture thread falls back to the time it reads, so a failure here isn't fatal.
+  if(( err = snd_pcm_sw_params_set_tstamp_mode( handle, sw_params, SND_PCM_TSTAMP_ENABLE )) < 0 )
+  {
+      cout << caller << ": Cannot enable timestamps (" << snd_strerror( err ) << ")." << endl;
+  }
+#if SND_LIB_VERSION >= 0x01001d
+  snd_pcm_sw_params_set_tstamp_type( handle, sw_params, SND_PCM_TSTAMP_TYPE_MONOTONIC );
+#endif
+
+  if(( err = snd_pcm_sw_params( handle, sw_params )) < 0 )
+  {
+      cout << caller << ": Cannot set software parameters (" << snd_strerror( err ) << ")." << endl;
+      snd_pcm_sw_params_free( sw_params );
+      return false;
+  }
+
+  snd_pcm_sw_params_free( sw_params );
+  return true;
+}
+
+/**
+ @brief  Returns how many frames ProcessSoundBuffer() keeps queued on the playback device.
+*/
+int ALSAManager::GetFillTargetFrames()
+{
+  return (int)(_playbackSampleRate * _mixer->GetBufferLatency() * _playbackByteAlign);
+}
+
+/**
+     @brief     Works out the playback avail_min that matches the fill target.
+     ProcessSoundBuffer() only writes once the device holds less than GetFillTargetFrames(),
+     so waking whenever a period is free would wake it over and over with nothing to do when
+     the device buffer is bigger than the target.  This waits until a whole block fits under
+     the target.
+*/
+int ALSAManager::GetPlaybackAvailMin()
+{
+  int blockFrames = _mixer->GetBlockFrames();
+  int availMin = _playbackFrames - GetFillTargetFrames() + blockFrames;
+  if( availMin < blockFrames )
+    {
+      availMin = blockFrames;
+    }
+  if( availMin > _playbackFrames )
+    {
+      availMin = _playbackFrames;
+    }
+  if( availMin < 1 )
+    {
+      availMin = 1;
+    }
+  return availMin;
+}
+
+/**
+ @brief  Gives the playback device a new avail_min when the buffer latency has changed.
+ Called by run() on every pass, so SetBufferLatency() and the latency controller take effect
+ on the audio thread.
+*/
+void ALSAManager::UpdatePlaybackAvailMin()
+{
+  if( !_inited )
+    {
+      return;
+    }
+  int availMin = GetPlaybackAvailMin();
+  if( availMin != _playbackAvailMin )
+    {
+      /// Not retried if ALSA refuses it.  WaitForEvents() falls back to a timed wait.
+      SetSoftwareParams( _playbackHandle, availMin, _periodFrames, "UpdatePlaybackAvailMin" );
+      _playbackAvailMin = availMin;
+    }
+}
+
+/**
+     @brief     Asks for mmap access on the playback and capture devices.
+     In mmap mode the mixer renders directly into the playback DMA buffer, which saves
+     copying each block out of the staging buffer.  A block that wraps past the end of the
+     DMA buffer is still staged and copied.  Capture saves nothing: the DMA area has to go
+     back to the card straight away, so captured data is copied into the capture ring as it
+     is with read access, and the recording callbacks get spans of the ring.  Devices that
+     can't do mmap fall back to read/write access.
+     @return
+     false if the playback device is already open.
+     @note
+     Must be called before Init() and CreateCaptureBuffer().
+*/
+bool ALSAManager::SetMmapMode( bool enable )
+{
+  if( _inited )
+    {
+      return false;
+    }
+  _mmapRequested = enable;
+  return true;
+}
+
+/**
+ @brief  Returns true if playback is using mmap access.
+*/
+bool ALSAManager::IsMmapActive()
+{
+  return _playbackMmap;
+}
+
+/**
+  @brief  Maps one of the SAMPLE_FORMAT values to the matching little-endian ALSA format.
+*/
+snd_pcm_format_t ALSAManager::GetAlsaFormat( int sampleFormat )
+{
+  switch( sampleFormat )
+    {
+    case SAMPLE_FORMAT_S24:
+      return SND_PCM_FORMAT_S24_3LE;
+    case SAMPLE_FORMAT_S32:
+      return SND_PCM_FORMAT_S32_LE;
+    case SAMPLE_FORMAT_F32:
+      return SND_PCM_FORMAT_FLOAT_LE;
+    }
+  return SND_PCM_FORMAT_S16_LE;
+}
+
+/**
+     @brief     Sets mmap interleaved access if it was requested.
+     @return
+     true if the device will use mmap access.  false means the caller should set read/write
+     access instead.
+*/
+bool ALSAManager::SetAccess( snd_pcm_t* handle, snd_pcm_hw_params_t* hw_params, const char* caller )
+{
+  if( !_mmapRequested )
+    {
+      return false;
+    }
+  int err = snd_pcm_hw_params_set_access( handle, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED );
+  if( err < 0 )
+    {
+      cout << caller << ": mmap access not available, using read/write access (" << snd_strerror( err ) << ")" << endl;
+      return false;
+    }
+  return true;
+}
+
+/**
+     @brief     Writes frames to the playback device through its mmap area.
+     Mixes one block straight into the DMA buffer, or clears the buffer when silence is true.
+     When the area wraps part way through the block it takes two begin/commit pairs, and the
+     block is mixed into the mixer's staging buffer and copied across in two pieces instead.
+     @return
+     The number of frames written, or a negative ALSA error if recovery failed.
+*/
+int ALSAManager::MmapWrite( int numFrames, bool silence )
+{
+  /// snd_pcm_mmap_begin relies on the pointers that avail_update refreshes.
+  snd_pcm_sframes_t avail = snd_pcm_avail_update( _playbackHandle );
+  if( avail < 0 )
     {
-      _secondaryBuffers[count]->_mutex->lock();
-      bool state = _secondaryBuffers[count]->_isPlaying;
-      _secondaryBuffers[count]->_mutex->unlock();
-      if( state == false )
-	continue;
-      _secondaryBuffers[count]->_mutex->lock();
-      /// Our buffer needs silence if we have less than one record chunk of data left in it.
-      readAvail = (_secondaryBuffers[count]->_bufferData)->GetReadAvail();
-      chunkSize = (int)_secondaryBuffers[count]->_chunkSize;
-      _secondaryBuffers[count]->_mutex->unlock();
-      //cout << "MonitorBuffer:  Secondary buffer " << count <<  " has " << readAvail << " bytes available to be read." << endl;
-      if( readAvail < chunkSize )
+      return XrunRecover( _playbackHandle, (int)avail );
+    }
+  if( avail < numFrames )
+    {
+      numFrames = (int)avail;
+    }
+
+  /// Set once the block has been mixed into the staging buffer.
+  short* block = NULL;
+  int written = 0;
+  while( written < numFrames )
+    {
+      const snd_pcm_channel_area_t* areas;
+      snd_pcm_uframes_t offset;
+      snd_pcm_uframes_t frames = numFrames - written;
+      int err = snd_pcm_mmap_begin( _playbackHandle, &areas, &offset, &frames );
+      if( err < 0 )
 	{
-	  //cout << "MonitorBuffer: Filling buffer " << count << " with silence." << endl;
-	  FillBufferSilence( count, chunkSize );
+	  cout << "MmapWrite: snd_pcm_mmap_begin failed (" << snd_strerror( err ) << ")" << endl;
+	  return XrunRecover( _playbackHandle, err );
+	}
+      if( frames == 0 )
+	{
+	  /// No room left.
+	  break;
+	}
+      /// Interleaved access puts both channels in one area, with frames packed back to back.
+      short* dest = (short *)((unsigned char *)areas[0].addr + ( areas[0].first + offset * areas[0].step ) / BITS_PER_BYTE );
+      if( silence )
+	{
+	  memset( dest, 0, frames * STEREO * BYTES_PER_WORD );
+	}
+      else if( block == NULL && (int)frames == numFrames )
+	{
+	  /// The whole block fits before the end of the area.
+	  _mixer->MixBlock( dest, numFrames, _masterVolume );
+	}
+      else
+	{
+	  /// Each MixBlock() call reads and resamples every channel, so a block split across
+	  /// the wrap is mixed once and copied rather than mixed in two pieces.
+	  if( block == NULL )
+	    {
+	      block = _mixer->GetBlockBuffer();
+	      _mixer->MixBlock( block, numFrames, _masterVolume );
+	    }
+	  memcpy( dest, block + written * STEREO, frames * STEREO * BYTES_PER_WORD );
 	}
+      snd_pcm_sframes_t committed = snd_pcm_mmap_commit( _playbackHandle, offset, frames );
+      if( committed < 0 || (snd_pcm_uframes_t)committed != frames )
+	{
+	  cout << "MmapWrite: snd_pcm_mmap_commit failed, calling XrunRecover" << endl;
+	  return XrunRecover( _playbackHandle, committed < 0 ? (int)committed : -EPIPE );
+	}
+      written += (int)frames;
     }
+  return written;
+}
 
-  return;
+/**
+     @brief     Writes silence to the playback device in whichever access mode it is using.
+*/
+void ALSAManager::WriteSilence( int numFrames )
+{
+  if( _playbackMmap )
+    {
+      MmapWrite( numFrames, true );
+    }
+  else
+    {
+      snd_pcm_writei( _playbackHandle, _mixer->GetSilence(), numFrames );
+    }
+}
+
+/**
+     @brief     Copies captured frames from the mmap area into the capture ring.
+     The mmap area has to be handed back to the card before the callback is done with the
+     data, so it is copied once into the capture ring and forwarded from there.
+     @return
+     false if the capture device had to be recovered.
+*/
+bool ALSAManager::MmapRead( int numFrames )
+{
+  int captured = 0;
+  while( captured < numFrames )
+    {
+      const snd_pcm_channel_area_t* areas;
+      snd_pcm_uframes_t offset;
+      snd_pcm_uframes_t frames = numFrames - captured;
+      int err = snd_pcm_mmap_begin( _captureHandle, &areas, &offset, &frames );
+      if( err < 0 )
+	{
+	  cout << "MmapRead: snd_pcm_mmap_begin failed (" << snd_strerror( err ) << ")" << endl;
+	  XrunRecover( _captureHandle, err );
+	  return false;
+	}
+      if( frames == 0 )
+	{
+	  break;
+	}
+      unsigned char* source = (unsigned char *)areas[0].addr + ( areas[0].first + offset * areas[0].step ) / BITS_PER_BYTE;
+      _captureRing.Write( source, (int)frames * GetCaptureFrameBytes() );
+      snd_pcm_sframes_t committed = snd_pcm_mmap_commit( _captureHandle, offset, frames );
+      if( committed < 0 || (snd_pcm_uframes_t)committed != frames )
+	{
+	  cout << "MmapRead: snd_pcm_mmap_commit failed, calling XrunRecover" << endl;
+	  XrunRecover( _captureHandle, committed < 0 ? (int)committed : -EPIPE );
+	  return false;
+	}
+      captured += (int)frames;
+    }
+  return true;
 }
 
 /**
@@ -1447,6 +1960,10 @@ int ALSAManager::XrunRecover(snd_pcm_t *handle, int err)
   if (err == -EPIPE)
     {
       /// Underrun 
+      if( handle == _playbackHandle )
+	{
+	  _latencyControl.ReportUnderrun();
+	}
       err = snd_pcm_prepare(handle);
       if (err < 0)
 	{
@@ -1476,7 +1993,9 @@ int ALSAManager::XrunRecover(snd_pcm_t *handle, int err)
 
 /**
   @brief  Sets the latency of buffers in milliseconds.
-  Sets the latency for primary, secondary, and capture buffers in milliseconds.
+  Sets the latency for primary, secondary, and capture buffers in milliseconds.  This is safe
+  to call while playing: the mixer builds its scratch space for the new block size here and
+  the audio thread switches to it between blocks.
    @note
   The playback latency will be twice the buffer latency value because it gets the
   delay once for secondary buffer monitoring and once for primary buffer monitoring.
@@ -1488,22 +2007,208 @@ void ALSAManager::SetBufferLatency( int msec )
   {
       return;
   }
-  /// This would be EXTREMELY non-thread-safe if called while the app was running.
+  /// With a requested period geometry the block size is the device's period, which can't
+  /// change without reopening the device.
+  if( _inited && _requestedPeriodFrames > 0 )
+  {
+      return;
+  }
   _bufferLatency = (float)msec / 1000.0f;
 
   int channel;
   for( channel = 0; channel < _numBuffers; channel++ )
   {
       _secondaryBuffers[channel]->_mutex->lock();
-      _secondaryBuffers[channel]->_chunkSize = _bufferLatency * _secondaryBuffers[channel]->_sampleRate * _secondaryBuffers[channel]->_bytesPerSample;
-      /// Make it an even number.
-      _secondaryBuffers[channel]->_chunkSize &= ~1;
+      _secondaryBuffers[channel]->UpdateChunkSize( _bufferLatency );
       _secondaryBuffers[channel]->_mutex->unlock();
   }
 
+  /// While playing, run() picks up the new block size at the start of its next pass.
+  if( _inited )
+    {
+      _mixer->Reconfigure( _bufferLatency );
+    }
+  else
+    {
+      AllocateMixArena();
+    }
+
   return;
 }
 
+/**
+  @brief  Spreads mixing over extra threads when many channels are playing.
+  Each of the numThreads workers only joins in once there are at least minChannelsPerThread
+  channels for it, so light loads are still mixed entirely on the audio thread.  Pass zero
+  to go back to single-threaded mixing.
+  @note
+  This replaces the mixer's workers and their scratch space, so it must not be called while
+  the app is running.
+*/
+bool ALSAManager::SetMixThreads( int numThreads, int minChannelsPerThread )
+{
+  if( numThreads < 0 )
+  {
+      return false;
+  }
+  return _mixer->SetWorkerCount( numThreads, minChannelsPerThread );
+}
+
+/**
+  @brief  Requests real-time scheduling, CPU affinity, and memory locking for the run() thread.
+  The settings are applied by the run() thread itself on its next pass, and to any mix
+  workers when they next wake.  Check GetRealtimeReport() afterwards to see what the system
+  allowed.
+*/
+bool ALSAManager::SetRealtimeConfig( const RealtimeConfig& config )
+{
+  _realtime.SetConfig( config );
+  _mixer->SetRealtimeConfig( config );
+  if( _captureThread != NULL )
+    {
+      _captureThread->_realtime.SetConfig( config );
+    }
+  Wake();
+  return true;
+}
+
+/**
+  @brief  Returns which of the real-time settings took effect.
+*/
+RealtimeReport ALSAManager::GetRealtimeReport()
+{
+  return _realtime.GetReport();
+}
+
+/**
+  @brief  Turns adaptive latency on or off and sets its bounds.
+  Nothing changes until UpdateLatency() is called.
+*/
+bool ALSAManager::SetLatencyConfig( const LatencyConfig& config )
+{
+  _latencyControl.SetConfig( config );
+  return true;
+}
+
+/**
+  @brief  Lets the latency controller act on what has happened since the last call.
+  Call this every few hundred milliseconds from a timer or other non-audio thread, since a
+  change goes through SetBufferLatency().
+  @return
+  The buffer latency in milliseconds after any change.
+*/
+int ALSAManager::UpdateLatency()
+{
+  int latency = (int)(_bufferLatency * 1000.0 + 0.5);
+  /// A requested period geometry fixes the block size for as long as the device is open.
+  if( !_inited || _requestedPeriodFrames > 0 )
+  {
+      return latency;
+  }
+  int newLatency = _latencyControl.Update( latency, _mixer );
+  if( newLatency != latency )
+  {
+      SetBufferLatency( newLatency );
+  }
+  return (int)(_bufferLatency * 1000.0 + 0.5);
+}
+
+/**
+  @brief  Returns the latency changes made since the last call, with the reason for each.
+*/
+std::vector<LatencyDecision> ALSAManager::TakeLatencyDecisions()
+{
+  return _latencyControl.TakeDecisions();
+}
+
+/**
+  @brief  Sizes the mixer's scratch space for the current latency.
+  Called from Init() and SetBufferLatency().
+*/
+void ALSAManager::AllocateMixArena()
+{
+  _mixer->Allocate( _bufferLatency, _playbackSampleRate, MAX_SAMPLE_RATE );
+}
+
+/**
+  @brief  Tells the mixer how far the card's playback is behind what was just written.
+  snd_pcm_delay includes everything queued in the card and its driver, so this is the time
+  until the last frame written is heard.
+*/
+void ALSAManager::PublishPlaybackDelay()
+{
+  snd_pcm_sframes_t delay;
+  if( snd_pcm_delay( _playbackHandle, &delay ) == 0 )
+    {
+      _mixer->PublishPosition( delay > 0 ? (int)delay : 0 );
+    }
+}
+
+/**
+  @brief  Returns the number of bytes waiting in a secondary buffer.
+  Kept in bytes for existing callers; use GetNumFramesQueued() for a count in frames.
+*/
+int ALSAManager::GetNumSamplesQueued( int channel )
+{
+  return GetNumBytesQueued( channel );
+}
+
+/**
+  @brief  Returns the number of frames waiting in a secondary buffer.
+  Frames are counted at the channel's own sample rate.  Use GetPlaybackPosition() to include
+  what has already been mixed but not yet heard.
+*/
+int ALSAManager::GetNumFramesQueued( int channel )
+{
+  if( channel < 0 || channel >= _numBuffers )
+  {
+      return 0;
+  }
+  SecondaryBuffer* buffer = _secondaryBuffers[channel];
+  buffer->_mutex->lock();
+  int value = buffer->_bufferData->GetReadAvail() / ( buffer->_bytesPerSample * buffer->_channels );
+  buffer->_mutex->unlock();
+  return value;
+}
+
+/**
+  @brief  Returns the number of bytes waiting in a secondary buffer.
+*/
+int ALSAManager::GetNumBytesQueued( int channel )
+{
+  if( channel < 0 || channel >= _numBuffers )
+  {
+      return 0;
+  }
+  SecondaryBuffer* buffer = _secondaryBuffers[channel];
+  buffer->_mutex->lock();
+  int value = buffer->_bufferData->GetReadAvail();
+  buffer->_mutex->unlock();
+  return value;
+}
+
+/**
+  @brief  Reports how much of a channel has been heard and how long new data will take to be heard.
+  Combines the data waiting in the secondary buffer with the mixer's record of what it has
+  handed to the card and the card's own delay.
+  @return
+  false if the channel doesn't exist.
+*/
+bool ALSAManager::GetPlaybackPosition( int channel, PlaybackPosition* position )
+{
+  if( channel < 0 || channel >= _numBuffers || position == NULL )
+  {
+      return false;
+  }
+  SecondaryBuffer* buffer = _secondaryBuffers[channel];
+  buffer->_mutex->lock();
+  int bufferedFrames = buffer->_bufferData->GetReadAvail() / ( buffer->_bytesPerSample * buffer->_channels );
+  unsigned int sampleRate = buffer->_sampleRate;
+  buffer->_mutex->unlock();
+  *position = _mixer->GetPosition( channel, bufferedFrames, sampleRate );
+  return true;
+}
+
 int ALSAManager::GetPeak( int channel )
 {
     if( channel < 0 || channel >= _numBuffers )
@@ -1511,10 +2216,28 @@ int ALSAManager::GetPeak( int channel )
         return 0;
     }
 
-    _secondaryBuffers[channel]->_mutex->lock();
-    int peak = _secondaryBuffers[channel]->_peak;
-    _secondaryBuffers[channel]->_mutex->unlock();
-    return peak;
+    // The mixer publishes meter levels atomically, so the UI never waits on the audio thread.
+    return _secondaryBuffers[channel]->_peak.load( std::memory_order_relaxed );
+}
+
+int ALSAManager::GetRms( int channel )
+{
+    if( channel < 0 || channel >= _numBuffers )
+    {
+        return 0;
+    }
+
+    return _secondaryBuffers[channel]->_rms.load( std::memory_order_relaxed );
+}
+
+int ALSAManager::GetMasterPeak()
+{
+    return _mixer->GetMasterPeak();
+}
+
+int ALSAManager::GetMasterRms()
+{
+    return _mixer->GetMasterRms();
 }
 
 #endif // !WIN32
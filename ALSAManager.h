@@ -7,10 +7,14 @@
 #include "System/Thread/CriticalSection.h"
 #include "Util/RingBuffer/RingBuffer.h"
 #include <alsa/asoundlib.h>
+#include <poll.h>
 #include <vector>
+#include <atomic>
 
 #include "AudioRecordingCallback.h"
 #include "SecondaryBuffer.h"
+#include "ActiveChannelList.h"
+#include "Mixer.h"
 #include "AudioBufferInterface.h"
 
 /** 
@@ -30,10 +34,11 @@ public:
 	bool Init(void *parentWindow = NULL, int* soundCard = NULL, const char *name = NULL);
 	/// Get individual secondary buffer sample rate.
 	unsigned int GetSampleRate(int channel);
-	bool CreateCaptureBuffer( AudioRecordingCallback * recordCallback = NULL, int* soundCard = NULL, const char *name = NULL);
-	int MonitorCaptureBuffer();
+	bool CreateCaptureBuffer( AudioRecordingCallback * recordCallback = NULL, int* soundCard = NULL, const char *name = NULL,
+	                          int numChannels = MONO, int sampleFormat = SAMPLE_FORMAT_S16 );
 
     virtual bool UnInit();
+	virtual int MonitorCaptureBuffer();
 	virtual bool Play();
 	virtual bool Play( int channel );
 	virtual bool Stop();
@@ -42,6 +47,8 @@ public:
 	virtual bool StopCapture();
 	virtual bool SetSampleRate( int channel, int frequency );
 	virtual bool SetRecordSampleRate( unsigned int sampleRate );
+	virtual bool SetChannelCount( int channel, int numChannels );
+	virtual int GetChannelCount( int channel );
 	virtual bool IsBufferPlaying( int channel );
 	/// Get global playback buffer sample rate.
 	virtual unsigned int GetSampleRate();
@@ -55,14 +62,33 @@ public:
 	virtual bool FillBuffer( int channel, unsigned char *data, int length, int sampleRate );
 	virtual bool FillBufferSilence( int channel, int length );
 	virtual void SetBufferLatency( int msec );
+	virtual int GetNumSamplesQueued( int channel );
+	virtual int GetNumBytesQueued( int channel );
+	virtual int GetNumFramesQueued( int channel );
+	virtual bool GetPlaybackPosition( int channel, PlaybackPosition* position );
+	virtual bool SetMixThreads( int numThreads, int minChannelsPerThread = 32 );
+	virtual bool SetRealtimeConfig( const RealtimeConfig& config );
+	virtual RealtimeReport GetRealtimeReport();
+	virtual bool SetLatencyConfig( const LatencyConfig& config );
+	virtual int UpdateLatency();
+	virtual std::vector<LatencyDecision> TakeLatencyDecisions();
     virtual int run();
+	void Wake();
+	bool SetPeriodGeometry( int periodFrames, int numPeriods );
+	int GetPeriodFrames();
+	int GetNumPeriods();
+	double GetPlaybackLatency();
+	double GetCaptureLatency();
+	bool SetMmapMode( bool enable );
+	bool IsMmapActive();
         int GetPeak( int channel );
+        int GetRms( int channel );
+        int GetMasterPeak();
+        int GetMasterRms();
 private:
     // Virtual private methods.
 	/// Take the sound data and forward it when we have a notification.
 	virtual bool ProcessCapturedData();
-	/// Check whether we need to fill the buffer with silence.
-	virtual void MonitorBuffer();
 
     // Non-virtual private methods and data
     /// This function takes our secondary buffers and mixes them into a single stream to feed to the primary buffer.
@@ -71,11 +97,61 @@ private:
 	snd_pcm_t * _captureHandle;
 	unsigned int _playbackByteAlign;
 	int _playbackFrames;
-	bool _capturing;
-	char * _captureBuffer;
+	/// Set by StartCapture() and StopCapture(), read by the capture thread.
+	std::atomic<bool> _capturing;
 	std::vector<SecondaryBuffer *> _secondaryBuffers;
+	/// Channels that are currently playing.  Maintained by Play() and Stop().
+	ActiveChannelList* _activeChannels;
+	/// Mixes the playing secondary buffers for ProcessSoundBuffer.
+	Mixer* _mixer;
+	/// Real-time settings for the thread that runs the mixer.
+	RealtimeThread _realtime;
+	/// Adapts the buffer latency to the underruns seen by the audio thread.
+	LatencyController _latencyControl;
+	void AllocateMixArena();
 	/// We may need to add some variables to track our buffer playing.
 	int XrunRecover( snd_pcm_t* handle, int err );
+	void PublishPlaybackDelay();
+	bool SetHardwareGeometry( snd_pcm_t* handle, snd_pcm_hw_params_t* hw_params, const char* caller );
+	bool SetSoftwareParams( snd_pcm_t* handle, int availMin, int startThreshold, const char* caller );
+	int GetFillTargetFrames();
+	int GetPlaybackAvailMin();
+	void UpdatePlaybackAvailMin();
+	/// avail_min last given to the playback device.
+	int _playbackAvailMin;
+	/// Period geometry asked for with SetPeriodGeometry().  Zero frames means let ALSA choose.
+	int _requestedPeriodFrames;
+	int _requestedPeriods;
+	/// Period geometry the playback device actually set up.
+	int _periodFrames;
+	int _numPeriods;
+	/// Capture device buffer and period size in frames.
+	int _captureFrames;
+	int _capturePeriodFrames;
+	/// Frames the capture device waits for before waking the capture thread.
+	int _captureAvailMin;
+	bool SetAccess( snd_pcm_t* handle, snd_pcm_hw_params_t* hw_params, const char* caller );
+	snd_pcm_format_t GetAlsaFormat( int sampleFormat );
+	int MmapWrite( int numFrames, bool silence );
+	bool MmapRead( int numFrames );
+	void WriteSilence( int numFrames );
+	/// mmap access asked for with SetMmapMode().
+	bool _mmapRequested;
+	/// Whether each device actually ended up with mmap access.
+	bool _playbackMmap;
+	bool _captureMmap;
+	void WaitForEvents();
+	virtual void WaitForCapture( int msec );
+	bool AddPollDescriptors( snd_pcm_t* handle, std::vector<struct pollfd>& fds );
+	/// eventfd written by Wake() to interrupt WaitForEvents().
+	int _wakeFd;
+	/// Set by ProcessSoundBuffer() when the device already holds enough, so WaitForEvents()
+	/// sleeps for a block instead of polling descriptors that are still signalled.
+	bool _playbackFull;
+	/// Descriptors for the current WaitForEvents() pass, kept to avoid reallocating.
+	std::vector<struct pollfd> _pollFds;
+	/// Descriptors for the capture thread's WaitForCapture().
+	std::vector<struct pollfd> _capturePollFds;
 };
 
 #endif // !WIN32
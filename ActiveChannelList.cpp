@@ -0,0 +1,108 @@
+
+#include <memory.h>
+#include "ActiveChannelList.h"
+
+ActiveChannelList::ActiveChannelList( int maxChannels )
+{
+  _maxChannels = maxChannels;
+  _count = 0;
+  _channels = new int[maxChannels];
+  _positions = new int[maxChannels];
+  int count;
+  for( count = 0; count < maxChannels; count++ )
+  {
+      _channels[count] = -1;
+      _positions[count] = -1;
+  }
+}
+
+ActiveChannelList::~ActiveChannelList()
+{
+  delete[] _channels;
+  delete[] _positions;
+}
+
+/**
+ @brief  Marks a channel as playing.  Returns false if it was already in the list.
+*/
+bool ActiveChannelList::Add( int channel )
+{
+  if( channel < 0 || channel >= _maxChannels )
+  {
+      return false;
+  }
+
+  _mutex.Lock();
+  if( _positions[channel] != -1 )
+  {
+      _mutex.Unlock();
+      return false;
+  }
+  _positions[channel] = _count;
+  _channels[_count] = channel;
+  _count++;
+  _mutex.Unlock();
+  return true;
+}
+
+/**
+ @brief  Removes a channel from the playing list.  Returns false if it was not playing.
+*/
+bool ActiveChannelList::Remove( int channel )
+{
+  if( channel < 0 || channel >= _maxChannels )
+  {
+      return false;
+  }
+
+  _mutex.Lock();
+  int position = _positions[channel];
+  if( position == -1 )
+  {
+      _mutex.Unlock();
+      return false;
+  }
+  // Move the last entry into the hole we are leaving so the list stays dense.
+  _count--;
+  int last = _channels[_count];
+  _channels[position] = last;
+  _positions[last] = position;
+  _channels[_count] = -1;
+  _positions[channel] = -1;
+  _mutex.Unlock();
+  return true;
+}
+
+bool ActiveChannelList::Contains( int channel )
+{
+  if( channel < 0 || channel >= _maxChannels )
+  {
+      return false;
+  }
+
+  _mutex.Lock();
+  bool playing = (_positions[channel] != -1);
+  _mutex.Unlock();
+  return playing;
+}
+
+int ActiveChannelList::GetCount()
+{
+  _mutex.Lock();
+  int count = _count;
+  _mutex.Unlock();
+  return count;
+}
+
+/**
+ @brief  Copies the playing channels into a caller-supplied array.
+ The array must hold at least maxChannels entries.  Returns the number of channels copied.
+*/
+int ActiveChannelList::Snapshot( int* channels )
+{
+  _mutex.Lock();
+  int count = _count;
+  memcpy( channels, _channels, count * sizeof(int) );
+  _mutex.Unlock();
+  return count;
+}
@@ -0,0 +1,32 @@
+#ifndef _ACTIVECHANNELLIST_H_
+#define _ACTIVECHANNELLIST_H_
+
+#include "wx/thread.h"
+
+/**
+     @brief     Dense list of the secondary buffers that are currently playing.
+     Play() and Stop() add and remove channels here so the mix loop only visits the
+     channels that are actually playing instead of scanning every allocated buffer.
+     Removal swaps the last entry into the hole, so both operations are constant time.
+     @note      The list is guarded by its own mutex.  The mix thread takes it once per
+     cycle and copies the list out with Snapshot().
+*/
+class ActiveChannelList
+{
+public:
+	ActiveChannelList( int maxChannels );
+	~ActiveChannelList();
+	bool Add( int channel );
+	bool Remove( int channel );
+	bool Contains( int channel );
+	int GetCount();
+	int Snapshot( int* channels );
+private:
+	int* _channels;  /**< Dense array of playing channel numbers. */
+	int* _positions; /**< Index of each channel within _channels, or -1 if it is not playing. */
+	int _count;
+	int _maxChannels;
+	wxMutex _mutex;
+};
+
+#endif
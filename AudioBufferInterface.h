@@ -4,8 +4,18 @@
 #include "wx/thread.h"
 #include "wx/wx.h"
 #include "AudioRecordingCallback.h"
+#include "CaptureRing.h"
+#include "CaptureClock.h"
+#include "LatencyCalibrator.h"
+#include "VoiceActivityDetector.h"
+#include "CaptureEncoder.h"
+#include "CaptureThread.h"
+#include "SampleFormat.h"
 #include "Resampler.h"
 #include "AudioSample.h"
+#include "RealtimeThread.h"
+#include "LatencyController.h"
+#include "Mixer.h"
 #include <list>
 
 using namespace std;
@@ -17,6 +27,31 @@ using namespace std;
 #define BYTES_PER_WORD 2
 #define MONO 1
 #define STEREO 2
+/// Widest interleaved frame a secondary buffer may hold.
+#define MAX_SOURCE_CHANNELS 8
+/// Widest interleaved frame a capture buffer may deliver.
+#define MAX_CAPTURE_CHANNELS 8
+/// Frames deinterleaved at a time for callbacks that take separate channels.
+#define CAPTURE_PLANE_FRAMES 1024
+/// Most recording callbacks one capture stream can feed at once.
+#define MAX_CAPTURE_SUBSCRIBERS MAX_CAPTURE_READERS
+
+/**
+ @brief A recording callback attached to the capture stream, with its own cursor in the
+ capture ring and its own delivery thread.
+*/
+class CaptureSubscriber
+{
+public:
+	CaptureSubscriber() : _callback(NULL), _delivery(NULL) {};
+	AudioRecordingCallback* _callback;
+	/// Hands data to _callback while capturing, NULL otherwise.
+	CaptureDelivery* _delivery;
+	/// Used on the delivery thread.  Off unless SetRecordingVad() turns it on.
+	VoiceActivityDetector _vad;
+	/// Used on the delivery thread.  Passes frames through unless SetRecordingCodec() picks a codec.
+	CaptureEncoder _encoder;
+};
 
 /**
  @brief Interface for an audio engine.  Derive from this to create an audio
@@ -29,6 +64,8 @@ using namespace std;
 */
 class AudioBufferInterface : public wxThread
 {
+	friend class CaptureThread;
+	friend class CaptureDelivery;
 public:
     AudioBufferInterface();
     virtual ~AudioBufferInterface();
@@ -36,6 +73,7 @@ public:
 	virtual bool FillBuffer( int channel, unsigned char *data, int length, int sampleRate ) = 0; // Data length is in bytes, not samples.
 	virtual bool FillBufferInterleaved(int channel, unsigned char* data, int length, int sampleRate, int blockSize, int everyNthBlock, int initialOffsetBytes);
 	virtual bool FillBufferSilence( int channel, int length ) = 0;
+	bool FillBufferEncoded( int channel, const unsigned char* data, int length, int sampleRate, int codec );
 	virtual bool Play() = 0;
 	virtual bool Stop() = 0;
 	virtual bool Stop( int channel ) = 0;
@@ -53,28 +91,89 @@ public:
 	virtual int GetPan( int channel ) = 0;
 	virtual bool DeleteCaptureBuffer() = 0;
 	virtual void SetBufferLatency( int msec ) = 0;
-	virtual int GetNumSamplesQueued( int channel ) = 0;
+	virtual int GetNumSamplesQueued( int channel ) = 0; // In bytes, despite the name.
+	virtual int GetNumBytesQueued( int channel ) = 0;
+	virtual int GetNumFramesQueued( int channel ) = 0; // At the channel's own sample rate.
+	virtual bool GetPlaybackPosition( int channel, PlaybackPosition* position );
+	virtual bool SetMixThreads( int numThreads, int minChannelsPerThread = 32 );
+	virtual bool SetChannelCount( int channel, int numChannels );
+	virtual int GetChannelCount( int channel );
+	virtual bool SetRealtimeConfig( const RealtimeConfig& config );
+	virtual RealtimeReport GetRealtimeReport();
+	virtual bool SetLatencyConfig( const LatencyConfig& config );
+	virtual int UpdateLatency();
+	virtual std::vector<LatencyDecision> TakeLatencyDecisions();
+	int GetRecordChannelCount();
+	int GetRecordSampleFormat();
+	bool AddRecordingCallback( AudioRecordingCallback* callback );
+	bool RemoveRecordingCallback( AudioRecordingCallback* callback );
+	long long GetRecordingOverflow( AudioRecordingCallback* callback );
+	bool SetRecordingVad( AudioRecordingCallback* callback, const VadConfig& config );
+	VadStats GetRecordingVadStats( AudioRecordingCallback* callback );
+	bool SetRecordingCodec( AudioRecordingCallback* callback, int codec );
+	double GetRecordTime( long long frame );
+	void SetMeasuredLatency( const LatencyMeasurement& measurement );
+	LatencyMeasurement GetMeasuredLatency();
 
     // From DSSystem::Thread
 	virtual void* Entry() = 0;
 private:
 	virtual bool Play( int channel ) = 0;
-	virtual void MonitorBuffer() = 0;
 	virtual bool ProcessCapturedData() = 0;
 protected:
+	/// Reads whatever the capture device has into _captureRing.  Called on the capture thread.
+	virtual int MonitorCaptureBuffer();
+	/// Blocks the capture thread until the device may have data, for at most msec milliseconds.
+	virtual void WaitForCapture( int msec );
+	bool StartCaptureThread( const RealtimeConfig& config );
+	void StopCaptureThread();
+	void SetRecordingCallback( AudioRecordingCallback* callback );
+	bool StartCaptureDelivery( int reader );
+	void StopCaptureDelivery( int reader );
+	void NotifyCaptureSubscribers();
+	void StampCapture( long long framesWaiting, long long deviceTime = -1 );
+	void ForwardCapturedData( int reader, float* const* planes );
+	void ForwardCapturedChannels( AudioRecordingCallback* callback, const CaptureSpan& span, float* const* planes );
+	void ForwardCapturedSpan( CaptureSubscriber& subscriber, int codec, const CaptureSpan& span, float* const* planes );
+	void ForwardVoiceRuns( CaptureSubscriber& subscriber, int mode, int codec, const CaptureSpan& span, float* const* planes );
+	void ForwardVoiceRun( CaptureSubscriber& subscriber, int mode, int codec, const CaptureSpan& span, int startFrame, int endFrame, bool voice, float* const* planes );
+	bool SetCaptureFormat( int numChannels, int sampleFormat );
+	int GetCaptureFrameBytes();
+	bool AllocateCaptureRing();
 	std::list<std::string> _playbackSamples;
 	int _numBuffers;
 	bool _inited;
 	bool _captureInited;
+	/// The callback given to CreateCaptureBuffer().  Also one of _captureSubscribers.
 	AudioRecordingCallback* _recordingCallback;
 	unsigned int _captureSampleRate;
 	unsigned int _captureChunkSize;
 	unsigned int _captureChunkTotal;
 	unsigned int _playbackSampleRate;
-	double _bufferLatency; /**< Latency, in seconds, of our buffers [total latency will be x2 - once for secondary and once for primary] */
+	/// Latency, in seconds, of our buffers [total latency will be x2 - once for secondary and once for primary].
+	/// Set by SetBufferLatency() on a control thread and read by the capture thread while it runs.
+	std::atomic<double> _bufferLatency;
 	unsigned int _recordBufferLength;
     int _masterVolume;
     Resampler _recordResampler;
+	/// Captured frames at _captureSampleRate, shared by every subscriber.
+	CaptureRing _captureRing;
+	/// When the frames in _captureRing were captured.
+	CaptureClock _captureClock;
+	/// The last round trip measured by a LatencyCalibrator.
+	LatencyMeasurement _measuredLatency;
+	wxMutex _measuredLatencyMutex;
+	/// Indexed by each subscriber's reader number in _captureRing.
+	CaptureSubscriber _captureSubscribers[MAX_CAPTURE_SUBSCRIBERS];
+	/// Held while subscribers are added or removed.  The capture thread only tries it, so it
+	/// never waits on the control thread.
+	wxMutex _captureSubscriberMutex;
+	/// Reads the capture device while capturing, NULL otherwise.
+	CaptureThread* _captureThread;
+	/// Interleaved channels per captured frame.
+	int _captureChannels;
+	/// One of the SAMPLE_FORMAT values.
+	int _captureSampleFormat;
 };
 
 #endif
@@ -0,0 +1,369 @@
+#include <string.h>
+#include "AudioCodec.h"
+
+/// Magnitude a mu-law sample is biased by before its segment is found, in 14-bit units.
+#define ULAW_BIAS 0x21
+/// Largest 14-bit magnitude mu-law can code.
+#define ULAW_CLIP 8159
+
+/// Tables for both G.711 laws.  Encoding is indexed by the 16-bit sample as unsigned.
+class G711Tables
+{
+public:
+	G711Tables();
+	unsigned char _encodeULaw[65536];
+	unsigned char _encodeALaw[65536];
+	short _decodeULaw[256];
+	short _decodeALaw[256];
+};
+
+/// Segment ends for the two laws.  A sample's segment is the first end it doesn't pass.
+static const int ULAW_SEGMENT_END[8] = { 0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF };
+static const int ALAW_SEGMENT_END[8] = { 0x1F, 0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF };
+
+static int FindSegment( int value, const int* ends )
+{
+  int segment;
+  for( segment = 0; segment < 8; segment++ )
+  {
+      if( value <= ends[segment] )
+      {
+          break;
+      }
+  }
+  return segment;
+}
+
+// The reference conversions from ITU-T G.711, used to fill the tables.
+static unsigned char LinearToULaw( int sample )
+{
+  int value = sample >> 2;
+  int mask = 0xFF;
+  if( value < 0 )
+  {
+      value = -value;
+      mask = 0x7F;
+  }
+  if( value > ULAW_CLIP )
+  {
+      value = ULAW_CLIP;
+  }
+  value += ULAW_BIAS;
+  int segment = FindSegment( value, ULAW_SEGMENT_END );
+  if( segment >= 8 )
+  {
+      return (unsigned char)( 0x7F ^ mask );
+  }
+  return (unsigned char)( ( ( segment << 4 ) | ( ( value >> ( segment + 1 ) ) & 0xF ) ) ^ mask );
+}
+
+static short ULawToLinear( unsigned char code )
+{
+  int value = ~code & 0xFF;
+  int magnitude = ( ( ( value & 0xF ) << 3 ) + ( ULAW_BIAS << 2 ) ) << ( ( value & 0x70 ) >> 4 );
+  return (short)( ( value & 0x80 ) ? ( ( ULAW_BIAS << 2 ) - magnitude ) : ( magnitude - ( ULAW_BIAS << 2 ) ) );
+}
+
+static unsigned char LinearToALaw( int sample )
+{
+  int value = sample >> 3;
+  int mask = 0xD5;
+  if( value < 0 )
+  {
+      mask = 0x55;
+      value = -value - 1;
+  }
+  int segment = FindSegment( value, ALAW_SEGMENT_END );
+  if( segment >= 8 )
+  {
+      return (unsigned char)( 0x7F ^ mask );
+  }
+  int code = segment << 4;
+  code |= segment < 2 ? ( value >> 1 ) & 0xF : ( value >> segment ) & 0xF;
+  return (unsigned char)( code ^ mask );
+}
+
+static short ALawToLinear( unsigned char code )
+{
+  int value = code ^ 0x55;
+  int magnitude = ( value & 0xF ) << 4;
+  int segment = ( value & 0x70 ) >> 4;
+  if( segment == 0 )
+  {
+      magnitude += 8;
+  }
+  else
+  {
+      magnitude = ( magnitude + 0x108 ) << ( segment - 1 );
+  }
+  return (short)( ( value & 0x80 ) ? magnitude : -magnitude );
+}
+
+G711Tables::G711Tables()
+{
+  int index;
+  for( index = 0; index < 65536; index++ )
+  {
+      _encodeULaw[index] = LinearToULaw( (short)index );
+      _encodeALaw[index] = LinearToALaw( (short)index );
+  }
+  for( index = 0; index < 256; index++ )
+  {
+      _decodeULaw[index] = ULawToLinear( (unsigned char)index );
+      _decodeALaw[index] = ALawToLinear( (unsigned char)index );
+  }
+}
+
+/// Built on first use.  Function statics are initialised once even if several threads get here together.
+static const G711Tables& GetG711Tables()
+{
+  static G711Tables tables;
+  return tables;
+}
+
+/// Quantizer step sizes and step index adjustments from the IMA ADPCM reference.
+static const int ADPCM_STEPS[89] =
+{
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+  337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+  2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+  15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+static const int ADPCM_INDEX_ADJUST[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static int Clamp( int value, int low, int high )
+{
+  return value < low ? low : ( value > high ? high : value );
+}
+
+/// Codes one sample against the predictor and moves the predictor and step index on.
+static int EncodeAdpcmSample( int sample, int* predictor, int* stepIndex )
+{
+  int step = ADPCM_STEPS[*stepIndex];
+  int difference = sample - *predictor;
+  int nibble = 0;
+  if( difference < 0 )
+  {
+      nibble = 8;
+      difference = -difference;
+  }
+  int delta = step >> 3;
+  if( difference >= step )
+  {
+      nibble |= 4;
+      difference -= step;
+      delta += step;
+  }
+  step >>= 1;
+  if( difference >= step )
+  {
+      nibble |= 2;
+      difference -= step;
+      delta += step;
+  }
+  step >>= 1;
+  if( difference >= step )
+  {
+      nibble |= 1;
+      delta += step;
+  }
+  *predictor = Clamp( *predictor + ( ( nibble & 8 ) ? -delta : delta ), -32768, 32767 );
+  *stepIndex = Clamp( *stepIndex + ADPCM_INDEX_ADJUST[nibble], 0, 88 );
+  return nibble;
+}
+
+static int DecodeAdpcmSample( int nibble, int* predictor, int* stepIndex )
+{
+  int step = ADPCM_STEPS[*stepIndex];
+  int delta = step >> 3;
+  if( nibble & 4 )
+  {
+      delta += step;
+  }
+  if( nibble & 2 )
+  {
+      delta += step >> 1;
+  }
+  if( nibble & 1 )
+  {
+      delta += step >> 2;
+  }
+  *predictor = Clamp( *predictor + ( ( nibble & 8 ) ? -delta : delta ), -32768, 32767 );
+  *stepIndex = Clamp( *stepIndex + ADPCM_INDEX_ADJUST[nibble], 0, 88 );
+  return *predictor;
+}
+
+bool AudioCodec::IsValid( int codec )
+{
+  return codec >= AUDIO_CODEC_PCM16 && codec <= AUDIO_CODEC_IMA_ADPCM;
+}
+
+/**
+ @brief  Bytes numFrames frames take once encoded.  IMA ADPCM only codes whole blocks, so
+ numFrames is rounded up to the next one.
+*/
+int AudioCodec::GetEncodedLength( int codec, int numFrames, int numChannels )
+{
+  switch( codec )
+  {
+    case AUDIO_CODEC_PCM16:
+      return numFrames * numChannels * 2;
+    case AUDIO_CODEC_ULAW:
+    case AUDIO_CODEC_ALAW:
+      return numFrames * numChannels;
+    case AUDIO_CODEC_IMA_ADPCM:
+      return ( numFrames + IMA_ADPCM_BLOCK_FRAMES - 1 ) / IMA_ADPCM_BLOCK_FRAMES * IMA_ADPCM_BLOCK_BYTES * numChannels;
+  }
+  return 0;
+}
+
+/**
+ @brief  Frames in length bytes of encoded audio.
+ @return
+ -1 if length isn't a whole number of frames, or of blocks for IMA ADPCM.
+*/
+int AudioCodec::GetDecodedFrames( int codec, int length, int numChannels )
+{
+  int frameLength = GetEncodedLength( codec, 1, numChannels );
+  if( codec == AUDIO_CODEC_IMA_ADPCM )
+  {
+      return length % frameLength == 0 ? length / frameLength * IMA_ADPCM_BLOCK_FRAMES : -1;
+  }
+  return frameLength > 0 && length % frameLength == 0 ? length / frameLength : -1;
+}
+
+void AudioCodec::EncodeULaw( const short* samples, int numSamples, unsigned char* encoded )
+{
+  const unsigned char* table = GetG711Tables()._encodeULaw;
+  for( int index = 0; index < numSamples; index++ )
+  {
+      encoded[index] = table[(unsigned short)samples[index]];
+  }
+}
+
+void AudioCodec::DecodeULaw( const unsigned char* encoded, int numSamples, short* samples )
+{
+  const short* table = GetG711Tables()._decodeULaw;
+  for( int index = 0; index < numSamples; index++ )
+  {
+      samples[index] = table[encoded[index]];
+  }
+}
+
+void AudioCodec::EncodeALaw( const short* samples, int numSamples, unsigned char* encoded )
+{
+  const unsigned char* table = GetG711Tables()._encodeALaw;
+  for( int index = 0; index < numSamples; index++ )
+  {
+      encoded[index] = table[(unsigned short)samples[index]];
+  }
+}
+
+void AudioCodec::DecodeALaw( const unsigned char* encoded, int numSamples, short* samples )
+{
+  const short* table = GetG711Tables()._decodeALaw;
+  for( int index = 0; index < numSamples; index++ )
+  {
+      samples[index] = table[encoded[index]];
+  }
+}
+
+/**
+     @brief     Codes IMA_ADPCM_BLOCK_FRAMES interleaved frames into one block.
+     The first frame goes in the header as it is.  stepIndex holds one step index per
+     channel and carries on from block to block, so the coder doesn't have to settle again
+     at the start of each one.  Start them at 0.
+     @param     block   IMA_ADPCM_BLOCK_BYTES * numChannels bytes.
+*/
+void AudioCodec::EncodeAdpcmBlock( const short* frames, int numChannels, int* stepIndex, unsigned char* block )
+{
+  int channel;
+  for( channel = 0; channel < numChannels; channel++ )
+  {
+      unsigned char* header = block + channel * 4;
+      int first = frames[channel];
+      header[0] = (unsigned char)( first & 0xFF );
+      header[1] = (unsigned char)( ( first >> 8 ) & 0xFF );
+      header[2] = (unsigned char)stepIndex[channel];
+      header[3] = 0;
+  }
+  // Then groups of eight samples per channel, four bytes each, low nibble first.
+  unsigned char* data = block + numChannels * 4;
+  for( channel = 0; channel < numChannels; channel++ )
+  {
+      int predictor = frames[channel];
+      int index = stepIndex[channel];
+      for( int frame = 1; frame < IMA_ADPCM_BLOCK_FRAMES; frame++ )
+      {
+          int position = frame - 1;
+          unsigned char* byte = data + ( position / 8 ) * numChannels * 4 + channel * 4 + ( position % 8 ) / 2;
+          int nibble = EncodeAdpcmSample( frames[frame * numChannels + channel], &predictor, &index );
+          if( position % 2 == 0 )
+          {
+              *byte = (unsigned char)nibble;
+          }
+          else
+          {
+              *byte |= (unsigned char)( nibble << 4 );
+          }
+      }
+      stepIndex[channel] = index;
+  }
+}
+
+/**
+ @brief  Decodes one block into IMA_ADPCM_BLOCK_FRAMES interleaved frames.
+*/
+void AudioCodec::DecodeAdpcmBlock( const unsigned char* block, int numChannels, short* frames )
+{
+  const unsigned char* data = block + numChannels * 4;
+  for( int channel = 0; channel < numChannels; channel++ )
+  {
+      const unsigned char* header = block + channel * 4;
+      int predictor = (short)( header[0] | ( header[1] << 8 ) );
+      int index = Clamp( header[2], 0, 88 );
+      frames[channel] = (short)predictor;
+      for( int frame = 1; frame < IMA_ADPCM_BLOCK_FRAMES; frame++ )
+      {
+          int position = frame - 1;
+          int byte = data[( position / 8 ) * numChannels * 4 + channel * 4 + ( position % 8 ) / 2];
+          int nibble = ( position % 2 == 0 ) ? byte & 0xF : byte >> 4;
+          frames[frame * numChannels + channel] = (short)DecodeAdpcmSample( nibble, &predictor, &index );
+      }
+  }
+}
+
+/**
+     @brief     Decodes length bytes into interleaved 16-bit frames.
+     @param     frames  Room for GetDecodedFrames() frames.
+     @return
+     The number of frames decoded, or -1 if length doesn't suit the codec.
+*/
+int AudioCodec::Decode( int codec, const unsigned char* encoded, int length, int numChannels, short* frames )
+{
+  int numFrames = GetDecodedFrames( codec, length, numChannels );
+  if( numFrames < 0 )
+  {
+      return -1;
+  }
+  switch( codec )
+  {
+    case AUDIO_CODEC_PCM16:
+      memcpy( frames, encoded, length );
+      break;
+    case AUDIO_CODEC_ULAW:
+      DecodeULaw( encoded, numFrames * numChannels, frames );
+      break;
+    case AUDIO_CODEC_ALAW:
+      DecodeALaw( encoded, numFrames * numChannels, frames );
+      break;
+    case AUDIO_CODEC_IMA_ADPCM:
+      for( int block = 0; block < numFrames / IMA_ADPCM_BLOCK_FRAMES; block++ )
+      {
+          DecodeAdpcmBlock( encoded + block * IMA_ADPCM_BLOCK_BYTES * numChannels, numChannels, frames + block * IMA_ADPCM_BLOCK_FRAMES * numChannels );
+      }
+      break;
+  }
+  return numFrames;
+}
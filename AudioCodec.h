@@ -0,0 +1,46 @@
+#ifndef _AUDIOCODEC_H_
+#define _AUDIOCODEC_H_
+
+/// Encodings for captured audio and for FillBufferEncoded().
+/// Plain interleaved 16-bit PCM.  For a recording callback, no encoding at all: frames arrive
+/// in the capture format.
+#define AUDIO_CODEC_PCM16 0
+/// G.711 mu-law, one byte per sample.
+#define AUDIO_CODEC_ULAW 1
+/// G.711 A-law, one byte per sample.
+#define AUDIO_CODEC_ALAW 2
+/// IMA ADPCM in the blocks WAV files use, four bits per sample.
+#define AUDIO_CODEC_IMA_ADPCM 3
+
+/// Bytes per channel in one IMA ADPCM block.
+#define IMA_ADPCM_BLOCK_BYTES 256
+/// Frames in one IMA ADPCM block: the one in the header plus two per remaining byte.
+#define IMA_ADPCM_BLOCK_FRAMES 505
+
+/**
+     @brief     Lightweight speech codecs with no outside dependencies.
+     G.711 halves the size of 16-bit PCM and IMA ADPCM quarters it.  G.711 is stateless, so
+     any run of bytes decodes on its own.  IMA ADPCM is coded in self-contained blocks of
+     IMA_ADPCM_BLOCK_FRAMES frames, each starting with the predictor and step index for every
+     channel, so a lost block doesn't disturb the ones after it.  Blocks are laid out as in
+     WAV files (format tag 0x11), with the channels interleaved four bytes at a time.
+     @note      G.711 runs through lookup tables built the first time they are needed.  They
+     turn each sample into a single load, which does more than SIMD could for code that is
+     all branches and shifts.
+*/
+class AudioCodec
+{
+public:
+	static bool IsValid( int codec );
+	static int GetEncodedLength( int codec, int numFrames, int numChannels );
+	static int GetDecodedFrames( int codec, int length, int numChannels );
+	static void EncodeULaw( const short* samples, int numSamples, unsigned char* encoded );
+	static void DecodeULaw( const unsigned char* encoded, int numSamples, short* samples );
+	static void EncodeALaw( const short* samples, int numSamples, unsigned char* encoded );
+	static void DecodeALaw( const unsigned char* encoded, int numSamples, short* samples );
+	static void EncodeAdpcmBlock( const short* frames, int numChannels, int* stepIndex, unsigned char* block );
+	static void DecodeAdpcmBlock( const unsigned char* block, int numChannels, short* frames );
+	static int Decode( int codec, const unsigned char* encoded, int length, int numChannels, short* frames );
+};
+
+#endif
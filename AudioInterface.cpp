@@ -7,6 +7,9 @@ AudioBufferInterface::AudioBufferInterface()
   _captureInited = false;
   _bufferLatency = 0.050;
   _recordingCallback = NULL;
+  _captureThread = NULL;
+  _captureChannels = MONO;
+  _captureSampleFormat = SAMPLE_FORMAT_S16;
   _playbackSampleRate = 44100;
 }
 
@@ -29,3 +32,528 @@ bool AudioBufferInterface::FillBufferInterleaved(int channel, unsigned char* dat
 	//delete newData;
 	return result;
 }
+
+// Decodes G.711 or IMA ADPCM and queues it like FillBuffer().  The data has the channel's
+// channel count, and IMA ADPCM has to come in whole blocks.
+bool AudioBufferInterface::FillBufferEncoded( int channel, const unsigned char* data, int length, int sampleRate, int codec )
+{
+	if( codec == AUDIO_CODEC_PCM16 )
+	{
+		return FillBuffer( channel, (unsigned char*)data, length, sampleRate );
+	}
+	int numChannels = GetChannelCount( channel );
+	if( numChannels < 1 )
+	{
+		numChannels = MONO;
+	}
+	int numFrames = AudioCodec::GetDecodedFrames( codec, length, numChannels );
+	if( numFrames <= 0 )
+	{
+		return false;
+	}
+	std::vector<short> decoded( numFrames * numChannels );
+	AudioCodec::Decode( codec, data, length, numChannels, &decoded[0] );
+	return FillBuffer( channel, (unsigned char*)&decoded[0], numFrames * numChannels * BYTES_PER_WORD, sampleRate );
+}
+
+// Engines that don't read capture into the ring have nothing to monitor.
+int AudioBufferInterface::MonitorCaptureBuffer()
+{
+	return false;
+}
+
+// Engines that can't wait on their capture device just look again after a while.
+void AudioBufferInterface::WaitForCapture( int msec )
+{
+	wxThread::Sleep( msec );
+}
+
+// Starts the thread that reads the capture device and one delivery thread per subscriber, so
+// capture runs apart from the playback loop and each callback apart from the others.
+bool AudioBufferInterface::StartCaptureThread( const RealtimeConfig& config )
+{
+	if( _captureThread != NULL )
+	{
+		return true;
+	}
+	_captureSubscriberMutex.Lock();
+	for( int reader = 0; reader < MAX_CAPTURE_SUBSCRIBERS; reader++ )
+	{
+		if( _captureSubscribers[reader]._callback != NULL && !StartCaptureDelivery( reader ) )
+		{
+			_captureSubscriberMutex.Unlock();
+			StopCaptureThread();
+			return false;
+		}
+	}
+	_captureSubscriberMutex.Unlock();
+	_captureThread = new CaptureThread( this );
+	if( !_captureThread->Start( config ) )
+	{
+		delete _captureThread;
+		_captureThread = NULL;
+		StopCaptureThread();
+		return false;
+	}
+	return true;
+}
+
+// Must be called before the capture device is stopped or closed.  Anything already read is
+// delivered before this returns.
+void AudioBufferInterface::StopCaptureThread()
+{
+	if( _captureThread != NULL )
+	{
+		_captureThread->Shutdown();
+		delete _captureThread;
+		_captureThread = NULL;
+	}
+	_captureSubscriberMutex.Lock();
+	for( int reader = 0; reader < MAX_CAPTURE_SUBSCRIBERS; reader++ )
+	{
+		StopCaptureDelivery( reader );
+	}
+	_captureSubscriberMutex.Unlock();
+}
+
+// Called with _captureSubscriberMutex held.
+bool AudioBufferInterface::StartCaptureDelivery( int reader )
+{
+	CaptureDelivery* delivery = new CaptureDelivery( this, reader, _captureChannels );
+	if( delivery->Create() != wxTHREAD_NO_ERROR )
+	{
+		delete delivery;
+		return false;
+	}
+	delivery->Run();
+	_captureSubscribers[reader]._delivery = delivery;
+	return true;
+}
+
+// Called with _captureSubscriberMutex held.  Delivers what the subscriber hasn't seen yet first.
+void AudioBufferInterface::StopCaptureDelivery( int reader )
+{
+	CaptureDelivery* delivery = _captureSubscribers[reader]._delivery;
+	if( delivery == NULL )
+	{
+		return;
+	}
+	_captureSubscribers[reader]._delivery = NULL;
+	delivery->Shutdown();
+	delete delivery;
+	_captureSubscribers[reader]._encoder.Flush( _captureSubscribers[reader]._callback, _captureChannels, _captureSampleRate );
+}
+
+// Adds a callback to the capture stream.  Each one gets every frame, read in place from the
+// shared capture ring, on a thread of its own.  It starts with the frames captured after it
+// was added.
+bool AudioBufferInterface::AddRecordingCallback( AudioRecordingCallback* callback )
+{
+	if( callback == NULL )
+	{
+		return false;
+	}
+	_captureSubscriberMutex.Lock();
+	for( int reader = 0; reader < MAX_CAPTURE_SUBSCRIBERS; reader++ )
+	{
+		if( _captureSubscribers[reader]._callback == callback )
+		{
+			_captureSubscriberMutex.Unlock();
+			return true;
+		}
+	}
+	int reader = _captureRing.AddReader();
+	if( reader < 0 )
+	{
+		_captureSubscriberMutex.Unlock();
+		return false;
+	}
+	_captureSubscribers[reader]._callback = callback;
+	_captureSubscribers[reader]._vad.SetConfig( VadConfig() );
+	_captureSubscribers[reader]._vad.ResetStats();
+	_captureSubscribers[reader]._encoder.SetCodec( AUDIO_CODEC_PCM16 );
+	if( _captureThread != NULL && !StartCaptureDelivery( reader ) )
+	{
+		_captureSubscribers[reader]._callback = NULL;
+		_captureRing.RemoveReader( reader );
+		_captureSubscriberMutex.Unlock();
+		return false;
+	}
+	_captureSubscriberMutex.Unlock();
+	return true;
+}
+
+// Must not be called from inside the callback being removed, since this waits for its
+// delivery thread to finish.
+bool AudioBufferInterface::RemoveRecordingCallback( AudioRecordingCallback* callback )
+{
+	bool found = false;
+	_captureSubscriberMutex.Lock();
+	for( int reader = 0; reader < MAX_CAPTURE_SUBSCRIBERS; reader++ )
+	{
+		if( callback != NULL && _captureSubscribers[reader]._callback == callback )
+		{
+			StopCaptureDelivery( reader );
+			_captureRing.RemoveReader( reader );
+			_captureSubscribers[reader]._callback = NULL;
+			found = true;
+		}
+	}
+	if( callback == _recordingCallback )
+	{
+		_recordingCallback = NULL;
+	}
+	_captureSubscriberMutex.Unlock();
+	return found;
+}
+
+// Bytes a callback missed because it fell too far behind the others.  -1 if it isn't attached.
+long long AudioBufferInterface::GetRecordingOverflow( AudioRecordingCallback* callback )
+{
+	long long overflow = -1;
+	_captureSubscriberMutex.Lock();
+	for( int reader = 0; reader < MAX_CAPTURE_SUBSCRIBERS; reader++ )
+	{
+		if( callback != NULL && _captureSubscribers[reader]._callback == callback )
+		{
+			overflow = _captureRing.GetOverflowBytes( reader );
+		}
+	}
+	_captureSubscriberMutex.Unlock();
+	return overflow;
+}
+
+// Turns voice activity detection on or off for one callback.  Takes effect from its next
+// delivery.
+bool AudioBufferInterface::SetRecordingVad( AudioRecordingCallback* callback, const VadConfig& config )
+{
+	bool found = false;
+	_captureSubscriberMutex.Lock();
+	for( int reader = 0; reader < MAX_CAPTURE_SUBSCRIBERS; reader++ )
+	{
+		if( callback != NULL && _captureSubscribers[reader]._callback == callback )
+		{
+			_captureSubscribers[reader]._vad.SetConfig( config );
+			found = true;
+		}
+	}
+	_captureSubscriberMutex.Unlock();
+	return found;
+}
+
+// Frames classified as voice and as silence for one callback since it was added.
+VadStats AudioBufferInterface::GetRecordingVadStats( AudioRecordingCallback* callback )
+{
+	VadStats stats;
+	_captureSubscriberMutex.Lock();
+	for( int reader = 0; reader < MAX_CAPTURE_SUBSCRIBERS; reader++ )
+	{
+		if( callback != NULL && _captureSubscribers[reader]._callback == callback )
+		{
+			stats = _captureSubscribers[reader]._vad.GetStats();
+		}
+	}
+	_captureSubscriberMutex.Unlock();
+	return stats;
+}
+
+// Has a callback's data encoded before it is delivered.  The callback then gets the encoded
+// bytes through ForwardRecordedSpans(), with _frame still counting frames.  Callbacks that want
+// separate channels always get them as floats.
+bool AudioBufferInterface::SetRecordingCodec( AudioRecordingCallback* callback, int codec )
+{
+	bool found = false;
+	_captureSubscriberMutex.Lock();
+	for( int reader = 0; reader < MAX_CAPTURE_SUBSCRIBERS; reader++ )
+	{
+		if( callback != NULL && _captureSubscribers[reader]._callback == callback )
+		{
+			found = _captureSubscribers[reader]._encoder.SetCodec( codec );
+		}
+	}
+	_captureSubscriberMutex.Unlock();
+	return found;
+}
+
+// CreateCaptureBuffer() replaces its own callback, leaving any others added alongside it.
+void AudioBufferInterface::SetRecordingCallback( AudioRecordingCallback* callback )
+{
+	if( _recordingCallback == callback )
+	{
+		return;
+	}
+	if( _recordingCallback != NULL )
+	{
+		RemoveRecordingCallback( _recordingCallback );
+	}
+	if( callback != NULL && AddRecordingCallback( callback ) )
+	{
+		_recordingCallback = callback;
+	}
+}
+
+// Called on the capture thread after new frames have been stored.  If a subscriber is being
+// added or removed right now, the next pass wakes everyone instead.
+void AudioBufferInterface::NotifyCaptureSubscribers()
+{
+	if( _captureSubscriberMutex.TryLock() != wxMUTEX_NO_ERROR )
+	{
+		return;
+	}
+	for( int reader = 0; reader < MAX_CAPTURE_SUBSCRIBERS; reader++ )
+	{
+		if( _captureSubscribers[reader]._delivery != NULL )
+		{
+			_captureSubscribers[reader]._delivery->Notify();
+		}
+	}
+	_captureSubscriberMutex.Unlock();
+}
+
+// Hands everything one subscriber hasn't seen to its callback without copying it, then
+// releases it.  Called on the subscriber's delivery thread.
+void AudioBufferInterface::ForwardCapturedData( int reader, float* const* planes )
+{
+	CaptureSubscriber& subscriber = _captureSubscribers[reader];
+	AudioRecordingCallback* callback = subscriber._callback;
+	int mode = subscriber._vad.ApplyIfPending();
+	int codec = subscriber._encoder.ApplyIfPending( callback, _captureChannels, _captureSampleRate );
+	CaptureSpan first;
+	CaptureSpan second;
+	int length = _captureRing.GetReadSpans( reader, &first, &second );
+	if( length > 0 && callback != NULL )
+	{
+		first._time = GetRecordTime( first._frame );
+		second._time = GetRecordTime( second._frame );
+		if( mode != VAD_MODE_OFF )
+		{
+			ForwardVoiceRuns( subscriber, mode, codec, first, planes );
+			ForwardVoiceRuns( subscriber, mode, codec, second, planes );
+		}
+		else if( codec != AUDIO_CODEC_PCM16 || callback->WantsRecordedChannels() )
+		{
+			ForwardCapturedSpan( subscriber, codec, first, planes );
+			ForwardCapturedSpan( subscriber, codec, second, planes );
+		}
+		else
+		{
+			callback->ForwardRecordedSpans( first, second, _captureSampleRate );
+		}
+	}
+	_captureRing.Consume( reader, length );
+}
+
+// Cuts a span into runs of voice and silence and delivers them in place, marked or with the
+// silence left out.  A run that carries on into the next span is delivered in two parts.
+void AudioBufferInterface::ForwardVoiceRuns( CaptureSubscriber& subscriber, int mode, int codec, const CaptureSpan& span, float* const* planes )
+{
+	int frameBytes = GetCaptureFrameBytes();
+	int numFrames = span._length / frameBytes;
+	int runStart = 0;
+	bool runVoice = true;
+	int offset = 0;
+	while( offset < numFrames )
+	{
+		bool voice;
+		int count = subscriber._vad.Process( span._data + offset * frameBytes, numFrames - offset, _captureChannels, _captureSampleFormat, _captureSampleRate, &voice );
+		if( offset > runStart && voice != runVoice )
+		{
+			ForwardVoiceRun( subscriber, mode, codec, span, runStart, offset, runVoice, planes );
+			runStart = offset;
+		}
+		runVoice = voice;
+		offset += count;
+	}
+	if( offset > runStart )
+	{
+		ForwardVoiceRun( subscriber, mode, codec, span, runStart, offset, runVoice, planes );
+	}
+}
+
+// Delivers frames startFrame to endFrame of a span as a run of their own.
+void AudioBufferInterface::ForwardVoiceRun( CaptureSubscriber& subscriber, int mode, int codec, const CaptureSpan& span, int startFrame, int endFrame, bool voice, float* const* planes )
+{
+	if( !voice && mode == VAD_MODE_DROP )
+	{
+		return;
+	}
+	int frameBytes = GetCaptureFrameBytes();
+	CaptureSpan run;
+	run._data = span._data + startFrame * frameBytes;
+	run._length = ( endFrame - startFrame ) * frameBytes;
+	run._frame = span._frame + startFrame;
+	run._time = GetRecordTime( run._frame );
+	run._voice = voice;
+	ForwardCapturedSpan( subscriber, codec, run, planes );
+}
+
+// Delivers one span as separate channels, encoded, or as it is, whichever the callback asked for.
+void AudioBufferInterface::ForwardCapturedSpan( CaptureSubscriber& subscriber, int codec, const CaptureSpan& span, float* const* planes )
+{
+	if( span._length <= 0 )
+	{
+		return;
+	}
+	if( subscriber._callback->WantsRecordedChannels() )
+	{
+		ForwardCapturedChannels( subscriber._callback, span, planes );
+	}
+	else if( codec != AUDIO_CODEC_PCM16 )
+	{
+		subscriber._encoder.Encode( subscriber._callback, span, _captureChannels, _captureSampleFormat, _captureSampleRate );
+	}
+	else
+	{
+		subscriber._callback->ForwardRecordedSpans( span, CaptureSpan(), _captureSampleRate );
+	}
+}
+
+// Splits a span into one float array per channel, a block at a time, for callbacks that
+// don't want interleaved frames.
+void AudioBufferInterface::ForwardCapturedChannels( AudioRecordingCallback* callback, const CaptureSpan& span, float* const* planes )
+{
+	int frameBytes = GetCaptureFrameBytes();
+	int numFrames = span._length / frameBytes;
+	int offset = 0;
+	while( offset < numFrames )
+	{
+		int blockFrames = numFrames - offset;
+		if( blockFrames > CAPTURE_PLANE_FRAMES )
+		{
+			blockFrames = CAPTURE_PLANE_FRAMES;
+		}
+		SampleFormat::Deinterleave( span._data + offset * frameBytes, blockFrames, _captureChannels, _captureSampleFormat, planes );
+		callback->ForwardRecordedChannels( planes, _captureChannels, blockFrames, _captureSampleRate, span._frame + offset, GetRecordTime( span._frame + offset ) );
+		offset += blockFrames;
+	}
+}
+
+// Called by CreateCaptureBuffer() before the device is opened.  Each manager then turns down
+// any format its device can't deliver.
+bool AudioBufferInterface::SetCaptureFormat( int numChannels, int sampleFormat )
+{
+	if( numChannels < 1 || numChannels > MAX_CAPTURE_CHANNELS || !SampleFormat::IsValid( sampleFormat ) )
+	{
+		return false;
+	}
+	_captureChannels = numChannels;
+	_captureSampleFormat = sampleFormat;
+	return true;
+}
+
+int AudioBufferInterface::GetCaptureFrameBytes()
+{
+	return _captureChannels * SampleFormat::GetBytes( _captureSampleFormat );
+}
+
+// Sizes the capture ring for the current rate and format.  Called once the device has settled
+// on them, before capture starts.
+bool AudioBufferInterface::AllocateCaptureRing()
+{
+	int frameBytes = GetCaptureFrameBytes();
+	_captureClock.Reset();
+	return _captureRing.Allocate( _captureSampleRate * CAPTURE_RING_SECONDS * frameBytes, frameBytes );
+}
+
+// Called on the capture thread just before reading the device.  framesWaiting frames were
+// ready at deviceTime, so the next frame to reach the ring was captured that long before.
+// Managers that can't get a time from the device pass -1 to use the current time.
+void AudioBufferInterface::StampCapture( long long framesWaiting, long long deviceTime )
+{
+	if( _captureSampleRate == 0 )
+	{
+		return;
+	}
+	if( deviceTime < 0 )
+	{
+		deviceTime = CaptureClock::Now();
+	}
+	long long frame = _captureRing.GetWriteTotal() / GetCaptureFrameBytes();
+	_captureClock.Stamp( frame, deviceTime - framesWaiting * 1000000000 / _captureSampleRate );
+}
+
+// Stored by LatencyCalibrator::Measure().  Can also be set from a saved measurement, so a
+// deployment doesn't have to be calibrated every time it starts.
+void AudioBufferInterface::SetMeasuredLatency( const LatencyMeasurement& measurement )
+{
+	_measuredLatencyMutex.Lock();
+	_measuredLatency = measurement;
+	_measuredLatencyMutex.Unlock();
+}
+
+// _valid is false until a round trip has been measured or set.
+LatencyMeasurement AudioBufferInterface::GetMeasuredLatency()
+{
+	_measuredLatencyMutex.Lock();
+	LatencyMeasurement measurement = _measuredLatency;
+	_measuredLatencyMutex.Unlock();
+	return measurement;
+}
+
+// Seconds on std::chrono::steady_clock when a captured frame, numbered as in CaptureSpan, was
+// captured.  -1 until the capture thread has read from the device.
+double AudioBufferInterface::GetRecordTime( long long frame )
+{
+	long long time = _captureClock.GetTime( frame, _captureSampleRate );
+	return time < 0 ? -1.0 : (double)time / 1000000000.0;
+}
+
+int AudioBufferInterface::GetRecordChannelCount()
+{
+	return _captureChannels;
+}
+
+int AudioBufferInterface::GetRecordSampleFormat()
+{
+	return _captureSampleFormat;
+}
+
+// Engines that mix in software can spread the work over extra threads.  Others have nothing to split.
+bool AudioBufferInterface::SetMixThreads( int numThreads, int minChannelsPerThread )
+{
+	return false;
+}
+
+// Engines that only take mono secondary buffers leave this alone.
+bool AudioBufferInterface::SetChannelCount( int channel, int numChannels )
+{
+	return false;
+}
+
+int AudioBufferInterface::GetChannelCount( int channel )
+{
+	return MONO;
+}
+
+// Engines whose audio thread belongs to someone else can't change how it is scheduled.
+bool AudioBufferInterface::SetRealtimeConfig( const RealtimeConfig& config )
+{
+	return false;
+}
+
+RealtimeReport AudioBufferInterface::GetRealtimeReport()
+{
+	return RealtimeReport();
+}
+
+// Engines without the shared mixer can't say when a frame reaches the speaker.
+bool AudioBufferInterface::GetPlaybackPosition( int channel, PlaybackPosition* position )
+{
+	return false;
+}
+
+// Engines without the shared mixer have no statistics to adapt their latency from.
+bool AudioBufferInterface::SetLatencyConfig( const LatencyConfig& config )
+{
+	return false;
+}
+
+int AudioBufferInterface::UpdateLatency()
+{
+	return (int)(_bufferLatency * 1000.0 + 0.5);
+}
+
+std::vector<LatencyDecision> AudioBufferInterface::TakeLatencyDecisions()
+{
+	return std::vector<LatencyDecision>();
+}
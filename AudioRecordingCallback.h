@@ -2,10 +2,38 @@
 #if !defined( _AUDIORECORDINGCALLBACK_H_ )
 #define _AUDIORECORDINGCALLBACK_H_
 
+/**
+     @brief     A read-only run of captured bytes.
+     Points straight into the capture ring, so it is only valid until the callback returns.
+*/
+class CaptureSpan
+{
+public:
+	CaptureSpan() : _data(0), _length(0), _frame(0), _time(-1.0), _voice(true) {};
+	const unsigned char* _data;
+	int _length;
+	/// Number of the first frame, counting from 0 when the capture buffer was created.
+	/// Frames a callback missed by falling behind are still counted, so gaps show up here.
+	long long _frame;
+	/// Seconds on std::chrono::steady_clock when the first frame was captured, or -1 if the
+	/// manager can't tell.  The same clock as PlaybackPosition::_time.
+	double _time;
+	/// False if the callback's voice activity detection, in VAD_MODE_MARK, found only silence.
+	bool _voice;
+};
+
 /**
      @brief     Base class to derive from in order to receive data from capture.
      Derive from this class and override the ForwardRecordedData method if you want to be able
      to process recorded data from either ALSAManager or DXAudioManager.
+     Captured data arrives through ForwardRecordedSpans() as one or two spans of the capture
+     ring; there are two when the data wraps around the end of the ring.  Override it to read
+     the spans in place.  By default each span is passed on to ForwardRecordedData().
+     The frames are in the channel count and sample format given to CreateCaptureBuffer().
+     Each span carries the number and capture time of its first frame, for lining captured
+     audio up with playback or with other devices.
+     A callback that would rather have each channel separately can return true from
+     WantsRecordedChannels() and take them as float arrays in ForwardRecordedChannels().
      @note      This is only required if you are going to be receiving recorded data.  A playback-
      only application will not need to derive from AudioRecordingCallback
 */
@@ -13,6 +41,30 @@ class AudioRecordingCallback
 {
 public:
         virtual void ForwardRecordedData( unsigned char* data, int length, int sampleRate ) = 0;
+        /// The spans belong to the capture ring, so they must not be written to or kept.
+        virtual void ForwardRecordedSpans( const CaptureSpan& first, const CaptureSpan& second, int sampleRate )
+        {
+            if( first._length > 0 )
+            {
+                ForwardRecordedData( (unsigned char *)first._data, first._length, sampleRate );
+            }
+            if( second._length > 0 )
+            {
+                ForwardRecordedData( (unsigned char *)second._data, second._length, sampleRate );
+            }
+        }
+        /// Checked before each delivery.  Return true to get ForwardRecordedChannels() instead
+        /// of ForwardRecordedSpans().
+        virtual bool WantsRecordedChannels()
+        {
+            return false;
+        }
+        /// channels[0] to channels[numChannels - 1] each hold numFrames samples scaled to
+        /// [-1, 1).  The arrays are reused for the next block, so copy anything to be kept.
+        /// frame and time are as in CaptureSpan, for the first frame of the block.
+        virtual void ForwardRecordedChannels( const float* const* /*channels*/, int /*numChannels*/, int /*numFrames*/, int /*sampleRate*/, long long /*frame*/, double /*time*/ )
+        {
+        }
 };
 
 #endif
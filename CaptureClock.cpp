@@ -0,0 +1,61 @@
+#include <chrono>
+#include "CaptureClock.h"
+
+CaptureClock::CaptureClock()
+{
+  _sequence = 0;
+  _frame = 0;
+  _time = -1;
+}
+
+/**
+ @brief  Forgets the last stamp.  Called when the capture ring's frame count starts again.
+*/
+void CaptureClock::Reset()
+{
+  Stamp( 0, -1 );
+}
+
+/**
+ @brief  Records that frame was captured at time.  Capture thread only.
+*/
+void CaptureClock::Stamp( long long frame, long long time )
+{
+  unsigned int sequence = _sequence.load( std::memory_order_relaxed );
+  _sequence.store( sequence + 1, std::memory_order_relaxed );
+  std::atomic_thread_fence( std::memory_order_release );
+  _frame.store( frame, std::memory_order_relaxed );
+  _time.store( time, std::memory_order_relaxed );
+  _sequence.store( sequence + 2, std::memory_order_release );
+}
+
+/**
+     @brief     Works out when a frame was, or will be, captured.
+     @return
+     Nanoseconds on std::chrono::steady_clock, or -1 if nothing has been stamped yet.
+     @note      Safe to call from any thread.
+*/
+long long CaptureClock::GetTime( long long frame, unsigned int sampleRate )
+{
+  long long stampFrame;
+  long long stampTime;
+  unsigned int sequence;
+  do
+  {
+      sequence = _sequence.load( std::memory_order_acquire );
+      stampFrame = _frame.load( std::memory_order_relaxed );
+      stampTime = _time.load( std::memory_order_relaxed );
+      std::atomic_thread_fence( std::memory_order_acquire );
+  } while( ( sequence & 1 ) != 0 || sequence != _sequence.load( std::memory_order_relaxed ) );
+
+  if( stampTime < 0 || sampleRate == 0 )
+  {
+      return -1;
+  }
+  return stampTime + ( frame - stampFrame ) * 1000000000 / sampleRate;
+}
+
+long long CaptureClock::Now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
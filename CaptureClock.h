@@ -0,0 +1,32 @@
+#ifndef _CAPTURECLOCK_H_
+#define _CAPTURECLOCK_H_
+
+#include <atomic>
+
+/**
+     @brief     Maps capture frame numbers to the time they were captured.
+     The capture thread stamps the first frame of each read with the time the device says it
+     was captured.  Any other frame is timed from the latest stamp at the nominal sample
+     rate, which stays well within a millisecond over the length of the capture ring.
+     Times are nanoseconds on std::chrono::steady_clock, the clock PlaybackPosition uses, so
+     captured and played frames can be lined up with each other.
+     @note      One thread stamps and any thread may read.  A sequence count lets readers
+     retry instead of taking a lock, as in Mixer::GetPosition().
+*/
+class CaptureClock
+{
+public:
+	CaptureClock();
+	void Reset();
+	void Stamp( long long frame, long long time );
+	long long GetTime( long long frame, unsigned int sampleRate );
+	/// Nanoseconds on std::chrono::steady_clock.
+	static long long Now();
+private:
+	std::atomic<unsigned int> _sequence;
+	std::atomic<long long> _frame;
+	/// -1 until the first stamp.
+	std::atomic<long long> _time;
+};
+
+#endif
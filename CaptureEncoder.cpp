@@ -0,0 +1,196 @@
+#include <string.h>
+#include "CaptureEncoder.h"
+#include "SampleFormat.h"
+
+CaptureEncoder::CaptureEncoder()
+{
+  _requested = AUDIO_CODEC_PCM16;
+  _codec = AUDIO_CODEC_PCM16;
+  _blockFrames = 0;
+  _blockFrame = 0;
+  _blockTime = -1.0;
+  _blockVoice = false;
+}
+
+CaptureEncoder::~CaptureEncoder()
+{
+}
+
+/**
+ @brief  Picks the codec for the callback's data.  AUDIO_CODEC_PCM16 turns encoding off.
+*/
+bool CaptureEncoder::SetCodec( int codec )
+{
+  if( !AudioCodec::IsValid( codec ) )
+  {
+      return false;
+  }
+  _requested.store( codec, std::memory_order_release );
+  return true;
+}
+
+int CaptureEncoder::GetCodec()
+{
+  return _requested.load( std::memory_order_acquire );
+}
+
+/**
+ @brief  Called on the delivery thread before each delivery.  A block held for the old codec
+ is delivered before the new one takes over.
+ @return
+ The codec in effect.
+*/
+int CaptureEncoder::ApplyIfPending( AudioRecordingCallback* callback, int numChannels, unsigned int sampleRate )
+{
+  int codec = _requested.load( std::memory_order_acquire );
+  if( codec != _codec )
+  {
+      Flush( callback, numChannels, sampleRate );
+      _codec = codec;
+  }
+  return _codec;
+}
+
+/**
+ @brief  Encodes a span of frames in the capture format and delivers what is ready.
+*/
+void CaptureEncoder::Encode( AudioRecordingCallback* callback, const CaptureSpan& span, int numChannels, int format, unsigned int sampleRate )
+{
+  int numFrames = span._length / ( numChannels * SampleFormat::GetBytes( format ) );
+  if( numFrames <= 0 || sampleRate == 0 )
+  {
+      return;
+  }
+  if( _codec == AUDIO_CODEC_IMA_ADPCM )
+  {
+      EncodeAdpcm( callback, span, numChannels, format, sampleRate );
+      return;
+  }
+  int frameBytes = numChannels * SampleFormat::GetBytes( format );
+  _samples.resize( ENCODER_CHUNK_FRAMES * numChannels );
+  _encoded.resize( AudioCodec::GetEncodedLength( _codec, ENCODER_CHUNK_FRAMES, numChannels ) );
+  int offset = 0;
+  while( offset < numFrames )
+  {
+      int chunkFrames = numFrames - offset;
+      if( chunkFrames > ENCODER_CHUNK_FRAMES )
+      {
+          chunkFrames = ENCODER_CHUNK_FRAMES;
+      }
+      ConvertFrames( span._data + offset * frameBytes, chunkFrames, numChannels, format, &_samples[0] );
+      if( _codec == AUDIO_CODEC_ULAW )
+      {
+          AudioCodec::EncodeULaw( &_samples[0], chunkFrames * numChannels, &_encoded[0] );
+      }
+      else if( _codec == AUDIO_CODEC_ALAW )
+      {
+          AudioCodec::EncodeALaw( &_samples[0], chunkFrames * numChannels, &_encoded[0] );
+      }
+      else
+      {
+          memcpy( &_encoded[0], &_samples[0], chunkFrames * numChannels * sizeof( short ) );
+      }
+      CaptureSpan encoded;
+      encoded._data = &_encoded[0];
+      encoded._length = AudioCodec::GetEncodedLength( _codec, chunkFrames, numChannels );
+      encoded._frame = span._frame + offset;
+      encoded._time = span._time < 0 ? -1.0 : span._time + (double)offset / sampleRate;
+      encoded._voice = span._voice;
+      callback->ForwardRecordedSpans( encoded, CaptureSpan(), sampleRate );
+      offset += chunkFrames;
+  }
+}
+
+/**
+ @brief  Pads out and delivers the IMA ADPCM block being filled, if there is one.
+ Called when capture stops, so the last few frames aren't lost.
+*/
+void CaptureEncoder::Flush( AudioRecordingCallback* callback, int numChannels, unsigned int sampleRate )
+{
+  if( _blockFrames == 0 )
+  {
+      return;
+  }
+  for( int frame = _blockFrames; frame < IMA_ADPCM_BLOCK_FRAMES; frame++ )
+  {
+      memcpy( &_block[frame * numChannels], &_block[( _blockFrames - 1 ) * numChannels], numChannels * sizeof( short ) );
+  }
+  if( callback != NULL )
+  {
+      DeliverBlock( callback, numChannels, sampleRate );
+  }
+  _blockFrames = 0;
+}
+
+// Copies frames into the block being filled, delivering each block as it fills up.
+void CaptureEncoder::EncodeAdpcm( AudioRecordingCallback* callback, const CaptureSpan& span, int numChannels, int format, unsigned int sampleRate )
+{
+  int frameBytes = numChannels * SampleFormat::GetBytes( format );
+  int numFrames = span._length / frameBytes;
+  if( (int)_stepIndex.size() != numChannels )
+  {
+      _blockFrames = 0;
+      _block.resize( IMA_ADPCM_BLOCK_FRAMES * numChannels );
+      _encoded.resize( IMA_ADPCM_BLOCK_BYTES * numChannels );
+      _stepIndex.assign( numChannels, 0 );
+  }
+  if( _blockFrames > 0 && _blockFrame + _blockFrames != span._frame )
+  {
+      // Frames are missing, so the held ones can't share a block with these.
+      Flush( callback, numChannels, sampleRate );
+  }
+  int offset = 0;
+  while( offset < numFrames )
+  {
+      if( _blockFrames == 0 )
+      {
+          _blockFrame = span._frame + offset;
+          _blockTime = span._time < 0 ? -1.0 : span._time + (double)offset / sampleRate;
+          _blockVoice = false;
+      }
+      int count = IMA_ADPCM_BLOCK_FRAMES - _blockFrames;
+      if( count > numFrames - offset )
+      {
+          count = numFrames - offset;
+      }
+      ConvertFrames( span._data + offset * frameBytes, count, numChannels, format, &_block[_blockFrames * numChannels] );
+      _blockFrames += count;
+      _blockVoice = _blockVoice || span._voice;
+      offset += count;
+      if( _blockFrames == IMA_ADPCM_BLOCK_FRAMES )
+      {
+          DeliverBlock( callback, numChannels, sampleRate );
+          _blockFrames = 0;
+      }
+  }
+}
+
+// Encodes the full block and hands it to the callback.
+void CaptureEncoder::DeliverBlock( AudioRecordingCallback* callback, int numChannels, unsigned int sampleRate )
+{
+  AudioCodec::EncodeAdpcmBlock( &_block[0], numChannels, &_stepIndex[0], &_encoded[0] );
+  CaptureSpan encoded;
+  encoded._data = &_encoded[0];
+  encoded._length = IMA_ADPCM_BLOCK_BYTES * numChannels;
+  encoded._frame = _blockFrame;
+  encoded._time = _blockTime;
+  encoded._voice = _blockVoice;
+  callback->ForwardRecordedSpans( encoded, CaptureSpan(), sampleRate );
+}
+
+// Converts interleaved frames in the capture format to 16-bit, clipping floats to full scale.
+void CaptureEncoder::ConvertFrames( const unsigned char* frames, int numFrames, int numChannels, int format, short* samples )
+{
+  int numSamples = numFrames * numChannels;
+  if( format == SAMPLE_FORMAT_S16 )
+  {
+      memcpy( samples, frames, numSamples * sizeof( short ) );
+      return;
+  }
+  int sampleBytes = SampleFormat::GetBytes( format );
+  for( int index = 0; index < numSamples; index++ )
+  {
+      int value = (int)( SampleFormat::GetSample( frames + index * sampleBytes, format ) * 32768.0f );
+      samples[index] = (short)( value > 32767 ? 32767 : ( value < -32768 ? -32768 : value ) );
+  }
+}
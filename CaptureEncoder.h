@@ -0,0 +1,54 @@
+#ifndef _CAPTUREENCODER_H_
+#define _CAPTUREENCODER_H_
+
+#include <atomic>
+#include <vector>
+#include "AudioRecordingCallback.h"
+#include "AudioCodec.h"
+
+/// Frames converted and encoded at a time for G.711.
+#define ENCODER_CHUNK_FRAMES 1024
+
+/**
+     @brief     Encodes captured audio for one recording callback.
+     Frames in any capture format are converted to 16-bit and encoded with one of the
+     AudioCodec codecs, and the callback gets the encoded bytes through ForwardRecordedSpans()
+     instead of the frames.  Each span keeps the number, capture time, and voice flag of its
+     first frame, so _frame still counts frames rather than bytes.
+     G.711 spans are delivered as soon as they are encoded.  IMA ADPCM is only delivered in
+     whole blocks, so up to IMA_ADPCM_BLOCK_FRAMES - 1 frames are held back for the next
+     delivery.  A held block is padded out with its last frame and delivered when the frames
+     that follow it are missing, when the codec changes, and by Flush().
+     @note      SetCodec() may be called from any thread.  The delivery thread picks the codec
+     up the next time it calls ApplyIfPending().
+*/
+class CaptureEncoder
+{
+public:
+	CaptureEncoder();
+	~CaptureEncoder();
+	bool SetCodec( int codec );
+	int GetCodec();
+	int ApplyIfPending( AudioRecordingCallback* callback, int numChannels, unsigned int sampleRate );
+	void Encode( AudioRecordingCallback* callback, const CaptureSpan& span, int numChannels, int format, unsigned int sampleRate );
+	void Flush( AudioRecordingCallback* callback, int numChannels, unsigned int sampleRate );
+private:
+	void ConvertFrames( const unsigned char* frames, int numFrames, int numChannels, int format, short* samples );
+	void EncodeAdpcm( AudioRecordingCallback* callback, const CaptureSpan& span, int numChannels, int format, unsigned int sampleRate );
+	void DeliverBlock( AudioRecordingCallback* callback, int numChannels, unsigned int sampleRate );
+	std::atomic<int> _requested;
+	/// The rest is only used on the delivery thread.
+	int _codec;
+	std::vector<short> _samples;
+	std::vector<unsigned char> _encoded;
+	/// The IMA ADPCM block being filled.
+	std::vector<short> _block;
+	int _blockFrames;
+	long long _blockFrame;
+	double _blockTime;
+	bool _blockVoice;
+	/// Step index per channel, carried from block to block.
+	std::vector<int> _stepIndex;
+};
+
+#endif
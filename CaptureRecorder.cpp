@@ -0,0 +1,253 @@
+#include "CaptureRecorder.h"
+#include "AudioBufferInterface.h"
+#include "SampleFormat.h"
+
+CaptureRecorderThread::CaptureRecorderThread( CaptureRecorder* recorder ) : wxThread( wxTHREAD_JOINABLE )
+{
+  _recorder = recorder;
+  _pending = false;
+  _exit = false;
+}
+
+CaptureRecorderThread::~CaptureRecorderThread()
+{
+}
+
+void CaptureRecorderThread::Notify()
+{
+  if( !_pending.exchange( true ) )
+  {
+      _wake.Post();
+  }
+}
+
+void CaptureRecorderThread::Shutdown()
+{
+  _exit = true;
+  _wake.Post();
+  Wait();
+}
+
+/**
+     @brief     Disk thread function.
+     Writes every whole block that is queued, and refreshes the header once
+     RECORDER_HEADER_INTERVAL has passed since the last refresh.  The wait times out after the
+     same interval, so the header is caught up even if no more blocks arrive.
+*/
+void* CaptureRecorderThread::Entry()
+{
+  while( true )
+  {
+      bool woken = _wake.WaitTimeout( RECORDER_HEADER_INTERVAL ) == wxSEMA_NO_ERROR;
+      _pending = false;
+      // Checked before writing, so the last pass picks up everything delivered before Stop().
+      bool exit = _exit;
+      // The last pass always writes, even if the wait timed out just as Shutdown() was called.
+      if( woken || exit )
+      {
+          _recorder->WriteQueued( exit );
+      }
+      if( exit )
+      {
+          break;
+      }
+      _recorder->UpdateHeader();
+  }
+  return NULL;
+}
+
+CaptureRecorder::CaptureRecorder()
+{
+  _manager = NULL;
+  _thread = NULL;
+  _reader = -1;
+  _bytesWritten = 0;
+  _headerStale = false;
+  _failed = false;
+}
+
+CaptureRecorder::~CaptureRecorder()
+{
+  Stop();
+}
+
+/**
+     @brief     Opens filename and starts recording manager's capture stream into it.
+     The capture buffer must already have been created, since the file takes its channel
+     count, sample format, and rate.  Recording starts with the next frames captured.
+     @return
+     false if the file can't be created or the manager has no room for another callback.
+*/
+bool CaptureRecorder::Start( AudioBufferInterface* manager, const char* filename )
+{
+  Stop();
+  if( manager == NULL )
+  {
+      return false;
+  }
+  int numChannels = manager->GetRecordChannelCount();
+  int sampleFormat = manager->GetRecordSampleFormat();
+  int sampleRate = manager->GetRecordSampleRate();
+  int frameBytes = numChannels * SampleFormat::GetBytes( sampleFormat );
+  int flags = WAV_FLAG_RF64 | WAV_FLAG_ALIGNED;
+  if( sampleFormat == SAMPLE_FORMAT_F32 )
+  {
+      flags |= WAV_FLAG_FLOAT;
+  }
+  // A reader may only fall half a ring behind, so the ring holds twice the queue.  It is a
+  // whole number of blocks, so the disk thread's writes fill it evenly.
+  int queueBytes = sampleRate * RECORDER_QUEUE_SECONDS * 2 * frameBytes;
+  queueBytes += RECORDER_WRITE_BLOCK - queueBytes % RECORDER_WRITE_BLOCK;
+  if( !_queue.Allocate( queueBytes, frameBytes ) )
+  {
+      return false;
+  }
+  if( !_writer.Open( filename, sampleRate, numChannels, SampleFormat::GetBytes( sampleFormat ) * 8, flags ) )
+  {
+      return false;
+  }
+  _reader = _queue.AddReader();
+  _bytesWritten = 0;
+  _headerStale = false;
+  _lastHeaderUpdate = std::chrono::steady_clock::now();
+  _failed = false;
+  _thread = new CaptureRecorderThread( this );
+  if( _thread->Create() != wxTHREAD_NO_ERROR )
+  {
+      delete _thread;
+      _thread = NULL;
+      _queue.RemoveReader( _reader );
+      _writer.Close();
+      return false;
+  }
+  _thread->Run();
+  _manager = manager;
+  if( !_manager->AddRecordingCallback( this ) )
+  {
+      Stop();
+      return false;
+  }
+  return true;
+}
+
+/**
+     @brief     Stops recording, writes out everything queued, and closes the file.
+     @return
+     false if any write to the file failed.
+*/
+bool CaptureRecorder::Stop()
+{
+  if( _thread == NULL )
+  {
+      return true;
+  }
+  // Waits for the delivery thread, so nothing more is queued after this.
+  _manager->RemoveRecordingCallback( this );
+  _manager = NULL;
+  _thread->Shutdown();
+  delete _thread;
+  _thread = NULL;
+  _queue.RemoveReader( _reader );
+  _reader = -1;
+  if( !_writer.Close() )
+  {
+      _failed = true;
+  }
+  return !_failed;
+}
+
+bool CaptureRecorder::IsRecording()
+{
+  return _thread != NULL;
+}
+
+unsigned long long CaptureRecorder::GetBytesWritten()
+{
+  return _bytesWritten.load( std::memory_order_relaxed );
+}
+
+/**
+ @brief  Bytes of audio left out of the file because the disk fell too far behind.
+*/
+long long CaptureRecorder::GetLostBytes()
+{
+  if( _reader < 0 )
+  {
+      return _queue.GetDroppedBytes();
+  }
+  return _queue.GetDroppedBytes() + _queue.GetOverflowBytes( _reader );
+}
+
+bool CaptureRecorder::HasFailed()
+{
+  return _failed;
+}
+
+void CaptureRecorder::ForwardRecordedData( unsigned char* data, int length, int /*sampleRate*/ )
+{
+  _queue.Write( data, length );
+  if( _queue.GetReadAvail( _reader ) >= RECORDER_WRITE_BLOCK )
+  {
+      _thread->Notify();
+  }
+}
+
+// Both spans are queued before the disk thread is woken, so it sees them as one run.
+void CaptureRecorder::ForwardRecordedSpans( const CaptureSpan& first, const CaptureSpan& second, int /*sampleRate*/ )
+{
+  _queue.Write( first._data, first._length );
+  _queue.Write( second._data, second._length );
+  if( _queue.GetReadAvail( _reader ) >= RECORDER_WRITE_BLOCK )
+  {
+      _thread->Notify();
+  }
+}
+
+/**
+     @brief     Writes queued data to the file, on the disk thread.
+     Only whole blocks are written unless flush is set, so every write starts on a block
+     boundary in the file.
+     @return
+     The number of bytes taken from the queue.
+*/
+int CaptureRecorder::WriteQueued( bool flush )
+{
+  CaptureSpan first;
+  CaptureSpan second;
+  int length = _queue.GetReadSpans( _reader, &first, &second );
+  if( !flush )
+  {
+      length -= length % RECORDER_WRITE_BLOCK;
+  }
+  int firstLength = length < first._length ? length : first._length;
+  if( length > 0 && !_failed )
+  {
+      if( !_writer.Write( first._data, firstLength ) || !_writer.Write( second._data, length - firstLength ) )
+      {
+          _failed = true;
+      }
+      else
+      {
+          _bytesWritten.fetch_add( length, std::memory_order_relaxed );
+          _headerStale = true;
+      }
+  }
+  _queue.Consume( _reader, length );
+  return length;
+}
+
+// On the disk thread, between writes.
+void CaptureRecorder::UpdateHeader()
+{
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if( !_headerStale || _failed || now - _lastHeaderUpdate < std::chrono::milliseconds( RECORDER_HEADER_INTERVAL ) )
+  {
+      return;
+  }
+  if( !_writer.UpdateHeader() )
+  {
+      _failed = true;
+  }
+  _headerStale = false;
+  _lastHeaderUpdate = now;
+}
@@ -0,0 +1,95 @@
+#ifndef _CAPTURERECORDER_H_
+#define _CAPTURERECORDER_H_
+
+#include "wx/thread.h"
+#include <atomic>
+#include <chrono>
+#include "AudioRecordingCallback.h"
+#include "CaptureRing.h"
+#include "WavWriter.h"
+
+class AudioBufferInterface;
+class CaptureRecorder;
+
+/// Seconds of audio the recorder can hold while the disk catches up.
+#define RECORDER_QUEUE_SECONDS 4
+/// The disk thread writes in whole multiples of this many bytes, except for the last write.
+#define RECORDER_WRITE_BLOCK 65536
+/// How often the file header is brought up to date while recording, in milliseconds.
+#define RECORDER_HEADER_INTERVAL 2000
+
+/**
+     @brief     Writes a CaptureRecorder's queued audio to disk.
+     Wakes when a block is ready or when the header is due for an update.
+*/
+class CaptureRecorderThread : public wxThread
+{
+public:
+	CaptureRecorderThread( CaptureRecorder* recorder );
+	~CaptureRecorderThread();
+	/// Called on the delivery thread once a block is queued.  Never blocks.
+	void Notify();
+	/// Writes whatever is left in the queue, then stops the thread and waits for it to exit.
+	void Shutdown();
+	virtual void* Entry();
+private:
+	CaptureRecorder* _recorder;
+	wxSemaphore _wake;
+	/// Set while a wake is posted and not yet picked up.
+	std::atomic<bool> _pending;
+	std::atomic<bool> _exit;
+};
+
+/**
+     @brief     Records a capture stream to a WAV file without disk I/O on the capture path.
+     The recorder subscribes to a manager's capture stream like any other recording callback.
+     Its callback only copies the frames into a queue of its own, a CaptureRing with a single
+     reader, and a background thread writes them out.  Writes are whole RECORDER_WRITE_BLOCK
+     multiples into a file whose data starts on a WAV_DATA_ALIGNMENT boundary, and the header
+     is rewritten every RECORDER_HEADER_INTERVAL so the file stays readable if the program
+     stops without closing it.  Files that pass 4 GB become RF64.
+     If the disk falls RECORDER_QUEUE_SECONDS behind, the frames that don't fit are lost and
+     counted in GetLostBytes().  Capture itself never waits on the disk.
+     @code
+     CaptureRecorder recorder;
+     manager->CreateCaptureBuffer( NULL, NULL, NULL, STEREO, SAMPLE_FORMAT_S24 );
+     recorder.Start( manager, "session.wav" );
+     manager->StartCapture();
+     ...
+     manager->StopCapture();
+     recorder.Stop();
+     @endcode
+*/
+class CaptureRecorder : public AudioRecordingCallback
+{
+public:
+	CaptureRecorder();
+	~CaptureRecorder();
+	bool Start( AudioBufferInterface* manager, const char* filename );
+	bool Stop();
+	bool IsRecording();
+	/// Bytes of audio written to the file so far.
+	unsigned long long GetBytesWritten();
+	long long GetLostBytes();
+	/// True if a write to the file has failed.  Recording carries on, discarding the data.
+	bool HasFailed();
+	virtual void ForwardRecordedData( unsigned char* data, int length, int sampleRate );
+	virtual void ForwardRecordedSpans( const CaptureSpan& first, const CaptureSpan& second, int sampleRate );
+private:
+	friend class CaptureRecorderThread;
+	int WriteQueued( bool flush );
+	void UpdateHeader();
+	AudioBufferInterface* _manager;
+	CaptureRecorderThread* _thread;
+	/// Frames on their way to the disk thread, which reads them as ring reader _reader.
+	CaptureRing _queue;
+	int _reader;
+	WavWriter _writer;
+	std::atomic<unsigned long long> _bytesWritten;
+	/// Written to the file since the header was last updated.
+	bool _headerStale;
+	std::chrono::steady_clock::time_point _lastHeaderUpdate;
+	std::atomic<bool> _failed;
+};
+
+#endif
@@ -0,0 +1,303 @@
+#include <string.h>
+#include "CaptureRing.h"
+
+CaptureRing::CaptureRing()
+{
+  _data = NULL;
+  _size = 0;
+  _frameSize = 1;
+  _lapLimit = 0;
+  _writeTotal = 0;
+  _droppedBytes = 0;
+}
+
+CaptureRing::~CaptureRing()
+{
+  delete[] _data;
+}
+
+/**
+ @brief  Sizes the ring, rounding down to a whole number of frames, and empties it.
+ Readers stay attached.
+*/
+bool CaptureRing::Allocate( int sizeBytes, int frameSize )
+{
+  if( frameSize <= 0 || sizeBytes < frameSize )
+  {
+      return false;
+  }
+  sizeBytes -= sizeBytes % frameSize;
+  if( sizeBytes != _size )
+  {
+      delete[] _data;
+      _data = new unsigned char[sizeBytes];
+      _size = sizeBytes;
+  }
+  _frameSize = frameSize;
+  _lapLimit = ( _size / 2 ) - ( _size / 2 ) % frameSize;
+  memset( _data, 0, _size );
+  Empty();
+  return true;
+}
+
+/**
+ @brief  Throws away everything captured.  Not safe while a reader or writer is running.
+*/
+void CaptureRing::Empty()
+{
+  _writeTotal = 0;
+  for( int reader = 0; reader < MAX_CAPTURE_READERS; reader++ )
+  {
+      _cursors[reader]._readPos = 0;
+      _cursors[reader]._busyFrom = CAPTURE_READER_IDLE;
+  }
+}
+
+/**
+     @brief     Attaches a new reader.  It sees everything written from now on.
+     Safe while the writer is running, but only one thread may add or remove readers.
+     @return
+     The reader's number, or -1 if MAX_CAPTURE_READERS are already attached.
+*/
+int CaptureRing::AddReader()
+{
+  for( int reader = 0; reader < MAX_CAPTURE_READERS; reader++ )
+  {
+      CaptureCursor& cursor = _cursors[reader];
+      if( !cursor._active )
+      {
+          cursor._readPos = _writeTotal.load();
+          cursor._busyFrom = CAPTURE_READER_IDLE;
+          cursor._overflowBytes = 0;
+          cursor._active = true;
+          return reader;
+      }
+  }
+  return -1;
+}
+
+/**
+ @brief  Detaches a reader.  Its thread must have stopped reading first.
+*/
+void CaptureRing::RemoveReader( int reader )
+{
+  if( reader >= 0 && reader < MAX_CAPTURE_READERS )
+  {
+      _cursors[reader]._active = false;
+  }
+}
+
+/**
+     @brief     Works out how far back the writer has to leave a reader's data alone.
+     An idle reader that would be overwritten is moved on to the oldest data that will
+     survive.  That can race with the reader starting to read: the reader publishes
+     _busyFrom and then checks _readPos, while this moves _readPos and then checks
+     _busyFrom, so at least one of them sees the other and the spans in use are kept.
+*/
+long long CaptureRing::GetProtectedPosition( CaptureCursor& cursor, long long writeEnd )
+{
+  long long busyFrom = cursor._busyFrom.load();
+  if( busyFrom != CAPTURE_READER_IDLE )
+  {
+      return busyFrom;
+  }
+  long long readPos = cursor._readPos.load();
+  long long oldest = writeEnd - _size;
+  if( readPos >= oldest )
+  {
+      return readPos;
+  }
+  if( !cursor._readPos.compare_exchange_strong( readPos, oldest ) )
+  {
+      // The reader consumed something in the meantime.  Leave it for the next write.
+      return readPos;
+  }
+  busyFrom = cursor._busyFrom.load();
+  if( busyFrom != CAPTURE_READER_IDLE )
+  {
+      // It started reading before the move.  Consume() counts whatever it ends up missing.
+      return busyFrom;
+  }
+  cursor._overflowBytes.fetch_add( oldest - readPos );
+  return oldest;
+}
+
+/**
+     @brief     Finds free space the device can read straight into.
+     The region stops at the end of the ring, so after filling it there may be more room at
+     the start.  Idle readers that are too far behind are moved on to make room for up to
+     numBytes.  Call CommitWrite() with the number of bytes actually stored.
+     @return
+     The number of bytes that can be written at *region.
+*/
+int CaptureRing::GetWriteRegion( unsigned char** region, int numBytes )
+{
+  long long writePos = _writeTotal.load( std::memory_order_relaxed );
+  int offset = _size > 0 ? (int)( writePos % _size ) : 0;
+  *region = _data + offset;
+  if( _data == NULL )
+  {
+      return 0;
+  }
+  int length = _size - offset;
+  if( length > numBytes )
+  {
+      length = numBytes;
+  }
+  long long limit = writePos + _size;
+  for( int reader = 0; reader < MAX_CAPTURE_READERS; reader++ )
+  {
+      CaptureCursor& cursor = _cursors[reader];
+      if( !cursor._active )
+      {
+          continue;
+      }
+      long long protect = GetProtectedPosition( cursor, writePos + length ) + _size;
+      if( protect < limit )
+      {
+          limit = protect;
+      }
+  }
+  if( limit - writePos < length )
+  {
+      length = limit > writePos ? (int)( limit - writePos ) : 0;
+  }
+  return length;
+}
+
+void CaptureRing::CommitWrite( int numBytes )
+{
+  if( numBytes <= 0 )
+  {
+      return;
+  }
+  _writeTotal.fetch_add( numBytes, std::memory_order_release );
+}
+
+/**
+     @brief     Copies data into the ring.
+     Whatever doesn't fit is dropped and counted in GetDroppedBytes().  The capture thread
+     must never wait for a reader.
+     @return
+     The number of bytes stored.
+*/
+int CaptureRing::Write( const unsigned char* data, int numBytes )
+{
+  int written = 0;
+  while( written < numBytes )
+  {
+      unsigned char* region;
+      int length = GetWriteRegion( &region, numBytes - written );
+      if( length <= 0 )
+      {
+          break;
+      }
+      memcpy( region, data + written, length );
+      CommitWrite( length );
+      written += length;
+  }
+  if( written < numBytes )
+  {
+      _droppedBytes.fetch_add( numBytes - written, std::memory_order_relaxed );
+  }
+  return written;
+}
+
+long long CaptureRing::GetWriteTotal()
+{
+  return _writeTotal.load( std::memory_order_acquire );
+}
+
+/**
+     @brief     Returns everything a reader hasn't seen yet as read-only spans into the ring.
+     second is only non-empty when the data wraps past the end of the ring.  The spans stay
+     valid until Consume() releases them.  A reader more than half a ring behind first skips
+     ahead, so that holding its spans still leaves the writer room.
+     @return
+     The total number of bytes in the two spans.
+*/
+int CaptureRing::GetReadSpans( int reader, CaptureSpan* first, CaptureSpan* second )
+{
+  CaptureCursor& cursor = _cursors[reader];
+  long long start;
+  long long end;
+  while( true )
+  {
+      start = cursor._readPos.load();
+      end = _writeTotal.load( std::memory_order_acquire );
+      long long oldest = end - _lapLimit;
+      if( start < oldest )
+      {
+          if( !cursor._readPos.compare_exchange_strong( start, oldest ) )
+          {
+              continue;
+          }
+          cursor._overflowBytes.fetch_add( oldest - start );
+          start = oldest;
+      }
+      cursor._busyFrom.store( start );
+      if( cursor._readPos.load() == start )
+      {
+          break;
+      }
+      // The writer moved us on before it could see _busyFrom.  Start again from there.
+      cursor._busyFrom.store( CAPTURE_READER_IDLE );
+  }
+  // Anything written since the first look is safe too, and saves waiting for the next wake.
+  end = _writeTotal.load( std::memory_order_acquire );
+  int readAvail = (int)( end - start );
+  int offset = _size > 0 ? (int)( start % _size ) : 0;
+  int untilEnd = _size - offset;
+  first->_data = _data + offset;
+  first->_length = readAvail < untilEnd ? readAvail : untilEnd;
+  first->_frame = start / _frameSize;
+  second->_data = _data;
+  second->_length = readAvail - first->_length;
+  second->_frame = ( start + first->_length ) / _frameSize;
+  return readAvail;
+}
+
+/**
+ @brief  Releases bytes the reader has finished with so the writer can reuse them.
+ Must follow GetReadSpans(), even if numBytes is 0.
+*/
+void CaptureRing::Consume( int reader, int numBytes )
+{
+  CaptureCursor& cursor = _cursors[reader];
+  long long start = cursor._busyFrom.load();
+  if( start == CAPTURE_READER_IDLE )
+  {
+      return;
+  }
+  long long target = start + ( numBytes > 0 ? numBytes : 0 );
+  long long readPos = cursor._readPos.load();
+  while( readPos < target && !cursor._readPos.compare_exchange_weak( readPos, target ) )
+  {
+  }
+  if( readPos > target )
+  {
+      // The writer moved the cursor past data this reader never got to.
+      cursor._overflowBytes.fetch_add( readPos - target );
+  }
+  cursor._busyFrom.store( CAPTURE_READER_IDLE );
+}
+
+int CaptureRing::GetReadAvail( int reader )
+{
+  return (int)( _writeTotal.load( std::memory_order_acquire ) - _cursors[reader]._readPos.load() );
+}
+
+long long CaptureRing::GetOverflowBytes( int reader )
+{
+  return _cursors[reader]._overflowBytes.load( std::memory_order_relaxed );
+}
+
+int CaptureRing::GetSize()
+{
+  return _size;
+}
+
+long long CaptureRing::GetDroppedBytes()
+{
+  return _droppedBytes.load( std::memory_order_relaxed );
+}
@@ -0,0 +1,82 @@
+#ifndef _CAPTURERING_H_
+#define _CAPTURERING_H_
+
+#include <atomic>
+#include "AudioRecordingCallback.h"
+
+/// Default length of a manager's capture ring, in seconds of audio.
+#define CAPTURE_RING_SECONDS 1
+/// Most readers one capture ring can feed at once.
+#define MAX_CAPTURE_READERS 8
+/// CaptureCursor::_busyFrom while the reader isn't looking at any spans.
+#define CAPTURE_READER_IDLE -1
+
+/**
+     @brief     One reader's position in a CaptureRing.
+     Positions count bytes since the ring was allocated, so they only ever go up.
+*/
+class CaptureCursor
+{
+public:
+	CaptureCursor() : _active(false), _readPos(0), _busyFrom(CAPTURE_READER_IDLE), _overflowBytes(0) {};
+	std::atomic<bool> _active;
+	/// Everything before this has been consumed, or was skipped because the reader fell behind.
+	std::atomic<long long> _readPos;
+	/// Start of the spans the reader is looking at, or CAPTURE_READER_IDLE.  The writer never
+	/// overwrites anything from here on.
+	std::atomic<long long> _busyFrom;
+	/// Bytes this reader missed by falling a ring behind.
+	std::atomic<long long> _overflowBytes;
+};
+
+/**
+     @brief     Holds captured audio between the device and the recording callbacks.
+     The capture thread either asks for a contiguous region to have the device read straight
+     into, or copies data in with Write().  Each reader has its own cursor, so several
+     callbacks share the one copy of the data.  Readers look at what has been captured as at
+     most two read-only spans, the second only when the data wraps past the end of the ring,
+     and then release what they have finished with.  The size is a whole number of frames so
+     a span never ends part way through a frame.
+     A reader that falls behind only loses its own data.  If it is idle, the writer moves its
+     cursor on; if it is more than half a ring behind when it next reads, it skips ahead
+     itself.  Either way the loss is counted against that reader.  The writer only drops data
+     when a reader holds its spans for longer than half the ring takes to fill.
+     One thread may write while one thread per reader reads, without any locking.  Allocate()
+     is not safe while any of them is running.
+*/
+class CaptureRing
+{
+public:
+	CaptureRing();
+	~CaptureRing();
+	bool Allocate( int sizeBytes, int frameSize );
+	void Empty();
+	int AddReader();
+	void RemoveReader( int reader );
+	int GetWriteRegion( unsigned char** region, int numBytes );
+	void CommitWrite( int numBytes );
+	int Write( const unsigned char* data, int numBytes );
+	/// Bytes written since the ring was allocated.
+	long long GetWriteTotal();
+	/// Also sets each span's _frame.  _time is left for the caller.
+	int GetReadSpans( int reader, CaptureSpan* first, CaptureSpan* second );
+	void Consume( int reader, int numBytes );
+	int GetReadAvail( int reader );
+	long long GetOverflowBytes( int reader );
+	int GetSize();
+	/// Bytes that arrived while a reader was holding the space they needed and were thrown away.
+	long long GetDroppedBytes();
+private:
+	long long GetProtectedPosition( CaptureCursor& cursor, long long writeEnd );
+	unsigned char* _data;
+	int _size;
+	int _frameSize;
+	/// Furthest a reader may be behind when it starts reading.  Half the ring, in whole frames.
+	int _lapLimit;
+	/// Bytes written so far.  Only changed by the writer, after the data has been copied.
+	std::atomic<long long> _writeTotal;
+	CaptureCursor _cursors[MAX_CAPTURE_READERS];
+	std::atomic<long long> _droppedBytes;
+};
+
+#endif
@@ -0,0 +1,111 @@
+#include "CaptureThread.h"
+#include "AudioBufferInterface.h"
+
+CaptureDelivery::CaptureDelivery( AudioBufferInterface* manager, int reader, int numChannels ) : wxThread( wxTHREAD_JOINABLE )
+{
+  _manager = manager;
+  _reader = reader;
+  _planeData.assign( numChannels * CAPTURE_PLANE_FRAMES, 0.0f );
+  for( int channel = 0; channel < numChannels; channel++ )
+  {
+      _planes.push_back( &_planeData[channel * CAPTURE_PLANE_FRAMES] );
+  }
+  _pending = false;
+  _exit = false;
+}
+
+CaptureDelivery::~CaptureDelivery()
+{
+}
+
+void CaptureDelivery::Notify()
+{
+  if( !_pending.exchange( true ) )
+  {
+      _wake.Post();
+  }
+}
+
+void CaptureDelivery::Shutdown()
+{
+  _exit = true;
+  _wake.Post();
+  Wait();
+}
+
+/**
+     @brief     Delivery thread function.
+     Waits to be woken and forwards everything its subscriber hasn't seen yet.  Data that
+     arrives while the callback is running is picked up by the next pass.
+*/
+void* CaptureDelivery::Entry()
+{
+  while( true )
+  {
+      _wake.Wait();
+      _pending = false;
+      // Checked before forwarding.  When the whole capture stream is stopping, the capture
+      // thread has already exited, so this pass delivers the last of its data.
+      bool exit = _exit;
+      _manager->ForwardCapturedData( _reader, &_planes[0] );
+      if( exit )
+      {
+          break;
+      }
+  }
+  return NULL;
+}
+
+CaptureThread::CaptureThread( AudioBufferInterface* manager ) : wxThread( wxTHREAD_JOINABLE )
+{
+  _manager = manager;
+  _exit = false;
+}
+
+CaptureThread::~CaptureThread()
+{
+}
+
+bool CaptureThread::Start( const RealtimeConfig& config )
+{
+  if( Create() != wxTHREAD_NO_ERROR )
+  {
+      return false;
+  }
+  // Same priority as the managers' own audio threads unless real-time scheduling is asked for.
+  SetPriority( 75 );
+  _realtime.SetConfig( config );
+  Run();
+  return true;
+}
+
+void CaptureThread::Shutdown()
+{
+  _exit = true;
+  Wait();
+}
+
+/**
+     @brief     Capture thread function.
+     Waits for the device, reads whatever it has into the capture ring, and wakes the
+     subscribers if anything new arrived.
+*/
+void* CaptureThread::Entry()
+{
+  while( !_exit )
+  {
+      _realtime.ApplyIfPending();
+      _manager->WaitForCapture( CAPTURE_WAIT_TIMEOUT );
+      if( _exit )
+      {
+          break;
+      }
+      long long written = _manager->_captureRing.GetWriteTotal();
+      _manager->MonitorCaptureBuffer();
+      if( _manager->_captureRing.GetWriteTotal() != written )
+      {
+          _manager->NotifyCaptureSubscribers();
+      }
+  }
+  return NULL;
+}
@@ -0,0 +1,68 @@
+#ifndef _CAPTURETHREAD_H_
+#define _CAPTURETHREAD_H_
+
+#include "wx/thread.h"
+#include <atomic>
+#include <vector>
+#include "RealtimeThread.h"
+
+class AudioBufferInterface;
+
+/// Longest the capture thread waits on the device before checking whether it should exit, in milliseconds.
+#define CAPTURE_WAIT_TIMEOUT 20
+
+/**
+     @brief     Hands captured audio to one recording callback on a thread of its own.
+     Every subscriber to a capture stream has one, woken whenever new frames reach the
+     capture ring.  A slow callback only holds up its own data, and if it falls too far
+     behind it is the one that misses frames.
+*/
+class CaptureDelivery : public wxThread
+{
+public:
+	CaptureDelivery( AudioBufferInterface* manager, int reader, int numChannels );
+	~CaptureDelivery();
+	/// Called by the capture thread after storing frames.  Never blocks.
+	void Notify();
+	/// Delivers whatever is left in the ring, then stops the thread and waits for it to exit.
+	void Shutdown();
+	virtual void* Entry();
+private:
+	AudioBufferInterface* _manager;
+	/// The subscriber's cursor in the capture ring.
+	int _reader;
+	/// One float array per capture channel, for callbacks that take separate channels.
+	std::vector<float> _planeData;
+	std::vector<float*> _planes;
+	wxSemaphore _wake;
+	/// Set while a wake is posted and not yet picked up, so a slow callback doesn't pile them up.
+	std::atomic<bool> _pending;
+	std::atomic<bool> _exit;
+};
+
+/**
+     @brief     Reads the capture device on a thread of its own.
+     The playback loop no longer polls capture, so a slow mix can't delay capture reads and a
+     slow recording callback can't hold up the mix.  The thread waits until the manager's
+     device has data, reads it into the capture ring, and wakes each subscriber's
+     CaptureDelivery thread to pass it on.
+     @note      The manager starts the thread in StartCapture() and stops it in StopCapture().
+*/
+class CaptureThread : public wxThread
+{
+public:
+	CaptureThread( AudioBufferInterface* manager );
+	~CaptureThread();
+	bool Start( const RealtimeConfig& config );
+	/// Stops the thread and waits for it to exit.
+	void Shutdown();
+	virtual void* Entry();
+	/// Scheduling for the reading thread, applied when it next wakes.  Delivery threads run
+	/// at normal priority.
+	RealtimeThread _realtime;
+private:
+	AudioBufferInterface* _manager;
+	std::atomic<bool> _exit;
+};
+
+#endif
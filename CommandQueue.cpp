@@ -0,0 +1,84 @@
+#include "CommandQueue.h"
+
+CommandQueue::CommandQueue( int capacity )
+{
+  unsigned int size = 1;
+  while( (int)size < capacity )
+  {
+      size <<= 1;
+  }
+  _slots = new Slot[size];
+  _mask = size - 1;
+  unsigned int count;
+  for( count = 0; count < size; count++ )
+  {
+      _slots[count]._sequence.store( count, std::memory_order_relaxed );
+  }
+  _pushPosition.store( 0, std::memory_order_relaxed );
+  _popPosition = 0;
+}
+
+CommandQueue::~CommandQueue()
+{
+  delete[] _slots;
+}
+
+/**
+     @brief     Adds a command to the back of the queue.
+     A slot is free when its sequence number equals the position being claimed.  The position
+     is claimed with a compare-and-swap so that concurrent pushers each get their own slot, and
+     the sequence is advanced once the command is in place to hand it to Pop().
+     @return
+     false if the queue is full.
+*/
+bool CommandQueue::Push( const MixerCommand& command )
+{
+  unsigned int position = _pushPosition.load( std::memory_order_relaxed );
+  Slot* slot;
+  for( ;; )
+  {
+      slot = &_slots[position & _mask];
+      unsigned int sequence = slot->_sequence.load( std::memory_order_acquire );
+      int difference = (int)(sequence - position);
+      if( difference == 0 )
+      {
+          if( _pushPosition.compare_exchange_weak( position, position + 1, std::memory_order_relaxed ) )
+          {
+              break;
+          }
+      }
+      else if( difference < 0 )
+      {
+          // The slot still holds a command from the previous lap that hasn't been popped.
+          return false;
+      }
+      else
+      {
+          position = _pushPosition.load( std::memory_order_relaxed );
+      }
+  }
+  slot->_command = command;
+  slot->_sequence.store( position + 1, std::memory_order_release );
+  return true;
+}
+
+/**
+     @brief     Takes the command at the front of the queue.
+     Must only be called from the audio thread.
+     @return
+     false if the queue is empty.
+*/
+bool CommandQueue::Pop( MixerCommand* command )
+{
+  Slot* slot = &_slots[_popPosition & _mask];
+  unsigned int sequence = slot->_sequence.load( std::memory_order_acquire );
+  if( (int)(sequence - (_popPosition + 1)) < 0 )
+  {
+      return false;
+  }
+  *command = slot->_command;
+  // Mark the slot free for the pusher that will reach it on the next lap.
+  slot->_sequence.store( _popPosition + _mask + 1, std::memory_order_release );
+  _popPosition++;
+  return true;
+}
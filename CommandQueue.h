@@ -0,0 +1,57 @@
+#ifndef _COMMANDQUEUE_H_
+#define _COMMANDQUEUE_H_
+
+#include <atomic>
+
+/// Control operations the audio thread applies at the start of each cycle.
+#define MIXER_COMMAND_PLAY 0
+#define MIXER_COMMAND_STOP 1
+/// Discards queued data up to a RingBuffer write count given as the value.
+#define MIXER_COMMAND_EMPTY 2
+#define MIXER_COMMAND_SET_VOLUME 3
+#define MIXER_COMMAND_SET_PAN 4
+#define MIXER_COMMAND_SET_SAMPLE_RATE 5
+#define MIXER_COMMAND_SET_CHANNELS 6
+
+/**
+     @brief     A single control operation for one channel.
+*/
+class MixerCommand
+{
+public:
+	int _type;
+	int _channel;
+	int _value;
+};
+
+/**
+     @brief     Fixed-size queue that passes MixerCommands to the audio thread without locks.
+     Any number of threads may call Push().  Only the audio thread may call Pop().  Each slot
+     carries a sequence number that tells pushers whether it is free and the popper whether it
+     has been filled, so neither side ever waits for the other: Push() fails when the queue is
+     full and Pop() fails when it is empty.
+*/
+class CommandQueue
+{
+public:
+	/// The capacity is rounded up to a power of two.
+	CommandQueue( int capacity );
+	~CommandQueue();
+	bool Push( const MixerCommand& command );
+	bool Pop( MixerCommand* command );
+private:
+	class Slot
+	{
+	public:
+		std::atomic<unsigned int> _sequence;
+		MixerCommand _command;
+	};
+	Slot* _slots;
+	unsigned int _mask;
+	/// Next slot to be claimed by Push().  Shared by the pushing threads.
+	std::atomic<unsigned int> _pushPosition;
+	/// Next slot to be read by Pop().  Only touched by the audio thread.
+	unsigned int _popPosition;
+};
+
+#endif
@@ -1256,17 +1256,37 @@ void DXAudioManager::SetBufferLatency( int msec )
 	return;
 }
 
+/**
+  @brief  Returns the number of bytes written to a secondary buffer but not yet played.
+  Kept in bytes for existing callers; use GetNumFramesQueued() for a count in frames.
+*/
 int DXAudioManager::GetNumSamplesQueued(int channel)
 {
-	//if( channel < 0 || channel >= _numBuffers )
-	//{
-	//	return 0;
-	//}
-	//int value;
-	//_secondaryBuffers[channel]->_mutex->Lock();
-	//value = _secondaryBuffers[channel]->_bufferData->GetReadAvail();
-	//_secondaryBuffers[channel]->_mutex->Unlock();
-	//return value;
-	return 0;
+	return GetNumBytesQueued(channel);
+}
+
+/**
+  @brief  Returns the number of bytes written to a secondary buffer but not yet played.
+*/
+int DXAudioManager::GetNumBytesQueued(int channel)
+{
+	if( channel < 0 || channel >= _numBuffers )
+	{
+		return 0;
+	}
+	int value;
+	(*_fillBufferMutex[channel]).Lock();
+	value = *_soundLength[channel];
+	(*_fillBufferMutex[channel]).Unlock();
+	return value > 0 ? value : 0;
+}
+
+/**
+  @brief  Returns the number of frames written to a secondary buffer but not yet played.
+  DirectSound secondary buffers are always mono, so a frame is one word.
+*/
+int DXAudioManager::GetNumFramesQueued(int channel)
+{
+	return GetNumBytesQueued(channel) / BYTES_PER_WORD;
 }
 #endif // WIN32
@@ -72,6 +72,8 @@ public:
 	virtual bool FillBufferSilence(int channel, int length );
 	virtual void SetBufferLatency( int msec );
 	virtual int GetNumSamplesQueued( int channel );
+	virtual int GetNumBytesQueued( int channel );
+	virtual int GetNumFramesQueued( int channel );
 	virtual int run();
 private:
     // Virtual private methods
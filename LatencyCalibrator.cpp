@@ -0,0 +1,219 @@
+#include <math.h>
+#include "LatencyCalibrator.h"
+#include "AudioBufferInterface.h"
+
+/// Level of the sequence as played, in 16-bit sample units.  About -12 dBFS.
+#define CALIBRATION_AMPLITUDE 8192
+/// Extra time allowed for the capture to come in after the longest round trip, in milliseconds.
+#define CALIBRATION_GRACE 500
+
+/// Feedback taps for a maximal Galois LFSR of each order from 2 to 16.
+static const unsigned int MLS_TAPS[] =
+{
+  0, 0, 0x3, 0x6, 0xC, 0x14, 0x30, 0x60, 0xB8, 0x110, 0x240, 0x500, 0xE08, 0x1C80, 0x3802, 0x6000, 0xD008
+};
+
+LatencyCalibrator::LatencyCalibrator()
+{
+  _capturedFrames = 0;
+  _gap = false;
+  _firstFrame = -1;
+}
+
+LatencyCalibrator::~LatencyCalibrator()
+{
+}
+
+/**
+     @brief     Plays the sequence through channel and finds how long it takes to be captured.
+     The channel must be playing and should have nothing queued, and capture must be
+     running.
+     @param     result  Filled in even when the sequence isn't found, so _peakRatio shows how
+     close it came.
+     @return
+     true if the sequence was found.  The measurement is then also stored on the manager.
+*/
+bool LatencyCalibrator::Measure( AudioBufferInterface* manager, int channel, LatencyMeasurement* result )
+{
+  if( manager == NULL || result == NULL )
+  {
+      return false;
+  }
+  *result = LatencyMeasurement();
+  unsigned int sampleRate = manager->GetRecordSampleRate();
+  if( sampleRate == 0 || !manager->IsBufferPlaying( channel ) )
+  {
+      return false;
+  }
+  MakeSequence( CALIBRATION_MLS_ORDER, _sequence );
+  int sequenceFrames = (int)_sequence.size();
+  _captured.assign( (size_t)( CALIBRATION_LEAD_IN + CALIBRATION_MAX_LATENCY ) * sampleRate / 1000 + sequenceFrames, 0.0f );
+  _capturedFrames = 0;
+  _gap = false;
+  _firstFrame = -1;
+  // The sequence is played at the capture rate, so it comes back sample for sample.  The
+  // managers take the rate from the channel rather than from FillBuffer(), so the channel is
+  // switched over for the measurement.  The lead-in gives the mixer time to pick it up.
+  unsigned int channelSampleRate = manager->GetSampleRate( channel );
+  if( channelSampleRate != sampleRate && !manager->SetSampleRate( channel, sampleRate ) )
+  {
+      return false;
+  }
+  if( !manager->AddRecordingCallback( this ) )
+  {
+      manager->SetSampleRate( channel, channelSampleRate );
+      return false;
+  }
+  // Gives the capture clock time to be stamped, and shows the noise floor before the sequence.
+  wxThread::Sleep( CALIBRATION_LEAD_IN );
+
+  int numChannels = manager->GetChannelCount( channel );
+  if( numChannels < 1 )
+  {
+      numChannels = MONO;
+  }
+  std::vector<short> playback( sequenceFrames * numChannels );
+  for( int frame = 0; frame < sequenceFrames; frame++ )
+  {
+      for( int sample = 0; sample < numChannels; sample++ )
+      {
+          playback[frame * numChannels + sample] = (short)( _sequence[frame] * CALIBRATION_AMPLITUDE );
+      }
+  }
+  PlaybackPosition position;
+  bool havePosition = manager->GetPlaybackPosition( channel, &position );
+  long long fillTime = CaptureClock::Now();
+  if( !manager->FillBuffer( channel, (unsigned char *)&playback[0], (int)playback.size() * BYTES_PER_WORD, sampleRate ) )
+  {
+      manager->RemoveRecordingCallback( this );
+      manager->SetSampleRate( channel, channelSampleRate );
+      return false;
+  }
+
+  int waited = 0;
+  int timeout = CALIBRATION_MAX_LATENCY + sequenceFrames * 1000 / (int)sampleRate + CALIBRATION_GRACE;
+  while( _capturedFrames < (int)_captured.size() && !_gap && waited < timeout )
+  {
+      wxThread::Sleep( 20 );
+      waited += 20;
+  }
+  // Waits for the delivery thread, so the capture can be read safely from here on.
+  manager->RemoveRecordingCallback( this );
+  // The sequence has played out by now, or never will.
+  manager->SetSampleRate( channel, channelSampleRate );
+
+  result->_sampleRate = sampleRate;
+  result->_time = (double)CaptureClock::Now() / 1000000000.0;
+  int offset = FindSequence( &result->_peakRatio );
+  if( offset < 0 || result->_peakRatio < CALIBRATION_MIN_PEAK_RATIO )
+  {
+      return false;
+  }
+  double arrivalTime = manager->GetRecordTime( _firstFrame + offset );
+  double startTime = (double)fillTime / 1000000000.0;
+  if( arrivalTime < startTime )
+  {
+      return false;
+  }
+  result->_roundTripSeconds = arrivalTime - startTime;
+  result->_roundTripFrames = (int)( result->_roundTripSeconds * sampleRate + 0.5 );
+  result->_unaccountedSeconds = arrivalTime - ( startTime + ( havePosition ? position._delay : 0.0 ) );
+  result->_valid = true;
+  manager->SetMeasuredLatency( *result );
+  return true;
+}
+
+void LatencyCalibrator::ForwardRecordedData( unsigned char* /*data*/, int /*length*/, int /*sampleRate*/ )
+{
+}
+
+bool LatencyCalibrator::WantsRecordedChannels()
+{
+  return true;
+}
+
+// Keeps the first channel until the buffer is full.  Called on the delivery thread.
+void LatencyCalibrator::ForwardRecordedChannels( const float* const* channels, int /*numChannels*/, int numFrames, int /*sampleRate*/, long long frame, double /*time*/ )
+{
+  if( _gap.load( std::memory_order_relaxed ) )
+  {
+      return;
+  }
+  int capturedFrames = _capturedFrames.load( std::memory_order_relaxed );
+  if( _firstFrame < 0 )
+  {
+      _firstFrame = frame;
+  }
+  // Frames this subscriber missed would throw every later offset out.  Stop at the gap, and
+  // leave _capturedFrames marking the end of what came before it.
+  if( frame != _firstFrame + capturedFrames )
+  {
+      _gap.store( true, std::memory_order_release );
+      return;
+  }
+  int count = (int)_captured.size() - capturedFrames;
+  if( count > numFrames )
+  {
+      count = numFrames;
+  }
+  for( int index = 0; index < count; index++ )
+  {
+      _captured[capturedFrames + index] = channels[0][index];
+  }
+  _capturedFrames.store( capturedFrames + count, std::memory_order_release );
+}
+
+/**
+ @brief  Fills sequence with one period of a maximum length sequence of the given order, as +1 and -1.
+*/
+void LatencyCalibrator::MakeSequence( int order, std::vector<float>& sequence )
+{
+  unsigned int length = ( 1U << order ) - 1;
+  unsigned int state = 1;
+  sequence.resize( length );
+  for( unsigned int index = 0; index < length; index++ )
+  {
+      sequence[index] = ( state & 1 ) ? 1.0f : -1.0f;
+      state = ( state >> 1 ) ^ ( ( state & 1 ) ? MLS_TAPS[order] : 0 );
+  }
+}
+
+/**
+     @brief     Cross-correlates the capture with the sequence.
+     The polarity of the path isn't known, so the largest peak either way wins.
+     Only the frames counted in _capturedFrames are searched.
+     @return
+     The capture offset where the sequence starts, or -1 if too little was captured.
+*/
+int LatencyCalibrator::FindSequence( double* peakRatio )
+{
+  int sequenceFrames = (int)_sequence.size();
+  int numOffsets = _capturedFrames.load( std::memory_order_acquire ) - sequenceFrames + 1;
+  *peakRatio = 0.0;
+  if( numOffsets <= 0 )
+  {
+      return -1;
+  }
+  const float* sequence = &_sequence[0];
+  double sumSquares = 0.0;
+  double peak = 0.0;
+  int peakOffset = -1;
+  for( int offset = 0; offset < numOffsets; offset++ )
+  {
+      const float* captured = &_captured[offset];
+      float sum = 0.0f;
+      for( int index = 0; index < sequenceFrames; index++ )
+      {
+          sum += captured[index] * sequence[index];
+      }
+      sumSquares += (double)sum * sum;
+      if( fabs( sum ) > peak )
+      {
+          peak = fabs( sum );
+          peakOffset = offset;
+      }
+  }
+  double rms = sqrt( sumSquares / numOffsets );
+  *peakRatio = rms > 0.0 ? peak / rms : 0.0;
+  return peakOffset;
+}
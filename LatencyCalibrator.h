@@ -0,0 +1,79 @@
+#ifndef _LATENCYCALIBRATOR_H_
+#define _LATENCYCALIBRATOR_H_
+
+#include <atomic>
+#include <vector>
+#include "AudioRecordingCallback.h"
+
+class AudioBufferInterface;
+
+/// Order of the maximum length sequence LatencyCalibrator plays, which is 2^order - 1 samples long.
+#define CALIBRATION_MLS_ORDER 12
+/// Capture collected before the sequence is played, in milliseconds.
+#define CALIBRATION_LEAD_IN 200
+/// Longest round trip looked for, in milliseconds.
+#define CALIBRATION_MAX_LATENCY 1000
+/// The correlation peak has to stand this many times above the correlation's RMS to count.
+#define CALIBRATION_MIN_PEAK_RATIO 8.0
+
+/**
+     @brief     The result of a round-trip latency measurement.
+*/
+class LatencyMeasurement
+{
+public:
+	LatencyMeasurement() : _valid(false), _roundTripFrames(0), _roundTripSeconds(0.0), _unaccountedSeconds(0.0),
+		_sampleRate(0), _peakRatio(0.0), _time(0.0) {};
+	/// False if the sequence wasn't found in the capture.
+	bool _valid;
+	/// Frames at _sampleRate from handing the sequence to FillBuffer() to capturing it.
+	int _roundTripFrames;
+	double _roundTripSeconds;
+	/// The part of the round trip the manager's own figures miss, mostly converter and driver
+	/// latency.  A frame is captured this long after PlaybackPosition said it would be heard,
+	/// so add it to playback times before lining them up with capture times.
+	double _unaccountedSeconds;
+	/// The capture rate.
+	unsigned int _sampleRate;
+	/// Height of the correlation peak over the correlation's RMS.  Higher is more certain.
+	double _peakRatio;
+	/// Seconds on std::chrono::steady_clock when the measurement was made.
+	double _time;
+};
+
+/**
+     @brief     Measures the round trip from a secondary buffer to the capture stream.
+     Measure() subscribes to capture, plays a maximum length sequence through a channel, and
+     cross-correlates it with what comes back.  A sequence rather than a click spreads the
+     energy out, so the peak stands clear of room noise at a comfortable level.  The result
+     is stored on the manager, where GetMeasuredLatency() picks it up for sync and echo
+     cancellation.
+     @note      The output has to be audible to the input, through a loopback cable or a speaker
+     and microphone.  Measure() blocks for a little over a second.
+*/
+class LatencyCalibrator : public AudioRecordingCallback
+{
+public:
+	LatencyCalibrator();
+	~LatencyCalibrator();
+	bool Measure( AudioBufferInterface* manager, int channel, LatencyMeasurement* result );
+	virtual void ForwardRecordedData( unsigned char* data, int length, int sampleRate );
+	virtual bool WantsRecordedChannels();
+	virtual void ForwardRecordedChannels( const float* const* channels, int numChannels, int numFrames, int sampleRate, long long frame, double time );
+private:
+	static void MakeSequence( int order, std::vector<float>& sequence );
+	int FindSequence( double* peakRatio );
+	/// +1 and -1 samples.
+	std::vector<float> _sequence;
+	/// The first capture channel, from the first frame delivered after subscribing.
+	/// Sized by Measure() and never resized while subscribed.
+	std::vector<float> _captured;
+	/// End of the usable capture.  FindSequence() looks no further.
+	std::atomic<int> _capturedFrames;
+	/// Set at the first gap in the capture.  Nothing after it is kept.
+	std::atomic<bool> _gap;
+	/// Capture frame number of _captured[0].
+	long long _firstFrame;
+};
+
+#endif
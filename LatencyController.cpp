@@ -0,0 +1,170 @@
+#include "LatencyController.h"
+#include "Mixer.h"
+
+/// SetBufferLatency() only takes latencies below one second.
+#define MAX_CONTROLLED_LATENCY 999
+
+LatencyController::LatencyController()
+{
+  _underruns = 0;
+  _lastUnderruns = 0;
+  _lastStarvedReads = 0;
+  _restart = true;
+}
+
+LatencyController::~LatencyController()
+{
+}
+
+/**
+ @brief  Replaces the settings.  The next Update() starts counting glitches afresh.
+*/
+void LatencyController::SetConfig( const LatencyConfig& config )
+{
+  _mutex.Lock();
+  _config = config;
+  if( _config._minLatency < 1 )
+  {
+      _config._minLatency = 1;
+  }
+  if( _config._maxLatency > MAX_CONTROLLED_LATENCY )
+  {
+      _config._maxLatency = MAX_CONTROLLED_LATENCY;
+  }
+  if( _config._maxLatency < _config._minLatency )
+  {
+      _config._maxLatency = _config._minLatency;
+  }
+  _restart = true;
+  _mutex.Unlock();
+}
+
+LatencyConfig LatencyController::GetConfig()
+{
+  _mutex.Lock();
+  LatencyConfig config = _config;
+  _mutex.Unlock();
+  return config;
+}
+
+long long LatencyController::GetUnderrunCount()
+{
+  return _underruns.load( std::memory_order_relaxed );
+}
+
+/**
+     @brief     Decides on a new latency from what has happened since the last call.
+     Device underruns, channels running dry, and slow mixes each count as a glitch.  A glitch
+     multiplies the latency by the grow factor.  After _stableSeconds without a glitch or a
+     change, the latency comes down by one shrink step.
+     @return
+     The latency to use, in milliseconds.  This is the latency passed in when there is no
+     change or the controller is disabled.
+*/
+int LatencyController::Update( int latency, Mixer* mixer )
+{
+  _mutex.Lock();
+  MixStats stats = mixer->GetStats();
+  double mixLoad = mixer->TakePeakMixLoad();
+  long long underrunCount = _underruns.load( std::memory_order_relaxed );
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  double nowSeconds = std::chrono::duration<double>( now.time_since_epoch() ).count();
+
+  long long underruns = underrunCount - _lastUnderruns;
+  long long starvedReads = stats._starvedReads - _lastStarvedReads;
+  _lastUnderruns = underrunCount;
+  _lastStarvedReads = stats._starvedReads;
+
+  if( !_config._enabled || _restart )
+  {
+      _restart = false;
+      _lastGlitch = now;
+      _lastChange = now;
+      _mutex.Unlock();
+      return latency;
+  }
+
+  int reason = LATENCY_REASON_NONE;
+  int newLatency = latency;
+  if( underruns > 0 )
+  {
+      reason = LATENCY_REASON_UNDERRUN;
+  }
+  else if( starvedReads > 0 && _config._countStarvedChannels )
+  {
+      reason = LATENCY_REASON_STARVED;
+  }
+  else if( mixLoad > _config._maxMixLoad )
+  {
+      reason = LATENCY_REASON_MIX_LOAD;
+  }
+
+  if( reason != LATENCY_REASON_NONE )
+  {
+      _lastGlitch = now;
+      newLatency = (int)( latency * _config._growFactor + 0.999 );
+      // Always make some progress, even with a small latency or a factor close to one.
+      if( newLatency <= latency )
+      {
+          newLatency = latency + 1;
+      }
+      if( newLatency > _config._maxLatency )
+      {
+          newLatency = _config._maxLatency;
+      }
+  }
+  else if( now - _lastGlitch >= std::chrono::duration<double>( _config._stableSeconds ) &&
+           now - _lastChange >= std::chrono::duration<double>( _config._stableSeconds ) )
+  {
+      newLatency = latency - _config._shrinkStep;
+      if( newLatency < _config._minLatency )
+      {
+          newLatency = _config._minLatency;
+      }
+      reason = LATENCY_REASON_STABLE;
+  }
+
+  // Pull the latency into range if the bounds were changed or it was set by hand.
+  if( newLatency < _config._minLatency || newLatency > _config._maxLatency )
+  {
+      newLatency = newLatency < _config._minLatency ? _config._minLatency : _config._maxLatency;
+      reason = LATENCY_REASON_BOUNDS;
+  }
+
+  if( newLatency != latency )
+  {
+      _lastChange = now;
+      Record( nowSeconds, latency, newLatency, reason, underruns, starvedReads, mixLoad );
+  }
+  _mutex.Unlock();
+  return newLatency;
+}
+
+/**
+ @brief  Hands back the decisions made since the last call, oldest first.
+*/
+std::vector<LatencyDecision> LatencyController::TakeDecisions()
+{
+  std::vector<LatencyDecision> decisions;
+  _mutex.Lock();
+  decisions.swap( _decisions );
+  _mutex.Unlock();
+  return decisions;
+}
+
+void LatencyController::Record( double now, int oldLatency, int newLatency, int reason, long long underruns, long long starvedReads, double mixLoad )
+{
+  if( _decisions.size() >= MAX_LATENCY_DECISIONS )
+  {
+      _decisions.erase( _decisions.begin() );
+  }
+  LatencyDecision decision;
+  decision._time = now;
+  decision._oldLatency = oldLatency;
+  decision._newLatency = newLatency;
+  decision._reason = reason;
+  decision._underruns = underruns;
+  decision._starvedReads = starvedReads;
+  decision._mixLoad = mixLoad;
+  _decisions.push_back( decision );
+}
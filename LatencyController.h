@@ -0,0 +1,115 @@
+#ifndef _LATENCYCONTROLLER_H_
+#define _LATENCYCONTROLLER_H_
+
+#include "wx/thread.h"
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+class Mixer;
+
+/// Why a LatencyController changed the latency.
+#define LATENCY_REASON_NONE 0
+/// The device ran out of data.
+#define LATENCY_REASON_UNDERRUN 1
+/// A playing channel ran out of data part way through a block.
+#define LATENCY_REASON_STARVED 2
+/// A block took too much of its own duration to mix.
+#define LATENCY_REASON_MIX_LOAD 3
+/// Nothing has gone wrong for a while, so the latency was brought down a step.
+#define LATENCY_REASON_STABLE 4
+/// The latency was outside the configured bounds.
+#define LATENCY_REASON_BOUNDS 5
+
+/// Decisions kept for TakeDecisions().  Older ones are dropped once this many are waiting.
+#define MAX_LATENCY_DECISIONS 256
+
+/**
+     @brief     Settings for adaptive buffer latency.
+     The controller is off by default, which leaves the latency wherever SetBufferLatency()
+     put it.
+*/
+class LatencyConfig
+{
+public:
+	LatencyConfig() : _enabled(false), _minLatency(10), _maxLatency(200), _growFactor(1.5), _shrinkStep(2),
+		_stableSeconds(10.0), _maxMixLoad(0.7), _countStarvedChannels(true) {};
+	bool _enabled;
+	/// Bounds for the latency, in milliseconds.  SetBufferLatency() can't go past 999.
+	int _minLatency;
+	int _maxLatency;
+	/// The latency is multiplied by this after a glitch.
+	double _growFactor;
+	/// Milliseconds taken off each time the system has been stable for _stableSeconds.
+	int _shrinkStep;
+	double _stableSeconds;
+	/// Grow if the slowest block took more than this fraction of its duration to mix.
+	double _maxMixLoad;
+	/// Treat channels running dry as glitches.  Turn this off if channels are routinely
+	/// left playing after their data has run out, since every end of a sound looks the same.
+	bool _countStarvedChannels;
+};
+
+/**
+     @brief     One change made by a LatencyController, with the evidence behind it.
+*/
+class LatencyDecision
+{
+public:
+	LatencyDecision() : _time(0.0), _oldLatency(0), _newLatency(0), _reason(LATENCY_REASON_NONE),
+		_underruns(0), _starvedReads(0), _mixLoad(0.0) {};
+	/// Seconds on std::chrono::steady_clock, which is CLOCK_MONOTONIC on Linux, so it can be
+	/// lined up with other system measurements.
+	double _time;
+	/// Latencies in milliseconds.
+	int _oldLatency;
+	int _newLatency;
+	/// One of the LATENCY_REASON values.
+	int _reason;
+	/// Device underruns since the previous update.
+	long long _underruns;
+	/// Channels that ran dry since the previous update.
+	long long _starvedReads;
+	/// Slowest block since the previous update, as a fraction of the block's duration.
+	double _mixLoad;
+};
+
+/**
+     @brief     Adjusts buffer latency from the glitches an audio engine sees.
+     The audio thread calls ReportUnderrun() whenever its device runs dry.  Everything else
+     comes from the Mixer's statistics.  Update() is called periodically from a control
+     thread; it grows the latency straight away when there has been a glitch and brings it
+     back down a step at a time once things have been quiet for a while.  Every change is
+     recorded, with its reason, for TakeDecisions().
+*/
+class LatencyController
+{
+public:
+	LatencyController();
+	~LatencyController();
+	void SetConfig( const LatencyConfig& config );
+	LatencyConfig GetConfig();
+	/// Called on the audio thread.  Costs one atomic increment.
+	void ReportUnderrun()
+	{
+		_underruns.fetch_add( 1, std::memory_order_relaxed );
+	}
+	long long GetUnderrunCount();
+	int Update( int latency, Mixer* mixer );
+	std::vector<LatencyDecision> TakeDecisions();
+private:
+	void Record( double now, int oldLatency, int newLatency, int reason, long long underruns, long long starvedReads, double mixLoad );
+	wxMutex _mutex;
+	LatencyConfig _config;
+	std::atomic<long long> _underruns;
+	/// Counts as of the previous Update().
+	long long _lastUnderruns;
+	long long _lastStarvedReads;
+	/// Set by SetConfig() so the next Update() only takes new baselines.
+	bool _restart;
+	std::chrono::steady_clock::time_point _lastGlitch;
+	std::chrono::steady_clock::time_point _lastChange;
+	std::vector<LatencyDecision> _decisions;
+};
+
+#endif
@@ -0,0 +1,107 @@
+
+#include <memory.h>
+#include "MixArena.h"
+#include "AudioBufferInterface.h"
+
+MixArena::MixArena()
+{
+  _copyBuffer = NULL;
+  _copyBufferSize = 0;
+  _channelData = NULL;
+  _channelDataSize = 0;
+  _resampleData = NULL;
+  _resampleDataSize = 0;
+  _mixBus = NULL;
+  _mixBusSize = 0;
+  _resampleFrom = NULL;
+  _resampleFromSize = 0;
+  _resampleTo = NULL;
+  _resampleToSize = 0;
+  _leftVolume = NULL;
+  _rightVolume = NULL;
+  _numChannels = 0;
+}
+
+MixArena::~MixArena()
+{
+  Free();
+}
+
+/**
+ @brief  Releases all of the arena's buffers.
+*/
+void MixArena::Free()
+{
+  delete[] _copyBuffer;
+  delete[] _channelData;
+  delete[] _resampleData;
+  delete[] _mixBus;
+  delete[] _leftVolume;
+  delete[] _rightVolume;
+  delete[] _resampleFrom;
+  delete[] _resampleTo;
+  _copyBuffer = NULL;
+  _channelData = NULL;
+  _resampleData = NULL;
+  _mixBus = NULL;
+  _leftVolume = NULL;
+  _rightVolume = NULL;
+  _resampleFrom = NULL;
+  _resampleTo = NULL;
+  _copyBufferSize = 0;
+  _channelDataSize = 0;
+  _resampleDataSize = 0;
+  _mixBusSize = 0;
+  _resampleFromSize = 0;
+  _resampleToSize = 0;
+  _numChannels = 0;
+}
+
+/**
+     @brief     Sizes the arena for one chunk of audio at the given latency.
+     Every buffer is sized for the worst case of a single mix pass: the stereo output
+     block at the playback rate and a single channel's read at the fastest source rate
+     and widest frames we expect.  Everything is zeroed so that short reads mix as silence.
+     @return
+     true once the buffers have been allocated.
+*/
+bool MixArena::Allocate( int numChannels, double bufferLatency, unsigned int playbackSampleRate, unsigned int maxSourceSampleRate, int maxSourceChannels )
+{
+  Free();
+
+  if( maxSourceSampleRate < playbackSampleRate )
+  {
+      maxSourceSampleRate = playbackSampleRate;
+  }
+
+  // Stereo output: samples x time x channels x bytes per sample.  Must be divisible by 4.
+  _copyBufferSize = (int)(playbackSampleRate * bufferLatency * STEREO * BYTES_PER_WORD);
+  _copyBufferSize &= ~3;
+  // A single channel read is never larger than a chunk of its widest frames at the highest source rate.
+  if( maxSourceChannels < STEREO )
+  {
+      maxSourceChannels = STEREO;
+  }
+  _channelDataSize = (int)(maxSourceSampleRate * bufferLatency) * maxSourceChannels * BYTES_PER_WORD;
+  _resampleDataSize = ((int)(playbackSampleRate * bufferLatency) + 1) * maxSourceChannels;
+  _mixBusSize = _copyBufferSize / BYTES_PER_WORD;
+  // The resampler works on one source channel at a time, so a read's sample count covers it.
+  _resampleFromSize = _channelDataSize / BYTES_PER_WORD;
+  _resampleToSize = _resampleDataSize;
+  _numChannels = numChannels;
+
+  _copyBuffer = new unsigned char[_copyBufferSize];
+  memset( _copyBuffer, 0, _copyBufferSize );
+  _channelData = new unsigned char[_channelDataSize];
+  memset( _channelData, 0, _channelDataSize );
+  _resampleData = new short[_resampleDataSize];
+  memset( _resampleData, 0, _resampleDataSize * sizeof(short) );
+  _mixBus = new float[_mixBusSize];
+  memset( _mixBus, 0, _mixBusSize * sizeof(float) );
+  _leftVolume = new double[numChannels];
+  _rightVolume = new double[numChannels];
+  _resampleFrom = new float[_resampleFromSize];
+  _resampleTo = new float[_resampleToSize];
+
+  return true;
+}
@@ -0,0 +1,43 @@
+#ifndef _MIXARENA_H_
+#define _MIXARENA_H_
+
+/**
+     @brief     Scratch memory used by a manager's mix pass.
+     All of the temporary buffers the audio thread needs for one mix cycle are allocated
+     here up front, when Init() or SetBufferLatency() runs, and reused every cycle.  The
+     mix thread must not call new or delete once playback is running.
+     @note      Allocate() frees and replaces the buffers, so it must not be called on an arena
+     that a mix pass is using.  Mixer::Reconfigure() builds a fresh arena instead.
+*/
+class MixArena
+{
+public:
+	MixArena();
+	~MixArena();
+	bool Allocate( int numChannels, double bufferLatency, unsigned int playbackSampleRate, unsigned int maxSourceSampleRate, int maxSourceChannels );
+	void Free();
+	/// Stereo 16-bit block that is handed to the sound card.
+	unsigned char* _copyBuffer;
+	int _copyBufferSize;
+	/// Raw data read from a single secondary buffer.  Holds a block of its widest frames.
+	unsigned char* _channelData;
+	int _channelDataSize;
+	/// A single secondary buffer's data after it has been resampled to the playback rate.
+	short* _resampleData;
+	int _resampleDataSize; /**< In samples, not bytes.  Sized for the widest frames. */
+	/// Floating point stereo bus the channels are summed into before clipping to 16 bits.
+	float* _mixBus;
+	int _mixBusSize; /**< In samples, not bytes. */
+	/// Float scratch for the resampler, one source channel at a time.  In samples.
+	float* _resampleFrom;
+	int _resampleFromSize;
+	float* _resampleTo;
+	int _resampleToSize;
+	/// Per-channel volume and pan multipliers, indexed by channel number.
+	double* _leftVolume;
+	double* _rightVolume;
+private:
+	int _numChannels;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include <memory.h>
+#include "MixWorker.h"
+#include "Mixer.h"
+#include "AudioBufferInterface.h"
+
+MixWorker::MixWorker( Mixer* mixer ) : wxThread( wxTHREAD_JOINABLE )
+{
+  _mixer = mixer;
+  _arena = NULL;
+  _framesMixed = 0;
+  _numFrames = 0;
+  _exit = false;
+}
+
+MixWorker::~MixWorker()
+{
+}
+
+void MixWorker::Start( int numFrames )
+{
+  _numFrames = numFrames;
+  _wake.Post();
+}
+
+void MixWorker::Shutdown()
+{
+  _exit = true;
+  _wake.Post();
+  Wait();
+}
+
+/**
+     @brief     Worker thread function.
+     Waits to be woken, clears its partial bus, and mixes channels until the Mixer has none
+     left to hand out.
+*/
+void* MixWorker::Entry()
+{
+  while( true )
+  {
+      _wake.Wait();
+      if( _exit )
+      {
+          break;
+      }
+      _realtime.ApplyIfPending();
+      memset( _arena->_mixBus, 0, _numFrames * STEREO * sizeof(float) );
+      _framesMixed = _mixer->MixChannels( _arena, _numFrames );
+      _mixer->WorkerDone();
+  }
+  return NULL;
+}
@@ -0,0 +1,44 @@
+#ifndef _MIXWORKER_H_
+#define _MIXWORKER_H_
+
+#include "wx/thread.h"
+#include <atomic>
+#include "MixArena.h"
+#include "RealtimeThread.h"
+
+class Mixer;
+
+/**
+     @brief     A helper thread that mixes part of the active channel list for the Mixer.
+     Each worker has its own arena, so the channels it takes are read, resampled, and summed
+     into a private float bus.  The Mixer adds the partial buses together once every worker
+     has finished the block.
+     @note      Workers sleep on a semaphore between blocks.  Channels are handed out with an
+     atomic counter and completion is reported with another, so no mutex is shared between
+     the workers and the audio thread.
+*/
+class MixWorker : public wxThread
+{
+public:
+	MixWorker( Mixer* mixer );
+	~MixWorker();
+	/// Wakes the worker to mix numFrames frames.
+	void Start( int numFrames );
+	/// Stops the thread and waits for it to exit.
+	void Shutdown();
+	virtual void* Entry();
+	/// Private scratch space and partial bus.  Owned by the Mixer's current MixConfig and
+	/// replaced by the audio thread between blocks, while the worker is asleep.
+	MixArena* _arena;
+	/// Number of frames of real data in the partial bus after the last block.
+	int _framesMixed;
+	/// Scheduling for this worker, applied when it next wakes.
+	RealtimeThread _realtime;
+private:
+	Mixer* _mixer;
+	wxSemaphore _wake;
+	int _numFrames;
+	std::atomic<bool> _exit;
+};
+
+#endif
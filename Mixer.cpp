@@ -0,0 +1,869 @@
+#include <memory.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include "Mixer.h"
+#include "MixWorker.h"
+#include "AudioBufferInterface.h"
+
+/// Room for a burst of control calls on every channel between two cycles.
+#define COMMAND_QUEUE_SIZE 4096
+/// Reconfigure() accepts latencies below this, so the shared silence is sized for it.
+#define MAX_BUFFER_LATENCY 1.0
+
+MixConfig::MixConfig()
+{
+  _bufferLatency = 0.0;
+  _blockFrames = 0;
+  _next = NULL;
+}
+
+MixConfig::~MixConfig()
+{
+  unsigned int worker;
+  for( worker = 0; worker < _workerArenas.size(); worker++ )
+  {
+      delete _workerArenas[worker];
+  }
+}
+
+Mixer::Mixer( std::vector<SecondaryBuffer *>* secondaryBuffers ) : _commands( COMMAND_QUEUE_SIZE )
+{
+  _secondaryBuffers = secondaryBuffers;
+  int numChannels = (int)_secondaryBuffers->size();
+  _activeChannels = new ActiveChannelList( numChannels );
+  _mixChannels = new int[numChannels];
+  // Start from the buffers' settings.  From here on they only change through commands.
+  _settings = new MixChannelSettings[numChannels];
+  int channel;
+  for( channel = 0; channel < numChannels; channel++ )
+  {
+      SecondaryBuffer* buffer = (*_secondaryBuffers)[channel];
+      _settings[channel]._volume = buffer->_volume;
+      _settings[channel]._pan = buffer->_pan;
+      _settings[channel]._sampleRate = buffer->_sampleRate;
+      _settings[channel]._channels = buffer->_channels;
+      _settings[channel]._bytesPerSample = buffer->_bytesPerSample;
+      _settings[channel]._hadData = false;
+      _settings[channel]._framesRead = 0;
+  }
+  _publishedFramesRead = new std::atomic<long long>[numChannels];
+  _publishedEndTime = new std::atomic<long long>[numChannels];
+  _publishedPlaying = new std::atomic<bool>[numChannels];
+  for( channel = 0; channel < numChannels; channel++ )
+  {
+      _publishedFramesRead[channel] = 0;
+      _publishedEndTime[channel] = 0;
+      _publishedPlaying[channel] = false;
+  }
+  _playbackSampleRate = 0;
+  _maxSourceSampleRate = 0;
+  _bufferLatency = 0.0;
+  _blockFrames = 0;
+  _config = NULL;
+  _pendingConfig = NULL;
+  _retiredConfigs = NULL;
+  _silence = NULL;
+  _silenceSize = 0;
+  _minChannelsPerWorker = 0;
+  _numActive = 0;
+  _nextChannel = 0;
+  _pendingWorkers = 0;
+  _masterPeak = 0;
+  _masterRms = 0;
+  _totalBlocks = 0;
+  _totalFrames = 0;
+  _totalMixNanoseconds = 0;
+  _starvedReads = 0;
+  _peakMixLoad = 0;
+  _positionSequence = 0;
+}
+
+Mixer::~Mixer()
+{
+  FreeWorkers();
+  delete _pendingConfig.exchange( NULL );
+  FreeRetiredConfigs();
+  delete _config;
+  delete[] _silence;
+  delete[] _mixChannels;
+  delete[] _settings;
+  delete[] _publishedFramesRead;
+  delete[] _publishedEndTime;
+  delete[] _publishedPlaying;
+  delete _activeChannels;
+}
+
+/**
+     @brief     Queues a control operation for the audio thread.
+     Safe to call from any thread.  The operation takes effect at the start of the next cycle.
+     @return
+     false if the channel is out of range or the queue is full.
+*/
+bool Mixer::PostCommand( int type, int channel, int value )
+{
+  if( channel < 0 || channel >= (int)_secondaryBuffers->size() )
+  {
+      return false;
+  }
+  MixerCommand command;
+  command._type = type;
+  command._channel = channel;
+  command._value = value;
+  return _commands.Push( command );
+}
+
+/**
+     @brief     Queues the removal of everything written to a channel so far.
+     Data written after this call is kept, so a channel can be emptied and refilled straight
+     away even though the empty happens later on the audio thread.
+*/
+bool Mixer::PostEmpty( int channel )
+{
+  if( channel < 0 || channel >= (int)_secondaryBuffers->size() )
+  {
+      return false;
+  }
+  unsigned int writeCount = (*_secondaryBuffers)[channel]->_bufferData->GetWriteCount();
+  return PostCommand( MIXER_COMMAND_EMPTY, channel, (int)writeCount );
+}
+
+/**
+     @brief     Queues a change to the number of interleaved channels in a channel's frames.
+     Each extra channel needs its own resampling filter, which is opened here on the calling
+     thread.  That would race with the audio thread if it were still resampling the channel,
+     so this fails until the audio thread has applied the channel's stop, which takes up to
+     one block after Stop().
+     Whatever was written before this call is in the old layout, so it is discarded first.
+     Reading it with the new frame stride would play garbage, or split frames across the
+     ring's wrap point.  Data written after this call is kept.
+     @note      The managers call this with the channel's mutex held, after checking that it
+     hasn't been played again, so no play can be applied in between.
+*/
+bool Mixer::PostChannelCount( int channel, int numChannels )
+{
+  if( channel < 0 || channel >= (int)_secondaryBuffers->size() || _publishedPlaying[channel].load( std::memory_order_acquire ) )
+  {
+      return false;
+  }
+  (*_secondaryBuffers)[channel]->_resampler.Reserve( 0, 0, numChannels );
+  if( !PostEmpty( channel ) )
+  {
+      return false;
+  }
+  return PostCommand( MIXER_COMMAND_SET_CHANNELS, channel, numChannels );
+}
+
+/**
+     @brief     Applies every queued command.  Called by the audio thread at the start of each cycle.
+     A configuration posted by Reconfigure() is swapped in here as well, so a block is always
+     mixed with a single block size.  The old configuration is handed back to the control
+     threads to free.
+*/
+void Mixer::ApplyCommands()
+{
+  MixConfig* config = _pendingConfig.exchange( NULL, std::memory_order_acquire );
+  if( config != NULL )
+  {
+      MixConfig* previous = _config;
+      InstallConfig( config );
+      // Push the old configuration onto the retired list.  Only control threads take from it,
+      // and they take the whole list at once, so this loop only repeats if one just did.
+      previous->_next = _retiredConfigs.load( std::memory_order_relaxed );
+      while( !_retiredConfigs.compare_exchange_weak( previous->_next, previous, std::memory_order_release, std::memory_order_relaxed ) )
+      {
+      }
+  }
+
+  MixerCommand command;
+  while( _commands.Pop( &command ) )
+  {
+      ApplyCommand( command );
+  }
+}
+
+void Mixer::ApplyCommand( const MixerCommand& command )
+{
+  int channel = command._channel;
+  SecondaryBuffer* buffer = (*_secondaryBuffers)[channel];
+  switch( command._type )
+  {
+  case MIXER_COMMAND_PLAY:
+      // A channel that is started before it has been filled hasn't run dry yet.
+      _settings[channel]._hadData = false;
+      _activeChannels->Add( channel );
+      _publishedPlaying[channel].store( true, std::memory_order_release );
+      break;
+  case MIXER_COMMAND_STOP:
+      _activeChannels->Remove( channel );
+      _publishedPlaying[channel].store( false, std::memory_order_release );
+      buffer->_peak.store( 0, std::memory_order_relaxed );
+      buffer->_rms.store( 0, std::memory_order_relaxed );
+      break;
+  case MIXER_COMMAND_EMPTY:
+      buffer->_bufferData->Discard( (unsigned int)command._value );
+      break;
+  case MIXER_COMMAND_SET_VOLUME:
+      _settings[channel]._volume = command._value;
+      break;
+  case MIXER_COMMAND_SET_PAN:
+      _settings[channel]._pan = command._value;
+      break;
+  case MIXER_COMMAND_SET_SAMPLE_RATE:
+      _settings[channel]._sampleRate = (unsigned int)command._value;
+      break;
+  case MIXER_COMMAND_SET_CHANNELS:
+      _settings[channel]._channels = command._value;
+      break;
+  default:
+      break;
+  }
+}
+
+int Mixer::GetPlayingCount()
+{
+  return _activeChannels->GetCount();
+}
+
+/**
+     @brief     Sizes the mixer's scratch space for one block at the given latency.
+     Also opens each channel's resampler filters so that MixBlock() never allocates.  Called
+     by the managers from Init(), before the audio thread is mixing.
+     @return
+     true once the scratch space has been allocated.
+*/
+bool Mixer::Allocate( double bufferLatency, unsigned int playbackSampleRate, unsigned int maxSourceSampleRate )
+{
+  _playbackSampleRate = playbackSampleRate;
+  _maxSourceSampleRate = maxSourceSampleRate;
+  _bufferLatency = bufferLatency;
+
+  // The silence is shared by every configuration, so size it for the longest block
+  // Reconfigure() can ask for.  That way it never has to be replaced while playing.
+  int silenceSize = (int)(playbackSampleRate * MAX_BUFFER_LATENCY) * STEREO * BYTES_PER_WORD;
+  if( silenceSize > _silenceSize )
+  {
+      delete[] _silence;
+      _silence = new unsigned char[silenceSize];
+      memset( _silence, 0, silenceSize );
+      _silenceSize = silenceSize;
+  }
+
+  delete _pendingConfig.exchange( NULL );
+  FreeRetiredConfigs();
+  delete _config;
+  InstallConfig( BuildConfig( bufferLatency ) );
+
+  int channel;
+  for( channel = 0; channel < (int)_secondaryBuffers->size(); channel++ )
+  {
+      SecondaryBuffer* buffer = (*_secondaryBuffers)[channel];
+      buffer->_resampler.Reserve( 0, 0, buffer->_channels );
+  }
+  return true;
+}
+
+/**
+     @brief     Changes the block size while the audio thread is running.
+     Everything the new block size needs is allocated here, on the calling thread, and the
+     audio thread swaps it in at the start of its next cycle.  A configuration that was posted
+     earlier but not yet picked up is simply replaced.
+     @return
+     false if Allocate() hasn't been called yet or the latency is out of range.
+*/
+bool Mixer::Reconfigure( double bufferLatency )
+{
+  if( _playbackSampleRate == 0 || bufferLatency <= 0.0 || bufferLatency >= MAX_BUFFER_LATENCY )
+  {
+      return false;
+  }
+  FreeRetiredConfigs();
+  _bufferLatency = bufferLatency;
+  delete _pendingConfig.exchange( BuildConfig( bufferLatency ), std::memory_order_acq_rel );
+  return true;
+}
+
+/**
+ @brief  Allocates the arenas for one block size, including one for each worker.
+*/
+MixConfig* Mixer::BuildConfig( double bufferLatency )
+{
+  int numChannels = (int)_secondaryBuffers->size();
+  MixConfig* config = new MixConfig;
+  config->_bufferLatency = bufferLatency;
+  config->_arena.Allocate( numChannels, bufferLatency, _playbackSampleRate, _maxSourceSampleRate, MAX_SOURCE_CHANNELS );
+  config->_blockFrames = config->_arena._copyBufferSize / (STEREO * BYTES_PER_WORD);
+  unsigned int worker;
+  for( worker = 0; worker < _workers.size(); worker++ )
+  {
+      MixArena* arena = new MixArena;
+      arena->Allocate( numChannels, bufferLatency, _playbackSampleRate, _maxSourceSampleRate, MAX_SOURCE_CHANNELS );
+      config->_workerArenas.push_back( arena );
+  }
+  return config;
+}
+
+/**
+     @brief     Makes a configuration current and points the workers at their arenas.
+     Called by the audio thread between blocks, or by Allocate() when nothing is mixing.  The
+     workers are asleep between blocks, so they see the new arenas when they are next woken.
+*/
+void Mixer::InstallConfig( MixConfig* config )
+{
+  _config = config;
+  unsigned int worker;
+  for( worker = 0; worker < _workers.size() && worker < config->_workerArenas.size(); worker++ )
+  {
+      _workers[worker]->_arena = config->_workerArenas[worker];
+  }
+  _blockFrames.store( config->_blockFrames, std::memory_order_relaxed );
+}
+
+/**
+ @brief  Deletes the configurations the audio thread has finished with.
+*/
+void Mixer::FreeRetiredConfigs()
+{
+  MixConfig* config = _retiredConfigs.exchange( NULL, std::memory_order_acquire );
+  while( config != NULL )
+  {
+      MixConfig* next = config->_next;
+      delete config;
+      config = next;
+  }
+}
+
+/**
+     @brief     Sets up the pool of threads used to mix large channel counts.
+     A block is only split when there are at least minChannelsPerWorker channels for each
+     thread taking part, counting the calling thread, so small loads never pay for waking
+     the pool.  Passing zero workers goes back to mixing everything on the calling thread.
+     The current configuration is rebuilt with an arena for each worker, so unlike
+     Reconfigure() this must not be called while the audio thread is mixing.
+     @return
+     false if a worker thread could not be started.
+*/
+bool Mixer::SetWorkerCount( int numWorkers, int minChannelsPerWorker )
+{
+  FreeWorkers();
+  if( minChannelsPerWorker < 1 )
+  {
+      minChannelsPerWorker = 1;
+  }
+  _minChannelsPerWorker = minChannelsPerWorker;
+
+  int count;
+  for( count = 0; count < numWorkers; count++ )
+  {
+      MixWorker* worker = new MixWorker( this );
+      if( worker->Create() != wxTHREAD_NO_ERROR )
+      {
+          delete worker;
+          return false;
+      }
+      worker->_realtime.SetConfig( _workerRealtime );
+      worker->Run();
+      _workers.push_back( worker );
+  }
+  if( _playbackSampleRate != 0 )
+  {
+      Allocate( _bufferLatency, _playbackSampleRate, _maxSourceSampleRate );
+  }
+  return true;
+}
+
+int Mixer::GetWorkerCount()
+{
+  return (int)_workers.size();
+}
+
+/**
+     @brief     Gives the worker threads the same scheduling as the audio thread.
+     The audio thread waits on the workers every block, so they need its policy and priority
+     or they could be starved by it.  They are left free to run on any CPU so that pinning the
+     audio thread doesn't pile them all onto one core, and memory locking is process-wide, so
+     it is left to the audio thread.
+*/
+void Mixer::SetRealtimeConfig( const RealtimeConfig& config )
+{
+  _workerRealtime = config;
+  _workerRealtime._cpu = -1;
+  _workerRealtime._lockMemory = false;
+  unsigned int worker;
+  for( worker = 0; worker < _workers.size(); worker++ )
+  {
+      _workers[worker]->_realtime.SetConfig( _workerRealtime );
+  }
+}
+
+/**
+ @brief  Stops and deletes every worker thread.
+*/
+void Mixer::FreeWorkers()
+{
+  unsigned int worker;
+  for( worker = 0; worker < _workers.size(); worker++ )
+  {
+      _workers[worker]->Shutdown();
+      delete _workers[worker];
+  }
+  _workers.clear();
+}
+
+/**
+ @brief  Returns the peak level of the last block sent to the device, in sample units.
+ Safe to call from any thread.
+*/
+int Mixer::GetMasterPeak()
+{
+  return _masterPeak.load( std::memory_order_relaxed );
+}
+
+/**
+ @brief  Returns the RMS level of the last block sent to the device, in sample units.
+ Safe to call from any thread.
+*/
+int Mixer::GetMasterRms()
+{
+  return _masterRms.load( std::memory_order_relaxed );
+}
+
+/**
+ @brief  Returns the mixer's running totals.  Safe to call from any thread.
+*/
+MixStats Mixer::GetStats()
+{
+  MixStats stats;
+  stats._blocks = _totalBlocks.load( std::memory_order_relaxed );
+  stats._frames = _totalFrames.load( std::memory_order_relaxed );
+  stats._mixNanoseconds = _totalMixNanoseconds.load( std::memory_order_relaxed );
+  stats._starvedReads = _starvedReads.load( std::memory_order_relaxed );
+  return stats;
+}
+
+/**
+     @brief     Records how far behind the speaker is, right after a block reaches the device.
+     deviceDelayFrames is the number of frames, at the playback rate, that the device has
+     been given but not yet played, including the block just written.  Each channel in that
+     block gets its frame count published along with the time its last frame will be heard,
+     so channels that stop keep an accurate position while the others carry on.
+     @note      Audio thread only.  Call once per device write, after the last MixBlock().
+*/
+void Mixer::PublishPosition( int deviceDelayFrames )
+{
+  if( _playbackSampleRate == 0 )
+  {
+      return;
+  }
+  long long now = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+  long long endTime = now + (long long)deviceDelayFrames * 1000000000 / _playbackSampleRate;
+  unsigned int sequence = _positionSequence.load( std::memory_order_relaxed );
+  _positionSequence.store( sequence + 1, std::memory_order_relaxed );
+  std::atomic_thread_fence( std::memory_order_release );
+  int index;
+  for( index = 0; index < _numActive; index++ )
+  {
+      int channel = _mixChannels[index];
+      // A channel that has run dry keeps the time its last frame was due, so it doesn't
+      // look as if it were still being played.
+      if( _publishedFramesRead[channel].load( std::memory_order_relaxed ) != _settings[channel]._framesRead )
+      {
+          _publishedFramesRead[channel].store( _settings[channel]._framesRead, std::memory_order_relaxed );
+          _publishedEndTime[channel].store( endTime, std::memory_order_relaxed );
+      }
+  }
+  _positionSequence.store( sequence + 2, std::memory_order_release );
+}
+
+/**
+     @brief     Works out a channel's playback position from what the audio thread last published.
+     The device delay is counted down by the time that has passed since it was measured, so
+     the position keeps moving between audio callbacks.
+     @param     bufferedFrames  Frames waiting in the channel's secondary buffer.
+     @param     sampleRate      The channel's sample rate.
+     @note      Safe to call from any thread.
+*/
+PlaybackPosition Mixer::GetPosition( int channel, int bufferedFrames, unsigned int sampleRate )
+{
+  PlaybackPosition position;
+  long long framesRead;
+  long long endTime;
+  unsigned int sequence;
+  do
+  {
+      sequence = _positionSequence.load( std::memory_order_acquire );
+      framesRead = _publishedFramesRead[channel].load( std::memory_order_relaxed );
+      endTime = _publishedEndTime[channel].load( std::memory_order_relaxed );
+      std::atomic_thread_fence( std::memory_order_acquire );
+  } while( ( sequence & 1 ) != 0 || sequence != _positionSequence.load( std::memory_order_relaxed ) );
+
+  long long now = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+  // Time left before the channel's last mixed frame is heard.
+  double remaining = endTime > now ? (double)( endTime - now ) / 1000000000.0 : 0.0;
+
+  position._bufferedFrames = bufferedFrames;
+  position._deviceFrames = (int)( remaining * _playbackSampleRate );
+  position._framesPlayed = framesRead - (long long)( remaining * sampleRate );
+  position._framesPlayed = position._framesPlayed < 0 ? 0 : position._framesPlayed;
+  position._framesQueued = bufferedFrames + ( framesRead - position._framesPlayed );
+  position._delay = remaining + ( sampleRate > 0 ? (double)bufferedFrames / sampleRate : 0.0 );
+  position._time = (double)now / 1000000000.0;
+  return position;
+}
+
+/**
+     @brief     Returns the longest time spent mixing one block since the last call.
+     The time is given as a fraction of the block's own duration, so anything near 1.0 means
+     the mixer is close to not keeping up.  Starts the next interval from zero.
+*/
+double Mixer::TakePeakMixLoad()
+{
+  return (double)_peakMixLoad.exchange( 0, std::memory_order_relaxed ) / 1000.0;
+}
+
+int Mixer::GetBlockFrames()
+{
+  return _blockFrames.load( std::memory_order_relaxed );
+}
+
+/**
+ @brief  Returns the latency of the configuration the audio thread is using, in seconds.
+ Only meaningful on the audio thread.
+*/
+double Mixer::GetBufferLatency()
+{
+  return _config != NULL ? _config->_bufferLatency : 0.0;
+}
+
+short* Mixer::GetBlockBuffer()
+{
+  return _config != NULL ? (short *)_config->_arena._copyBuffer : NULL;
+}
+
+unsigned char* Mixer::GetSilence()
+{
+  return _silence;
+}
+
+int Mixer::GetSilenceSize()
+{
+  return _silenceSize;
+}
+
+/**
+     @brief     Mixes every playing channel into a block of interleaved stereo frames.
+     The whole block is always written; frames that no channel had data for are silent.
+     Requests longer than GetBlockFrames() are cut down to one block.
+     @return
+     The number of frames that held real data from at least one channel, which may be less
+     than numFrames if the secondary buffers ran short.
+*/
+int Mixer::MixBlock( short* output, int numFrames, int masterVolume )
+{
+  if( output == NULL || numFrames <= 0 || _config == NULL )
+  {
+      return 0;
+  }
+  if( numFrames > _config->_blockFrames )
+  {
+      numFrames = _config->_blockFrames;
+  }
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  int numSamples = numFrames * STEREO;
+  float* bus = _config->_arena._mixBus;
+  memset( bus, 0, numSamples * sizeof(float) );
+
+  // Only channels in the active list get mixed, so take one copy of it for this block.
+  int numActive = _activeChannels->Snapshot( _mixChannels );
+  CalculateChannelVolume( numActive, masterVolume );
+  _numActive = numActive;
+  _nextChannel = 0;
+
+  int framesMixed;
+  if( _workers.size() > 0 && numActive >= _minChannelsPerWorker * 2 )
+  {
+      framesMixed = MixParallel( numActive, numFrames );
+  }
+  else
+  {
+      framesMixed = MixChannels( &_config->_arena, numFrames );
+  }
+
+  // Summing in floating point means several loud channels clip once here instead of
+  // wrapping around in 16 bits.  The master meter is measured on the clipped output.
+  float peak = 0.0f;
+  float sumSquares = 0.0f;
+  int count;
+  for( count = 0; count < numSamples; count++ )
+  {
+      float sample = bus[count];
+      sample = sample > 32767.0f ? 32767.0f : sample;
+      sample = sample < -32768.0f ? -32768.0f : sample;
+      output[count] = (short)sample;
+      float magnitude = fabsf( sample );
+      peak = magnitude > peak ? magnitude : peak;
+      sumSquares += sample * sample;
+  }
+  _masterPeak.store( (int)peak, std::memory_order_relaxed );
+  _masterRms.store( (int)sqrtf( sumSquares / (float)numSamples ), std::memory_order_relaxed );
+
+  // Only this thread writes the totals, so plain loads and stores are enough.
+  long long nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+  _totalBlocks.store( _totalBlocks.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+  _totalFrames.store( _totalFrames.load( std::memory_order_relaxed ) + numFrames, std::memory_order_relaxed );
+  _totalMixNanoseconds.store( _totalMixNanoseconds.load( std::memory_order_relaxed ) + nanoseconds, std::memory_order_relaxed );
+  int load = (int)( nanoseconds * _playbackSampleRate / ( (long long)numFrames * 1000000 ) );
+  if( load > _peakMixLoad.load( std::memory_order_relaxed ) )
+  {
+      _peakMixLoad.store( load, std::memory_order_relaxed );
+  }
+
+  return framesMixed;
+}
+
+/**
+     @brief     Splits the block's channels between the calling thread and the workers.
+     The calling thread mixes into the main bus alongside the workers, waits for them to
+     finish, and then adds their partial buses into its own.
+     @return
+     The largest number of frames any channel contributed.
+*/
+int Mixer::MixParallel( int numActive, int numFrames )
+{
+  // Only wake as many workers as can be kept busy.  The calling thread takes a share as well.
+  int numWorkers = numActive / _minChannelsPerWorker - 1;
+  if( numWorkers > (int)_workers.size() )
+  {
+      numWorkers = (int)_workers.size();
+  }
+
+  _pendingWorkers = numWorkers;
+  int worker;
+  for( worker = 0; worker < numWorkers; worker++ )
+  {
+      _workers[worker]->Start( numFrames );
+  }
+
+  int framesMixed = MixChannels( &_config->_arena, numFrames );
+
+  // The workers only ever have a block's worth of channels left by now, so this wait is short.
+  while( _pendingWorkers.load( std::memory_order_acquire ) > 0 )
+  {
+      wxThread::Yield();
+  }
+
+  int numSamples = numFrames * STEREO;
+  float* bus = _config->_arena._mixBus;
+  for( worker = 0; worker < numWorkers; worker++ )
+  {
+      float* partialBus = _workers[worker]->_arena->_mixBus;
+      int count;
+      for( count = 0; count < numSamples; count++ )
+      {
+          bus[count] += partialBus[count];
+      }
+      if( _workers[worker]->_framesMixed > framesMixed )
+      {
+          framesMixed = _workers[worker]->_framesMixed;
+      }
+  }
+
+  return framesMixed;
+}
+
+int Mixer::MixChannels( MixArena* arena, int numFrames )
+{
+  int framesMixed = 0;
+  int index;
+  while( (index = _nextChannel.fetch_add( 1 )) < _numActive )
+  {
+      int frames = MixChannel( arena, _mixChannels[index], numFrames );
+      if( frames > framesMixed )
+      {
+          framesMixed = frames;
+      }
+  }
+  return framesMixed;
+}
+
+void Mixer::WorkerDone()
+{
+  _pendingWorkers.fetch_sub( 1, std::memory_order_release );
+}
+
+/**
+     @brief     Reads, resamples, and sums a single channel into an arena's mix bus.
+     Mono sources are panned, stereo sources use pan as a balance control, and wider
+     sources are folded down with even channels on the left and odd channels on the right.
+     The volume tables always come from the Mixer's own arena.
+     @return
+     The number of frames the channel contributed.
+*/
+int Mixer::MixChannel( MixArena* arena, int channel, int numFrames )
+{
+  SecondaryBuffer* buffer = (*_secondaryBuffers)[channel];
+  MixChannelSettings* settings = &_settings[channel];
+  unsigned char* channelData = arena->_channelData;
+
+  unsigned int sampleRate = settings->_sampleRate;
+  int numChannels = settings->_channels;
+  int frameSize = settings->_bytesPerSample * numChannels;
+  // The number of source frames that will cover numFrames at the playback rate.
+  int bytesRequested = (int)((double)numFrames * sampleRate / _playbackSampleRate) * frameSize;
+  // Never read more than the arena can hold, even if the source rate is unusually high.  Reads
+  // are always whole frames so that interleaved channels stay in step.
+  if( bytesRequested > arena->_channelDataSize )
+  {
+      bytesRequested = arena->_channelDataSize - (arena->_channelDataSize % frameSize);
+  }
+  // The mixer is the ring's only reader, so this needs no lock even while the channel is being filled.
+  int bytesRead = (buffer->_bufferData)->Read( channelData, bytesRequested );
+  // Count each time a channel that had been keeping up comes back short, rather than every
+  // empty block, so one stall doesn't look like many.
+  if( bytesRead < bytesRequested && settings->_hadData )
+  {
+      _starvedReads.fetch_add( 1, std::memory_order_relaxed );
+  }
+  settings->_hadData = bytesRead == bytesRequested;
+
+  int sourceFrames = bytesRead / frameSize;
+  settings->_framesRead += sourceFrames;
+  if( sourceFrames <= 0 )
+  {
+      buffer->_peak.store( 0, std::memory_order_relaxed );
+      buffer->_rms.store( 0, std::memory_order_relaxed );
+      return 0;
+  }
+
+  short* samples = (short *)channelData;
+  int mixFrames = sourceFrames;
+  // Channels that already match the playback rate are mixed straight from the read buffer.
+  if( sampleRate != _playbackSampleRate )
+  {
+      int targetFrames = (int)((double)numFrames * bytesRead / bytesRequested);
+      if( targetFrames > arena->_resampleDataSize / numChannels )
+      {
+          targetFrames = arena->_resampleDataSize / numChannels;
+      }
+      mixFrames = buffer->_resampler.ResampleInto( samples, sourceFrames, arena->_resampleData, targetFrames, numChannels,
+                                                   arena->_resampleFrom, arena->_resampleTo );
+      samples = arena->_resampleData;
+  }
+  if( mixFrames > numFrames )
+  {
+      mixFrames = numFrames;
+  }
+
+  float leftVolume = (float)_config->_arena._leftVolume[channel];
+  float rightVolume = (float)_config->_arena._rightVolume[channel];
+  float* bus = arena->_mixBus;
+  // Meter levels are gathered in the same pass as the mix.  The loops avoid branches so the
+  // compiler can vectorize them.
+  int peak = 0;
+  float sumSquares = 0.0f;
+  int count;
+  if( numChannels == MONO )
+  {
+      for( count = 0; count < mixFrames; count++ )
+      {
+          int value = samples[count];
+          float sample = (float)value;
+          bus[count * 2] += sample * leftVolume;
+          bus[count * 2 + 1] += sample * rightVolume;
+          int magnitude = value < 0 ? -value : value;
+          peak = magnitude > peak ? magnitude : peak;
+          sumSquares += sample * sample;
+      }
+  }
+  else if( numChannels == STEREO )
+  {
+      for( count = 0; count < mixFrames; count++ )
+      {
+          int leftValue = samples[count * 2];
+          int rightValue = samples[count * 2 + 1];
+          float left = (float)leftValue;
+          float right = (float)rightValue;
+          bus[count * 2] += left * leftVolume;
+          bus[count * 2 + 1] += right * rightVolume;
+          int leftMagnitude = leftValue < 0 ? -leftValue : leftValue;
+          int rightMagnitude = rightValue < 0 ? -rightValue : rightValue;
+          peak = leftMagnitude > peak ? leftMagnitude : peak;
+          peak = rightMagnitude > peak ? rightMagnitude : peak;
+          sumSquares += left * left + right * right;
+      }
+  }
+  else
+  {
+      // Fold down.  A trailing odd channel (usually a center) goes to both sides, and each side
+      // is scaled by the number of channels feeding it so full-scale input stays in range.
+      float leftGain[MAX_SOURCE_CHANNELS];
+      float rightGain[MAX_SOURCE_CHANNELS];
+      float scale = 1.0f / (float)((numChannels + 1) / 2);
+      int sourceChannel;
+      for( sourceChannel = 0; sourceChannel < numChannels; sourceChannel++ )
+      {
+          bool isLeft = (sourceChannel % 2) == 0;
+          bool isCenter = (sourceChannel == numChannels - 1) && isLeft;
+          leftGain[sourceChannel] = (isLeft ? leftVolume * scale : 0.0f);
+          rightGain[sourceChannel] = ((!isLeft || isCenter) ? rightVolume * scale : 0.0f);
+      }
+      for( count = 0; count < mixFrames; count++ )
+      {
+          short* frame = &samples[count * numChannels];
+          float left = 0.0f;
+          float right = 0.0f;
+          for( sourceChannel = 0; sourceChannel < numChannels; sourceChannel++ )
+          {
+              int value = frame[sourceChannel];
+              float sample = (float)value;
+              left += sample * leftGain[sourceChannel];
+              right += sample * rightGain[sourceChannel];
+              int magnitude = value < 0 ? -value : value;
+              peak = magnitude > peak ? magnitude : peak;
+              sumSquares += sample * sample;
+          }
+          bus[count * 2] += left;
+          bus[count * 2 + 1] += right;
+      }
+  }
+
+  // Publish the meter levels.  Readers only need a recent value, not one that is in step with
+  // anything else, so relaxed stores are enough.
+  buffer->_peak.store( peak, std::memory_order_relaxed );
+  buffer->_rms.store( (int)sqrtf( sumSquares / (float)(mixFrames * numChannels) ), std::memory_order_relaxed );
+
+  return mixFrames;
+}
+
+/**
+     @brief     Calculates the left and right multipliers for each playing channel.
+     Combines the channel's volume and pan with the master volume.  Volumes range from
+     -9600 to 0 and pan from -1000 (left) to 1000 (right).
+*/
+void Mixer::CalculateChannelVolume( int numActive, int masterVolume )
+{
+  double* leftVolumeAdjustment = _config->_arena._leftVolume;
+  double* rightVolumeAdjustment = _config->_arena._rightVolume;
+  double master = (masterVolume + 9600.0) / 9600.0;
+  int index;
+  for( index = 0; index < numActive; index++ )
+  {
+      int channel = _mixChannels[index];
+      MixChannelSettings* settings = &_settings[channel];
+      // We are using pan to attenuate the channel that we're panning away from, but we are not increasing
+      // the volume on the channel we've panned toward.  Doing so would put us in danger of digital clipping
+      // unless we limit the volume adjustment values to 1.0.
+      double volume = ((settings->_volume + 9600.0) / 9600.0) * master;
+      if( settings->_pan < 0 )
+      {
+          leftVolumeAdjustment[channel] = volume;
+          rightVolumeAdjustment[channel] = ((settings->_pan + 1000.0) / 1000.0) * volume;
+      }
+      else
+      {
+          leftVolumeAdjustment[channel] = ((settings->_pan * -1.0 + 1000.0) / 1000.0) * volume;
+          rightVolumeAdjustment[channel] = volume;
+      }
+  }
+}
@@ -0,0 +1,211 @@
+#ifndef _MIXER_H_
+#define _MIXER_H_
+
+#include <vector>
+#include <atomic>
+#include "SecondaryBuffer.h"
+#include "ActiveChannelList.h"
+#include "MixArena.h"
+#include "RealtimeThread.h"
+#include "CommandQueue.h"
+
+class MixWorker;
+
+/**
+     @brief     The audio thread's own copy of a channel's settings.
+     Only changed by commands, so the mix loop can read it without taking the channel's mutex.
+*/
+class MixChannelSettings
+{
+public:
+	int _volume;
+	int _pan;
+	unsigned int _sampleRate;
+	int _channels;
+	int _bytesPerSample;
+	/// The channel's last read came back full, so a short read now means it ran dry.
+	bool _hadData;
+	/// Source frames taken from the channel's ring since it was created.
+	long long _framesRead;
+};
+
+/**
+     @brief     Where a channel's playback has got to, as of _time.
+     Frame counts are at the channel's own sample rate unless noted.  The device figures come
+     from what the audio thread last measured, brought forward to _time.
+*/
+class PlaybackPosition
+{
+public:
+	PlaybackPosition() : _framesPlayed(0), _framesQueued(0), _bufferedFrames(0), _deviceFrames(0), _delay(0.0), _time(0.0) {};
+	/// Frames of the channel's data that have reached the speaker since the channel was created.
+	/// Data thrown away by EmptyBuffer() or Stop() is never counted.
+	long long _framesPlayed;
+	/// Frames written with FillBuffer() that have not been heard yet.
+	long long _framesQueued;
+	/// The part of _framesQueued still waiting in the secondary buffer.
+	int _bufferedFrames;
+	/// Frames at the playback rate between the mixer and the speaker.
+	int _deviceFrames;
+	/// Seconds until a frame written now would be heard.
+	double _delay;
+	/// Seconds on std::chrono::steady_clock when this position was true.
+	double _time;
+};
+
+/**
+     @brief     Running totals kept by the mixer for anyone watching how well it keeps up.
+     The counters only ever go up.  Take the difference between two snapshots to get the
+     activity over an interval.
+*/
+class MixStats
+{
+public:
+	MixStats() : _blocks(0), _frames(0), _mixNanoseconds(0), _starvedReads(0) {};
+	long long _blocks;
+	long long _frames;
+	/// Time spent inside MixBlock().
+	long long _mixNanoseconds;
+	/// Times a playing channel ran out of data part way through a block after having kept up.
+	long long _starvedReads;
+};
+
+/**
+     @brief     Everything the mixer needs for one block size.
+     Built on a control thread by Mixer::Reconfigure() and swapped in by the audio thread
+     between blocks, so the block size can change while the device is playing.
+*/
+class MixConfig
+{
+public:
+	MixConfig();
+	~MixConfig();
+	double _bufferLatency;
+	/// Number of stereo frames in one block.
+	int _blockFrames;
+	MixArena _arena;
+	/// One arena for each MixWorker, in the same order as the workers.
+	std::vector<MixArena *> _workerArenas;
+	/// Link in the mixer's list of configurations waiting to be freed.
+	MixConfig* _next;
+};
+
+/**
+     @brief     Mixes the playing secondary buffers into blocks of interleaved 16-bit stereo.
+     This is the mixing engine shared by ALSAManager, OpenALManager, and RtAudioManager.  Each
+     call to MixBlock() reads one block's worth of data from every channel in the active list,
+     resamples it to the playback rate, applies volume and pan, and sums it into a floating
+     point bus that is clipped into the caller's buffer.  The managers are left with moving
+     that block to their device.
+     With SetWorkerCount(), large channel counts are split across a pool of MixWorker threads
+     that each sum their share into a partial bus.  Small loads stay on the calling thread.
+     Control operations (play, stop, empty, volume, pan, sample rate, and channel count) reach
+     the mixer as commands posted from any thread with PostCommand().  The audio thread applies
+     them with ApplyCommands() at the start of each cycle, so mixing never takes a lock that a
+     control thread might be holding.  Sample data still arrives through each channel's
+     RingBuffer, which the mixer reads without locking as its only reader.
+     The block size can be changed while playing with Reconfigure(), which builds a new
+     MixConfig for the audio thread to swap in at the start of its next cycle.
+     @note      MixBlock() and ApplyCommands() must only be called from the audio thread.
+     Allocate() and SetWorkerCount() replace the scratch space in place, so they must not be
+     called while a mix is in progress.
+*/
+class Mixer
+{
+public:
+	Mixer( std::vector<SecondaryBuffer *>* secondaryBuffers );
+	~Mixer();
+	bool PostCommand( int type, int channel, int value = 0 );
+	bool PostEmpty( int channel );
+	bool PostChannelCount( int channel, int numChannels );
+	void ApplyCommands();
+	/// Number of channels the audio thread is mixing.  Only meaningful on the audio thread.
+	int GetPlayingCount();
+	bool Allocate( double bufferLatency, unsigned int playbackSampleRate, unsigned int maxSourceSampleRate );
+	bool Reconfigure( double bufferLatency );
+	int MixBlock( short* output, int numFrames, int masterVolume );
+	bool SetWorkerCount( int numWorkers, int minChannelsPerWorker );
+	int GetWorkerCount();
+	void SetRealtimeConfig( const RealtimeConfig& config );
+	int GetMasterPeak();
+	int GetMasterRms();
+	MixStats GetStats();
+	double TakePeakMixLoad();
+	void PublishPosition( int deviceDelayFrames );
+	PlaybackPosition GetPosition( int channel, int bufferedFrames, unsigned int sampleRate );
+	/// Mixes channels from the current block's list into the given arena until none are left.
+	int MixChannels( MixArena* arena, int numFrames );
+	/// Called by a MixWorker when it has finished its share of a block.
+	void WorkerDone();
+	/// Number of stereo frames in one block at the current latency.  Safe from any thread.
+	int GetBlockFrames();
+	double GetBufferLatency();
+	/// Staging buffer for managers that need somewhere to put a block before handing it to the device.
+	short* GetBlockBuffer();
+	unsigned char* GetSilence();
+	int GetSilenceSize();
+private:
+	void ApplyCommand( const MixerCommand& command );
+	void CalculateChannelVolume( int numActive, int masterVolume );
+	int MixChannel( MixArena* arena, int channel, int numFrames );
+	int MixParallel( int numActive, int numFrames );
+	void FreeWorkers();
+	MixConfig* BuildConfig( double bufferLatency );
+	void InstallConfig( MixConfig* config );
+	void FreeRetiredConfigs();
+	std::vector<SecondaryBuffer *>* _secondaryBuffers;
+	/// Channels being mixed, as of the last ApplyCommands().  Only used on the audio thread, so
+	/// its mutex is never contended.
+	ActiveChannelList* _activeChannels;
+	MixChannelSettings* _settings;
+	CommandQueue _commands;
+	/// Per-block copy of the active channel list.
+	int* _mixChannels;
+	/// The configuration the audio thread is mixing with.
+	MixConfig* _config;
+	/// Posted by Reconfigure() and taken by ApplyCommands().
+	std::atomic<MixConfig *> _pendingConfig;
+	/// Configurations the audio thread has finished with, freed by the control threads.
+	std::atomic<MixConfig *> _retiredConfigs;
+	unsigned int _playbackSampleRate;
+	unsigned int _maxSourceSampleRate;
+	/// The most recently requested latency.  The audio thread may still be using the previous one.
+	double _bufferLatency;
+	/// The current configuration's block size, published for other threads.
+	std::atomic<int> _blockFrames;
+	/// Zeroes, long enough for the largest block.  Shared by every configuration.
+	unsigned char* _silence;
+	int _silenceSize;
+	std::vector<MixWorker *> _workers;
+	/// Scheduling given to workers, including ones started later.
+	RealtimeConfig _workerRealtime;
+	/// Don't wake another worker unless it will get at least this many channels.
+	int _minChannelsPerWorker;
+	/// Number of channels in the current block's list.
+	int _numActive;
+	/// Next entry in _mixChannels to be handed out.
+	std::atomic<int> _nextChannel;
+	/// Workers that have not yet finished the current block.
+	std::atomic<int> _pendingWorkers;
+	/// Meter levels of the last block, published for the UI.
+	std::atomic<int> _masterPeak;
+	std::atomic<int> _masterRms;
+	/// Totals for GetStats().
+	std::atomic<long long> _totalBlocks;
+	std::atomic<long long> _totalFrames;
+	std::atomic<long long> _totalMixNanoseconds;
+	std::atomic<long long> _starvedReads;
+	/// Worst block since the last TakePeakMixLoad(), as thousandths of the block's duration.
+	std::atomic<int> _peakMixLoad;
+	/// Published by PublishPosition() for GetPosition().  The sequence is odd while the audio
+	/// thread is part way through an update, and readers retry until they see a whole one.
+	std::atomic<unsigned int> _positionSequence;
+	std::atomic<long long>* _publishedFramesRead;
+	/// When each channel's last published frame will have been played, in steady_clock nanoseconds.
+	std::atomic<long long>* _publishedEndTime;
+	/// Whether each channel is in the audio thread's list, as of the last ApplyCommands().
+	/// Once this is false the channel's resampler is free until the next play is applied.
+	std::atomic<bool>* _publishedPlaying;
+};
+
+#endif
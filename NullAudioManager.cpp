@@ -0,0 +1,961 @@
+
+#include <iostream>
+using namespace std;
+
+#include "NullAudioManager.h"
+
+/// Define the size of our secondary buffer in bytes.
+#define SECONDARY_BUFFER_SIZE 32768
+/// Used for resampling calculations and buffer info.
+#define MAX_SAMPLE_RATE 44100
+/// How long the thread sleeps between checks when it has nothing to render, in milliseconds.
+#define IDLE_SLEEP 10
+
+/**
+     @brief     Constructor, sets initial values for internal data.
+     Constructor, sets initial values for internal data.
+     @return
+     void
+*/
+NullAudioManager::NullAudioManager(int numBuffers)
+{
+  _numBuffers = numBuffers;
+  _playbackSampleRate = MAX_SAMPLE_RATE;
+  _captureSampleRate = MAX_SAMPLE_RATE;
+  _output = NULLAUDIO_OUTPUT_NONE;
+  _pacing = NULLAUDIO_PACING_REALTIME;
+  _memoryOutput = NULL;
+  _memorySeconds = NULLAUDIO_MEMORY_SECONDS;
+  _memoryFramesDropped = 0;
+  _framesRendered = 0;
+  _mixNanoseconds = 0;
+  int count;
+  // Create volume and pan values.
+  for( count = 0; count < _numBuffers; count++ )
+    {
+      _secondaryBuffers.push_back( new SecondaryBuffer );
+      _secondaryBuffers[count]->_volume = 0;
+      _secondaryBuffers[count]->_pan = 0;
+      _secondaryBuffers[count]->_bytesPerSample = BYTES_PER_WORD;
+      _secondaryBuffers[count]->_channels = MONO;
+      _secondaryBuffers[count]->_mutex = new wxMutex;
+      _secondaryBuffers[count]->_bufferData = new RingBuffer( SECONDARY_BUFFER_SIZE );
+      _secondaryBuffers[count]->_sampleRate = MAX_SAMPLE_RATE;
+      _secondaryBuffers[count]->UpdateChunkSize( _bufferLatency );
+    }
+  // Tracks which channels are playing for IsBufferPlaying().  The mixer keeps its own list,
+  // updated through commands, so the audio thread never touches this one.
+  _activeChannels = new ActiveChannelList( _numBuffers );
+  _mixer = new Mixer( &_secondaryBuffers );
+	if( wxThread::Create(wxTHREAD_JOINABLE) != wxTHREAD_NO_ERROR )
+	{
+		wxMessageBox( _("Unable to create null audio thread"), _("ERROR"), wxOK );
+		return;
+	}
+	Run();
+}
+
+/**
+     @brief     Destructor, cleans up allocations and uninitializes audio.
+     Destructor, cleans up allocations and uninitializes audio.
+     @return
+     void
+*/
+NullAudioManager::~NullAudioManager()
+{
+    // The thread uses the mixer, so it has to be stopped before anything is deleted.
+    Delete();
+    if( _inited )
+    {
+        UnInit();
+    }
+    int count;
+    for( count = _numBuffers - 1; count > -1; --count )
+    {
+      delete _secondaryBuffers[count]->_bufferData;
+      delete _secondaryBuffers[count]->_mutex;
+      delete _secondaryBuffers[count];
+    }
+    delete _mixer;
+    delete _activeChannels;
+    delete _memoryOutput;
+}
+
+/**
+     @brief     Chooses where the mixed output goes.
+     filename is only used with NULLAUDIO_OUTPUT_WAV.
+     @return
+     false if the manager is already initialized or the arguments don't make sense.
+*/
+bool NullAudioManager::SetOutput( int output, const char* filename )
+{
+  if( _inited || output < NULLAUDIO_OUTPUT_NONE || output > NULLAUDIO_OUTPUT_WAV )
+  {
+      return false;
+  }
+  if( output == NULLAUDIO_OUTPUT_WAV && filename == NULL )
+  {
+      return false;
+  }
+  _output = output;
+  _filename = ( filename != NULL ) ? filename : "";
+  return true;
+}
+
+/**
+     @brief     Chooses whether the thread renders in real time, flat out, or not at all.
+     @return
+     false if the manager is already initialized or the pacing is unknown.
+*/
+bool NullAudioManager::SetPacing( int pacing )
+{
+  if( _inited || pacing < NULLAUDIO_PACING_REALTIME || pacing > NULLAUDIO_PACING_MANUAL )
+  {
+      return false;
+  }
+  _pacing = pacing;
+  return true;
+}
+
+/**
+     @brief     Sets how much rendered output the memory buffer holds, in seconds.
+     The buffer is allocated by Init() so rendering never has to grow it.  Anything rendered
+     while it is full is dropped and counted by GetMemoryFramesDropped(), so call
+     TakeRenderedData() at least this often.
+     @return
+     false if the manager is already initialized or the length isn't positive.
+*/
+bool NullAudioManager::SetMemoryLength( int seconds )
+{
+  if( _inited || seconds <= 0 )
+  {
+      return false;
+  }
+  _memorySeconds = seconds;
+  return true;
+}
+
+/**
+     @brief     Initializes the NullAudioManager.
+     Sizes the mixer and opens the output file if there is one.  Once this returns, the
+     thread starts rendering unless the pacing is NULLAUDIO_PACING_MANUAL.
+     @return
+     returns false if the output file could not be created.
+     @note
+     The arguments are ignored.  They are only included for interface compatibility with
+     the other managers.
+*/
+bool NullAudioManager::Init(void *parentWindow, int* soundCard, const char *name)
+{
+    // No multiple initialization.
+    if( _inited == true )
+    {
+        return( true );
+    }
+
+    // Size our mixing scratch space now so rendering never has to allocate.
+    AllocateMixArena();
+
+    if( _output == NULLAUDIO_OUTPUT_MEMORY )
+    {
+        int size = _memorySeconds * _playbackSampleRate * STEREO * BYTES_PER_WORD;
+        if( _memoryOutput == NULL || _memoryOutput->GetSize() != size )
+        {
+            delete _memoryOutput;
+            _memoryOutput = new RingBuffer( size );
+        }
+        else
+        {
+            _memoryOutput->Empty();
+        }
+        _memoryFramesDropped = 0;
+    }
+
+    if( _output == NULLAUDIO_OUTPUT_WAV && !_wavWriter.Open( _filename.c_str(), _playbackSampleRate, STEREO, BITS_PER_WORD ) )
+    {
+        cout << "NullAudioManager::Init: cannot create " << _filename << endl;
+        return false;
+    }
+
+    _framesRendered = 0;
+    _mixNanoseconds = 0;
+    _clockStart = std::chrono::steady_clock::now();
+    _inited = true;
+
+    return( _inited );
+}
+
+/**
+     @brief     Uninitializes the NullAudioManager.
+     Stops rendering and finishes the WAV file, if one is being written.
+     @return
+     false if the WAV file could not be finished.
+*/
+bool NullAudioManager::UnInit()
+{
+  _inited = false;
+  // Let a block that is already being rendered finish before the file is closed.
+  _memoryMutex.Lock();
+  bool result = _wavWriter.Close();
+  _memoryMutex.Unlock();
+  return result;
+}
+
+/**
+     @brief     Renders blocks on the calling thread.
+     This is how the clock moves with NULLAUDIO_PACING_MANUAL, so offline renders and tests
+     can step the mixer exactly as far as they need.
+     @return
+     The number of blocks rendered, which is zero if the manager isn't initialized or the
+     thread is doing the rendering.
+*/
+int NullAudioManager::RenderBlocks( int numBlocks )
+{
+  if( !_inited || _pacing != NULLAUDIO_PACING_MANUAL )
+  {
+      return 0;
+  }
+  int count;
+  for( count = 0; count < numBlocks; count++ )
+  {
+      RenderBlock();
+  }
+  return numBlocks;
+}
+
+/**
+     @brief     Mixes one block and sends it to the output.
+     Control commands posted since the last block are applied first, which may also change the
+     block size.  The block is mixed into the mixer's staging buffer, timed for GetMixTime(), and then
+     written to the WAV file or copied into the memory output.  A block that doesn't fit in the
+     memory output is counted and dropped, rather than making room on the audio thread.
+*/
+void NullAudioManager::RenderBlock()
+{
+  _mixer->ApplyCommands();
+
+  short* block = _mixer->GetBlockBuffer();
+  int numFrames = _mixer->GetBlockFrames();
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  _mixer->MixBlock( block, numFrames, _masterVolume );
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  _mixNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>( end - start ).count();
+  // When paced to real time the block plays out over the next block period.  Otherwise it
+  // is heard the moment it is rendered.
+  _mixer->PublishPosition( _pacing == NULLAUDIO_PACING_REALTIME ? numFrames : 0 );
+
+  int numBytes = numFrames * STEREO * BYTES_PER_WORD;
+  if( _output == NULLAUDIO_OUTPUT_WAV )
+  {
+      _memoryMutex.Lock();
+      _wavWriter.Write( (unsigned char *)block, numBytes );
+      _memoryMutex.Unlock();
+  }
+  else if( _output == NULLAUDIO_OUTPUT_MEMORY )
+  {
+      if( _memoryOutput->GetWriteAvail() >= numBytes )
+      {
+          _memoryOutput->Write( (unsigned char *)block, numBytes );
+      }
+      else
+      {
+          _memoryFramesDropped += numFrames;
+      }
+  }
+
+  _framesRendered += numFrames;
+}
+
+/**
+ @brief  Returns the number of frames rendered since Init().
+*/
+long long NullAudioManager::GetFramesRendered()
+{
+  return _framesRendered;
+}
+
+/**
+ @brief  Returns the virtual clock in seconds of audio rendered since Init().
+*/
+double NullAudioManager::GetStreamTime()
+{
+  return (double)_framesRendered / _playbackSampleRate;
+}
+
+/**
+ @brief  Returns the total time spent mixing, in seconds.
+ Dividing GetStreamTime() by this gives how many times faster than real time the mixer runs.
+*/
+double NullAudioManager::GetMixTime()
+{
+  return (double)_mixNanoseconds / 1000000000.0;
+}
+
+/**
+ @brief  Hands over everything rendered to memory since the last call.
+ The data is interleaved 16-bit stereo at the playback sample rate.  Only one thread may
+ call this at a time.
+*/
+std::vector<short> NullAudioManager::TakeRenderedData()
+{
+  std::vector<short> data;
+  if( _memoryOutput == NULL )
+  {
+      return data;
+  }
+  data.resize( _memoryOutput->GetReadAvail() / BYTES_PER_WORD );
+  if( !data.empty() )
+  {
+      _memoryOutput->Read( (unsigned char *)&data[0], (int)data.size() * BYTES_PER_WORD );
+  }
+  return data;
+}
+
+/**
+ @brief  Returns how many frames were dropped because the memory output was full.
+*/
+long long NullAudioManager::GetMemoryFramesDropped()
+{
+  return _memoryFramesDropped;
+}
+
+/**
+     @brief     Main thread function for NullAudioManager.
+     Renders blocks for the paced modes.  In real time mode it sleeps until the wall clock
+     has caught up with the virtual clock; if rendering falls behind it carries on without
+     sleeping until it catches up, the same as a device would keep asking for data.  Falling
+     more than a block behind is reported to the latency controller as an underrun.
+*/
+void* NullAudioManager::Entry()
+{
+  while(!TestDestroy())
+  {
+      _realtime.ApplyIfPending();
+
+      if( !_inited || _pacing == NULLAUDIO_PACING_MANUAL )
+      {
+          wxThread::Sleep( IDLE_SLEEP );
+          continue;
+      }
+
+      RenderBlock();
+
+      if( _pacing == NULLAUDIO_PACING_REALTIME )
+      {
+          std::chrono::steady_clock::time_point due = _clockStart +
+              std::chrono::microseconds( (long long)( GetStreamTime() * 1000000.0 ) );
+          std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+          if( due > now )
+          {
+              wxThread::Sleep( (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>( due - now ).count() );
+          }
+          // A whole block behind is where a real device would have run dry.
+          else if( now - due > std::chrono::duration<double>( _mixer->GetBufferLatency() ) )
+          {
+              _latencyControl.ReportUnderrun();
+          }
+      }
+  }
+  return NULL;
+}
+
+/**
+  @brief  Copies raw data into a secondary buffer.
+  @note
+  The data passed in must match the format of the secondary buffer.  Matching this is the
+  application's responsiblity.
+*/
+bool NullAudioManager::FillBuffer( int channel, unsigned char* data, int length, int sampleRate )
+{
+  if( channel >= _numBuffers || channel < 0 || length <= 0 )
+  {
+      return false;
+  }
+
+  _secondaryBuffers[channel]->_mutex->Lock();
+  int result = (_secondaryBuffers[channel]->_bufferData)->Write( data, length );
+  _secondaryBuffers[channel]->_mutex->Unlock();
+
+  return result == length;
+}
+
+/**
+  @brief  Fills an individual secondary buffer with silence.
+*/
+bool NullAudioManager::FillBufferSilence( int channel, int length )
+{
+  if( channel >= _numBuffers || channel < 0 || length == 0 )
+  {
+      return false;
+  }
+
+  bool err;
+
+  // Use the mixer's silence whenever it is big enough so that rendering never allocates.
+  if( length <= _mixer->GetSilenceSize() )
+  {
+      return FillBuffer( channel, _mixer->GetSilence(), length, _secondaryBuffers[channel]->_sampleRate );
+  }
+
+  unsigned char *data = new unsigned char[length];
+  memset(data, 0, length );
+
+  err = FillBuffer( channel, data, length, _secondaryBuffers[channel]->_sampleRate );
+
+  delete[] data;
+
+  return err;
+}
+
+bool NullAudioManager::EmptyBuffer( int channel )
+{
+  if( channel >= _numBuffers || channel < 0 )
+  {
+      return false;
+  }
+
+  // The mixer may be reading the buffer, so it empties it itself at the start of its next cycle.
+  return _mixer->PostEmpty( channel );
+}
+
+/**
+  @brief  There is no capture device, so this always fails.
+*/
+bool NullAudioManager::CreateCaptureBuffer( AudioRecordingCallback * recordCallback, int* soundCard, const char *name,
+                                            int numChannels, int sampleFormat )
+{
+  return false;
+}
+
+bool NullAudioManager::DeleteCaptureBuffer()
+{
+  _captureInited = false;
+  return true;
+}
+
+bool NullAudioManager::StartCapture( )
+{
+  return false;
+}
+
+bool NullAudioManager::StopCapture( )
+{
+  return true;
+}
+
+bool NullAudioManager::ProcessCapturedData()
+{
+  return true;
+}
+
+/**
+  @brief  Returns the sample rate of an individual channel.
+*/
+unsigned int NullAudioManager::GetSampleRate(int channel)
+{
+  if( channel < 0 || channel >= _numBuffers )
+  {
+      return false;
+  }
+
+  return _secondaryBuffers[channel]->_sampleRate;
+}
+
+/**
+  @brief  Returns the playback sample rate of the virtual device.
+*/
+unsigned int NullAudioManager::GetSampleRate( void )
+{
+  return _playbackSampleRate;
+}
+
+/**
+  @brief  Returns the capture sample rate.
+*/
+unsigned int NullAudioManager::GetRecordSampleRate()
+{
+  return _captureSampleRate;
+}
+
+/**
+  @brief  Sets the playback sample rate for a single secondary buffer.
+*/
+bool NullAudioManager::SetSampleRate( int channel, unsigned int frequency )
+{
+  if( channel < 0 || channel >= _numBuffers )
+  {
+      return false;
+  }
+  _secondaryBuffers[channel]->_mutex->Lock();
+
+  // The mixer keeps its own copy of the rate.  Posting under the mutex keeps the commands in
+  // the same order as the changes made here.
+  bool result = _mixer->PostCommand( MIXER_COMMAND_SET_SAMPLE_RATE, channel, (int)frequency );
+  if( result )
+  {
+      _secondaryBuffers[channel]->_sampleRate = frequency;
+
+      // Changing our playback sample rate forces us to recalculate our chunk size.
+      _secondaryBuffers[channel]->UpdateChunkSize( _bufferLatency );
+  }
+
+  _secondaryBuffers[channel]->_mutex->Unlock();
+  return result;
+}
+
+/**
+  @brief  Sets the number of interleaved channels in each frame of a secondary buffer.
+  @note
+  Fails while the channel is playing, and for up to a block after Stop() while the audio
+  thread lets go of it.  Anything still queued in the old layout is discarded.
+*/
+bool NullAudioManager::SetChannelCount( int channel, int numChannels )
+{
+  if( channel < 0 || channel >= _numBuffers || numChannels < 1 || numChannels > MAX_SOURCE_CHANNELS )
+  {
+      return false;
+  }
+
+  _secondaryBuffers[channel]->_mutex->Lock();
+  // Data already queued would be read with the wrong frame stride, so the mixer drops it, and
+  // that is only safe once the channel has stopped.
+  if( _activeChannels->Contains( channel ) )
+  {
+      _secondaryBuffers[channel]->_mutex->Unlock();
+      return false;
+  }
+  bool result = _mixer->PostChannelCount( channel, numChannels );
+  if( result )
+  {
+      _secondaryBuffers[channel]->_channels = numChannels;
+      _secondaryBuffers[channel]->UpdateChunkSize( _bufferLatency );
+  }
+  _secondaryBuffers[channel]->_mutex->Unlock();
+  return result;
+}
+
+/**
+  @brief  Returns the number of interleaved channels in a secondary buffer.
+*/
+int NullAudioManager::GetChannelCount( int channel )
+{
+  if( channel < 0 || channel >= _numBuffers )
+  {
+      return 0;
+  }
+
+  _secondaryBuffers[channel]->_mutex->Lock();
+  int numChannels = _secondaryBuffers[channel]->_channels;
+  _secondaryBuffers[channel]->_mutex->Unlock();
+  return numChannels;
+}
+
+bool NullAudioManager::SetRecordSampleRate( unsigned int frequency )
+{
+  _captureSampleRate = frequency;
+
+  return true;
+}
+
+/**
+  @brief  Sets the master volume level.
+  @note
+  Volume levels range from -9600 to 0.
+*/
+void NullAudioManager::SetMasterVolume( int volume )
+{
+  if( volume > 0 || volume < -9600 )
+  {
+      return;
+  }
+
+  _masterVolume = volume;
+}
+
+/**
+  @brief  Sets the volume value for a single secondary buffer.
+*/
+void NullAudioManager::SetVolume( int channel, int volume )
+{
+  if( channel < 0 || channel >= _numBuffers )
+  {
+      return;
+  }
+
+  _secondaryBuffers[channel]->_mutex->Lock();
+  if( _mixer->PostCommand( MIXER_COMMAND_SET_VOLUME, channel, volume ) )
+  {
+      _secondaryBuffers[channel]->_volume = volume;
+  }
+  _secondaryBuffers[channel]->_mutex->Unlock();
+}
+
+/**
+  @brief  Sets the pan value for a single secondary buffer.
+*/
+void NullAudioManager::SetPan( int channel, int pan )
+{
+  if( channel < 0 || channel >= _numBuffers )
+  {
+      return;
+  }
+
+  _secondaryBuffers[channel]->_mutex->Lock();
+  if( _mixer->PostCommand( MIXER_COMMAND_SET_PAN, channel, pan ) )
+  {
+      _secondaryBuffers[channel]->_pan = pan;
+  }
+  _secondaryBuffers[channel]->_mutex->Unlock();
+}
+
+/**
+  @brief  Returns volume value for a single secondary buffer.
+*/
+int NullAudioManager::GetVolume( int channel )
+{
+  if( channel < 0 || channel >= _numBuffers )
+  {
+      return 0;
+  }
+
+  _secondaryBuffers[channel]->_mutex->Lock();
+  int volume = _secondaryBuffers[channel]->_volume;
+  _secondaryBuffers[channel]->_mutex->Unlock();
+  return volume;
+}
+
+/**
+  @brief  Returns pan value for a single secondary buffer.
+*/
+int NullAudioManager::GetPan( int channel )
+{
+  if( channel < 0 || channel >= _numBuffers )
+  {
+      return 0;
+  }
+
+  _secondaryBuffers[channel]->_mutex->Lock();
+  int pan = _secondaryBuffers[channel]->_pan;
+  _secondaryBuffers[channel]->_mutex->Unlock();
+
+  return pan;
+}
+
+/**
+     @brief     Starts the playback of all secondary buffers.
+     @return
+     bool value, only false if Init() has not been called.
+*/
+bool NullAudioManager::Play()
+{
+  if( !_inited )
+  {
+      return false;
+  }
+
+  int count;
+  for( count = 0; count < _numBuffers; count++ )
+  {
+      Play( count );
+  }
+  return true;
+}
+
+/**
+  @brief  Sets a secondary buffer as playing.
+*/
+bool NullAudioManager::Play( int channel )
+{
+  if( channel >= _numBuffers || channel < 0 )
+  {
+      return false;
+  }
+
+  _secondaryBuffers[channel]->_mutex->Lock();
+  if( !_mixer->PostCommand( MIXER_COMMAND_PLAY, channel ) )
+  {
+      _secondaryBuffers[channel]->_mutex->Unlock();
+      return false;
+  }
+  _activeChannels->Add( channel );
+  _secondaryBuffers[channel]->_mutex->Unlock();
+
+  return true;
+}
+
+/**
+ @brief  Stops all secondary buffers from playing.
+*/
+bool NullAudioManager::Stop( )
+{
+  if( !_inited )
+  {
+      return false;
+  }
+
+  int count;
+  for( count = 0; count < _numBuffers; count++ )
+  {
+      Stop( count );
+  }
+
+  return true;
+}
+
+/**
+ @brief  Stops playing of an individual secondary buffer.
+*/
+bool NullAudioManager::Stop( int channel )
+{
+  if( channel >= _numBuffers || channel < 0 )
+  {
+      return false;
+  }
+
+  _secondaryBuffers[channel]->_mutex->Lock();
+  bool result = _mixer->PostCommand( MIXER_COMMAND_STOP, channel );
+  if( result )
+  {
+      _activeChannels->Remove( channel );
+  }
+  _secondaryBuffers[channel]->_mutex->Unlock();
+  EmptyBuffer( channel );
+
+  return result;
+}
+
+/**
+ @brief  Checks whether an individual secondary buffer is playing.
+*/
+bool NullAudioManager::IsBufferPlaying( int channel )
+{
+  if( !_inited || channel < 0 || channel >= _numBuffers )
+  {
+      return false;
+  }
+
+  return _activeChannels->Contains( channel );
+}
+
+/**
+  @brief  Sets the latency of buffers in milliseconds.
+  This sets the size of each rendered block.  It may be called while rendering; the new
+  size takes effect from the next block.
+*/
+void NullAudioManager::SetBufferLatency( int msec )
+{
+  // Buffer length must be nonzero and less than one second.
+  if( msec <= 0 || msec >= 1000 )
+  {
+      return;
+  }
+  _bufferLatency = (double)msec / 1000.0;
+
+  int channel;
+  for( channel = 0; channel < _numBuffers; channel++ )
+  {
+      _secondaryBuffers[channel]->_mutex->Lock();
+      _secondaryBuffers[channel]->UpdateChunkSize( _bufferLatency );
+      _secondaryBuffers[channel]->_mutex->Unlock();
+  }
+
+  if( _inited )
+  {
+      _mixer->Reconfigure( _bufferLatency );
+  }
+  else
+  {
+      AllocateMixArena();
+  }
+}
+
+/**
+  @brief  Spreads mixing over extra threads when many channels are playing.
+  @note
+  This replaces the mixer's workers and their scratch space, so it must not be called while
+  rendering.
+*/
+bool NullAudioManager::SetMixThreads( int numThreads, int minChannelsPerThread )
+{
+  if( numThreads < 0 )
+  {
+      return false;
+  }
+  return _mixer->SetWorkerCount( numThreads, minChannelsPerThread );
+}
+
+/**
+  @brief  Requests real-time scheduling for the rendering thread.
+  Applied by Entry() on its next pass.  RenderBlocks() runs on the caller's thread and is
+  not affected.
+*/
+bool NullAudioManager::SetRealtimeConfig( const RealtimeConfig& config )
+{
+  _realtime.SetConfig( config );
+  _mixer->SetRealtimeConfig( config );
+  return true;
+}
+
+RealtimeReport NullAudioManager::GetRealtimeReport()
+{
+  return _realtime.GetReport();
+}
+
+/**
+  @brief  Turns adaptive latency on or off and sets its bounds.
+  Nothing changes until UpdateLatency() is called.
+*/
+bool NullAudioManager::SetLatencyConfig( const LatencyConfig& config )
+{
+  _latencyControl.SetConfig( config );
+  return true;
+}
+
+/**
+  @brief  Lets the latency controller act on what has happened since the last call.
+  Call this every few hundred milliseconds from a timer or other non-audio thread, since a
+  change goes through SetBufferLatency().
+  @return
+  The buffer latency in milliseconds after any change.
+*/
+int NullAudioManager::UpdateLatency()
+{
+  int latency = (int)(_bufferLatency * 1000.0 + 0.5);
+  if( !_inited )
+  {
+      return latency;
+  }
+  int newLatency = _latencyControl.Update( latency, _mixer );
+  if( newLatency != latency )
+  {
+      SetBufferLatency( newLatency );
+  }
+  return (int)(_bufferLatency * 1000.0 + 0.5);
+}
+
+/**
+  @brief  Returns the latency changes made since the last call, with the reason for each.
+*/
+std::vector<LatencyDecision> NullAudioManager::TakeLatencyDecisions()
+{
+  return _latencyControl.TakeDecisions();
+}
+
+/**
+  @brief  Sizes the mixer's scratch space for the current latency.
+  Called from Init() and SetBufferLatency().
+*/
+void NullAudioManager::AllocateMixArena()
+{
+  _mixer->Allocate( _bufferLatency, _playbackSampleRate, MAX_SAMPLE_RATE );
+}
+
+int NullAudioManager::GetPeak( int channel )
+{
+  if( channel < 0 || channel >= _numBuffers )
+  {
+      return 0;
+  }
+
+  return _secondaryBuffers[channel]->_peak.load( std::memory_order_relaxed );
+}
+
+int NullAudioManager::GetRms( int channel )
+{
+  if( channel < 0 || channel >= _numBuffers )
+  {
+      return 0;
+  }
+
+  return _secondaryBuffers[channel]->_rms.load( std::memory_order_relaxed );
+}
+
+int NullAudioManager::GetMasterPeak()
+{
+  return _mixer->GetMasterPeak();
+}
+
+int NullAudioManager::GetMasterRms()
+{
+  return _mixer->GetMasterRms();
+}
+
+/**
+  @brief  Returns the number of bytes waiting in a secondary buffer.
+  Kept in bytes for existing callers; use GetNumFramesQueued() for a count in frames.
+*/
+int NullAudioManager::GetNumSamplesQueued(int channel)
+{
+	return GetNumBytesQueued(channel);
+}
+
+/**
+  @brief  Returns the number of frames waiting in a secondary buffer.
+  Frames are counted at the channel's own sample rate.  Use GetPlaybackPosition() to include
+  what has already been mixed but not yet heard.
+*/
+int NullAudioManager::GetNumFramesQueued(int channel)
+{
+	if( channel < 0 || channel >= _numBuffers )
+	{
+		return 0;
+	}
+	int value;
+	_secondaryBuffers[channel]->_mutex->Lock();
+	value = _secondaryBuffers[channel]->_bufferData->GetReadAvail() /
+		( _secondaryBuffers[channel]->_bytesPerSample * _secondaryBuffers[channel]->_channels );
+	_secondaryBuffers[channel]->_mutex->Unlock();
+	return value;
+}
+
+/**
+  @brief  Returns the number of bytes waiting in a secondary buffer.
+*/
+int NullAudioManager::GetNumBytesQueued(int channel)
+{
+	if( channel < 0 || channel >= _numBuffers )
+	{
+		return 0;
+	}
+	int value;
+	_secondaryBuffers[channel]->_mutex->Lock();
+	value = _secondaryBuffers[channel]->_bufferData->GetReadAvail();
+	_secondaryBuffers[channel]->_mutex->Unlock();
+	return value;
+}
+
+/**
+  @brief  Reports how much of a channel has been heard and how long new data will take to be heard.
+  Combines the data waiting in the secondary buffer with the mixer's record of what it has
+  handed to the device.  Use it to keep video or other events in step with the sound.
+  @return
+  false if the channel doesn't exist.
+*/
+bool NullAudioManager::GetPlaybackPosition( int channel, PlaybackPosition* position )
+{
+	if( channel < 0 || channel >= _numBuffers || position == NULL )
+	{
+		return false;
+	}
+	SecondaryBuffer* buffer = _secondaryBuffers[channel];
+	buffer->_mutex->Lock();
+	int bufferedFrames = buffer->_bufferData->GetReadAvail() / ( buffer->_bytesPerSample * buffer->_channels );
+	unsigned int sampleRate = buffer->_sampleRate;
+	buffer->_mutex->Unlock();
+	*position = _mixer->GetPosition( channel, bufferedFrames, sampleRate );
+	return true;
+}
+
+int NullAudioManager::GetWriteBytesAvailable(int channel)
+{
+	if( channel < 0 || channel >= _numBuffers )
+	{
+		return 0;
+	}
+	int value;
+	_secondaryBuffers[channel]->_mutex->Lock();
+	value = _secondaryBuffers[channel]->_bufferData->GetWriteAvail();
+	_secondaryBuffers[channel]->_mutex->Unlock();
+	return value;
+}
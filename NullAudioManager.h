@@ -0,0 +1,141 @@
+#if !defined(_NULLAUDIOMANAGER_H_)
+#define _NULLAUDIOMANAGER_H_
+
+#include "RingBuffer.h"
+#include "ActiveChannelList.h"
+#include "Mixer.h"
+#include "WavWriter.h"
+#include <vector>
+#include <string>
+#include <atomic>
+#include <chrono>
+
+#include "AudioRecordingCallback.h"
+#include "SecondaryBuffer.h"
+#include "AudioBufferInterface.h"
+
+/// Where NullAudioManager sends the mixed output.
+#define NULLAUDIO_OUTPUT_NONE 0
+#define NULLAUDIO_OUTPUT_MEMORY 1
+#define NULLAUDIO_OUTPUT_WAV 2
+
+/// Default length of the memory output, in seconds.  See SetMemoryLength().
+#define NULLAUDIO_MEMORY_SECONDS 10
+
+/// How NullAudioManager's virtual clock advances.
+/// Blocks are rendered by the manager's thread at the playback rate.
+#define NULLAUDIO_PACING_REALTIME 0
+/// Blocks are rendered by the manager's thread as fast as the mixer can go.
+#define NULLAUDIO_PACING_FAST 1
+/// Nothing is rendered until the application calls RenderBlocks().
+#define NULLAUDIO_PACING_MANUAL 2
+
+/**
+     @brief     An audio engine with no sound card behind it.
+     NullAudioManager runs the same secondary buffers and Mixer as the device-backed managers,
+     but its clock is just a count of the frames rendered.  The mixed output can be thrown
+     away, kept in memory, or written to a WAV file.  Rendering can be paced to real time,
+     run flat out to benchmark the mixer, or stepped by hand with RenderBlocks() for offline
+     rendering and tests on machines without audio hardware.
+     @note      SetOutput() and SetPacing() must be called before Init().  There is no capture
+     device, so CreateCaptureBuffer() always fails.
+*/
+class NullAudioManager : public AudioBufferInterface
+{
+public:
+    // Non-virtual methods
+	NullAudioManager(int numBuffers);
+	~NullAudioManager();
+	bool SetOutput( int output, const char* filename = NULL );
+	bool SetPacing( int pacing );
+	bool SetMemoryLength( int seconds );
+	/// Get individual secondary buffer sample rate.
+	unsigned int GetSampleRate(int channel);
+    bool Init(void *parentWindow = NULL, int* soundCard = NULL, const char *name = NULL);
+	bool CreateCaptureBuffer( AudioRecordingCallback * recordCallback = NULL, int* soundCard = NULL, const char *name = NULL,
+	                          int numChannels = MONO, int sampleFormat = SAMPLE_FORMAT_S16 );
+	int RenderBlocks( int numBlocks );
+	long long GetFramesRendered();
+	double GetStreamTime();
+	double GetMixTime();
+	std::vector<short> TakeRenderedData();
+	long long GetMemoryFramesDropped();
+
+    virtual bool UnInit();
+	virtual bool Play();
+	virtual bool Stop();
+	virtual bool Stop( int channel );
+	virtual bool StartCapture();
+	virtual bool StopCapture();
+	virtual bool SetSampleRate( int channel, unsigned int frequency );
+	virtual bool SetRecordSampleRate( unsigned int sampleRate );
+	virtual bool SetChannelCount( int channel, int numChannels );
+	virtual int GetChannelCount( int channel );
+	virtual bool IsBufferPlaying( int channel );
+	// Get global playback buffer sample rate.
+	virtual unsigned int GetSampleRate();
+	virtual unsigned int GetRecordSampleRate();
+	virtual void SetVolume( int channel, int volume );
+    virtual void SetMasterVolume( int volume );
+	virtual int GetVolume( int channel );
+	virtual void SetPan( int channel, int pan );
+	virtual int GetPan( int channel );
+	virtual bool DeleteCaptureBuffer();
+	virtual bool FillBuffer( int channel, unsigned char *data, int length, int sampleRate );
+    bool EmptyBuffer( int channel );
+	virtual bool FillBufferSilence( int channel, int length );
+	virtual void SetBufferLatency( int msec );
+	virtual bool SetMixThreads( int numThreads, int minChannelsPerThread = 32 );
+	virtual bool SetRealtimeConfig( const RealtimeConfig& config );
+	virtual RealtimeReport GetRealtimeReport();
+	virtual bool SetLatencyConfig( const LatencyConfig& config );
+	virtual int UpdateLatency();
+	virtual std::vector<LatencyDecision> TakeLatencyDecisions();
+	virtual int GetNumSamplesQueued( int channel );
+	virtual int GetNumBytesQueued( int channel );
+	virtual int GetNumFramesQueued( int channel );
+	virtual bool GetPlaybackPosition( int channel, PlaybackPosition* position );
+    virtual void* Entry();
+    int GetPeak( int channel );
+    int GetRms( int channel );
+    int GetMasterPeak();
+    int GetMasterRms();
+	int GetWriteBytesAvailable(int channel);
+private:
+    // Virtual private methods.
+	virtual bool ProcessCapturedData();
+    virtual bool Play( int channel );
+
+    // Non-virtual private methods and data
+	void RenderBlock();
+	void AllocateMixArena();
+	std::vector<SecondaryBuffer *> _secondaryBuffers;
+	/// Channels that are currently playing.  Maintained by Play() and Stop().
+	ActiveChannelList* _activeChannels;
+	/// Mixes the playing secondary buffers for RenderBlock.
+	Mixer* _mixer;
+	/// Real-time settings for the rendering thread.
+	RealtimeThread _realtime;
+	/// Adapts the buffer latency to the underruns seen by the audio thread.
+	LatencyController _latencyControl;
+	int _output;
+	int _pacing;
+	WavWriter _wavWriter;
+	std::string _filename;
+	/// Rendered output when _output is NULLAUDIO_OUTPUT_MEMORY.  Sized by Init(), written by
+	/// RenderBlock() and read by TakeRenderedData() without a lock.
+	RingBuffer* _memoryOutput;
+	int _memorySeconds;
+	/// Frames that didn't fit in _memoryOutput because nobody took them in time.
+	std::atomic<long long> _memoryFramesDropped;
+	/// Keeps UnInit() from closing the WAV file under a block that is being written.
+	wxMutex _memoryMutex;
+	/// The virtual clock.  Advanced by every block rendered.
+	std::atomic<long long> _framesRendered;
+	/// Total time spent inside the mixer, in nanoseconds.
+	std::atomic<long long> _mixNanoseconds;
+	/// Wall-clock time matching frame zero when pacing to real time.
+	std::chrono::steady_clock::time_point _clockStart;
+};
+
+#endif // _NULLAUDIOMANAGER_H_
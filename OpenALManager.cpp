@@ -31,10 +31,8 @@ OpenALManager::OpenALManager(int numBuffers)
   /// Used to keep track of the number of frames in our playback buffer.
   _playbackFrames = 0;
   _captureSampleRate = MAX_SAMPLE_RATE;
-  // A chunk of data in our record buffer.
+  // A chunk of data in the capture device's buffer.
   _recordBufferLength = (int)(_captureSampleRate * _bufferLatency * BYTES_PER_WORD);
-  _captureBuffer = new char[_recordBufferLength];
-  memset( _captureBuffer, 0, _recordBufferLength );
   int count;
   // Create volume and pan values.
   for( count = 0; count < _numBuffers; count++ )
@@ -42,15 +40,17 @@ OpenALManager::OpenALManager(int numBuffers)
       _secondaryBuffers.push_back( new SecondaryBuffer );
       _secondaryBuffers[count]->_volume = 0;
       _secondaryBuffers[count]->_pan = 0;
-      _secondaryBuffers[count]->_isPlaying = false;
       _secondaryBuffers[count]->_bytesPerSample = BYTES_PER_WORD;
+      _secondaryBuffers[count]->_channels = MONO;
       _secondaryBuffers[count]->_mutex = new wxMutex;
       _secondaryBuffers[count]->_bufferData = new RingBuffer( SECONDARY_BUFFER_SIZE );
       _secondaryBuffers[count]->_sampleRate = MAX_SAMPLE_RATE;
-      _secondaryBuffers[count]->_chunkSize = (int)(_bufferLatency * _secondaryBuffers[count]->_sampleRate * _secondaryBuffers[count]->_bytesPerSample);
-      // Chunk size MUST be an even number of bytes.
-      _secondaryBuffers[count]->_chunkSize &= ~1;
+      _secondaryBuffers[count]->UpdateChunkSize( _bufferLatency );
     }
+  // Tracks which channels are playing for IsBufferPlaying().  The mixer keeps its own list,
+  // updated through commands, so the audio thread never touches this one.
+  _activeChannels = new ActiveChannelList( _numBuffers );
+  _mixer = new Mixer( &_secondaryBuffers );
 	// Higher thread priority in order to watch the sound buffers better.
 	/// Above normal thread priority so we can monitor the sound buffer a little better.
 	if( wxThread::Create(wxTHREAD_JOINABLE) != wxTHREAD_NO_ERROR )
@@ -86,7 +86,8 @@ OpenALManager::~OpenALManager()
     {
       delete _secondaryBuffers[count];
     }
-    delete[] _captureBuffer;
+    delete _mixer;
+    delete _activeChannels;
 
 }
 
@@ -194,6 +195,9 @@ bool OpenALManager::Init(void *parentWindow, int* soundCard, const char *name)
 
   alGenBuffers( 2, _playbackBuffers );
 
+  // Size our mixing scratch space now so the audio thread never has to allocate.
+  AllocateMixArena();
+
   _inited = true;
 
   return( _inited );
@@ -207,6 +211,8 @@ bool OpenALManager::Init(void *parentWindow, int* soundCard, const char *name)
 */
 bool OpenALManager::UnInit()
 {
+  _capturing = false;
+  StopCaptureThread();
   alutExit();
   _inited = false;
   return true;
@@ -226,8 +232,6 @@ bool OpenALManager::ProcessSoundBuffer( void )
   ALuint workingBuffer;
   static int underruns = 0;
   static int bufferscrewups = 0;
-  bool playing = false;
-  int channel = 0;      // Channel iterator.
 
   if( !_inited )
   {
@@ -236,17 +240,7 @@ bool OpenALManager::ProcessSoundBuffer( void )
 
   // We only need to monitor the buffer if one of our sound streams is playing.  If it is not,
   // then we can safely ignore it.
-  for( channel = 0; channel < _numBuffers; channel++ )
-  {
-      _secondaryBuffers[channel]->_mutex->Lock();
-      if( _secondaryBuffers[channel]->_isPlaying == true )
-      {
-	    playing = true;
-	  }
-      _secondaryBuffers[channel]->_mutex->Unlock();
-  }
-  // If we have nothing to monitor, we bail.
-  if( playing == false )
+  if( _mixer->GetPlayingCount() == 0 )
   {
       return false;
   }
@@ -266,19 +260,17 @@ bool OpenALManager::ProcessSoundBuffer( void )
   if( buffersprocessed == 2 )
   {
         underruns++;
+        _latencyControl.ReportUnderrun();
         // If we're out of buffers it's time to unfuck things up.
         ALuint silenceBuffer;
         alSourceUnqueueBuffers( _playbackHandle, 1, &silenceBuffer );
         alSourceUnqueueBuffers( _playbackHandle, 1, &workingBuffer );
-        // Use the first buffer to put silence in and give ourselves room to work.
-        int chunkSize = (int)(_playbackSampleRate * _bufferLatency * BYTES_PER_WORD * STEREO );
-        char* data = new char[chunkSize];
-        memset( data, 0, chunkSize );
-        alBufferData( silenceBuffer, _format, data, chunkSize, _playbackSampleRate );
+        // Use the first buffer to put silence in and give ourselves room to work.  The mixer's
+        // silence block is preallocated so an underrun doesn't cost us a trip to the heap.
+        alBufferData( silenceBuffer, _format, _mixer->GetSilence(), _mixer->GetBlockFrames() * STEREO * BYTES_PER_WORD, _playbackSampleRate );
         CheckALError();
         alSourceQueueBuffers( _playbackHandle, 1, &silenceBuffer );
         CheckALError();
-        delete[] data;
         alSourcePlay( _playbackHandle );
         CheckALError();
         // The second buffer will be used to mix data to.
@@ -356,6 +348,12 @@ bool OpenALManager::FillBufferSilence( int channel, int length )
 
   bool err;
 
+  // The mixer calls this from the audio thread, so use the mixer's silence whenever it is big enough.
+  if( length <= _mixer->GetSilenceSize() )
+  {
+      return FillBuffer( channel, _mixer->GetSilence(), length, _secondaryBuffers[channel]->_sampleRate );
+  }
+
   unsigned char *data = new unsigned char[length];
   memset(data, 0, length );
 
@@ -373,17 +371,15 @@ bool OpenALManager::EmptyBuffer( int channel )
         return false;
     }
 
-  _secondaryBuffers[channel]->_mutex->Lock();
-  bool result = (_secondaryBuffers[channel]->_bufferData)->Empty( );
-  _secondaryBuffers[channel]->_mutex->Unlock();
-    
-  return result;
+  // The mixer may be reading the buffer, so it empties it itself at the start of its next cycle.
+  return _mixer->PostEmpty( channel );
 }
 
 /**
   @brief  Creates the capture buffer and initializes audio capture.
 */
-bool OpenALManager::CreateCaptureBuffer( AudioRecordingCallback * recordCallback, int* soundCard, const char *name )
+bool OpenALManager::CreateCaptureBuffer( AudioRecordingCallback * recordCallback, int* soundCard, const char *name,
+                                         int numChannels, int sampleFormat )
 {
   /// Have to init the OpenALManager first.
   if( !_inited )
@@ -393,12 +389,24 @@ bool OpenALManager::CreateCaptureBuffer( AudioRecordingCallback * recordCallback
 
   /// Set our recording callback, even if the buffer is already created - this
   /// allows us to change which callback we are using.
-  _recordingCallback = recordCallback;
+  SetRecordingCallback( recordCallback );
 
-  /// Buffer already created - don't create again.
+  /// Buffer already created - don't create again.  The format can only be changed by
+  /// deleting the capture buffer first.
   if( _captureInited )
   {
-      return true;
+      return numChannels == _captureChannels && sampleFormat == _captureSampleFormat;
+  }
+
+  ALenum captureFormat = 0;
+  if( SetCaptureFormat( numChannels, sampleFormat ) )
+  {
+      captureFormat = GetCaptureALFormat();
+  }
+  if( captureFormat == 0 )
+  {
+      wxMessageBox( _("The capture device doesn't support the requested channel count and sample format."), _("Error"), wxOK );
+      return false;
   }
 
   const ALCchar* captureDeviceString = alcGetString( NULL, ALC_CAPTURE_DEFAULT_DEVICE_SPECIFIER );
@@ -406,22 +414,87 @@ bool OpenALManager::CreateCaptureBuffer( AudioRecordingCallback * recordCallback
   CheckALCError(_device);
 
   // Buffer size is in samples, NOT in bytes.
-  _captureDevice = alcCaptureOpenDevice( captureDeviceString, _captureSampleRate, AL_FORMAT_MONO16, (_recordBufferLength / 2) );
+  _captureDevice = alcCaptureOpenDevice( captureDeviceString, _captureSampleRate, captureFormat, (_recordBufferLength / 2) );
   if( CheckALCError(_captureDevice) )
   {
       wxMessageBox( _("Unable to open capture device with default device string."), _("Error"), wxOK );
   }
 
+  if( !AllocateCaptureRing() )
+  {
+      wxMessageBox( _("Unable to allocate the capture ring."), _("Error"), wxOK );
+      return false;
+  }
+
   _captureInited = true;
 
   return true;
 }
 
+/**
+  @brief  Finds the OpenAL format for the capture channel count and sample format.
+  Float and multichannel formats come from extensions, so they are looked up by name.
+  @return
+  The format, or 0 if OpenAL has none to match.  There are no 24 or 32-bit integer formats.
+*/
+ALenum OpenALManager::GetCaptureALFormat()
+{
+  bool isFloat = ( _captureSampleFormat == SAMPLE_FORMAT_F32 );
+  if( _captureSampleFormat != SAMPLE_FORMAT_S16 && !isFloat )
+  {
+      return 0;
+  }
+  if( !isFloat && _captureChannels == MONO )
+  {
+      return AL_FORMAT_MONO16;
+  }
+  if( !isFloat && _captureChannels == STEREO )
+  {
+      return AL_FORMAT_STEREO16;
+  }
+  const char* name = NULL;
+  switch( _captureChannels )
+  {
+    case 1:
+      name = "AL_FORMAT_MONO_FLOAT32";
+      break;
+    case 2:
+      name = "AL_FORMAT_STEREO_FLOAT32";
+      break;
+    case 4:
+      name = isFloat ? "AL_FORMAT_QUAD32" : "AL_FORMAT_QUAD16";
+      break;
+    case 6:
+      name = isFloat ? "AL_FORMAT_51CHN32" : "AL_FORMAT_51CHN16";
+      break;
+    case 7:
+      name = isFloat ? "AL_FORMAT_61CHN32" : "AL_FORMAT_61CHN16";
+      break;
+    case 8:
+      name = isFloat ? "AL_FORMAT_71CHN32" : "AL_FORMAT_71CHN16";
+      break;
+    default:
+      return 0;
+  }
+  if( isFloat && !alIsExtensionPresent( "AL_EXT_float32" ) )
+  {
+      return 0;
+  }
+  if( _captureChannels > STEREO && !alIsExtensionPresent( "AL_EXT_MCFORMATS" ) )
+  {
+      return 0;
+  }
+  ALenum format = alGetEnumValue( name );
+  return format == -1 ? 0 : format;
+}
+
 /**
   @brief  Closes the capture buffer and sets the initialized flag to false.
 */
 bool OpenALManager::DeleteCaptureBuffer()
 {
+  _capturing = false;
+  StopCaptureThread();
   CheckALCError(_captureDevice);
   alcCaptureCloseDevice( _captureDevice );
   _captureInited = false;
@@ -468,15 +541,68 @@ bool OpenALManager::SetSampleRate( int channel, unsigned int frequency )
   }
   _secondaryBuffers[channel]->_mutex->Lock();
 
-  _secondaryBuffers[channel]->_sampleRate = frequency;
+  // The mixer keeps its own copy of the rate.  Posting under the mutex keeps the commands in
+  // the same order as the changes made here.
+  bool result = _mixer->PostCommand( MIXER_COMMAND_SET_SAMPLE_RATE, channel, (int)frequency );
+  if( result )
+  {
+      _secondaryBuffers[channel]->_sampleRate = frequency;
 
-  // Changing our playback sample rate forces us to recalculate our chunk size.
-  _secondaryBuffers[channel]->_chunkSize = (int)(_bufferLatency * _secondaryBuffers[channel]->_sampleRate * _secondaryBuffers[channel]->_bytesPerSample);
-  // Chunk size MUST be an even number of bytes.
-  _secondaryBuffers[channel]->_chunkSize &= ~1;
+      // Changing our playback sample rate forces us to recalculate our chunk size.
+      _secondaryBuffers[channel]->UpdateChunkSize( _bufferLatency );
+  }
 
   _secondaryBuffers[channel]->_mutex->Unlock();
-  return true;
+  return result;
+}
+
+/**
+  @brief  Sets the number of interleaved channels in each frame of a secondary buffer.
+  Data written with FillBuffer must then be whole interleaved frames.  Mono buffers are
+  panned, stereo buffers use pan as balance, and wider buffers are folded down to stereo.
+  @note
+  Fails while the channel is playing, and for up to a block after Stop() while the audio
+  thread lets go of it.  Anything still queued in the old layout is discarded.
+*/
+bool OpenALManager::SetChannelCount( int channel, int numChannels )
+{
+  if( channel < 0 || channel >= _numBuffers || numChannels < 1 || numChannels > MAX_SOURCE_CHANNELS )
+  {
+      return false;
+  }
+
+  _secondaryBuffers[channel]->_mutex->Lock();
+  // Data already queued would be read with the wrong frame stride, so the mixer drops it, and
+  // that is only safe once the channel has stopped.
+  if( _activeChannels->Contains( channel ) )
+  {
+      _secondaryBuffers[channel]->_mutex->Unlock();
+      return false;
+  }
+  bool result = _mixer->PostChannelCount( channel, numChannels );
+  if( result )
+  {
+      _secondaryBuffers[channel]->_channels = numChannels;
+      _secondaryBuffers[channel]->UpdateChunkSize( _bufferLatency );
+  }
+  _secondaryBuffers[channel]->_mutex->Unlock();
+  return result;
+}
+
+/**
+  @brief  Returns the number of interleaved channels in a secondary buffer.
+*/
+int OpenALManager::GetChannelCount( int channel )
+{
+  if( channel < 0 || channel >= _numBuffers )
+  {
+      return 0;
+  }
+
+  _secondaryBuffers[channel]->_mutex->Lock();
+  int numChannels = _secondaryBuffers[channel]->_channels;
+  _secondaryBuffers[channel]->_mutex->Unlock();
+  return numChannels;
 }
 
 /**
@@ -518,7 +644,10 @@ void OpenALManager::SetVolume( int channel, int volume )
   }
 
   _secondaryBuffers[channel]->_mutex->Lock();
-  _secondaryBuffers[channel]->_volume = volume;
+  if( _mixer->PostCommand( MIXER_COMMAND_SET_VOLUME, channel, volume ) )
+  {
+      _secondaryBuffers[channel]->_volume = volume;
+  }
   _secondaryBuffers[channel]->_mutex->Unlock();
 }
 
@@ -533,7 +662,10 @@ void OpenALManager::SetPan( int channel, int pan )
   }
 
   _secondaryBuffers[channel]->_mutex->Lock();
-  _secondaryBuffers[channel]->_pan = pan;
+  if( _mixer->PostCommand( MIXER_COMMAND_SET_PAN, channel, pan ) )
+  {
+      _secondaryBuffers[channel]->_pan = pan;
+  }
   _secondaryBuffers[channel]->_mutex->Unlock();
 }
 
@@ -615,15 +747,20 @@ bool OpenALManager::Play( int channel )
 //  int sampleRate = _secondaryBuffers[channel]->_sampleRate;
   _secondaryBuffers[channel]->_mutex->Unlock();
 
-  // Prime the buffer so we can be sure not to start off with crap.  As soon as _isPlaying is set to true
-  // this sucker could be off and running.
+  // Prime the buffer so we can be sure not to start off with crap.  As soon as the channel is in the
+  // active list this sucker could be off and running.
   EmptyBuffer( channel );
   //FillBufferSilence( channel, (int)(sampleRate * _bufferLatency) );
 
   // It is the responsiblity of buffer monitoring to make sure that data is actually
   // in the secondary buffer and to start copying it into the primary buffer.
   _secondaryBuffers[channel]->_mutex->Lock();
-  _secondaryBuffers[channel]->_isPlaying = true;
+  if( !_mixer->PostCommand( MIXER_COMMAND_PLAY, channel ) )
+  {
+      _secondaryBuffers[channel]->_mutex->Unlock();
+      return false;
+  }
+  _activeChannels->Add( channel );
   _secondaryBuffers[channel]->_mutex->Unlock();
 
   // Make sure the master buffer is playing.
@@ -646,14 +783,11 @@ bool OpenALManager::Play( int channel )
             CheckALError();
         }
 
-        int chunkSize = (int)(_playbackSampleRate * _bufferLatency * BYTES_PER_WORD * STEREO );
-        char* data = new char[chunkSize];
-        memset( data, 0, chunkSize );
-        alBufferData( _playbackBuffers[0], _format, data, chunkSize, _playbackSampleRate );
-        alBufferData( _playbackBuffers[1], _format, data, chunkSize, _playbackSampleRate );
+        int chunkSize = _mixer->GetBlockFrames() * STEREO * BYTES_PER_WORD;
+        alBufferData( _playbackBuffers[0], _format, _mixer->GetSilence(), chunkSize, _playbackSampleRate );
+        alBufferData( _playbackBuffers[1], _format, _mixer->GetSilence(), chunkSize, _playbackSampleRate );
         alSourceQueueBuffers( _playbackHandle, 2, _playbackBuffers );
         CheckALError();
-        delete[] data;
 
       alSourcePlay( _playbackHandle );
       }
@@ -671,14 +805,11 @@ bool OpenALManager::Play( int channel )
             CheckALError();
         }
 
-        int chunkSize = (int)(_playbackSampleRate * _bufferLatency * BYTES_PER_WORD * STEREO );
-        char* data = new char[chunkSize];
-        memset( data, 0, chunkSize );
-        alBufferData( _playbackBuffers[0], _format, data, chunkSize, _playbackSampleRate );
-        alBufferData( _playbackBuffers[1], _format, data, chunkSize, _playbackSampleRate );
+        int chunkSize = _mixer->GetBlockFrames() * STEREO * BYTES_PER_WORD;
+        alBufferData( _playbackBuffers[0], _format, _mixer->GetSilence(), chunkSize, _playbackSampleRate );
+        alBufferData( _playbackBuffers[1], _format, _mixer->GetSilence(), chunkSize, _playbackSampleRate );
         alSourceQueueBuffers( _playbackHandle, 2, _playbackBuffers );
         CheckALError();
-        delete[] data;
 
       alSourcePlay( _playbackHandle );
       }
@@ -696,18 +827,15 @@ bool OpenALManager::Play( int channel )
             CheckALError();
         }
 
-        int chunkSize = (int)(_playbackSampleRate * _bufferLatency * BYTES_PER_WORD * STEREO );
-        char* data = new char[chunkSize];
-        memset( data, 0, chunkSize );
-        alBufferData( _playbackBuffers[0], _format, data, chunkSize, _playbackSampleRate );
-        alBufferData( _playbackBuffers[1], _format, data, chunkSize, _playbackSampleRate );
+        int chunkSize = _mixer->GetBlockFrames() * STEREO * BYTES_PER_WORD;
+        alBufferData( _playbackBuffers[0], _format, _mixer->GetSilence(), chunkSize, _playbackSampleRate );
+        alBufferData( _playbackBuffers[1], _format, _mixer->GetSilence(), chunkSize, _playbackSampleRate );
         alSourceQueueBuffers( _playbackHandle, 2, _playbackBuffers );
         FillBufferSilence( 0, chunkSize );
         FillBufferSilence( 1, chunkSize );
         FillBufferSilence( 2, chunkSize );
         FillBufferSilence( 3, chunkSize );
         CheckALError();
-        delete[] data;
 
       alSourcePlay( _playbackHandle );
       CheckALError();
@@ -768,16 +896,60 @@ bool OpenALManager::Stop( int channel )
   // It is the responsiblity of buffer monitoring to make sure that we stop
   // copying data from a secondary buffer that is no longer playing.
   _secondaryBuffers[channel]->_mutex->Lock();
-  _secondaryBuffers[channel]->_isPlaying = false;
+  bool result = _mixer->PostCommand( MIXER_COMMAND_STOP, channel );
+  if( result )
+  {
+      _activeChannels->Remove( channel );
+  }
   _secondaryBuffers[channel]->_mutex->Unlock();
   EmptyBuffer( channel );
 
-  return true;
+  return result;
+}
+
+/**
+  @brief  Works out how many samples to wait for before reading the capture device.
+*/
+int OpenALManager::GetCaptureChunkSize()
+{
+  // Limit our capture chunk size to the largest size we can actually send out on the network.
+  int frameBytes = GetCaptureFrameBytes();
+  int captureChunkSize = (int)(_captureSampleRate * _bufferLatency); // Calculated in frames.
+  if( captureChunkSize > (CAPTURE_CHUNK_SIZE / frameBytes ) ) // Compared in frames.
+  {
+      captureChunkSize = (CAPTURE_CHUNK_SIZE / frameBytes ); // Calculated in frames.
+  }
+  return captureChunkSize;
 }
 
 /**
-  @brief  Monitors the record buffer and processes data if necessary.
-  This is called continuously by the run() method.
+  @brief  Blocks the capture thread until a chunk should have been recorded.
+  OpenAL has no way to signal that capture data has arrived, so this sleeps for as long as
+  the rest of the chunk takes to record at the capture rate.
+*/
+void OpenALManager::WaitForCapture( int msec )
+{
+  int samplesAvailable = 0;
+  if( _captureInited && _capturing && _captureDevice != NULL && _captureSampleRate > 0 )
+  {
+      alcGetIntegerv( _captureDevice, ALC_CAPTURE_SAMPLES, sizeof(int), &samplesAvailable );
+      int samplesMissing = GetCaptureChunkSize() - samplesAvailable;
+      if( samplesMissing <= 0 )
+      {
+          return;
+      }
+      int missingMsec = (int)( samplesMissing * 1000 / _captureSampleRate ) + 1;
+      if( missingMsec < msec )
+      {
+          msec = missingMsec;
+      }
+  }
+  wxThread::Sleep( msec );
+}
+
+/**
+  @brief  Monitors the record buffer and reads it into the capture ring if necessary.
+  This is called continuously by the capture thread.
 */
 int OpenALManager::MonitorCaptureBuffer()
 {
@@ -789,12 +961,7 @@ int OpenALManager::MonitorCaptureBuffer()
       return false;
   }
 
-  // Limit our capture chunk size to the largest size we can actually send out on the network.
-  int captureChunkSize = (int)(_captureSampleRate * _bufferLatency); // Calculated in samples.
-  if( captureChunkSize > (CAPTURE_CHUNK_SIZE / BYTES_PER_WORD ) ) // Compared in samples.
-  {
-      captureChunkSize = (CAPTURE_CHUNK_SIZE / BYTES_PER_WORD ); // Calculated in samples.
-  }
+  int captureChunkSize = GetCaptureChunkSize();
 
   alcGetIntegerv( _captureDevice, ALC_CAPTURE_SAMPLES, sizeof(int), &samplesAvailable );
   if( CheckALCError(_captureDevice) )
@@ -810,24 +977,35 @@ int OpenALManager::MonitorCaptureBuffer()
       return true;
   }
 
-  unsigned char data[CAPTURE_CHUNK_SIZE];
-  memset( data, 0, CAPTURE_CHUNK_SIZE );
-  alcCaptureSamples( _captureDevice, data, captureChunkSize );
-  if( CheckALCError(_captureDevice) )
+  // The device was opened at _captureSampleRate, so it reads straight into the capture ring.
+  // Everything waiting is taken so the capture thread doesn't fall behind the device.  The
+  // free space may wrap, in which case it takes two reads.
+  int samplesToRead = samplesAvailable;
+  // OpenAL can't say when the samples were captured, so assume the newest just arrived.
+  StampCapture( samplesAvailable );
+  while( samplesToRead > 0 )
   {
+      unsigned char* region;
+      int regionSamples = _captureRing.GetWriteRegion( &region, samplesToRead * GetCaptureFrameBytes() ) / GetCaptureFrameBytes();
+      if( regionSamples <= 0 )
+      {
+          // A subscriber is holding the space.  Leave the rest in the device for the next pass.
+          break;
+      }
+      if( regionSamples > samplesToRead )
+      {
+          regionSamples = samplesToRead;
+      }
+      alcCaptureSamples( _captureDevice, region, regionSamples );
+      if( CheckALCError(_captureDevice) )
+      {
 #ifdef WIN32
-      MessageBox( NULL, _("Unable to read capture buffer."), _("Error"), MB_OK );
+          MessageBox( NULL, _("Unable to read capture buffer."), _("Error"), MB_OK );
 #endif
-  }
-  // OK TO HERE
-  if( _recordingCallback != NULL )
-  {
-      int resampleTarget = captureChunkSize * _captureSampleRate / MAX_SAMPLE_RATE;
-
-      // THIS line of code is responsible for all of the pops and clicks.
-      _recordResampler.Resample( data, captureChunkSize, resampleTarget, BYTES_PER_WORD, 1 );
-
-      _recordingCallback->ForwardRecordedData( data, (resampleTarget * BYTES_PER_WORD), _captureSampleRate);
+          break;
+      }
+      _captureRing.CommitWrite( regionSamples * GetCaptureFrameBytes() );
+      samplesToRead -= regionSamples;
   }
 
   return true;
@@ -847,14 +1025,12 @@ void* OpenALManager::Entry()
 //  int count;
   while(!TestDestroy())
   { 
-      // Grab and process any captured data.
-
-      MonitorCaptureBuffer();
+      _realtime.ApplyIfPending();
 
-      // Call MonitorBuffer() here to make sure we fill the secondary buffers with
-      // silence if nothing is being received.
+      // Pick up any Play(), Stop(), volume, or other changes made since the last pass.
+      _mixer->ApplyCommands();
 
-      MonitorBuffer();
+      // Capture is read on its own thread.  See StartCapture().
 
       // Now that we're sure we have something in our secondary buffers we can mix in
       // some data if we need to.
@@ -901,6 +1077,15 @@ bool OpenALManager::StartCapture( )
 
   _capturing = true;
 
+  // Capture is read on its own thread so that neither the mix nor the recording callback
+  // can hold the other up.
+  if( !StartCaptureThread( _realtime.GetConfig() ) )
+  {
+      _capturing = false;
+      alcCaptureStop( _captureDevice );
+      return false;
+  }
+
   return true;
 }
 
@@ -912,6 +1097,9 @@ bool OpenALManager::StartCapture( )
 */
 bool OpenALManager::StopCapture( )
 {
+  _capturing = false;
+  StopCaptureThread();
+
   CheckALCError(_captureDevice);
   alcCaptureStop( _captureDevice );
 
@@ -922,8 +1110,6 @@ bool OpenALManager::StopCapture( )
 #endif
   }
 
-  _capturing = false;
-
   return true;
 }
 
@@ -938,51 +1124,7 @@ bool OpenALManager::IsBufferPlaying( int channel )
   }
 
   // Returns the status of a secondary buffer.
-  _secondaryBuffers[channel]->_mutex->Lock();
-  bool playing = _secondaryBuffers[channel]->_isPlaying;
-  _secondaryBuffers[channel]->_mutex->Unlock();
-
-  return playing;
-}
-
-/**
-     @brief     Monitors secondary buffers and pads them with silence if necessary.
-     This function is here to monitor the secondary sound buffers and add silence ot them if
-     necessary in order to avoid underruns, which tend to sound like pops, clicks, and static.
-     It will keep at least one "chunk" of data in a secondary buffer, a chunk being the size
-     of a piece of data normally read to the primary buffer.
-     @return
-     No return values.
-     @note
-     The amount of data that MonitorBuffer tries to keep in a secondary buffer is dependent upon
-     the buffer latency value.
-*/
-void OpenALManager::MonitorBuffer()
-{
-  int count;
-  int readAvail;
-  int chunkSize;
-  for( count = 0; count < _numBuffers; count++ )
-  {
-    _secondaryBuffers[count]->_mutex->Lock();
-    bool state = _secondaryBuffers[count]->_isPlaying;
-    _secondaryBuffers[count]->_mutex->Unlock();
-    if( state == false )
-    {
-	    continue;
-    }
-    _secondaryBuffers[count]->_mutex->Lock();
-    // Our buffer needs silence if we have less than one record chunk of data left in it.
-    readAvail = (_secondaryBuffers[count]->_bufferData)->GetReadAvail();
-    chunkSize = (int)_secondaryBuffers[count]->_chunkSize;
-    _secondaryBuffers[count]->_mutex->Unlock();
-    if( readAvail < chunkSize )
-	{
-	  //FillBufferSilence( count, chunkSize );
-	}
-  }
-
-  return;
+  return _activeChannels->Contains( channel );
 }
 
 /**
@@ -1057,7 +1199,9 @@ bool OpenALManager::CheckALError( void )
 
 /**
   @brief  Sets the latency of buffers in milliseconds.
-  Sets the latency for primary, secondary, and capture buffers in milliseconds.
+  Sets the latency for primary, secondary, and capture buffers in milliseconds.  This is safe
+  to call while playing: the mixer builds its scratch space for the new block size here and
+  the audio thread switches to it between blocks.
    @note
   The playback latency will be twice the buffer latency value because it gets the
   delay once for secondary buffer monitoring and once for primary buffer monitoring.
@@ -1069,25 +1213,119 @@ void OpenALManager::SetBufferLatency( int msec )
   {
       return;
   }
-  // This would be EXTREMELY non-thread-safe if called while the app was running.
-  //
-  // Any dialog or entry point that allows changing this number should be grayed
-  // or disabled while the app is running (such as how it is done in the Digital Radio).
   _bufferLatency = (double)msec / 1000.0;
 
   int channel;
   for( channel = 0; channel < _numBuffers; channel++ )
   {
       _secondaryBuffers[channel]->_mutex->Lock();
-      _secondaryBuffers[channel]->_chunkSize = (int)(_bufferLatency * _secondaryBuffers[channel]->_sampleRate * _secondaryBuffers[channel]->_bytesPerSample);
-      // Make it an even number.
-      _secondaryBuffers[channel]->_chunkSize &= ~1;
+      _secondaryBuffers[channel]->UpdateChunkSize( _bufferLatency );
       _secondaryBuffers[channel]->_mutex->Unlock();
   }
 
+  if( _inited )
+  {
+      _mixer->Reconfigure( _bufferLatency );
+  }
+  else
+  {
+      AllocateMixArena();
+  }
+
   return;
 }
 
+/**
+  @brief  Spreads mixing over extra threads when many channels are playing.
+  Each of the numThreads workers only joins in once there are at least minChannelsPerThread
+  channels for it, so light loads are still mixed entirely on the audio thread.  Pass zero
+  to go back to single-threaded mixing.
+  @note
+  This replaces the mixer's workers and their scratch space, so it must not be called while
+  the app is running.
+*/
+bool OpenALManager::SetMixThreads( int numThreads, int minChannelsPerThread )
+{
+  if( numThreads < 0 )
+  {
+      return false;
+  }
+  return _mixer->SetWorkerCount( numThreads, minChannelsPerThread );
+}
+
+/**
+  @brief  Requests real-time scheduling, CPU affinity, and memory locking for the mixing thread.
+  The settings are applied by Entry() on its next pass, and to any mix workers when they
+  next wake.  Check GetRealtimeReport() afterwards to see what the system allowed.
+*/
+bool OpenALManager::SetRealtimeConfig( const RealtimeConfig& config )
+{
+  _realtime.SetConfig( config );
+  _mixer->SetRealtimeConfig( config );
+  if( _captureThread != NULL )
+  {
+      _captureThread->_realtime.SetConfig( config );
+  }
+  return true;
+}
+
+/**
+  @brief  Returns which of the real-time settings took effect.
+*/
+RealtimeReport OpenALManager::GetRealtimeReport()
+{
+  return _realtime.GetReport();
+}
+
+/**
+  @brief  Turns adaptive latency on or off and sets its bounds.
+  Nothing changes until UpdateLatency() is called.
+*/
+bool OpenALManager::SetLatencyConfig( const LatencyConfig& config )
+{
+  _latencyControl.SetConfig( config );
+  return true;
+}
+
+/**
+  @brief  Lets the latency controller act on what has happened since the last call.
+  Call this every few hundred milliseconds from a timer or other non-audio thread, since a
+  change goes through SetBufferLatency().
+  @return
+  The buffer latency in milliseconds after any change.
+*/
+int OpenALManager::UpdateLatency()
+{
+  int latency = (int)(_bufferLatency * 1000.0 + 0.5);
+  if( !_inited )
+  {
+      return latency;
+  }
+  int newLatency = _latencyControl.Update( latency, _mixer );
+  if( newLatency != latency )
+  {
+      SetBufferLatency( newLatency );
+  }
+  return (int)(_bufferLatency * 1000.0 + 0.5);
+}
+
+/**
+  @brief  Returns the latency changes made since the last call, with the reason for each.
+*/
+std::vector<LatencyDecision> OpenALManager::TakeLatencyDecisions()
+{
+  return _latencyControl.TakeDecisions();
+}
+
+/**
+  @brief  Sizes the mixer's scratch space for the current latency.
+  Called from Init() and SetBufferLatency().
+*/
+void OpenALManager::AllocateMixArena()
+{
+  _mixer->Allocate( _bufferLatency, _playbackSampleRate, MAX_SAMPLE_RATE );
+}
+
 /**
  @brief  Grabs data from the capture buffer and forwards it to the appropriate function.
 */
@@ -1106,13 +1344,62 @@ int OpenALManager::GetPeak( int channel )
         return 0;
     }
 
-    _secondaryBuffers[channel]->_mutex->Lock();
-    int peak = _secondaryBuffers[channel]->_peak;
-    _secondaryBuffers[channel]->_mutex->Unlock();
-    return peak;
+    // The mixer publishes meter levels atomically, so the UI never waits on the audio thread.
+    return _secondaryBuffers[channel]->_peak.load( std::memory_order_relaxed );
+}
+
+int OpenALManager::GetRms( int channel )
+{
+    if( channel < 0 || channel >= _numBuffers )
+    {
+        return 0;
+    }
+
+    return _secondaryBuffers[channel]->_rms.load( std::memory_order_relaxed );
+}
+
+int OpenALManager::GetMasterPeak()
+{
+    return _mixer->GetMasterPeak();
+}
+
+int OpenALManager::GetMasterRms()
+{
+    return _mixer->GetMasterRms();
 }
 
+/**
+  @brief  Returns the number of bytes waiting in a secondary buffer.
+  Kept in bytes for existing callers; use GetNumFramesQueued() for a count in frames.
+*/
 int OpenALManager::GetNumSamplesQueued(int channel)
+{
+	return GetNumBytesQueued(channel);
+}
+
+/**
+  @brief  Returns the number of frames waiting in a secondary buffer.
+  Frames are counted at the channel's own sample rate.  Use GetPlaybackPosition() to include
+  what has already been mixed but not yet heard.
+*/
+int OpenALManager::GetNumFramesQueued(int channel)
+{
+	if( channel < 0 || channel >= _numBuffers )
+	{
+		return 0;
+	}
+	int value;
+	_secondaryBuffers[channel]->_mutex->Lock();
+	value = _secondaryBuffers[channel]->_bufferData->GetReadAvail() /
+		( _secondaryBuffers[channel]->_bytesPerSample * _secondaryBuffers[channel]->_channels );
+	_secondaryBuffers[channel]->_mutex->Unlock();
+	return value;
+}
+
+/**
+  @brief  Returns the number of bytes waiting in a secondary buffer.
+*/
+int OpenALManager::GetNumBytesQueued(int channel)
 {
 	if( channel < 0 || channel >= _numBuffers )
 	{
@@ -1125,6 +1412,28 @@ int OpenALManager::GetNumSamplesQueued(int channel)
 	return value;
 }
 
+/**
+  @brief  Reports how much of a channel has been heard and how long new data will take to be heard.
+  Combines the data waiting in the secondary buffer with the mixer's record of what it has
+  handed to the device.  Use it to keep video or other events in step with the sound.
+  @return
+  false if the channel doesn't exist.
+*/
+bool OpenALManager::GetPlaybackPosition( int channel, PlaybackPosition* position )
+{
+	if( channel < 0 || channel >= _numBuffers || position == NULL )
+	{
+		return false;
+	}
+	SecondaryBuffer* buffer = _secondaryBuffers[channel];
+	buffer->_mutex->Lock();
+	int bufferedFrames = buffer->_bufferData->GetReadAvail() / ( buffer->_bytesPerSample * buffer->_channels );
+	unsigned int sampleRate = buffer->_sampleRate;
+	buffer->_mutex->Unlock();
+	*position = _mixer->GetPosition( channel, bufferedFrames, sampleRate );
+	return true;
+}
+
 int OpenALManager::GetWriteBytesAvailable(int channel)
 {
 	if( channel < 0 || channel >= _numBuffers )
@@ -1138,134 +1447,30 @@ int OpenALManager::GetWriteBytesAvailable(int channel)
 	return value;
 }
 
+/**
+  @brief  Has the mixer build a block from the secondary buffers and queues it on the source.
+*/
 bool OpenALManager::MixAudio(ALuint workingBuffer)
 {
-  int writePos = 0;     // Write positions of the buffer.
-  int counter = 0;      // Data iterator.
-  int bytesWritten = 0;
-  int channel = 0;      // Channel iterator.
-
   // Statistical data on pauses, re-inits, underruns, overflows, etc.
   static int nodata = 0;
-  static int nobytesread = 0;
-  static int misreads = 0;
-
-  // Calculate the size of buffer we need to mix a chunk of 16-bit stereo data for the length of time
-  // defined by our latency and sample rate.
-  int maxBufferSize = (int)(_playbackSampleRate * 2 * _bufferLatency * _playbackByteAlign);
-  maxBufferSize &= ~3;
-  // Buffer for a single channel's data.
-  unsigned char* channelData = new unsigned char[maxBufferSize];
-  memset( channelData, 0, maxBufferSize );
-  // Buffer for mixed data.
-  unsigned char *copyBuffer = new unsigned char[maxBufferSize];
-  memset( copyBuffer, 0, maxBufferSize );
-  int bytesRead;
-
-  // Get our volume modifier per-channel.
-  double* rightVolumeAdjustment = new double[_numBuffers];
-  double* leftVolumeAdjustment = new double[_numBuffers];
-  CalculateChannelVolume(leftVolumeAdjustment, rightVolumeAdjustment);
-
-  // Get data from our secondary buffers and mix it all together.
-  for( channel = 0; channel < _numBuffers; channel++ )
-  {
-      // Tracking for V/U meters.
-      int maxValue = 0;
 
-      // Don't mix it if it isn't playing.
-      _secondaryBuffers[channel]->_mutex->Lock();
-      bool status = _secondaryBuffers[channel]->_isPlaying;
-      _secondaryBuffers[channel]->_mutex->Unlock();
-      if( status == false )
-      {
-	    continue;
-      }
+  // The mixer reads, resamples, and pans every playing channel into one block of stereo frames.
+  // Its scratch space was sized by Init() or SetBufferLatency(), so nothing here touches the heap.
+  short* copyBuffer = _mixer->GetBlockBuffer();
+  int numFrames = _mixer->GetBlockFrames();
+  int framesMixed = _mixer->MixBlock( copyBuffer, numFrames, _masterVolume );
 
-      // Set set our chunk size and grab a chunk of data.  Make sure we are requesting an
-      // even number of bytes.  Not doing so would hose every other chunk of data.
-      _secondaryBuffers[channel]->_mutex->Lock();
-      // Reset peaked data - this is a per-chunk test.
-      int bytesRequested = (int)(_secondaryBuffers[channel]->_sampleRate * _bufferLatency * _secondaryBuffers[channel]->_bytesPerSample );
-      bytesRequested &= ~1;
-
-      bytesRead = (_secondaryBuffers[channel]->_bufferData)->Read( channelData, bytesRequested );
-      _secondaryBuffers[channel]->_mutex->Unlock();
-
-#ifdef _DEBUG
-  // Log in debug mode only.
-  FILE* fp;
-  char filename[64];
-  memset( filename, 0, 64 );
-  _snprintf( filename, 64, "getdatafrombuffer%d.raw", channel );
-  if( (fp = fopen( filename, "ab" ) ))
-  {
-     fwrite( channelData, bytesRead, 1, fp );
-     fclose( fp );
-  }
-#endif
-
-
-      // We can't mix a channel if it doesn't give us any data.  If we get nothing, we fake it
-      // with blank data.
-      if( bytesRead == 0 )
-      {
-          nobytesread++;
-          memset( channelData, 0, maxBufferSize );
-		  continue;
-      }
-      else if( bytesRead != bytesRequested )
-      {
-		  int difference = bytesRequested - bytesRead;
-          misreads++;
-      }
-
-      // Add our result to the copy buffer.
-      //
-      // Note that with four channels being mixed down, it would be very easy to get some ugly
-      // digital clipping due to volume overflow.  If it sounds bad, turn down the master volume.
-      //
-      // Cast these to two-byte shorts in order to allow ourselves to multiply each sample by a float without
-      // breaking things.  Things will break if a short isn't two bytes.
-      short* sampleBuffer = (short *)channelData;
-      short* shortCopyBuffer = (short *)copyBuffer;
-	  int channelOffset = channel % 2;
-      for( counter = 0; counter < (bytesRead / 2); counter++ )
-      {
-          writePos = counter * 2 + channelOffset;
-          if( abs(sampleBuffer[counter]) > maxValue )
-          {
-			maxValue = abs(sampleBuffer[counter]);
-          }
-          shortCopyBuffer[writePos] += (sampleBuffer[counter] * leftVolumeAdjustment[channel] );
-      }
-
-	  // Set the number of bytes written to the max number of bytes written for any channel.
-	  if( bytesWritten < bytesRead)
-	  {
-		bytesWritten = bytesRead;
-	  }
-      _secondaryBuffers[channel]->_mutex->Lock();
-      _secondaryBuffers[channel]->_peak = maxValue;
-      _secondaryBuffers[channel]->_mutex->Unlock();
-  } // Cycle through channels.
-  delete[] leftVolumeAdjustment;
-  delete[] rightVolumeAdjustment;
-  delete[] channelData;
-
-  // If we wrote no data, set our write length to the length of the blank buffer intead
-  // of that of the number of bytes we've written.  This relies on the channelData being
-  // initially memset to all zeroes.
-  if( bytesWritten == 0 )
+  // If the channels ran short, only queue what they gave us.  If they gave us nothing, queue a
+  // whole block of silence so the source keeps running.
+  if( framesMixed == 0 )
   {
       nodata++;
-      bytesWritten = maxBufferSize;
+      framesMixed = numFrames;
   }
+  int bytesWritten = framesMixed * STEREO * BYTES_PER_WORD;
 
   // Put it in the buffer
-  //
-  // We take the number of bytes of data in our mixing buffer and divide it by the two
-  // bytes per sample we are using and two channels for the number of frames.
 #ifdef _DEBUG
   // Log in debug mode only.
   FILE* fp;
@@ -1282,8 +1487,14 @@ bool OpenALManager::MixAudio(ALuint workingBuffer)
   alSourceQueueBuffers( _playbackHandle, 1, &workingBuffer);
   CheckALError();
 
-  // Free the buffer we were sending to snd_pcm_writei
-  delete[] copyBuffer;
+  // AL_SAMPLE_OFFSET counts from the start of the queue, which is the buffer now playing.
+  // Every buffer but the one just queued is taken to be a full block.
+  ALint buffersqueued = 0;
+  ALint sampleOffset = 0;
+  alGetSourcei( _playbackHandle, AL_BUFFERS_QUEUED, &buffersqueued );
+  alGetSourcei( _playbackHandle, AL_SAMPLE_OFFSET, &sampleOffset );
+  int delayFrames = ( buffersqueued - 1 ) * numFrames + framesMixed - sampleOffset;
+  _mixer->PublishPosition( delayFrames > framesMixed ? delayFrames : framesMixed );
 
   RestartBufferIfNecessary();
 
@@ -1321,34 +1532,6 @@ void OpenALManager::RestartBufferIfNecessary()
   }
 }
 
-// Calculates the volume on each channel based on volume, pan, and master volume settings.
-void OpenALManager::CalculateChannelVolume(double * rightVolumeAdjustment, double * leftVolumeAdjustment)
-{
-  int channel = 0;
-
-  // Set up our volume+pan multipliers for each channel to make this run a little quicker.
-  for( channel = 0; channel < _numBuffers; channel++ )
-  {
-      // We are using pan to attenuate the channel that we're panning away from, but we are not increasing
-      // the volume on the channel we've panned toward.  Doing so would put us in danger of digital clipping
-      // unless we limit the volume adjustment values to 1.0.
-      _secondaryBuffers[channel]->_mutex->Lock();
-      if( _secondaryBuffers[channel]->_pan < 0 )
-      {
-	    leftVolumeAdjustment[channel] = ((_secondaryBuffers[channel]->_volume + 9600.0) / 9600.0) * ((_masterVolume + 9600.0) / 9600.0f);
-	    rightVolumeAdjustment[channel] = ((_secondaryBuffers[channel]->_pan + 1000.0) / 1000.0) *
-	      ((_secondaryBuffers[channel]->_volume + 9600.0) / 9600.0) * ((_masterVolume + 9600.0) / 9600.0);
-      }
-      else
-      {
-	    leftVolumeAdjustment[channel] = ((_secondaryBuffers[channel]->_pan * -1.0f + 1000.0 ) / 1000.0) *
-	      ((_secondaryBuffers[channel]->_volume + 9600.0) / 9600.0 ) * ((_masterVolume + 9600.0) / 9600.0);
-	    rightVolumeAdjustment[channel] = ((_secondaryBuffers[channel]->_volume + 9600.0) / 9600.0) * ((_masterVolume + 9600.0) / 9600.0f);
-      }
-      _secondaryBuffers[channel]->_mutex->Unlock();
-  }
-}
-
 //// Changes data from the channel sample rate to our playback sample rate.
 //int OpenALManager::ResampleChunk(unsigned char* channelData, int channelNumber, int bytesRead, int bytesRequested)
 //{
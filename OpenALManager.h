@@ -5,11 +5,14 @@
 #ifndef __WXMAC__
 
 #include "RingBuffer.h"
+#include "ActiveChannelList.h"
+#include "Mixer.h"
 #include "al.h"
 #include "alc.h"
 // On Linux, this Requires that alut-dev be installed:
 #include "alut.h"
 #include <vector>
+#include <atomic>
 
 #include "AudioRecordingCallback.h"
 #include "SecondaryBuffer.h"
@@ -32,13 +35,14 @@ public:
 	/// Get individual secondary buffer sample rate.
 	unsigned int GetSampleRate(int channel);
     bool Init(void *parentWindow = NULL, int* soundCard = NULL, const char *name = NULL);
-	bool CreateCaptureBuffer( AudioRecordingCallback * recordCallback = NULL, int* soundCard = NULL, const char *name = NULL);
+	bool CreateCaptureBuffer( AudioRecordingCallback * recordCallback = NULL, int* soundCard = NULL, const char *name = NULL,
+	                          int numChannels = MONO, int sampleFormat = SAMPLE_FORMAT_S16 );
 
-	int MonitorCaptureBuffer();
     bool CheckALError( void );
     bool CheckALCError( ALCdevice* device );
 
     virtual bool UnInit();
+	virtual int MonitorCaptureBuffer();
 	virtual bool Play();
 	virtual bool Stop();
 	virtual bool Stop( int channel );
@@ -46,6 +50,8 @@ public:
 	virtual bool StopCapture();
 	virtual bool SetSampleRate( int channel, unsigned int frequency );
 	virtual bool SetRecordSampleRate( unsigned int sampleRate );
+	virtual bool SetChannelCount( int channel, int numChannels );
+	virtual int GetChannelCount( int channel );
 	virtual bool IsBufferPlaying( int channel );
 	// Get global playback buffer sample rate.
 	virtual unsigned int GetSampleRate();
@@ -60,16 +66,26 @@ public:
     bool EmptyBuffer( int channel );
 	virtual bool FillBufferSilence( int channel, int length );
 	virtual void SetBufferLatency( int msec );
+	virtual bool SetMixThreads( int numThreads, int minChannelsPerThread = 32 );
+	virtual bool SetRealtimeConfig( const RealtimeConfig& config );
+	virtual RealtimeReport GetRealtimeReport();
+	virtual bool SetLatencyConfig( const LatencyConfig& config );
+	virtual int UpdateLatency();
+	virtual std::vector<LatencyDecision> TakeLatencyDecisions();
 	virtual int GetNumSamplesQueued( int channel );
+	virtual int GetNumBytesQueued( int channel );
+	virtual int GetNumFramesQueued( int channel );
+	virtual bool GetPlaybackPosition( int channel, PlaybackPosition* position );
     virtual void* Entry();
     int GetPeak( int channel );
+    int GetRms( int channel );
+    int GetMasterPeak();
+    int GetMasterRms();
 	int GetWriteBytesAvailable(int channel);
 private:
     // Virtual private methods.
 	/// Take the sound data and forward it when we have a notification.
 	virtual bool ProcessCapturedData();
-	/// Check whether we need to fill the buffer with silence.
-	virtual void MonitorBuffer();
 
     // Non-virtual private methods and data
     /// This function takes our secondary buffers and mixes them into a single stream to feed to the primary buffer.
@@ -82,18 +98,29 @@ private:
     ALCdevice* _captureDevice;
 	unsigned int _playbackByteAlign;
 	int _playbackFrames;
-	bool _capturing;
-	char * _captureBuffer;
+	/// Set by StartCapture() and StopCapture(), read by the capture thread.
+	std::atomic<bool> _capturing;
 	std::vector<SecondaryBuffer *> _secondaryBuffers;
+	/// Channels that are currently playing.  Maintained by Play() and Stop().
+	ActiveChannelList* _activeChannels;
+	/// Mixes the playing secondary buffers for MixAudio.
+	Mixer* _mixer;
+	/// Real-time settings for the thread that runs the mixer.
+	RealtimeThread _realtime;
+	/// Adapts the buffer latency to the underruns seen by the audio thread.
+	LatencyController _latencyControl;
+	void AllocateMixArena();
 	/// Number of bytes per sample, may be expanded to cover more formats.
     int _format;
 	/// We may need to add some variables to track our buffer playing.
 	//int XrunRecover( snd_pcm_t* handle, int err );
 	bool MixAudio(ALuint workingBuffer);
-	void CalculateChannelVolume(double* leftVolumeAdjustment, double* righVolumeAdjustment);
 	int ResampleChunk( unsigned char* channelData, int channelNumber, int bytesRead, int bytesRequested);
     virtual bool Play( int channel );
 	void RestartBufferIfNecessary( void );
+	virtual void WaitForCapture( int msec );
+	int GetCaptureChunkSize();
+	ALenum GetCaptureALFormat();
 };
 
 #endif
@@ -0,0 +1,194 @@
+#include "RealtimeThread.h"
+#include <memory.h>
+#include <errno.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+/// Largest stack pre-fault we will do.  Most thread stacks are at least this big.
+#define MAX_PREFAULT_STACK_BYTES (256 * 1024)
+/// Stack touched by each level of PrefaultStack().  One page on the usual systems.
+#define PREFAULT_STACK_STEP 4096
+
+/**
+ @brief  Touches bytes of stack below the caller, one PREFAULT_STACK_STEP frame per call.
+ Recursing keeps the stack used down to what was asked for.  volatile keeps the writes, and
+ reading the page back after the call stops the compiler turning the recursion into a loop.
+*/
+static void PrefaultStack( int bytes )
+{
+  volatile unsigned char page[PREFAULT_STACK_STEP];
+  page[0] = 0;
+  if( bytes > PREFAULT_STACK_STEP )
+  {
+      PrefaultStack( bytes - PREFAULT_STACK_STEP );
+  }
+  page[PREFAULT_STACK_STEP - 1] = page[0];
+}
+
+RealtimeThread::RealtimeThread()
+{
+  _pending = false;
+}
+
+RealtimeThread::~RealtimeThread()
+{
+}
+
+/**
+ @brief  Stores a new config for the audio thread to pick up.
+ Safe to call from any thread.  The report is cleared until the audio thread has applied it.
+*/
+void RealtimeThread::SetConfig( const RealtimeConfig& config )
+{
+  _mutex.Lock();
+  _config = config;
+  _report = RealtimeReport();
+  _mutex.Unlock();
+  _pending.store( true, std::memory_order_release );
+}
+
+RealtimeConfig RealtimeThread::GetConfig()
+{
+  _mutex.Lock();
+  RealtimeConfig config = _config;
+  _mutex.Unlock();
+  return config;
+}
+
+RealtimeReport RealtimeThread::GetReport()
+{
+  _mutex.Lock();
+  RealtimeReport report = _report;
+  _mutex.Unlock();
+  return report;
+}
+
+/**
+     @brief     Applies the pending config to the calling thread.
+     Each setting is tried on its own so that one being refused doesn't stop the others.
+     Asking for REALTIME_POLICY_NONE puts the thread back on the normal scheduler.
+*/
+void RealtimeThread::Apply()
+{
+  _pending.store( false, std::memory_order_relaxed );
+  RealtimeConfig config = GetConfig();
+  RealtimeReport report;
+
+#ifdef WIN32
+  // Windows has no policies as such; the time-critical class is the closest match.
+  int priority = config._policy == REALTIME_POLICY_NONE ? THREAD_PRIORITY_NORMAL : THREAD_PRIORITY_TIME_CRITICAL;
+  if( SetThreadPriority( GetCurrentThread(), priority ) )
+  {
+      report._scheduling = config._policy != REALTIME_POLICY_NONE;
+  }
+  else
+  {
+      report._schedulingError = (int)GetLastError();
+  }
+
+  if( config._cpu >= 0 )
+  {
+      if( SetThreadAffinityMask( GetCurrentThread(), ((DWORD_PTR)1) << config._cpu ) != 0 )
+      {
+          report._affinity = true;
+      }
+      else
+      {
+          report._affinityError = (int)GetLastError();
+      }
+  }
+
+  // There is no process-wide equivalent of mlockall.
+  if( config._lockMemory )
+  {
+      report._memoryError = ERROR_NOT_SUPPORTED;
+  }
+#else
+  struct sched_param param;
+  memset( &param, 0, sizeof(param) );
+  int policy = SCHED_OTHER;
+  if( config._policy == REALTIME_POLICY_FIFO )
+  {
+      policy = SCHED_FIFO;
+  }
+  else if( config._policy == REALTIME_POLICY_RR )
+  {
+      policy = SCHED_RR;
+  }
+  if( policy != SCHED_OTHER )
+  {
+      param.sched_priority = config._priority;
+      int minimum = sched_get_priority_min( policy );
+      int maximum = sched_get_priority_max( policy );
+      if( param.sched_priority < minimum )
+      {
+          param.sched_priority = minimum;
+      }
+      else if( param.sched_priority > maximum )
+      {
+          param.sched_priority = maximum;
+      }
+  }
+  // pthread functions return the error rather than setting errno.
+  int err = pthread_setschedparam( pthread_self(), policy, &param );
+  if( err == 0 )
+  {
+      report._scheduling = policy != SCHED_OTHER;
+  }
+  else
+  {
+      report._schedulingError = err;
+  }
+
+  if( config._cpu >= 0 )
+  {
+      cpu_set_t cpus;
+      CPU_ZERO( &cpus );
+      CPU_SET( config._cpu, &cpus );
+      err = pthread_setaffinity_np( pthread_self(), sizeof(cpus), &cpus );
+      if( err == 0 )
+      {
+          report._affinity = true;
+      }
+      else
+      {
+          report._affinityError = err;
+      }
+  }
+
+  // Locking current pages also faults them in, which covers buffers that were allocated
+  // before this point, such as the mixer's arena.
+  if( config._lockMemory )
+  {
+      if( mlockall( MCL_CURRENT | MCL_FUTURE ) == 0 )
+      {
+          report._memoryLocked = true;
+      }
+      else
+      {
+          report._memoryError = errno;
+      }
+  }
+#endif
+
+  if( config._prefaultStackBytes > 0 )
+  {
+      int bytes = config._prefaultStackBytes;
+      if( bytes > MAX_PREFAULT_STACK_BYTES )
+      {
+          bytes = MAX_PREFAULT_STACK_BYTES;
+      }
+      PrefaultStack( bytes );
+      report._stackPrefaulted = true;
+  }
+
+  report._applied = true;
+  _mutex.Lock();
+  _report = report;
+  _mutex.Unlock();
+}
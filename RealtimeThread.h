@@ -0,0 +1,85 @@
+#ifndef _REALTIMETHREAD_H_
+#define _REALTIMETHREAD_H_
+
+#include "wx/thread.h"
+#include <atomic>
+
+/// Scheduling policies a RealtimeConfig can ask for.
+#define REALTIME_POLICY_NONE 0
+#define REALTIME_POLICY_FIFO 1
+#define REALTIME_POLICY_RR 2
+
+/**
+     @brief     Real-time settings requested for an audio thread.
+     Everything is off by default, so a default-constructed config leaves the thread as a
+     normal thread.
+*/
+class RealtimeConfig
+{
+public:
+	RealtimeConfig() : _policy(REALTIME_POLICY_NONE), _priority(0), _cpu(-1), _lockMemory(false), _prefaultStackBytes(0) {};
+	/// One of the REALTIME_POLICY values.
+	int _policy;
+	/// Priority within the policy.  1 to 99 on Linux.
+	int _priority;
+	/// CPU to pin the thread to, or -1 to leave it free to move.
+	int _cpu;
+	/// Lock the process's current and future pages into memory.
+	bool _lockMemory;
+	/// Bytes of stack to touch so the thread never faults in a new stack page mid-mix.
+	int _prefaultStackBytes;
+};
+
+/**
+     @brief     Which parts of a RealtimeConfig actually took effect.
+     The error values are errno codes (or GetLastError() codes on Windows) from the call
+     that failed, such as EPERM when RLIMIT_RTPRIO doesn't allow the requested priority.
+     They are zero when the setting was applied or was not asked for.
+*/
+class RealtimeReport
+{
+public:
+	RealtimeReport() : _applied(false), _scheduling(false), _affinity(false), _memoryLocked(false), _stackPrefaulted(false),
+		_schedulingError(0), _affinityError(0), _memoryError(0) {};
+	/// The audio thread has picked up the current config.
+	bool _applied;
+	bool _scheduling;
+	bool _affinity;
+	bool _memoryLocked;
+	bool _stackPrefaulted;
+	int _schedulingError;
+	int _affinityError;
+	int _memoryError;
+};
+
+/**
+     @brief     Applies a RealtimeConfig on the thread it is meant for.
+     Scheduling and affinity calls only affect the calling thread, so SetConfig() just stores
+     the request.  The audio thread calls ApplyIfPending() from its loop or callback, which
+     costs one atomic load when nothing has changed.
+*/
+class RealtimeThread
+{
+public:
+	RealtimeThread();
+	~RealtimeThread();
+	void SetConfig( const RealtimeConfig& config );
+	RealtimeConfig GetConfig();
+	RealtimeReport GetReport();
+	/// Called on the audio thread.
+	void ApplyIfPending()
+	{
+		if( _pending.load( std::memory_order_acquire ) )
+		{
+			Apply();
+		}
+	}
+private:
+	void Apply();
+	wxMutex _mutex;
+	RealtimeConfig _config;
+	RealtimeReport _report;
+	std::atomic<bool> _pending;
+};
+
+#endif
@@ -6,6 +6,11 @@
 */
 Resampler::Resampler()
 {
+  _fromScratch = 0;
+  _toScratch = 0;
+  _fromScratchSize = 0;
+  _toScratchSize = 0;
+
   /// Initialize the resampling library (int highQuality, float lowRatio, float highRatio)
   // 0.9 for 48k -> 44.1k, 6 for 8k->48k
 
@@ -38,6 +43,134 @@ Resampler::~Resampler()
 {
   resample_close(_upSampleHandle);
   resample_close(_downSampleHandle);
+  unsigned int count;
+  for( count = 0; count < _extraUpSampleHandles.size(); ++count )
+  {
+	  resample_close( _extraUpSampleHandles[count] );
+	  resample_close( _extraDownSampleHandles[count] );
+  }
+  delete[] _fromScratch;
+  delete[] _toScratch;
+}
+
+/**
+ @brief  Makes sure ResampleInto can handle a chunk of the given size and channel count.
+ Call this from setup code so that ResampleInto never has to allocate on the audio thread.
+ Each channel of an interleaved stream keeps its own filter state.
+*/
+void Resampler::Reserve( int maxOriginalFrames, int maxResultingFrames, int numChannels )
+{
+  if( maxOriginalFrames > _fromScratchSize )
+  {
+	  delete[] _fromScratch;
+	  _fromScratch = new float[maxOriginalFrames];
+	  _fromScratchSize = maxOriginalFrames;
+  }
+  if( maxResultingFrames > _toScratchSize )
+  {
+	  delete[] _toScratch;
+	  _toScratch = new float[maxResultingFrames];
+	  _toScratchSize = maxResultingFrames;
+  }
+  while( (int)_extraUpSampleHandles.size() < numChannels - 1 )
+  {
+	  void* upSampleHandle = resample_open( 1, 1.0, 6.0 );
+	  void* downSampleHandle = resample_open( 1, 0.18, 1.0 );
+	  // Prime the new filters the same way the constructor does to avoid a pop on startup.
+	  float silence[512];
+	  float result[512];
+	  int srcused = 0;
+	  memset( silence, 0, sizeof(silence) );
+	  resample_process( upSampleHandle, 2.0, silence, 256, 0, &srcused, result, 512 );
+	  resample_process( downSampleHandle, 0.5, silence, 512, 0, &srcused, result, 256 );
+	  _extraUpSampleHandles.push_back( upSampleHandle );
+	  _extraDownSampleHandles.push_back( downSampleHandle );
+  }
+}
+
+/**
+     @brief     Resamples interleaved 16-bit audio into a caller-supplied buffer.
+     Unlike Resample(), the input is left alone and nothing is allocated as long as Reserve()
+     has been called with large enough sizes beforehand, or the caller supplies float scratch
+     buffers of at least originalNumFrames and resultingNumFrames.  Each channel is run through
+     its own filter and written back into the same position of the output frames.
+     @return
+     The number of frames written to output.
+*/
+int Resampler::ResampleInto( short* input, int originalNumFrames, short* output, int resultingNumFrames, int numChannels,
+                             float* fromScratch, float* toScratch )
+{
+  if( input == 0 || output == 0 || originalNumFrames <= 0 || resultingNumFrames <= 0 || numChannels <= 0 )
+	  return 0;
+
+  // Same rate, so there is nothing to interpolate.
+  if( originalNumFrames == resultingNumFrames )
+  {
+	  memcpy( output, input, originalNumFrames * numChannels * sizeof(short) );
+	  return resultingNumFrames;
+  }
+
+  if( fromScratch == 0 || toScratch == 0 )
+  {
+	  Reserve( originalNumFrames, resultingNumFrames, numChannels );
+	  fromScratch = _fromScratch;
+	  toScratch = _toScratch;
+  }
+  else
+  {
+	  // Only the filters for extra channels can be missing.  SetChannelCount() normally opens them.
+	  Reserve( 0, 0, numChannels );
+  }
+
+  double factor = (double)resultingNumFrames / (double)originalNumFrames;
+  int channel;
+  for( channel = 0; channel < numChannels; ++channel )
+  {
+	  int count;
+	  for( count = 0; count < originalNumFrames; ++count )
+	  {
+		  fromScratch[count] = (float)input[count * numChannels + channel] / 32767.0f;
+	  }
+
+	  int srcused = 0;
+	  int out;
+	  if( resultingNumFrames > originalNumFrames )
+	  {
+		  void* handle = (channel == 0) ? _upSampleHandle : _extraUpSampleHandles[channel - 1];
+		  out = resample_process(handle, factor, fromScratch, originalNumFrames, 0, &srcused,
+					 toScratch, resultingNumFrames);
+	  }
+	  else
+	  {
+		  void* handle = (channel == 0) ? _downSampleHandle : _extraDownSampleHandles[channel - 1];
+		  out = resample_process(handle, factor, fromScratch, originalNumFrames, 0, &srcused,
+					 toScratch, resultingNumFrames);
+	  }
+	  if( out < 0 )
+	  {
+		  out = 0;
+	  }
+
+	  for( count = 0; count < out; ++count )
+	  {
+		  float value = toScratch[count];
+		  if( value > 1.0f )
+		  {
+			  value = 1.0f;
+		  }
+		  else if( value < -1.0f )
+		  {
+			  value = -1.0f;
+		  }
+		  output[count * numChannels + channel] = (short)(value * 32767.0f);
+	  }
+	  // The filter may hold back a few samples on the first chunks; pad them with silence.
+	  for( ; count < resultingNumFrames; ++count )
+	  {
+		  output[count * numChannels + channel] = 0;
+	  }
+  }
+  return resultingNumFrames;
 }
 
 /**
@@ -2,6 +2,7 @@
 #define _RESAMPLER_H_
 
 #include "libresample.h"
+#include <vector>
 
 class Resampler
 {
@@ -9,9 +10,20 @@ public:
     Resampler();
     ~Resampler();
 	short* Resample( unsigned char* channelData, int originalNumSamples, int resultingNumSamples, int bytesPerSample, int numChannels );
+	int ResampleInto( short* input, int originalNumFrames, short* output, int resultingNumFrames, int numChannels = 1,
+	                  float* fromScratch = 0, float* toScratch = 0 );
+	void Reserve( int maxOriginalFrames, int maxResultingFrames, int numChannels = 1 );
 private:
   	void* _upSampleHandle;
     void* _downSampleHandle;
+    // Filter state for the second and later channels of an interleaved stream, opened by Reserve().
+    std::vector<void*> _extraUpSampleHandles;
+    std::vector<void*> _extraDownSampleHandles;
+    // Float scratch space for ResampleInto, grown by Reserve() and reused afterward.
+    float* _fromScratch;
+    float* _toScratch;
+    int _fromScratchSize;
+    int _toScratchSize;
 };
 
 #endif
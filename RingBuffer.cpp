@@ -9,6 +9,8 @@ RingBuffer::RingBuffer( int sizeBytes )
 	_readPtr = 0;
 	_writePtr = 0;
 	_writeBytesAvail = sizeBytes;
+	_writeCount = 0;
+	_readCount = 0;
 }
 
 RingBuffer::~RingBuffer( )
@@ -23,19 +25,44 @@ bool RingBuffer::Empty( void )
     _readPtr = 0;
     _writePtr = 0;
     _writeBytesAvail = _size;
+    _readCount = _writeCount;
     return true;
 }
 
+// Throw away everything that was written before GetWriteCount() returned
+// writeCount, keeping anything written since.  Called by the reading thread.
+int RingBuffer::Discard( unsigned int writeCount )
+{
+	int numBytes = (int)(writeCount - _readCount);
+	int readBytesAvail = _size - _writeBytesAvail.load( std::memory_order_acquire );
+	if( numBytes <= 0 )
+	{
+		return 0;
+	}
+	if( numBytes > readBytesAvail )
+	{
+		numBytes = readBytesAvail;
+	}
+	_readPtr = (_readPtr + numBytes) % _size;
+	_readCount += numBytes;
+	_writeBytesAvail.fetch_add( numBytes, std::memory_order_release );
+	return numBytes;
+}
+
+unsigned int RingBuffer::GetWriteCount( void )
+{
+	return _writeCount.load( std::memory_order_acquire );
+}
+
 int RingBuffer::Read( unsigned char *dataPtr, int numBytes )
 {
 	// If there's nothing to read or no data available, then we can't read anything.
-	if( dataPtr == 0 || numBytes <= 0 || _writeBytesAvail == _size )
+	int readBytesAvail = _size - _writeBytesAvail.load( std::memory_order_acquire );
+	if( dataPtr == 0 || numBytes <= 0 || readBytesAvail == 0 )
 	{
 		return 0;
 	}
 
-	int readBytesAvail = _size - _writeBytesAvail;
-
 	// Cap our read at the number of bytes available to be read.
 	if( numBytes > readBytesAvail )
 	{
@@ -51,8 +78,10 @@ int RingBuffer::Read( unsigned char *dataPtr, int numBytes )
 		memcpy(dataPtr, _data+_readPtr, numBytes);
 	}
 
+	// Only hand the space back to the writer once we are done copying out of it.
 	_readPtr = (_readPtr + numBytes) % _size;
-	_writeBytesAvail += numBytes;
+	_readCount += numBytes;
+	_writeBytesAvail.fetch_add( numBytes, std::memory_order_release );
 
 	return numBytes;
 }
@@ -62,15 +91,16 @@ int RingBuffer::Read( unsigned char *dataPtr, int numBytes )
 int RingBuffer::Write( unsigned char *dataPtr, int numBytes )
 {
 	// If there's nothing to write or no room available, we can't write anything.
-	if( dataPtr == 0 || numBytes <= 0 || _writeBytesAvail == 0 )
+	int writeBytesAvail = _writeBytesAvail.load( std::memory_order_acquire );
+	if( dataPtr == 0 || numBytes <= 0 || writeBytesAvail == 0 )
 	{
 		return 0;
 	}
 
 	// Cap our write at the number of bytes available to be written.
-	if( numBytes > _writeBytesAvail )
+	if( numBytes > writeBytesAvail )
 	{
-		numBytes = _writeBytesAvail;
+		numBytes = writeBytesAvail;
 	}
 
 	// Simulataneously keep track of how many bytes we've written and our position in the incoming buffer
@@ -82,8 +112,10 @@ int RingBuffer::Write( unsigned char *dataPtr, int numBytes )
 		memcpy(_data+_writePtr, dataPtr, numBytes);
 	}
 
+	// Publish the data to the reader only after it has been copied in.
 	_writePtr = (_writePtr + numBytes) % _size;
-	_writeBytesAvail -= numBytes;
+	_writeCount.fetch_add( numBytes, std::memory_order_relaxed );
+	_writeBytesAvail.fetch_sub( numBytes, std::memory_order_release );
 
 	return numBytes;
 }
@@ -95,11 +127,11 @@ int RingBuffer::GetSize( void )
 
 int RingBuffer::GetWriteAvail( void )
 {
-	return _writeBytesAvail;
+	return _writeBytesAvail.load( std::memory_order_acquire );
 }
 
 int RingBuffer::GetReadAvail( void )
 {
-	return _size - _writeBytesAvail;
+	return _size - _writeBytesAvail.load( std::memory_order_acquire );
 }
 
@@ -3,6 +3,7 @@
 #define RING_BUFFER_H
 
 #include <memory.h>
+#include <atomic>
 
 /**
 	@brief     Ring buffer class.
@@ -11,9 +12,11 @@
 	secondary buffer, but may have other uses.  Maintains internal read and
 	write pointers for filling and pulling data.
 
-	This is not thread-safe.  If you want to use this in a multithreaded
-	environment you will have to create your own mutex and lock it before
-	each read or write.
+	One thread may write while another reads without any locking: the fill
+	level is kept in an atomic that is only updated after the data has been
+	copied.  Several writers, or several readers, still need their own mutex.
+	Empty() is not safe while another thread is reading or writing; use
+	Discard() from the reading thread instead.
 
 	This buffer will only allow you to write a total number of bytes equal
 	to the size of the buffer.  If a write larger than the buffer is requested
@@ -32,6 +35,8 @@ public:
 	int Read( unsigned char* dataPtr, int numBytes );
 	int Write( unsigned char *dataPtr, int numBytes );
     bool Empty( void );
+	int Discard( unsigned int writeCount );
+	unsigned int GetWriteCount( );
 	int GetSize( );
 	int GetWriteAvail( );
 	int GetReadAvail( );
@@ -40,7 +45,10 @@ private:
 	int _size;
 	int _readPtr;
 	int _writePtr;
-	int _writeBytesAvail;
+	std::atomic<int> _writeBytesAvail;
+	/// Total bytes ever written and read.  They wrap around, and only their difference matters.
+	std::atomic<unsigned int> _writeCount;
+	unsigned int _readCount;
 };
 
 #endif
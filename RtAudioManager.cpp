@@ -4,8 +4,9 @@ using namespace std;
 
 #include "RtAudioManager.h"
 
-/// Define the size of our secondary buffer in frames.
-#define BUFFER_SIZE 4096
+/// Define the size of our secondary buffer in bytes.  This holds several blocks at the
+/// default latency, since the stream asks for a whole block on each callback.
+#define SECONDARY_BUFFER_SIZE 32768
 #define CAPTURE_CHUNK_SIZE 1400
 /// Used for resampling calculations and buffer info.
 #define MAX_SAMPLE_RATE 44100
@@ -19,7 +20,8 @@ using namespace std;
 RtAudioManager::RtAudioManager(int numBuffers)
 {
   _audio = NULL;
-  _format = RTAUDIO_FLOAT32;
+  // The mixer produces interleaved 16-bit stereo, so that is what the stream is opened with.
+  _format = RTAUDIO_SINT16;
   _capturing = false;
   _numBuffers = numBuffers;
   // These are the default values that we record and play at.  Other values will be resampled
@@ -29,11 +31,9 @@ RtAudioManager::RtAudioManager(int numBuffers)
   _playbackByteAlign = 2;
   /// Used to keep track of the number of frames in our playback buffer.
   _playbackFrames = 0;
+  _underruns = 0;
+  _outputLatency = 0;
   _captureSampleRate = MAX_SAMPLE_RATE;
-  // A chunk of data in our record buffer.
-  _recordBufferLength = (int)(_captureSampleRate * _bufferLatency * BYTES_PER_WORD);
-  _captureBuffer = new char[_recordBufferLength];
-  memset( _captureBuffer, 0, _recordBufferLength );
   int count;
   // Create volume and pan values.
   for( count = 0; count < _numBuffers; count++ )
@@ -41,24 +41,19 @@ RtAudioManager::RtAudioManager(int numBuffers)
       _secondaryBuffers.push_back( new SecondaryBuffer );
       _secondaryBuffers[count]->_volume = 0;
       _secondaryBuffers[count]->_pan = 0;
-      _secondaryBuffers[count]->_isPlaying = false;
       _secondaryBuffers[count]->_bytesPerSample = BYTES_PER_WORD;
+      _secondaryBuffers[count]->_channels = MONO;
       _secondaryBuffers[count]->_mutex = new wxMutex;
-      _secondaryBuffers[count]->_bufferData = new RingBuffer( BUFFER_SIZE );
+      _secondaryBuffers[count]->_bufferData = new RingBuffer( SECONDARY_BUFFER_SIZE );
       _secondaryBuffers[count]->_sampleRate = MAX_SAMPLE_RATE;
-      _secondaryBuffers[count]->_chunkSize = (int)(_bufferLatency * _secondaryBuffers[count]->_sampleRate * _secondaryBuffers[count]->_bytesPerSample);
-      // Chunk size MUST be an even number of bytes.
-      _secondaryBuffers[count]->_chunkSize &= ~1;
+      _secondaryBuffers[count]->UpdateChunkSize( _bufferLatency );
     }
-	// Higher thread priority in order to watch the sound buffers better.
-	/// Above normal thread priority so we can monitor the sound buffer a little better.
-	if( wxThread::Create(wxTHREAD_JOINABLE) != wxTHREAD_NO_ERROR )
-	{
-		wxMessageBox( _("Unable to create playlist thread"), _("ERROR"), wxOK );
-		return;
-	}
-	SetPriority(75);
-	Run();
+  // Tracks which channels are playing for IsBufferPlaying().  The mixer keeps its own list,
+  // updated through commands, so the audio thread never touches this one.
+  _activeChannels = new ActiveChannelList( _numBuffers );
+  _mixer = new Mixer( &_secondaryBuffers );
+  // No thread of our own is started.  RtAudio pulls playback through PlaybackCallback and
+  // capture runs on its own thread, so there is nothing left to poll.
 }
 
 /**
@@ -69,18 +64,12 @@ RtAudioManager::RtAudioManager(int numBuffers)
 */
 RtAudioManager::~RtAudioManager()
 {
-    if( _audio != NULL )
-    {
-        _audio->stopStream();
-        if( _audio->isStreamOpen() )
-        {
-            _audio->closeStream();
-        }
-    }
+    // The stream callback uses the mixer, so it has to be closed before anything is deleted.
     if( _inited )
     {
         UnInit();
     }
+    delete _audio;
     if( _captureInited )
     {
         DeleteCaptureBuffer();
@@ -90,7 +79,8 @@ RtAudioManager::~RtAudioManager()
     {
       delete _secondaryBuffers[count];
     }
-    delete[] _captureBuffer;
+    delete _mixer;
+    delete _activeChannels;
 
 }
 
@@ -149,16 +139,27 @@ bool RtAudioManager::Init(void *parentWindow, int* soundCard, const char *name)
         " input channels, " << info.duplexChannels << " duplex channels, " << info.nativeFormats << " native formats" << endl;
     parameters.nChannels = 2;
     parameters.firstChannel = 0;
-    unsigned int sampleRate = 44100;
-    unsigned int bufferFrames = BUFFER_SIZE; // 256 sample frames
+    // Size our mixing scratch space before the stream starts calling back for data, so the
+    // callback never has to allocate.
+    AllocateMixArena();
+
+    // Ask for one mixer block per callback.  RtAudio may pick something else, which
+    // PlaybackCallback handles by mixing in as many blocks as it takes.
+    unsigned int bufferFrames = (unsigned int)_mixer->GetBlockFrames();
     try {
-        _audio->openStream( &parameters, NULL, RTAUDIO_FLOAT64,
-                            sampleRate, &bufferFrames, FillBuffer, (void *)_musicStream );
+        _audio->openStream( &parameters, NULL, _format,
+                            _playbackSampleRate, &bufferFrames, PlaybackCallback, (void *)this );
+        _playbackFrames = bufferFrames;
+        _outputLatency = (int)_audio->getStreamLatency();
         _audio->startStream();
     }
     catch ( RtAudioError& e ) {
         e.printMessage();
-        exit( 0 );
+        if( _audio->isStreamOpen() )
+        {
+            _audio->closeStream();
+        }
+        return false;
     }
 
     _inited = true;
@@ -174,92 +175,65 @@ bool RtAudioManager::Init(void *parentWindow, int* soundCard, const char *name)
 */
 bool RtAudioManager::UnInit()
 {
+  _capturing = false;
+  StopCaptureThread();
+  if( _audio != NULL && _audio->isStreamOpen() )
+  {
+      try {
+          if( _audio->isStreamRunning() )
+          {
+              _audio->stopStream();
+          }
+          _audio->closeStream();
+      }
+      catch ( RtAudioError& e ) {
+          e.printMessage();
+      }
+  }
   _inited = false;
   return true;
 }
 
 /**
-     @brief     Mixes secondary buffers into main playback buffer.
-     This function mixes data from the secondary buffers into a main stereo buffer,
-	 including resampling and calculations for pan and volume settings, and then
-	 writes it to the soundcard.  This is the real workhorse of RtAudioManager.
+     @brief     RtAudio stream callback.
+     Called on the driver's audio thread whenever the device needs more data.  It hands the
+     request to the owning RtAudioManager, which mixes straight into the device's buffer.
      @return
-     returns false if the sound has not been initialized or is not playing.
+     0 to keep the stream running.
 */
-bool RtAudioManager::ProcessSoundBuffer( void )
+int RtAudioManager::PlaybackCallback( void* outputBuffer, void* inputBuffer, unsigned int numFrames,
+                                      double streamTime, RtAudioStreamStatus status, void* userData )
 {
-  static int skips = 0;
-  static int underruns = 0;
-  static int bufferscrewups = 0;
-  bool playing = false;
-  int channel = 0;      // Channel iterator.
-
-  if( !_inited )
+  RtAudioManager* manager = (RtAudioManager *)userData;
+  manager->_realtime.ApplyIfPending();
+  manager->_mixer->ApplyCommands();
+  if( status & RTAUDIO_OUTPUT_UNDERFLOW )
   {
-      return false;
-  }
-
-  // We only need to monitor the buffer if one of our sound streams is playing.  If it is not,
-  // then we can safely ignore it.
-  for( channel = 0; channel < _numBuffers; channel++ )
-  {
-      _secondaryBuffers[channel]->_mutex->Lock();
-      if( _secondaryBuffers[channel]->_isPlaying == true )
-      {
-	    playing = true;
-	  }
-      _secondaryBuffers[channel]->_mutex->Unlock();
-  }
-  // If we have nothing to monitor, we bail.
-  if( playing == false )
-  {
-      return false;
+      manager->_underruns++;
+      manager->_latencyControl.ReportUnderrun();
   }
+  manager->MixAudio( (short *)outputBuffer, (int)numFrames );
+  // The buffer just filled is played after whatever the device already holds.
+  manager->_mixer->PublishPosition( (int)numFrames + manager->_outputLatency );
+  return 0;
+}
 
-  //ALint state = 0;
-  //alGetSourcei( _playbackHandle, AL_SOURCE_STATE, &state ); // Will be: AL_PLAYING, AL_PAUSED, AL_STOPPED, or AL_INITIAL
-  // Check whether a buffer has been processed.  If we don't need to add data to the buffer
-  // we won't bother.
-  //ALint buffersprocessed = 0;
-  //alGetSourcei( _playbackHandle, AL_BUFFERS_PROCESSED, &buffersprocessed );
-  //ALint buffersqueued = 0;
-  //alGetSourcei( _playbackHandle, AL_BUFFERS_QUEUED, &buffersqueued );
-
-  /*if( buffersprocessed == 2 )
-  {
-        underruns++;
-        // If we're out of buffers it's time to unfuck things up.
-        //ALuint silenceBuffer;
-        //alSourceUnqueueBuffers( _playbackHandle, 1, &silenceBuffer );
-        //alSourceUnqueueBuffers( _playbackHandle, 1, &workingBuffer );
-        // Use the first buffer to put silence in and give ourselves room to work.
-        int chunkSize = (int)(_playbackSampleRate * _bufferLatency * BYTES_PER_WORD * STEREO );
-        char* data = new char[chunkSize];
-        memset( data, 0, chunkSize );
-        //alBufferData( silenceBuffer, _format, data, chunkSize, _playbackSampleRate );
-        //alSourceQueueBuffers( _playbackHandle, 1, &silenceBuffer );
-        delete[] data;
-        //alSourcePlay( _playbackHandle );
-        // The second buffer will be used to mix data to.
-  }
-  // Only unqueue a buffer and get it ready to fill if one has been processed.  Otherwise we may be
-  // ripping out buffers that have data that is waiting to be played.
-  else if( buffersprocessed > 0 )
+/**
+     @brief     Mixes secondary buffers into the device's buffer.
+     Pulls numFrames of mixed stereo from the Mixer, one block at a time if the device asked
+     for more than a block.  Runs on the RtAudio callback thread, so it must not block or
+     allocate.  The Mixer always fills the whole block, with silence if nothing is playing.
+*/
+void RtAudioManager::MixAudio( short* output, int numFrames )
+{
+  int blockFrames = _mixer->GetBlockFrames();
+  while( numFrames > 0 )
   {
-        //alSourceUnqueueBuffers( _playbackHandle, 1, &workingBuffer);
+      int frames = numFrames < blockFrames ? numFrames : blockFrames;
+      _mixer->MixBlock( output, frames, _masterVolume );
+      output += frames * STEREO;
+      numFrames -= frames;
   }
-  else
-  {
-      skips++;
-      if( buffersqueued == 0 )
-      {
-          bufferscrewups++;
-      }
-      return true;
-  }*/
-
-  return true;
-  //return MixAudio(workingBuffer);
 }
 
 /**
@@ -313,6 +287,12 @@ bool RtAudioManager::FillBufferSilence( int channel, int length )
 
   bool err;
 
+  // Use the mixer's silence whenever it is big enough so that the audio thread never allocates.
+  if( length <= _mixer->GetSilenceSize() )
+  {
+      return FillBuffer( channel, _mixer->GetSilence(), length, _secondaryBuffers[channel]->_sampleRate );
+  }
+
   unsigned char *data = new unsigned char[length];
   memset(data, 0, length );
 
@@ -330,17 +310,15 @@ bool RtAudioManager::EmptyBuffer( int channel )
         return false;
     }
 
-  _secondaryBuffers[channel]->_mutex->Lock();
-  bool result = (_secondaryBuffers[channel]->_bufferData)->Empty( );
-  _secondaryBuffers[channel]->_mutex->Unlock();
-    
-  return result;
+  // The mixer may be reading the buffer, so it empties it itself at the start of its next cycle.
+  return _mixer->PostEmpty( channel );
 }
 
 /**
   @brief  Creates the capture buffer and initializes audio capture.
 */
-bool RtAudioManager::CreateCaptureBuffer( AudioRecordingCallback * recordCallback, int* soundCard, const char *name )
+bool RtAudioManager::CreateCaptureBuffer( AudioRecordingCallback * recordCallback, int* soundCard, const char *name,
+                                          int numChannels, int sampleFormat )
 {
   /// Have to init the RtAudioManager first.
   if( !_inited )
@@ -350,12 +328,18 @@ bool RtAudioManager::CreateCaptureBuffer( AudioRecordingCallback * recordCallbac
 
   /// Set our recording callback, even if the buffer is already created - this
   /// allows us to change which callback we are using.
-  _recordingCallback = recordCallback;
+  SetRecordingCallback( recordCallback );
 
-  /// Buffer already created - don't create again.
+  /// Buffer already created - don't create again.  The format can only be changed by
+  /// deleting the capture buffer first.
   if( _captureInited )
   {
-      return true;
+      return numChannels == _captureChannels && sampleFormat == _captureSampleFormat;
+  }
+
+  if( !SetCaptureFormat( numChannels, sampleFormat ) )
+  {
+      return false;
   }
 
   //const ALCchar* captureDeviceString = alcGetString( NULL, ALC_CAPTURE_DEFAULT_DEVICE_SPECIFIER );
@@ -365,6 +349,11 @@ bool RtAudioManager::CreateCaptureBuffer( AudioRecordingCallback * recordCallbac
   // Buffer size is in samples, NOT in bytes.
   //_captureDevice = alcCaptureOpenDevice( captureDeviceString, _captureSampleRate, AL_FORMAT_MONO16, (_recordBufferLength / 2) );
 
+  if( !AllocateCaptureRing() )
+  {
+      return false;
+  }
+
   _captureInited = true;
 
   return true;
@@ -375,6 +364,8 @@ bool RtAudioManager::CreateCaptureBuffer( AudioRecordingCallback * recordCallbac
 */
 bool RtAudioManager::DeleteCaptureBuffer()
 {
+  _capturing = false;
+  StopCaptureThread();
   //alcCaptureCloseDevice( _captureDevice );
   _captureInited = false;
   return true;
@@ -420,15 +411,68 @@ bool RtAudioManager::SetSampleRate( int channel, unsigned int frequency )
   }
   _secondaryBuffers[channel]->_mutex->Lock();
 
-  _secondaryBuffers[channel]->_sampleRate = frequency;
+  // The mixer keeps its own copy of the rate.  Posting under the mutex keeps the commands in
+  // the same order as the changes made here.
+  bool result = _mixer->PostCommand( MIXER_COMMAND_SET_SAMPLE_RATE, channel, (int)frequency );
+  if( result )
+  {
+      _secondaryBuffers[channel]->_sampleRate = frequency;
 
-  // Changing our playback sample rate forces us to recalculate our chunk size.
-  _secondaryBuffers[channel]->_chunkSize = (int)(_bufferLatency * _secondaryBuffers[channel]->_sampleRate * _secondaryBuffers[channel]->_bytesPerSample);
-  // Chunk size MUST be an even number of bytes.
-  _secondaryBuffers[channel]->_chunkSize &= ~1;
+      // Changing our playback sample rate forces us to recalculate our chunk size.
+      _secondaryBuffers[channel]->UpdateChunkSize( _bufferLatency );
+  }
 
   _secondaryBuffers[channel]->_mutex->Unlock();
-  return true;
+  return result;
+}
+
+/**
+  @brief  Sets the number of interleaved channels in each frame of a secondary buffer.
+  Data written with FillBuffer must then be whole interleaved frames.  Mono buffers are
+  panned, stereo buffers use pan as balance, and wider buffers are folded down to stereo.
+  @note
+  Fails while the channel is playing, and for up to a block after Stop() while the audio
+  thread lets go of it.  Anything still queued in the old layout is discarded.
+*/
+bool RtAudioManager::SetChannelCount( int channel, int numChannels )
+{
+  if( channel < 0 || channel >= _numBuffers || numChannels < 1 || numChannels > MAX_SOURCE_CHANNELS )
+  {
+      return false;
+  }
+
+  _secondaryBuffers[channel]->_mutex->Lock();
+  // Data already queued would be read with the wrong frame stride, so the mixer drops it, and
+  // that is only safe once the channel has stopped.
+  if( _activeChannels->Contains( channel ) )
+  {
+      _secondaryBuffers[channel]->_mutex->Unlock();
+      return false;
+  }
+  bool result = _mixer->PostChannelCount( channel, numChannels );
+  if( result )
+  {
+      _secondaryBuffers[channel]->_channels = numChannels;
+      _secondaryBuffers[channel]->UpdateChunkSize( _bufferLatency );
+  }
+  _secondaryBuffers[channel]->_mutex->Unlock();
+  return result;
+}
+
+/**
+  @brief  Returns the number of interleaved channels in a secondary buffer.
+*/
+int RtAudioManager::GetChannelCount( int channel )
+{
+  if( channel < 0 || channel >= _numBuffers )
+  {
+      return 0;
+  }
+
+  _secondaryBuffers[channel]->_mutex->Lock();
+  int numChannels = _secondaryBuffers[channel]->_channels;
+  _secondaryBuffers[channel]->_mutex->Unlock();
+  return numChannels;
 }
 
 /**
@@ -470,7 +514,10 @@ void RtAudioManager::SetVolume( int channel, int volume )
   }
 
   _secondaryBuffers[channel]->_mutex->Lock();
-  _secondaryBuffers[channel]->_volume = volume;
+  if( _mixer->PostCommand( MIXER_COMMAND_SET_VOLUME, channel, volume ) )
+  {
+      _secondaryBuffers[channel]->_volume = volume;
+  }
   _secondaryBuffers[channel]->_mutex->Unlock();
 }
 
@@ -485,7 +532,10 @@ void RtAudioManager::SetPan( int channel, int pan )
   }
 
   _secondaryBuffers[channel]->_mutex->Lock();
-  _secondaryBuffers[channel]->_pan = pan;
+  if( _mixer->PostCommand( MIXER_COMMAND_SET_PAN, channel, pan ) )
+  {
+      _secondaryBuffers[channel]->_pan = pan;
+  }
   _secondaryBuffers[channel]->_mutex->Unlock();
 }
 
@@ -567,15 +617,20 @@ bool RtAudioManager::Play( int channel )
 //  int sampleRate = _secondaryBuffers[channel]->_sampleRate;
   _secondaryBuffers[channel]->_mutex->Unlock();
 
-  // Prime the buffer so we can be sure not to start off with crap.  As soon as _isPlaying is set to true
-  // this sucker could be off and running.
+  // Prime the buffer so we can be sure not to start off with crap.  As soon as the channel is in the
+  // active list this sucker could be off and running.
   EmptyBuffer( channel );
   //FillBufferSilence( channel, (int)(sampleRate * _bufferLatency) );
 
   // It is the responsiblity of buffer monitoring to make sure that data is actually
   // in the secondary buffer and to start copying it into the primary buffer.
   _secondaryBuffers[channel]->_mutex->Lock();
-  _secondaryBuffers[channel]->_isPlaying = true;
+  if( !_mixer->PostCommand( MIXER_COMMAND_PLAY, channel ) )
+  {
+      _secondaryBuffers[channel]->_mutex->Unlock();
+      return false;
+  }
+  _activeChannels->Add( channel );
   _secondaryBuffers[channel]->_mutex->Unlock();
 
   // Make sure the master buffer is playing.
@@ -711,16 +766,20 @@ bool RtAudioManager::Stop( int channel )
   // It is the responsiblity of buffer monitoring to make sure that we stop
   // copying data from a secondary buffer that is no longer playing.
   _secondaryBuffers[channel]->_mutex->Lock();
-  _secondaryBuffers[channel]->_isPlaying = false;
+  bool result = _mixer->PostCommand( MIXER_COMMAND_STOP, channel );
+  if( result )
+  {
+      _activeChannels->Remove( channel );
+  }
   _secondaryBuffers[channel]->_mutex->Unlock();
   EmptyBuffer( channel );
 
-  return true;
+  return result;
 }
 
 /**
-  @brief  Monitors the record buffer and processes data if necessary.
-  This is called continuously by the run() method.
+  @brief  Monitors the record buffer and reads it into the capture ring if necessary.
+  This is called continuously by the capture thread.
 */
 int RtAudioManager::MonitorCaptureBuffer()
 {
@@ -733,10 +792,10 @@ int RtAudioManager::MonitorCaptureBuffer()
   }
 
   // Limit our capture chunk size to the largest size we can actually send out on the network.
-  int captureChunkSize = (int)(_captureSampleRate * _bufferLatency); // Calculated in samples.
-  if( captureChunkSize > (CAPTURE_CHUNK_SIZE / BYTES_PER_WORD ) ) // Compared in samples.
+  int captureChunkSize = (int)(_captureSampleRate * _bufferLatency); // Calculated in frames.
+  if( captureChunkSize > (CAPTURE_CHUNK_SIZE / GetCaptureFrameBytes() ) ) // Compared in frames.
   {
-      captureChunkSize = (CAPTURE_CHUNK_SIZE / BYTES_PER_WORD ); // Calculated in samples.
+      captureChunkSize = (CAPTURE_CHUNK_SIZE / GetCaptureFrameBytes() ); // Calculated in frames.
   }
 
   //alcGetIntegerv( _captureDevice, ALC_CAPTURE_SAMPLES, sizeof(int), &samplesAvailable );
@@ -747,61 +806,20 @@ int RtAudioManager::MonitorCaptureBuffer()
       return true;
   }
 
-  unsigned char data[CAPTURE_CHUNK_SIZE];
-  memset( data, 0, CAPTURE_CHUNK_SIZE );
-  //alcCaptureSamples( _captureDevice, data, captureChunkSize );
-
-  // OK TO HERE
-  if( _recordingCallback != NULL )
-  {
-      int resampleTarget = captureChunkSize * _captureSampleRate / MAX_SAMPLE_RATE;
-
-      // THIS line of code is responsible for all of the pops and clicks.
-      _recordResampler.Resample( data, captureChunkSize, resampleTarget, BYTES_PER_WORD, 1 );
-
-      _recordingCallback->ForwardRecordedData( data, (resampleTarget * BYTES_PER_WORD), _captureSampleRate);
-  }
+  // Capture isn't read from the stream yet.  Once it is, the input frames go into _captureRing
+  // with Write(), after StampCapture() with the stream's input latency, and the capture thread
+  // hands them on from there.
 
   return true;
 }
 
 /**
-     @brief     Main thread function for RtAudioManager.
-     This is the main thread function for RtAudioManager.  It calls functions to monitor
-     the primary, secondary, and capture buffers.
-     @return
-     This function should not only return when the class is terminated.
-     @note
-     This function includes a half-millisecond microsleep call.
+     @brief     Thread function required by AudioBufferInterface.
+     The thread is never started.  Playback is mixed in PlaybackCallback, on RtAudio's own
+     thread, and capture is read by the capture thread.  See StartCapture().
 */
 void* RtAudioManager::Entry()
 {
-//  int count;
-  while(!TestDestroy())
-  { 
-      // Grab and process any captured data.
-
-      MonitorCaptureBuffer();
-
-      // Call MonitorBuffer() here to make sure we fill the secondary buffers with
-      // silence if nothing is being received.
-
-      MonitorBuffer();
-
-      // Now that we're sure we have something in our secondary buffers we can mix in
-      // some data if we need to.
-
-      ProcessSoundBuffer();
-
-      // Sleep for 3 milliseconds.  That should be enough to get us at least 32 bytes of data at 8khz 16 bit mono.
-      // At 44.1 stereo we would get about 11 times that (352+).  Adjust if necessary for slower machines and/or
-      // machines running many applications.
-#ifdef linux
-      usleep( 3000 ); // More responsive because we have a more precise timer readily available.
-#else
-      Sleep( 3 );
-#endif
-  } 
   return NULL;
 }
 
@@ -826,6 +844,14 @@ bool RtAudioManager::StartCapture( )
 
   _capturing = true;
 
+  // Capture is read on its own thread so that neither the mix nor the recording callback
+  // can hold the other up.
+  if( !StartCaptureThread( _realtime.GetConfig() ) )
+  {
+      _capturing = false;
+      return false;
+  }
+
   return true;
 }
 
@@ -837,9 +863,10 @@ bool RtAudioManager::StartCapture( )
 */
 bool RtAudioManager::StopCapture( )
 {
-  //alcCaptureStop( _captureDevice );
-
   _capturing = false;
+  StopCaptureThread();
+
+  //alcCaptureStop( _captureDevice );
 
   return true;
 }
@@ -855,56 +882,14 @@ bool RtAudioManager::IsBufferPlaying( int channel )
   }
 
   // Returns the status of a secondary buffer.
-  _secondaryBuffers[channel]->_mutex->Lock();
-  bool playing = _secondaryBuffers[channel]->_isPlaying;
-  _secondaryBuffers[channel]->_mutex->Unlock();
-
-  return playing;
-}
-
-/**
-     @brief     Monitors secondary buffers and pads them with silence if necessary.
-     This function is here to monitor the secondary sound buffers and add silence ot them if
-     necessary in order to avoid underruns, which tend to sound like pops, clicks, and static.
-     It will keep at least one "chunk" of data in a secondary buffer, a chunk being the size
-     of a piece of data normally read to the primary buffer.
-     @return
-     No return values.
-     @note
-     The amount of data that MonitorBuffer tries to keep in a secondary buffer is dependent upon
-     the buffer latency value.
-*/
-void RtAudioManager::MonitorBuffer()
-{
-  int count;
-  int readAvail;
-  int chunkSize;
-  for( count = 0; count < _numBuffers; count++ )
-  {
-    _secondaryBuffers[count]->_mutex->Lock();
-    bool state = _secondaryBuffers[count]->_isPlaying;
-    _secondaryBuffers[count]->_mutex->Unlock();
-    if( state == false )
-    {
-	    continue;
-    }
-    _secondaryBuffers[count]->_mutex->Lock();
-    // Our buffer needs silence if we have less than one record chunk of data left in it.
-    readAvail = (_secondaryBuffers[count]->_bufferData)->GetReadAvail();
-    chunkSize = (int)_secondaryBuffers[count]->_chunkSize;
-    _secondaryBuffers[count]->_mutex->Unlock();
-    if( readAvail < chunkSize )
-	{
-	  //FillBufferSilence( count, chunkSize );
-	}
-  }
-
-  return;
+  return _activeChannels->Contains( channel );
 }
 
 /**
   @brief  Sets the latency of buffers in milliseconds.
-  Sets the latency for primary, secondary, and capture buffers in milliseconds.
+  Sets the latency for primary, secondary, and capture buffers in milliseconds.  This is safe
+  to call while playing: the mixer builds its scratch space for the new block size here and
+  the audio thread switches to it between blocks.
    @note
   The playback latency will be twice the buffer latency value because it gets the
   delay once for secondary buffer monitoring and once for primary buffer monitoring.
@@ -916,25 +901,120 @@ void RtAudioManager::SetBufferLatency( int msec )
   {
       return;
   }
-  // This would be EXTREMELY non-thread-safe if called while the app was running.
-  //
-  // Any dialog or entry point that allows changing this number should be grayed
-  // or disabled while the app is running (such as how it is done in the Digital Radio).
   _bufferLatency = (double)msec / 1000.0;
 
   int channel;
   for( channel = 0; channel < _numBuffers; channel++ )
   {
       _secondaryBuffers[channel]->_mutex->Lock();
-      _secondaryBuffers[channel]->_chunkSize = (int)(_bufferLatency * _secondaryBuffers[channel]->_sampleRate * _secondaryBuffers[channel]->_bytesPerSample);
-      // Make it an even number.
-      _secondaryBuffers[channel]->_chunkSize &= ~1;
+      _secondaryBuffers[channel]->UpdateChunkSize( _bufferLatency );
       _secondaryBuffers[channel]->_mutex->Unlock();
   }
 
+  if( _inited )
+  {
+      _mixer->Reconfigure( _bufferLatency );
+  }
+  else
+  {
+      AllocateMixArena();
+  }
+
   return;
 }
 
+/**
+  @brief  Spreads mixing over extra threads when many channels are playing.
+  Each of the numThreads workers only joins in once there are at least minChannelsPerThread
+  channels for it, so light loads are still mixed entirely on the audio thread.  Pass zero
+  to go back to single-threaded mixing.
+  @note
+  This replaces the mixer's workers and their scratch space, so it must not be called while
+  the app is running.
+*/
+bool RtAudioManager::SetMixThreads( int numThreads, int minChannelsPerThread )
+{
+  if( numThreads < 0 )
+  {
+      return false;
+  }
+  return _mixer->SetWorkerCount( numThreads, minChannelsPerThread );
+}
+
+/**
+  @brief  Requests real-time scheduling, CPU affinity, and memory locking for the mixing thread.
+  Mixing happens on RtAudio's callback thread, so the settings are applied at the start of
+  the next callback, and to any mix workers when they next wake.  Check GetRealtimeReport()
+  afterwards to see what the system allowed.
+*/
+bool RtAudioManager::SetRealtimeConfig( const RealtimeConfig& config )
+{
+  _realtime.SetConfig( config );
+  _mixer->SetRealtimeConfig( config );
+  if( _captureThread != NULL )
+  {
+      _captureThread->_realtime.SetConfig( config );
+  }
+  return true;
+}
+
+/**
+  @brief  Returns which of the real-time settings took effect.
+*/
+RealtimeReport RtAudioManager::GetRealtimeReport()
+{
+  return _realtime.GetReport();
+}
+
+/**
+  @brief  Turns adaptive latency on or off and sets its bounds.
+  Nothing changes until UpdateLatency() is called.
+*/
+bool RtAudioManager::SetLatencyConfig( const LatencyConfig& config )
+{
+  _latencyControl.SetConfig( config );
+  return true;
+}
+
+/**
+  @brief  Lets the latency controller act on what has happened since the last call.
+  Call this every few hundred milliseconds from a timer or other non-audio thread, since a
+  change goes through SetBufferLatency().
+  @return
+  The buffer latency in milliseconds after any change.
+*/
+int RtAudioManager::UpdateLatency()
+{
+  int latency = (int)(_bufferLatency * 1000.0 + 0.5);
+  if( !_inited )
+  {
+      return latency;
+  }
+  int newLatency = _latencyControl.Update( latency, _mixer );
+  if( newLatency != latency )
+  {
+      SetBufferLatency( newLatency );
+  }
+  return (int)(_bufferLatency * 1000.0 + 0.5);
+}
+
+/**
+  @brief  Returns the latency changes made since the last call, with the reason for each.
+*/
+std::vector<LatencyDecision> RtAudioManager::TakeLatencyDecisions()
+{
+  return _latencyControl.TakeDecisions();
+}
+
+/**
+  @brief  Sizes the mixer's scratch space for the current latency.
+  Called from Init() and SetBufferLatency().
+*/
+void RtAudioManager::AllocateMixArena()
+{
+  _mixer->Allocate( _bufferLatency, _playbackSampleRate, MAX_SAMPLE_RATE );
+}
+
 /**
  @brief  Grabs data from the capture buffer and forwards it to the appropriate function.
 */
@@ -953,13 +1033,45 @@ int RtAudioManager::GetPeak( int channel )
         return 0;
     }
 
-    _secondaryBuffers[channel]->_mutex->Lock();
-    int peak = _secondaryBuffers[channel]->_peak;
-    _secondaryBuffers[channel]->_mutex->Unlock();
-    return peak;
+    // The mixer publishes meter levels atomically, so the UI never waits on the audio thread.
+    return _secondaryBuffers[channel]->_peak.load( std::memory_order_relaxed );
+}
+
+int RtAudioManager::GetRms( int channel )
+{
+    if( channel < 0 || channel >= _numBuffers )
+    {
+        return 0;
+    }
+
+    return _secondaryBuffers[channel]->_rms.load( std::memory_order_relaxed );
+}
+
+int RtAudioManager::GetMasterPeak()
+{
+    return _mixer->GetMasterPeak();
 }
 
+int RtAudioManager::GetMasterRms()
+{
+    return _mixer->GetMasterRms();
+}
+
+/**
+  @brief  Returns the number of bytes waiting in a secondary buffer.
+  Kept in bytes for existing callers; use GetNumFramesQueued() for a count in frames.
+*/
 int RtAudioManager::GetNumSamplesQueued(int channel)
+{
+	return GetNumBytesQueued(channel);
+}
+
+/**
+  @brief  Returns the number of frames waiting in a secondary buffer.
+  Frames are counted at the channel's own sample rate.  Use GetPlaybackPosition() to include
+  what has already been mixed but not yet heard.
+*/
+int RtAudioManager::GetNumFramesQueued(int channel)
 {
 	if( channel < 0 || channel >= _numBuffers )
 	{
@@ -967,12 +1079,16 @@ int RtAudioManager::GetNumSamplesQueued(int channel)
 	}
 	int value;
 	_secondaryBuffers[channel]->_mutex->Lock();
-	value = _secondaryBuffers[channel]->_bufferData->GetReadAvail();
+	value = _secondaryBuffers[channel]->_bufferData->GetReadAvail() /
+		( _secondaryBuffers[channel]->_bytesPerSample * _secondaryBuffers[channel]->_channels );
 	_secondaryBuffers[channel]->_mutex->Unlock();
 	return value;
 }
 
-int RtAudioManager::GetWriteBytesAvailable(int channel)
+/**
+  @brief  Returns the number of bytes waiting in a secondary buffer.
+*/
+int RtAudioManager::GetNumBytesQueued(int channel)
 {
 	if( channel < 0 || channel >= _numBuffers )
 	{
@@ -980,160 +1096,45 @@ int RtAudioManager::GetWriteBytesAvailable(int channel)
 	}
 	int value;
 	_secondaryBuffers[channel]->_mutex->Lock();
-	value = _secondaryBuffers[channel]->_bufferData->GetWriteAvail();
+	value = _secondaryBuffers[channel]->_bufferData->GetReadAvail();
 	_secondaryBuffers[channel]->_mutex->Unlock();
 	return value;
 }
 
-/*bool RtAudioManager::MixAudio(ALuint workingBuffer)
+/**
+  @brief  Reports how much of a channel has been heard and how long new data will take to be heard.
+  Combines the data waiting in the secondary buffer with the mixer's record of what it has
+  handed to the device.  Use it to keep video or other events in step with the sound.
+  @return
+  false if the channel doesn't exist.
+*/
+bool RtAudioManager::GetPlaybackPosition( int channel, PlaybackPosition* position )
 {
-  int writePos = 0;     // Write positions of the buffer.
-  int counter = 0;      // Data iterator.
-  int bytesWritten = 0;
-  int channel = 0;      // Channel iterator.
-
-  // Statistical data on pauses, re-inits, underruns, overflows, etc.
-  static int nodata = 0;
-  static int nobytesread = 0;
-  static int misreads = 0;
-
-  // Calculate the size of buffer we need to mix a chunk of 16-bit stereo data for the length of time
-  // defined by our latency and sample rate.
-  int maxBufferSize = (int)(_playbackSampleRate * 2 * _bufferLatency * _playbackByteAlign);
-  maxBufferSize &= ~3;
-  // Buffer for a single channel's data.
-  unsigned char* channelData = new unsigned char[maxBufferSize];
-  memset( channelData, 0, maxBufferSize );
-  // Buffer for mixed data.
-  unsigned char *copyBuffer = new unsigned char[maxBufferSize];
-  memset( copyBuffer, 0, maxBufferSize );
-  int bytesRead;
-
-  // Get our volume modifier per-channel.
-  double* rightVolumeAdjustment = new double[_numBuffers];
-  double* leftVolumeAdjustment = new double[_numBuffers];
-  CalculateChannelVolume(leftVolumeAdjustment, rightVolumeAdjustment);
-
-  // Get data from our secondary buffers and mix it all together.
-  for( channel = 0; channel < _numBuffers; channel++ )
-  {
-      // Tracking for V/U meters.
-      int maxValue = 0;
-
-      // Don't mix it if it isn't playing.
-      _secondaryBuffers[channel]->_mutex->Lock();
-      bool status = _secondaryBuffers[channel]->_isPlaying;
-      _secondaryBuffers[channel]->_mutex->Unlock();
-      if( status == false )
-      {
-	    continue;
-      }
-
-      // Set set our chunk size and grab a chunk of data.  Make sure we are requesting an
-      // even number of bytes.  Not doing so would hose every other chunk of data.
-      _secondaryBuffers[channel]->_mutex->Lock();
-      // Reset peaked data - this is a per-chunk test.
-      int bytesRequested = (int)(_secondaryBuffers[channel]->_sampleRate * _bufferLatency * _secondaryBuffers[channel]->_bytesPerSample );
-      bytesRequested &= ~1;
-
-      bytesRead = (_secondaryBuffers[channel]->_bufferData)->Read( channelData, bytesRequested );
-      _secondaryBuffers[channel]->_mutex->Unlock();
-
-#ifdef _DEBUG
-  // Log in debug mode only.
-  FILE* fp;
-  char filename[64];
-  memset( filename, 0, 64 );
-  _snprintf( filename, 64, "getdatafrombuffer%d.raw", channel );
-  if( (fp = fopen( filename, "ab" ) ))
-  {
-     fwrite( channelData, bytesRead, 1, fp );
-     fclose( fp );
-  }
-#endif
-
-
-      // We can't mix a channel if it doesn't give us any data.  If we get nothing, we fake it
-      // with blank data.
-      if( bytesRead == 0 )
-      {
-          nobytesread++;
-          memset( channelData, 0, maxBufferSize );
-		  continue;
-      }
-      else if( bytesRead != bytesRequested )
-      {
-		  int difference = bytesRequested - bytesRead;
-          misreads++;
-      }
-
-      // Add our result to the copy buffer.
-      //
-      // Note that with four channels being mixed down, it would be very easy to get some ugly
-      // digital clipping due to volume overflow.  If it sounds bad, turn down the master volume.
-      //
-      // Cast these to two-byte shorts in order to allow ourselves to multiply each sample by a float without
-      // breaking things.  Things will break if a short isn't two bytes.
-      short* sampleBuffer = (short *)channelData;
-      short* shortCopyBuffer = (short *)copyBuffer;
-	  int channelOffset = channel % 2;
-      for( counter = 0; counter < (bytesRead / 2); counter++ )
-      {
-          writePos = counter * 2 + channelOffset;
-          if( abs(sampleBuffer[counter]) > maxValue )
-          {
-			maxValue = abs(sampleBuffer[counter]);
-          }
-          shortCopyBuffer[writePos] += (sampleBuffer[counter] * leftVolumeAdjustment[channel] );
-      }
-
-	  // Set the number of bytes written to the max number of bytes written for any channel.
-	  if( bytesWritten < bytesRead)
-	  {
-		bytesWritten = bytesRead;
-	  }
-      _secondaryBuffers[channel]->_mutex->Lock();
-      _secondaryBuffers[channel]->_peak = maxValue;
-      _secondaryBuffers[channel]->_mutex->Unlock();
-  } // Cycle through channels.
-  delete[] leftVolumeAdjustment;
-  delete[] rightVolumeAdjustment;
-  delete[] channelData;
-
-  // If we wrote no data, set our write length to the length of the blank buffer intead
-  // of that of the number of bytes we've written.  This relies on the channelData being
-  // initially memset to all zeroes.
-  if( bytesWritten == 0 )
-  {
-      nodata++;
-      bytesWritten = maxBufferSize;
-  }
-
-  // Put it in the buffer
-  //
-  // We take the number of bytes of data in our mixing buffer and divide it by the two
-  // bytes per sample we are using and two channels for the number of frames.
-#ifdef _DEBUG
-  // Log in debug mode only.
-  FILE* fp;
-  if( (fp = fopen( "soundcard_data_16signed_stereo.raw", "ab" ) ))
-  {
-     fwrite( copyBuffer, bytesWritten, 1, fp );
-     fclose( fp );
-  }
-#endif
-
-  // Write the data to the buffer.  Since this is a stereo buffer we can just dump it right in.
-  //alBufferData(workingBuffer, _format, copyBuffer, bytesWritten, _playbackSampleRate );
-  //alSourceQueueBuffers( _playbackHandle, 1, &workingBuffer);
-
-  // Free the buffer we were sending to snd_pcm_writei
-  delete[] copyBuffer;
-
-  RestartBufferIfNecessary();
+	if( channel < 0 || channel >= _numBuffers || position == NULL )
+	{
+		return false;
+	}
+	SecondaryBuffer* buffer = _secondaryBuffers[channel];
+	buffer->_mutex->Lock();
+	int bufferedFrames = buffer->_bufferData->GetReadAvail() / ( buffer->_bytesPerSample * buffer->_channels );
+	unsigned int sampleRate = buffer->_sampleRate;
+	buffer->_mutex->Unlock();
+	*position = _mixer->GetPosition( channel, bufferedFrames, sampleRate );
+	return true;
+}
 
-  return true;
-}*/
+int RtAudioManager::GetWriteBytesAvailable(int channel)
+{
+	if( channel < 0 || channel >= _numBuffers )
+	{
+		return 0;
+	}
+	int value;
+	_secondaryBuffers[channel]->_mutex->Lock();
+	value = _secondaryBuffers[channel]->_bufferData->GetWriteAvail();
+	_secondaryBuffers[channel]->_mutex->Unlock();
+	return value;
+}
 
 // After we've put data in the buffer, we may need to restart it, usually in the case
 // of an underrun, etc.
@@ -1165,34 +1166,6 @@ void RtAudioManager::RestartBufferIfNecessary()
   }*/
 }
 
-// Calculates the volume on each channel based on volume, pan, and master volume settings.
-void RtAudioManager::CalculateChannelVolume(double * rightVolumeAdjustment, double * leftVolumeAdjustment)
-{
-  int channel = 0;
-
-  // Set up our volume+pan multipliers for each channel to make this run a little quicker.
-  for( channel = 0; channel < _numBuffers; channel++ )
-  {
-      // We are using pan to attenuate the channel that we're panning away from, but we are not increasing
-      // the volume on the channel we've panned toward.  Doing so would put us in danger of digital clipping
-      // unless we limit the volume adjustment values to 1.0.
-      _secondaryBuffers[channel]->_mutex->Lock();
-      if( _secondaryBuffers[channel]->_pan < 0 )
-      {
-	    leftVolumeAdjustment[channel] = ((_secondaryBuffers[channel]->_volume + 9600.0) / 9600.0) * ((_masterVolume + 9600.0) / 9600.0f);
-	    rightVolumeAdjustment[channel] = ((_secondaryBuffers[channel]->_pan + 1000.0) / 1000.0) *
-	      ((_secondaryBuffers[channel]->_volume + 9600.0) / 9600.0) * ((_masterVolume + 9600.0) / 9600.0);
-      }
-      else
-      {
-	    leftVolumeAdjustment[channel] = ((_secondaryBuffers[channel]->_pan * -1.0f + 1000.0 ) / 1000.0) *
-	      ((_secondaryBuffers[channel]->_volume + 9600.0) / 9600.0 ) * ((_masterVolume + 9600.0) / 9600.0);
-	    rightVolumeAdjustment[channel] = ((_secondaryBuffers[channel]->_volume + 9600.0) / 9600.0) * ((_masterVolume + 9600.0) / 9600.0f);
-      }
-      _secondaryBuffers[channel]->_mutex->Unlock();
-  }
-}
-
 //// Changes data from the channel sample rate to our playback sample rate.
 //int RtAudioManager::ResampleChunk(unsigned char* channelData, int channelNumber, int bytesRead, int bytesRequested)
 //{
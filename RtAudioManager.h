@@ -3,9 +3,12 @@
 #define _RTAUDIOMANAGER_H_
 
 #include "RingBuffer.h"
+#include "ActiveChannelList.h"
+#include "Mixer.h"
 #include "RtAudio.h"
 // On Linux, this Requires that alut-dev be installed:
 #include <vector>
+#include <atomic>
 
 #include "AudioRecordingCallback.h"
 #include "SecondaryBuffer.h"
@@ -21,11 +24,11 @@ public:
 	/// Get individual secondary buffer sample rate.
 	unsigned int GetSampleRate(int channel);
     bool Init(void *parentWindow = NULL, int* soundCard = NULL, const char *name = NULL);
-	bool CreateCaptureBuffer( AudioRecordingCallback * recordCallback = NULL, int* soundCard = NULL, const char *name = NULL);
-
-	int MonitorCaptureBuffer();
+	bool CreateCaptureBuffer( AudioRecordingCallback * recordCallback = NULL, int* soundCard = NULL, const char *name = NULL,
+	                          int numChannels = MONO, int sampleFormat = SAMPLE_FORMAT_S16 );
 
     virtual bool UnInit();
+	virtual int MonitorCaptureBuffer();
 	virtual bool Play();
 	virtual bool Stop();
 	virtual bool Stop( int channel );
@@ -33,6 +36,8 @@ public:
 	virtual bool StopCapture();
 	virtual bool SetSampleRate( int channel, unsigned int frequency );
 	virtual bool SetRecordSampleRate( unsigned int sampleRate );
+	virtual bool SetChannelCount( int channel, int numChannels );
+	virtual int GetChannelCount( int channel );
 	virtual bool IsBufferPlaying( int channel );
 	// Get global playback buffer sample rate.
 	virtual unsigned int GetSampleRate();
@@ -47,33 +52,56 @@ public:
     bool EmptyBuffer( int channel );
 	virtual bool FillBufferSilence( int channel, int length );
 	virtual void SetBufferLatency( int msec );
+	virtual bool SetMixThreads( int numThreads, int minChannelsPerThread = 32 );
+	virtual bool SetRealtimeConfig( const RealtimeConfig& config );
+	virtual RealtimeReport GetRealtimeReport();
+	virtual bool SetLatencyConfig( const LatencyConfig& config );
+	virtual int UpdateLatency();
+	virtual std::vector<LatencyDecision> TakeLatencyDecisions();
 	virtual int GetNumSamplesQueued( int channel );
+	virtual int GetNumBytesQueued( int channel );
+	virtual int GetNumFramesQueued( int channel );
+	virtual bool GetPlaybackPosition( int channel, PlaybackPosition* position );
     virtual void* Entry();
     int GetPeak( int channel );
+    int GetRms( int channel );
+    int GetMasterPeak();
+    int GetMasterRms();
 	int GetWriteBytesAvailable(int channel);
 private:
     // Virtual private methods.
 	/// Take the sound data and forward it when we have a notification.
 	virtual bool ProcessCapturedData();
-	/// Check whether we need to fill the buffer with silence.
-	virtual void MonitorBuffer();
 
     // Non-virtual private methods and data
-    /// This function takes our secondary buffers and mixes them into a single stream to feed to the primary buffer.
-	bool ProcessSoundBuffer();
+    /// RtAudio calls this for each buffer of output; it mixes our secondary buffers straight into it.
+	static int PlaybackCallback( void* outputBuffer, void* inputBuffer, unsigned int numFrames,
+	                             double streamTime, RtAudioStreamStatus status, void* userData );
+	void MixAudio( short* output, int numFrames );
     // RtAudio source to send audio data to.
     RtAudio* _audio;
+	/// Number of times RtAudio has reported an output underflow.
+	int _underruns;
+	/// Frames of delay the API reports beyond the buffer being filled.  Zero if it doesn't know.
+	int _outputLatency;
 	unsigned int _playbackByteAlign;
 	int _playbackFrames;
-	bool _capturing;
-	char * _captureBuffer;
+	/// Set by StartCapture() and StopCapture(), read by the capture thread.
+	std::atomic<bool> _capturing;
 	std::vector<SecondaryBuffer *> _secondaryBuffers;
+	/// Channels that are currently playing.  Maintained by Play() and Stop().
+	ActiveChannelList* _activeChannels;
+	/// Mixes the playing secondary buffers.
+	Mixer* _mixer;
+	/// Real-time settings for the thread that runs the mixer.
+	RealtimeThread _realtime;
+	/// Adapts the buffer latency to the underruns seen by the audio thread.
+	LatencyController _latencyControl;
+	void AllocateMixArena();
 	/// Number of bytes per sample, may be expanded to cover more formats.
     int _format;
 	/// We may need to add some variables to track our buffer playing.
 	//int XrunRecover( snd_pcm_t* handle, int err );
-	//bool MixAudio(ALuint workingBuffer);
-	void CalculateChannelVolume(double* leftVolumeAdjustment, double* righVolumeAdjustment);
 	int ResampleChunk( unsigned char* channelData, int channelNumber, int bytesRead, int bytesRequested);
     virtual bool Play( int channel );
 	void RestartBufferIfNecessary( void );
@@ -0,0 +1,195 @@
+#include "SampleFormat.h"
+
+int SampleFormat::GetBytes( int format )
+{
+  switch( format )
+  {
+    case SAMPLE_FORMAT_S16:
+      return 2;
+    case SAMPLE_FORMAT_S24:
+      return 3;
+    case SAMPLE_FORMAT_S32:
+    case SAMPLE_FORMAT_F32:
+      return 4;
+  }
+  return 0;
+}
+
+bool SampleFormat::IsValid( int format )
+{
+  return GetBytes( format ) != 0;
+}
+
+/**
+ @brief  Reads one sample, scaled to [-1, 1) as Deinterleave() does.  For code that looks at
+ samples one at a time.
+*/
+float SampleFormat::GetSample( const unsigned char* sample, int format )
+{
+  switch( format )
+  {
+    case SAMPLE_FORMAT_S16:
+      return (float)*(const short *)sample * ( 1.0f / 32768.0f );
+    case SAMPLE_FORMAT_S24:
+      return (float)( (int)( ( (unsigned int)sample[0] << 8 ) | ( (unsigned int)sample[1] << 16 ) | ( (unsigned int)sample[2] << 24 ) ) >> 8 ) * ( 1.0f / 8388608.0f );
+    case SAMPLE_FORMAT_S32:
+      return (float)*(const int *)sample * ( 1.0f / 2147483648.0f );
+    case SAMPLE_FORMAT_F32:
+      return *(const float *)sample;
+  }
+  return 0.0f;
+}
+
+// The integer formats share these loops.  Samples are read with a fixed type so that each
+// loop is a plain load, convert, and multiply.
+static void DeinterleaveS16( const short* in, int numFrames, int numChannels, float* const* planes )
+{
+  const float scale = 1.0f / 32768.0f;
+  int frame;
+  if( numChannels == 1 )
+  {
+      float* out = planes[0];
+      for( frame = 0; frame < numFrames; frame++ )
+      {
+          out[frame] = (float)in[frame] * scale;
+      }
+      return;
+  }
+  if( numChannels == 2 )
+  {
+      float* left = planes[0];
+      float* right = planes[1];
+      for( frame = 0; frame < numFrames; frame++ )
+      {
+          left[frame] = (float)in[frame * 2] * scale;
+          right[frame] = (float)in[frame * 2 + 1] * scale;
+      }
+      return;
+  }
+  int channel;
+  for( channel = 0; channel < numChannels; channel++ )
+  {
+      float* out = planes[channel];
+      const short* source = in + channel;
+      for( frame = 0; frame < numFrames; frame++ )
+      {
+          out[frame] = (float)source[frame * numChannels] * scale;
+      }
+  }
+}
+
+static void DeinterleaveS32( const int* in, int numFrames, int numChannels, float* const* planes )
+{
+  const float scale = 1.0f / 2147483648.0f;
+  int frame;
+  if( numChannels == 1 )
+  {
+      float* out = planes[0];
+      for( frame = 0; frame < numFrames; frame++ )
+      {
+          out[frame] = (float)in[frame] * scale;
+      }
+      return;
+  }
+  if( numChannels == 2 )
+  {
+      float* left = planes[0];
+      float* right = planes[1];
+      for( frame = 0; frame < numFrames; frame++ )
+      {
+          left[frame] = (float)in[frame * 2] * scale;
+          right[frame] = (float)in[frame * 2 + 1] * scale;
+      }
+      return;
+  }
+  int channel;
+  for( channel = 0; channel < numChannels; channel++ )
+  {
+      float* out = planes[channel];
+      const int* source = in + channel;
+      for( frame = 0; frame < numFrames; frame++ )
+      {
+          out[frame] = (float)source[frame * numChannels] * scale;
+      }
+  }
+}
+
+static void DeinterleaveF32( const float* in, int numFrames, int numChannels, float* const* planes )
+{
+  int frame;
+  if( numChannels == 1 )
+  {
+      float* out = planes[0];
+      for( frame = 0; frame < numFrames; frame++ )
+      {
+          out[frame] = in[frame];
+      }
+      return;
+  }
+  if( numChannels == 2 )
+  {
+      float* left = planes[0];
+      float* right = planes[1];
+      for( frame = 0; frame < numFrames; frame++ )
+      {
+          left[frame] = in[frame * 2];
+          right[frame] = in[frame * 2 + 1];
+      }
+      return;
+  }
+  int channel;
+  for( channel = 0; channel < numChannels; channel++ )
+  {
+      float* out = planes[channel];
+      const float* source = in + channel;
+      for( frame = 0; frame < numFrames; frame++ )
+      {
+          out[frame] = source[frame * numChannels];
+      }
+  }
+}
+
+// Packed 24-bit samples aren't aligned to anything wider than a byte, so they are assembled
+// into the top of an int and shifted back down to keep the sign.
+static void DeinterleaveS24( const unsigned char* in, int numFrames, int numChannels, float* const* planes )
+{
+  const float scale = 1.0f / 8388608.0f;
+  int stride = numChannels * 3;
+  int channel;
+  for( channel = 0; channel < numChannels; channel++ )
+  {
+      float* out = planes[channel];
+      const unsigned char* source = in + channel * 3;
+      int frame;
+      for( frame = 0; frame < numFrames; frame++ )
+      {
+          const unsigned char* sample = source + frame * stride;
+          int value = (int)( ( (unsigned int)sample[0] << 8 ) | ( (unsigned int)sample[1] << 16 ) | ( (unsigned int)sample[2] << 24 ) ) >> 8;
+          out[frame] = (float)value * scale;
+      }
+  }
+}
+
+/**
+     @brief     Splits interleaved frames into one float array per channel.
+     Each of planes[0] to planes[numChannels - 1] must have room for numFrames samples.  The
+     frames must be aligned to their sample size, which the capture ring guarantees.
+*/
+void SampleFormat::Deinterleave( const unsigned char* frames, int numFrames, int numChannels, int format, float* const* planes )
+{
+  switch( format )
+  {
+    case SAMPLE_FORMAT_S16:
+      DeinterleaveS16( (const short *)frames, numFrames, numChannels, planes );
+      break;
+    case SAMPLE_FORMAT_S24:
+      DeinterleaveS24( frames, numFrames, numChannels, planes );
+      break;
+    case SAMPLE_FORMAT_S32:
+      DeinterleaveS32( (const int *)frames, numFrames, numChannels, planes );
+      break;
+    case SAMPLE_FORMAT_F32:
+      DeinterleaveF32( (const float *)frames, numFrames, numChannels, planes );
+      break;
+  }
+}
@@ -0,0 +1,30 @@
+#ifndef _SAMPLEFORMAT_H_
+#define _SAMPLEFORMAT_H_
+
+/// Sample formats for captured audio.  All are little-endian and interleaved.
+/// 16-bit signed integer.  The default, and the only format every manager supports.
+#define SAMPLE_FORMAT_S16 0
+/// 24-bit signed integer packed into 3 bytes.
+#define SAMPLE_FORMAT_S24 1
+/// 32-bit signed integer.  Also how most drivers deliver 24-bit audio padded to 4 bytes.
+#define SAMPLE_FORMAT_S32 2
+/// 32-bit float, nominally between -1 and 1.
+#define SAMPLE_FORMAT_F32 3
+
+/**
+     @brief     Sizes of and conversions between the capture sample formats.
+     Deinterleave() splits interleaved frames into one float array per channel, scaled to
+     [-1, 1).  Mono and stereo get their own loops with a fixed stride so the compiler can
+     vectorize them.  Wider frames use a strided loop per channel.
+*/
+class SampleFormat
+{
+public:
+	/// Bytes per sample, or 0 if the format is unknown.
+	static int GetBytes( int format );
+	static bool IsValid( int format );
+	static float GetSample( const unsigned char* sample, int format );
+	static void Deinterleave( const unsigned char* frames, int numFrames, int numChannels, int format, float* const* planes );
+};
+
+#endif
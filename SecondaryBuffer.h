@@ -3,34 +3,49 @@
 #include "Resampler.h"
 #include "RingBuffer.h"
 #include "wx/thread.h"
+#include <atomic>
 //#include "System/Thread/CriticalSection.h"
 
 /**
-     @brief     A struct that represents a single mono channel for a secondary audio buffer.
-     This struct contains the data necessary to keep track of a single mono channel of audio
+     @brief     A struct that represents a single secondary audio buffer.
+     This struct contains the data necessary to keep track of a single stream of audio
      data.  It includes a ring buffer to hold the data and information such as volume, pan,
-     and sample rate settings.  This is intended to be an equivalent to a DirectSound
-     secondary buffer.
-     @note      The secondary buffer is not itself thread-safe.  Users are required to lock
-     the included mutex whenever necessary.
+     sample rate, and channel count settings.  Stereo and multichannel streams are stored as
+     interleaved frames so their channels can never drift apart.  This is intended to be an
+     equivalent to a DirectSound secondary buffer.
+     @note      The mutex serializes the control and writing threads.  The mixer takes no lock:
+     it is the ring buffer's only reader, and it mixes from its own copy of the settings,
+     which the managers keep up to date by posting commands to the Mixer.  Whether a buffer is
+     playing is tracked by the owning manager's ActiveChannelList rather than by the buffer
+     itself.
 */
 class SecondaryBuffer
 {
 public:
-	SecondaryBuffer() {};
+	SecondaryBuffer() : _peak(0), _rms(0) {};
 	~SecondaryBuffer() {};
     unsigned int _sampleRate;
     int _volume;
     int _pan;
     unsigned int _bytesPerSample;  // Should default to 2.
-    /// This is [buffer latency] x [samplerate] x [bytes per sample] and is the chunk size used for buffer writes and reads.
+    unsigned int _channels;  // Interleaved channels per frame.  Should default to 1.
+    /// This is [buffer latency] x [samplerate] x [bytes per sample] x [channels] and is the chunk size used for buffer writes and reads.
     /// typically this will be 800 for 8KHz and 4410 for 44.1KHz
     unsigned int _chunkSize;
-    bool _isPlaying;
+    /// Recalculates _chunkSize, keeping it a whole number of frames.
+    void UpdateChunkSize( double bufferLatency )
+    {
+        unsigned int frameSize = _bytesPerSample * _channels;
+        _chunkSize = (unsigned int)(bufferLatency * _sampleRate * frameSize);
+        _chunkSize -= _chunkSize % frameSize;
+    }
     RingBuffer* _bufferData;
     wxMutex* _mutex;
-    int _peak;
-    Resampler _resampler; /**< Allows sample rate conversion */
+    /// Meter levels for the last block mixed, in sample units.  Written by the mixer and read
+    /// by the UI without taking the mutex.
+    std::atomic<int> _peak;
+    std::atomic<int> _rms;
+    Resampler _resampler; /**< Allows sample rate conversion */
 };
 
 #endif
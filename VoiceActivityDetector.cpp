@@ -0,0 +1,167 @@
+#include <math.h>
+#include "VoiceActivityDetector.h"
+#include "SampleFormat.h"
+
+/// The noise floor closes this fraction of the gap to a quieter window each window, so one
+/// dropout doesn't pull it all the way down.
+#define VAD_NOISE_FALL 0.5
+
+VoiceActivityDetector::VoiceActivityDetector()
+{
+  _pending = false;
+  _voiceFrames = 0;
+  _silentFrames = 0;
+  Apply();
+}
+
+VoiceActivityDetector::~VoiceActivityDetector()
+{
+}
+
+/**
+ @brief  Stores a new config for the delivery thread to pick up.  Detection starts over with it.
+*/
+void VoiceActivityDetector::SetConfig( const VadConfig& config )
+{
+  _mutex.Lock();
+  _config = config;
+  _mutex.Unlock();
+  _pending.store( true, std::memory_order_release );
+}
+
+VadConfig VoiceActivityDetector::GetConfig()
+{
+  _mutex.Lock();
+  VadConfig config = _config;
+  _mutex.Unlock();
+  return config;
+}
+
+VadStats VoiceActivityDetector::GetStats()
+{
+  VadStats stats;
+  stats._voiceFrames = _voiceFrames.load( std::memory_order_relaxed );
+  stats._silentFrames = _silentFrames.load( std::memory_order_relaxed );
+  return stats;
+}
+
+void VoiceActivityDetector::ResetStats()
+{
+  _voiceFrames = 0;
+  _silentFrames = 0;
+}
+
+void VoiceActivityDetector::Apply()
+{
+  _pending.store( false, std::memory_order_relaxed );
+  _mutex.Lock();
+  _active = _config;
+  _mutex.Unlock();
+  _mode = _active._mode;
+  _windowFrames = 0;
+  _energy = 0.0;
+  _zeroCrossings = 0;
+  _lastNegative = false;
+  _noiseDb = 1.0;
+  _hangoverFrames = 0;
+  _voice = false;
+}
+
+/**
+     @brief     Classifies frames up to the end of the current analysis window.
+     Each frame is the average of its channels.  The decision covers the frames taken, and
+     only changes when a window is completed.
+     @return
+     The number of frames taken, at least 1 if numFrames is.
+*/
+int VoiceActivityDetector::Process( const unsigned char* frames, int numFrames, int numChannels, int format, unsigned int sampleRate, bool* voice )
+{
+  int windowLength = (int)( (long long)_active._windowMs * sampleRate / 1000 );
+  if( windowLength < 1 )
+  {
+      windowLength = 1;
+  }
+  int count = windowLength - _windowFrames;
+  if( count > numFrames )
+  {
+      count = numFrames;
+  }
+  int sampleBytes = SampleFormat::GetBytes( format );
+  float scale = 1.0f / numChannels;
+  for( int frame = 0; frame < count; frame++ )
+  {
+      const unsigned char* sample = frames + frame * numChannels * sampleBytes;
+      float value = 0.0f;
+      for( int channel = 0; channel < numChannels; channel++ )
+      {
+          value += SampleFormat::GetSample( sample + channel * sampleBytes, format );
+      }
+      value *= scale;
+      _energy += (double)value * value;
+      bool negative = value < 0.0f;
+      if( negative != _lastNegative )
+      {
+          _zeroCrossings++;
+      }
+      _lastNegative = negative;
+  }
+  _windowFrames += count;
+  if( _windowFrames >= windowLength )
+  {
+      EndWindow( sampleRate );
+  }
+  *voice = _voice;
+  if( _voice )
+  {
+      _voiceFrames.fetch_add( count, std::memory_order_relaxed );
+  }
+  else
+  {
+      _silentFrames.fetch_add( count, std::memory_order_relaxed );
+  }
+  return count;
+}
+
+/**
+ @brief  Decides whether the window just completed was voice and tracks the noise floor.
+*/
+void VoiceActivityDetector::EndWindow( unsigned int sampleRate )
+{
+  double level = 10.0 * log10( _energy / _windowFrames + 1e-12 );
+  double zeroCrossingRate = (double)_zeroCrossings / _windowFrames;
+  if( _noiseDb > 0.0 )
+  {
+      _noiseDb = level;
+  }
+  double above = level - _noiseDb;
+  bool voiced = level > _active._minLevelDb && above > _active._thresholdDb &&
+    ( zeroCrossingRate <= _active._maxZeroCrossingRate || above > 2.0 * _active._thresholdDb );
+
+  if( level < _noiseDb )
+  {
+      _noiseDb += ( level - _noiseDb ) * VAD_NOISE_FALL;
+  }
+  else
+  {
+      // Rises slowly even through voice, so a lasting rise in the noise is followed in the end.
+      _noiseDb += _active._noiseRiseDb * _windowFrames / sampleRate;
+  }
+  // Anything quieter can't be voice anyway, and a floor far below it would take too long to rise.
+  if( _noiseDb < _active._minLevelDb - _active._thresholdDb )
+  {
+      _noiseDb = _active._minLevelDb - _active._thresholdDb;
+  }
+
+  if( voiced )
+  {
+      _hangoverFrames = (int)( (long long)_active._hangoverMs * sampleRate / 1000 );
+  }
+  else if( _hangoverFrames > 0 )
+  {
+      _hangoverFrames -= _windowFrames;
+  }
+  _voice = voiced || _hangoverFrames > 0;
+  _windowFrames = 0;
+  _energy = 0.0;
+  _zeroCrossings = 0;
+}
@@ -0,0 +1,106 @@
+#ifndef _VOICEACTIVITYDETECTOR_H_
+#define _VOICEACTIVITYDETECTOR_H_
+
+#include "wx/thread.h"
+#include <atomic>
+
+/// What a recording callback's VoiceActivityDetector does with silence.
+/// Everything is delivered unchanged.
+#define VAD_MODE_OFF 0
+/// Everything is delivered, with CaptureSpan::_voice false on the silent runs.
+#define VAD_MODE_MARK 1
+/// Silent runs are not delivered at all.
+#define VAD_MODE_DROP 2
+
+/**
+     @brief     Settings for a recording callback's voice activity detection.
+     Off by default.
+*/
+class VadConfig
+{
+public:
+	VadConfig() : _mode(VAD_MODE_OFF), _windowMs(10), _thresholdDb(9.0), _minLevelDb(-55.0), _maxZeroCrossingRate(0.35),
+		_hangoverMs(300), _noiseRiseDb(3.0) {};
+	/// One of the VAD_MODE values.
+	int _mode;
+	/// Length of each analysis window, in milliseconds.
+	int _windowMs;
+	/// How far above the noise floor a window has to be to count as voice, in dB.
+	double _thresholdDb;
+	/// Windows quieter than this, in dB below full scale, are never voice.
+	double _minLevelDb;
+	/// Fraction of samples that change sign, above which a window that is only just over the
+	/// threshold is taken for hiss rather than voice.
+	double _maxZeroCrossingRate;
+	/// How long voice stays on after the last voiced window, so word endings and short pauses
+	/// aren't cut, in milliseconds.
+	int _hangoverMs;
+	/// How fast the noise floor estimate may rise, in dB per second.  It falls straight away.
+	double _noiseRiseDb;
+};
+
+/**
+     @brief     Frames a VoiceActivityDetector has classified, as voice or silence.
+*/
+class VadStats
+{
+public:
+	VadStats() : _voiceFrames(0), _silentFrames(0) {};
+	long long _voiceFrames;
+	long long _silentFrames;
+};
+
+/**
+     @brief     Energy and zero-crossing voice activity detection for one recording callback.
+     Captured frames are cut into short windows.  A window is voice when its energy is well
+     above a running estimate of the noise floor and above an absolute minimum, unless it
+     only just clears the threshold and crosses zero so often that it looks like hiss.  Voice
+     then holds for the hangover time.
+     The delivery thread passes frames through Process(), which says how many frames share
+     one decision, so runs of voice and silence can be delivered as spans in place.
+     @note      SetConfig() may be called from any thread.  The delivery thread picks the
+     config up the next time it calls Process(), as RealtimeThread does.
+*/
+class VoiceActivityDetector
+{
+public:
+	VoiceActivityDetector();
+	~VoiceActivityDetector();
+	void SetConfig( const VadConfig& config );
+	VadConfig GetConfig();
+	VadStats GetStats();
+	void ResetStats();
+	/// Called on the delivery thread before each delivery.  Returns the mode in effect.
+	int ApplyIfPending()
+	{
+		if( _pending.load( std::memory_order_acquire ) )
+		{
+			Apply();
+		}
+		return _mode;
+	}
+	int Process( const unsigned char* frames, int numFrames, int numChannels, int format, unsigned int sampleRate, bool* voice );
+private:
+	void Apply();
+	void EndWindow( unsigned int sampleRate );
+	wxMutex _mutex;
+	VadConfig _config;
+	std::atomic<bool> _pending;
+	/// The rest is only used on the delivery thread.
+	int _mode;
+	VadConfig _active;
+	/// The window being filled.
+	int _windowFrames;
+	double _energy;
+	int _zeroCrossings;
+	bool _lastNegative;
+	/// Noise floor in dB, or above 0 before the first window.
+	double _noiseDb;
+	/// Hangover left, in frames.
+	int _hangoverFrames;
+	bool _voice;
+	std::atomic<long long> _voiceFrames;
+	std::atomic<long long> _silentFrames;
+};
+
+#endif
@@ -0,0 +1,206 @@
+#include <string.h>
+#include "WavWriter.h"
+
+/// Largest value a 32-bit RIFF size field can hold.
+#define MAX_RIFF_SIZE 0xFFFFFFFFULL
+/// Size of the ds64 chunk body: RIFF size, data size, sample count, and an empty table.
+#define DS64_SIZE 28
+
+/// Writes a value in little-endian order regardless of the host's byte order.
+static void PutLittleEndian( unsigned char* dest, unsigned long long value, int numBytes )
+{
+  int count;
+  for( count = 0; count < numBytes; count++ )
+  {
+      dest[count] = (unsigned char)(value >> (count * 8));
+  }
+}
+
+WavWriter::WavWriter()
+{
+  _file = NULL;
+  _sampleRate = 0;
+  _numChannels = 0;
+  _bitsPerSample = 0;
+  _flags = 0;
+  _headerLength = 0;
+  _dataLength = 0;
+}
+
+WavWriter::~WavWriter()
+{
+  Close();
+}
+
+/**
+ @brief  Creates the file and writes a header with the sizes left at zero.
+ flags is any combination of the WAV_FLAG values.
+ @return
+ false if the file could not be created.
+*/
+bool WavWriter::Open( const char* filename, unsigned int sampleRate, int numChannels, int bitsPerSample, int flags )
+{
+  Close();
+  if( filename == NULL || numChannels < 1 || bitsPerSample < 8 || ( bitsPerSample % 8 ) != 0 )
+  {
+      return false;
+  }
+  _file = fopen( filename, "wb" );
+  if( _file == NULL )
+  {
+      return false;
+  }
+  if( flags & WAV_FLAG_ALIGNED )
+  {
+      setvbuf( _file, NULL, _IONBF, 0 );
+  }
+  _sampleRate = sampleRate;
+  _numChannels = numChannels;
+  _bitsPerSample = bitsPerSample;
+  _flags = flags;
+  _dataLength = 0;
+  // RIFF header, then the reserved ds64 space, the format chunk, and the data chunk header.
+  _headerLength = 12 + ( ( flags & WAV_FLAG_RF64 ) ? 8 + DS64_SIZE : 0 ) + 8 + 16 + 8;
+  if( flags & WAV_FLAG_ALIGNED )
+  {
+      _headerLength = WAV_DATA_ALIGNMENT;
+  }
+  if( !WriteHeader() )
+  {
+      fclose( _file );
+      _file = NULL;
+      return false;
+  }
+  return true;
+}
+
+/**
+ @brief  Appends sample data.  The data must already be in the format given to Open().
+ @return
+ false if the file isn't open, the write failed, or the file has reached the 4 GB limit
+ and wasn't opened with WAV_FLAG_RF64.
+*/
+bool WavWriter::Write( const unsigned char* data, int length )
+{
+  if( _file == NULL || length < 0 )
+  {
+      return false;
+  }
+  // The RIFF size counts everything after its own field, plus a pad byte if the data is odd.
+  if( !( _flags & WAV_FLAG_RF64 ) && _dataLength + length > MAX_RIFF_SIZE - _headerLength )
+  {
+      return false;
+  }
+  if( fwrite( data, 1, length, _file ) != (size_t)length )
+  {
+      return false;
+  }
+  _dataLength += length;
+  return true;
+}
+
+/**
+ @brief  Fills in the header sizes for the data written so far and flushes the file.
+ Writing carries on from the end.
+*/
+bool WavWriter::UpdateHeader()
+{
+  if( _file == NULL )
+  {
+      return false;
+  }
+  if( fseek( _file, 0, SEEK_SET ) != 0 || !WriteHeader() )
+  {
+      return false;
+  }
+  return fseek( _file, 0, SEEK_END ) == 0 && fflush( _file ) == 0;
+}
+
+/**
+ @brief  Fills in the header sizes and closes the file.
+*/
+bool WavWriter::Close()
+{
+  if( _file == NULL )
+  {
+      return true;
+  }
+  bool result = true;
+  // The data chunk has to be an even number of bytes long.
+  if( _dataLength & 1 )
+  {
+      result = fputc( 0, _file ) != EOF;
+  }
+  if( fseek( _file, 0, SEEK_SET ) != 0 || !WriteHeader() )
+  {
+      result = false;
+  }
+  if( fclose( _file ) != 0 )
+  {
+      result = false;
+  }
+  _file = NULL;
+  return result;
+}
+
+bool WavWriter::IsOpen()
+{
+  return _file != NULL;
+}
+
+unsigned long long WavWriter::GetDataLength()
+{
+  return _dataLength;
+}
+
+int WavWriter::GetHeaderLength()
+{
+  return _headerLength;
+}
+
+bool WavWriter::WriteHeader()
+{
+  unsigned char header[WAV_DATA_ALIGNMENT];
+  int blockAlign = _numChannels * _bitsPerSample / 8;
+  unsigned long long paddedLength = _dataLength + ( _dataLength & 1 );
+  unsigned long long riffSize = _headerLength - 8 + paddedLength;
+  // Only possible with WAV_FLAG_RF64.  The 32-bit sizes are then set to all ones and the
+  // real ones go in the ds64 chunk.
+  bool rf64 = riffSize > MAX_RIFF_SIZE;
+  int pos = 12;
+  memset( header, 0, _headerLength );
+  memcpy( header, rf64 ? "RF64" : "RIFF", 4 );
+  PutLittleEndian( header + 4, rf64 ? MAX_RIFF_SIZE : riffSize, 4 );
+  memcpy( header + 8, "WAVE", 4 );
+  if( _flags & WAV_FLAG_RF64 )
+  {
+      memcpy( header + pos, rf64 ? "ds64" : "JUNK", 4 );
+      PutLittleEndian( header + pos + 4, DS64_SIZE, 4 );
+      if( rf64 )
+      {
+          PutLittleEndian( header + pos + 8, riffSize, 8 );
+          PutLittleEndian( header + pos + 16, _dataLength, 8 );
+          PutLittleEndian( header + pos + 24, _dataLength / blockAlign, 8 );
+      }
+      pos += 8 + DS64_SIZE;
+  }
+  memcpy( header + pos, "fmt ", 4 );
+  PutLittleEndian( header + pos + 4, 16, 4 );
+  PutLittleEndian( header + pos + 8, ( _flags & WAV_FLAG_FLOAT ) ? 3 : 1, 2 ); // IEEE float or PCM
+  PutLittleEndian( header + pos + 10, _numChannels, 2 );
+  PutLittleEndian( header + pos + 12, _sampleRate, 4 );
+  PutLittleEndian( header + pos + 16, _sampleRate * blockAlign, 4 );
+  PutLittleEndian( header + pos + 20, blockAlign, 2 );
+  PutLittleEndian( header + pos + 22, _bitsPerSample, 2 );
+  pos += 8 + 16;
+  if( pos + 8 < _headerLength )
+  {
+      // Fill the gap up to the aligned data chunk with a chunk readers know to skip.
+      memcpy( header + pos, "JUNK", 4 );
+      PutLittleEndian( header + pos + 4, _headerLength - 8 - ( pos + 8 ), 4 );
+      pos = _headerLength - 8;
+  }
+  memcpy( header + pos, "data", 4 );
+  PutLittleEndian( header + pos + 4, rf64 ? MAX_RIFF_SIZE : _dataLength, 4 );
+  return fwrite( header, 1, _headerLength, _file ) == (size_t)_headerLength;
+}
@@ -0,0 +1,53 @@
+#ifndef _WAVWRITER_H_
+#define _WAVWRITER_H_
+
+#include <stdio.h>
+
+/// Options for WavWriter::Open().
+/// The samples are 32-bit floats rather than integers.
+#define WAV_FLAG_FLOAT 1
+/// Reserve room for an RF64 header, so the file can keep growing past 4 GB.
+#define WAV_FLAG_RF64 2
+/// Pad the header so the sample data starts on a WAV_DATA_ALIGNMENT boundary, and leave
+/// buffering to the caller, who is expected to write whole blocks.
+#define WAV_FLAG_ALIGNED 4
+
+/// Offset of the sample data in a file opened with WAV_FLAG_ALIGNED.
+#define WAV_DATA_ALIGNMENT 4096
+
+/**
+     @brief     Writes PCM audio to a RIFF WAVE file.
+     The header is written with placeholder sizes when the file is opened and patched with
+     the real sizes by Close(), so data can be streamed in as it is produced.
+     UpdateHeader() patches them in mid-stream too, so a recording that is cut off still
+     opens.
+     A file opened with WAV_FLAG_RF64 starts out as an ordinary WAVE file with a JUNK chunk
+     reserving space for the 64-bit sizes.  If it grows past what the 32-bit RIFF sizes can
+     hold, the header is rewritten as RF64 (EBU Tech 3306) and the JUNK chunk becomes ds64.
+*/
+class WavWriter
+{
+public:
+	WavWriter();
+	~WavWriter();
+	bool Open( const char* filename, unsigned int sampleRate, int numChannels, int bitsPerSample, int flags = 0 );
+	bool Write( const unsigned char* data, int length );
+	bool UpdateHeader();
+	bool Close();
+	bool IsOpen();
+	/// Bytes of sample data written so far.
+	unsigned long long GetDataLength();
+	/// Bytes before the sample data.
+	int GetHeaderLength();
+private:
+	bool WriteHeader();
+	FILE* _file;
+	unsigned int _sampleRate;
+	int _numChannels;
+	int _bitsPerSample;
+	int _flags;
+	int _headerLength;
+	unsigned long long _dataLength;
+};
+
+#endif
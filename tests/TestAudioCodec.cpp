@@ -0,0 +1,155 @@
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include "AudioCodec.h"
+#include "TestCheck.h"
+
+#define ADPCM_TEST_BLOCKS 4
+
+/**
+     @brief     Runs every 16-bit value through a G.711 coder and back.
+     The error has to stay within half a step of the segment the value falls in, which is
+     about 1/32 of the value plus the smallest step.  Every code has to survive a second
+     trip unchanged.
+*/
+static void CheckG711( bool aLaw )
+{
+  std::vector<short> samples( 65536 );
+  std::vector<unsigned char> encoded( 65536 );
+  std::vector<short> decoded( 65536 );
+  int value;
+  for( value = 0; value < 65536; value++ )
+  {
+      samples[value] = (short)( value - 32768 );
+  }
+  if( aLaw )
+  {
+      AudioCodec::EncodeALaw( &samples[0], 65536, &encoded[0] );
+      AudioCodec::DecodeALaw( &encoded[0], 65536, &decoded[0] );
+  }
+  else
+  {
+      AudioCodec::EncodeULaw( &samples[0], 65536, &encoded[0] );
+      AudioCodec::DecodeULaw( &encoded[0], 65536, &decoded[0] );
+  }
+  int worst = 0;
+  for( value = 0; value < 65536; value++ )
+  {
+      int error = abs( samples[value] - decoded[value] ) - ( abs( samples[value] ) / 32 + 64 );
+      if( error > worst )
+      {
+          worst = error;
+      }
+  }
+  CHECK( worst == 0 );
+
+  unsigned char codes[256];
+  short levels[256];
+  unsigned char recoded[256];
+  short relevels[256];
+  for( value = 0; value < 256; value++ )
+  {
+      codes[value] = (unsigned char)value;
+  }
+  if( aLaw )
+  {
+      AudioCodec::DecodeALaw( codes, 256, levels );
+      AudioCodec::EncodeALaw( levels, 256, recoded );
+      AudioCodec::DecodeALaw( recoded, 256, relevels );
+  }
+  else
+  {
+      AudioCodec::DecodeULaw( codes, 256, levels );
+      AudioCodec::EncodeULaw( levels, 256, recoded );
+      AudioCodec::DecodeULaw( recoded, 256, relevels );
+  }
+  int mismatches = 0;
+  for( value = 0; value < 256; value++ )
+  {
+      if( levels[value] != relevels[value] )
+      {
+          ++mismatches;
+      }
+  }
+  CHECK( mismatches == 0 );
+}
+
+/**
+     @brief     Codes a stereo tone as IMA ADPCM and checks what Decode() gives back.
+     Each block's first frame is stored as it is.  The rest only has to track the tone.
+*/
+static void CheckAdpcm()
+{
+  int numFrames = ADPCM_TEST_BLOCKS * IMA_ADPCM_BLOCK_FRAMES;
+  std::vector<short> frames( numFrames * 2 );
+  int frame;
+  for( frame = 0; frame < numFrames; frame++ )
+  {
+      frames[frame * 2] = (short)( 12000.0 * sin( frame * 0.05 ) );
+      frames[frame * 2 + 1] = (short)( 6000.0 * sin( frame * 0.13 ) );
+  }
+
+  int length = AudioCodec::GetEncodedLength( AUDIO_CODEC_IMA_ADPCM, numFrames, 2 );
+  CHECK( length == ADPCM_TEST_BLOCKS * IMA_ADPCM_BLOCK_BYTES * 2 );
+  CHECK( AudioCodec::GetDecodedFrames( AUDIO_CODEC_IMA_ADPCM, length, 2 ) == numFrames );
+  CHECK( AudioCodec::GetDecodedFrames( AUDIO_CODEC_IMA_ADPCM, length - 1, 2 ) == -1 );
+
+  std::vector<unsigned char> encoded( length );
+  int stepIndex[2] = { 0, 0 };
+  int block;
+  for( block = 0; block < ADPCM_TEST_BLOCKS; block++ )
+  {
+      AudioCodec::EncodeAdpcmBlock( &frames[block * IMA_ADPCM_BLOCK_FRAMES * 2], 2, stepIndex,
+                                    &encoded[block * IMA_ADPCM_BLOCK_BYTES * 2] );
+  }
+  std::vector<short> decoded( numFrames * 2 );
+  CHECK( AudioCodec::Decode( AUDIO_CODEC_IMA_ADPCM, &encoded[0], length, 2, &decoded[0] ) == numFrames );
+
+  for( block = 0; block < ADPCM_TEST_BLOCKS; block++ )
+  {
+      int first = block * IMA_ADPCM_BLOCK_FRAMES * 2;
+      CHECK( decoded[first] == frames[first] );
+      CHECK( decoded[first + 1] == frames[first + 1] );
+  }
+  // Skip the first block while the step size settles on the tone.
+  double signal = 0.0;
+  double noise = 0.0;
+  int sample;
+  for( sample = IMA_ADPCM_BLOCK_FRAMES * 2; sample < numFrames * 2; sample++ )
+  {
+      double error = decoded[sample] - frames[sample];
+      signal += (double)frames[sample] * frames[sample];
+      noise += error * error;
+  }
+  double snr = 10.0 * log10( signal / ( noise > 0.0 ? noise : 1.0 ) );
+  printf( "IMA ADPCM SNR %.1f dB\n", snr );
+  CHECK( snr > 25.0 );
+}
+
+/**
+     @brief     Checks that plain PCM and G.711 go through Decode() and the length helpers.
+*/
+static void CheckDecode()
+{
+  short frames[8] = { 0, 1000, -1000, 32767, -32768, 12345, -54, 7 };
+  unsigned char encoded[8];
+  short decoded[8];
+  CHECK( AudioCodec::GetEncodedLength( AUDIO_CODEC_PCM16, 4, 2 ) == 16 );
+  CHECK( AudioCodec::GetEncodedLength( AUDIO_CODEC_ULAW, 4, 2 ) == 8 );
+  CHECK( AudioCodec::GetDecodedFrames( AUDIO_CODEC_PCM16, 15, 2 ) == -1 );
+  CHECK( AudioCodec::Decode( AUDIO_CODEC_PCM16, (unsigned char *)frames, 16, 2, decoded ) == 4 );
+  CHECK( decoded[3] == 32767 && decoded[7] == 7 );
+  AudioCodec::EncodeULaw( frames, 8, encoded );
+  CHECK( AudioCodec::Decode( AUDIO_CODEC_ULAW, encoded, 8, 2, decoded ) == 4 );
+  CHECK( decoded[0] == 0 );
+  CHECK( !AudioCodec::IsValid( AUDIO_CODEC_IMA_ADPCM + 1 ) );
+}
+
+int main()
+{
+  CheckG711( false );
+  CheckG711( true );
+  CheckAdpcm();
+  CheckDecode();
+  return testFailures;
+}
@@ -0,0 +1,148 @@
+#include "CaptureRing.h"
+#include "TestCheck.h"
+
+#define RING_BYTES 1024
+#define FRAME_BYTES 4
+#define WRITE_BYTES 100
+
+/**
+ @brief  Writes bytes numbered by their position in the stream, so readers can tell where they came from.
+*/
+static int WritePattern( CaptureRing& ring, int numBytes )
+{
+  unsigned char data[RING_BYTES * 2];
+  long long start = ring.GetWriteTotal();
+  int count;
+  for( count = 0; count < numBytes; count++ )
+  {
+      data[count] = (unsigned char)( start + count );
+  }
+  return ring.Write( data, numBytes );
+}
+
+/**
+ @brief  Checks that the spans hold the stream from their first frame on, without a seam at the wrap.
+*/
+static bool SpansMatch( const CaptureSpan& first, const CaptureSpan& second )
+{
+  long long position = first._frame * FRAME_BYTES;
+  int count;
+  for( count = 0; count < first._length; count++ )
+  {
+      if( first._data[count] != (unsigned char)( position + count ) )
+      {
+          return false;
+      }
+  }
+  position += first._length;
+  if( second._length > 0 && second._frame * FRAME_BYTES != position )
+  {
+      return false;
+  }
+  for( count = 0; count < second._length; count++ )
+  {
+      if( second._data[count] != (unsigned char)( position + count ) )
+      {
+          return false;
+      }
+  }
+  return true;
+}
+
+/**
+ @brief  A reader that stops reading is lapped.  The writer carries on and the reader skips ahead.
+*/
+static void CheckIdleReaderLapped()
+{
+  CaptureRing ring;
+  CHECK( ring.Allocate( RING_BYTES, FRAME_BYTES ) );
+  int reader = ring.AddReader();
+  CHECK( reader >= 0 );
+  int written = 0;
+  while( written < 3000 )
+  {
+      CHECK( WritePattern( ring, WRITE_BYTES ) == WRITE_BYTES );
+      written += WRITE_BYTES;
+  }
+  CHECK( ring.GetDroppedBytes() == 0 );
+
+  CaptureSpan first;
+  CaptureSpan second;
+  int readAvail = ring.GetReadSpans( reader, &first, &second );
+  // A lapped reader comes back half a ring behind the writer.
+  CHECK( readAvail == RING_BYTES / 2 );
+  CHECK( first._length + second._length == readAvail );
+  CHECK( first._frame == ( written - readAvail ) / FRAME_BYTES );
+  CHECK( SpansMatch( first, second ) );
+  ring.Consume( reader, readAvail );
+  CHECK( ring.GetReadAvail( reader ) == 0 );
+  CHECK( ring.GetOverflowBytes( reader ) == written - readAvail );
+}
+
+/**
+ @brief  Spans a reader is holding are never overwritten.  The writer drops what doesn't fit instead.
+*/
+static void CheckBusyReaderProtected()
+{
+  CaptureRing ring;
+  CHECK( ring.Allocate( RING_BYTES, FRAME_BYTES ) );
+  int reader = ring.AddReader();
+  CHECK( WritePattern( ring, 400 ) == 400 );
+
+  CaptureSpan first;
+  CaptureSpan second;
+  CHECK( ring.GetReadSpans( reader, &first, &second ) == 400 );
+  CHECK( WritePattern( ring, 1000 ) == RING_BYTES - 400 );
+  CHECK( ring.GetDroppedBytes() == 1000 - ( RING_BYTES - 400 ) );
+  CHECK( SpansMatch( first, second ) );
+  ring.Consume( reader, 400 );
+  CHECK( ring.GetOverflowBytes( reader ) == 0 );
+
+  // What did get in is more than half a ring, so the reader skips the oldest of it.
+  CHECK( ring.GetReadSpans( reader, &first, &second ) == RING_BYTES / 2 );
+  CHECK( SpansMatch( first, second ) );
+  ring.Consume( reader, RING_BYTES / 2 );
+  CHECK( ring.GetOverflowBytes( reader ) == RING_BYTES - 400 - RING_BYTES / 2 );
+}
+
+/**
+ @brief  A reader that keeps up sees every frame, however far behind another reader falls.
+*/
+static void CheckReadersIndependent()
+{
+  CaptureRing ring;
+  CHECK( ring.Allocate( RING_BYTES, FRAME_BYTES ) );
+  int fast = ring.AddReader();
+  int slow = ring.AddReader();
+  CHECK( fast != slow );
+  long long nextFrame = 0;
+  bool wrapped = false;
+  int block;
+  for( block = 0; block < 40; block++ )
+  {
+      CHECK( WritePattern( ring, WRITE_BYTES ) == WRITE_BYTES );
+      CaptureSpan first;
+      CaptureSpan second;
+      int readAvail = ring.GetReadSpans( fast, &first, &second );
+      CHECK( readAvail == WRITE_BYTES );
+      CHECK( first._frame == nextFrame );
+      CHECK( SpansMatch( first, second ) );
+      wrapped = wrapped || second._length > 0;
+      ring.Consume( fast, readAvail );
+      nextFrame += readAvail / FRAME_BYTES;
+  }
+  CHECK( wrapped );
+  CHECK( ring.GetOverflowBytes( fast ) == 0 );
+  CHECK( ring.GetOverflowBytes( slow ) > 0 );
+  CHECK( ring.GetDroppedBytes() == 0 );
+  ring.RemoveReader( slow );
+  CHECK( ring.AddReader() == slow );
+}
+
+int main()
+{
+  CheckIdleReaderLapped();
+  CheckBusyReaderProtected();
+  CheckReadersIndependent();
+  return testFailures;
+}
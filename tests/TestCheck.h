@@ -0,0 +1,20 @@
+#ifndef _TESTCHECK_H_
+#define _TESTCHECK_H_
+
+#include <stdio.h>
+
+/// Checks that have failed so far.  Each test's main() returns it, so make test stops on a failure.
+static int testFailures = 0;
+
+/// Reports a failed condition and carries on, so one run shows every failure.
+#define CHECK( condition ) \
+  do \
+  { \
+      if( !( condition ) ) \
+      { \
+          printf( "%s:%d: CHECK( %s ) failed\n", __FILE__, __LINE__, #condition ); \
+          ++testFailures; \
+      } \
+  } while( 0 )
+
+#endif
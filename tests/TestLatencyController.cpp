@@ -0,0 +1,117 @@
+#include <vector>
+#include "LatencyController.h"
+#include "Mixer.h"
+#include "TestCheck.h"
+
+/**
+ @brief  Settings with round numbers, and a stable period of zero so shrinking needs no waiting.
+*/
+static LatencyConfig GetTestConfig()
+{
+  LatencyConfig config;
+  config._enabled = true;
+  config._minLatency = 10;
+  config._maxLatency = 200;
+  config._growFactor = 1.5;
+  config._shrinkStep = 2;
+  config._stableSeconds = 0.0;
+  return config;
+}
+
+/**
+ @brief  Underruns grow the latency by the grow factor, up to the maximum.
+*/
+static void CheckGrow( Mixer* mixer )
+{
+  LatencyController controller;
+  LatencyConfig config = GetTestConfig();
+  config._stableSeconds = 1000.0;
+  controller.SetConfig( config );
+  // The first update after SetConfig() only takes a baseline.
+  controller.ReportUnderrun();
+  CHECK( controller.Update( 20, mixer ) == 20 );
+
+  controller.ReportUnderrun();
+  CHECK( controller.Update( 20, mixer ) == 30 );
+  controller.ReportUnderrun();
+  controller.ReportUnderrun();
+  CHECK( controller.Update( 150, mixer ) == 200 );
+  controller.ReportUnderrun();
+  CHECK( controller.Update( 200, mixer ) == 200 );
+  // Without a glitch, and before the stable period is up, nothing changes.
+  CHECK( controller.Update( 200, mixer ) == 200 );
+  CHECK( controller.GetUnderrunCount() == 5 );
+
+  std::vector<LatencyDecision> decisions = controller.TakeDecisions();
+  CHECK( decisions.size() == 2 );
+  if( decisions.size() == 2 )
+  {
+      CHECK( decisions[0]._oldLatency == 20 && decisions[0]._newLatency == 30 );
+      CHECK( decisions[0]._reason == LATENCY_REASON_UNDERRUN && decisions[0]._underruns == 1 );
+      CHECK( decisions[1]._newLatency == 200 && decisions[1]._underruns == 2 );
+  }
+  CHECK( controller.TakeDecisions().empty() );
+}
+
+/**
+ @brief  A stable system comes down one step at a time, and never below the minimum.
+*/
+static void CheckShrink( Mixer* mixer )
+{
+  LatencyController controller;
+  controller.SetConfig( GetTestConfig() );
+  CHECK( controller.Update( 50, mixer ) == 50 );
+  CHECK( controller.Update( 50, mixer ) == 48 );
+  CHECK( controller.Update( 48, mixer ) == 46 );
+  CHECK( controller.Update( 11, mixer ) == 10 );
+  CHECK( controller.Update( 10, mixer ) == 10 );
+
+  std::vector<LatencyDecision> decisions = controller.TakeDecisions();
+  CHECK( decisions.size() == 3 );
+  if( decisions.size() == 3 )
+  {
+      CHECK( decisions[0]._reason == LATENCY_REASON_STABLE );
+      CHECK( decisions[2]._oldLatency == 11 && decisions[2]._newLatency == 10 );
+  }
+}
+
+/**
+ @brief  A latency set outside the bounds is pulled back in.  A disabled controller leaves it alone.
+*/
+static void CheckBounds( Mixer* mixer )
+{
+  LatencyController controller;
+  LatencyConfig config = GetTestConfig();
+  config._stableSeconds = 1000.0;
+  controller.SetConfig( config );
+  CHECK( controller.Update( 500, mixer ) == 500 );
+  CHECK( controller.Update( 500, mixer ) == 200 );
+  CHECK( controller.Update( 5, mixer ) == 10 );
+  std::vector<LatencyDecision> decisions = controller.TakeDecisions();
+  CHECK( decisions.size() == 2 && decisions[0]._reason == LATENCY_REASON_BOUNDS );
+
+  // SetConfig() keeps the bounds usable whatever it is given.
+  config._minLatency = 0;
+  config._maxLatency = 5000;
+  controller.SetConfig( config );
+  CHECK( controller.GetConfig()._minLatency == 1 );
+  CHECK( controller.GetConfig()._maxLatency == 999 );
+
+  config._enabled = false;
+  controller.SetConfig( config );
+  controller.Update( 500, mixer );
+  controller.ReportUnderrun();
+  CHECK( controller.Update( 5, mixer ) == 5 );
+  CHECK( controller.TakeDecisions().empty() );
+}
+
+int main()
+{
+  // The controller only reads the mixer's statistics, so a mixer with no channels will do.
+  std::vector<SecondaryBuffer *> secondaryBuffers;
+  Mixer mixer( &secondaryBuffers );
+  CheckGrow( &mixer );
+  CheckShrink( &mixer );
+  CheckBounds( &mixer );
+  return testFailures;
+}
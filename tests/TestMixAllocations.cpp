@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include <math.h>
+#include <new>
+#include <atomic>
+#include "NullAudioManager.h"
+#include "TestCheck.h"
+
+#define TEST_CHANNELS 8
+#define TEST_BLOCKS 200
+/// Frames of tone kept on hand for refilling the channels between blocks.
+#define TONE_FRAMES 4096
+
+/// Heap allocations made by any thread while counting is switched on.
+static std::atomic<bool> counting( false );
+static std::atomic<long long> allocations( 0 );
+
+void* operator new( size_t size )
+{
+  if( counting.load( std::memory_order_relaxed ) )
+  {
+      allocations.fetch_add( 1, std::memory_order_relaxed );
+  }
+  void* memory = malloc( size > 0 ? size : 1 );
+  if( memory == NULL )
+  {
+      throw std::bad_alloc();
+  }
+  return memory;
+}
+
+void* operator new[]( size_t size )
+{
+  return operator new( size );
+}
+
+void operator delete( void* memory ) noexcept
+{
+  free( memory );
+}
+
+void operator delete[]( void* memory ) noexcept
+{
+  free( memory );
+}
+
+static short tone[TONE_FRAMES * STEREO];
+
+/**
+     @brief     Renders blocks through NullAudioManager and counts the allocations they make.
+     The channels mix a blend of sample rates and layouts so the resamplers and both pan
+     paths run.  They are topped up between blocks with counting off, since only the mix is
+     meant to be allocation free.
+*/
+static void CheckMixAllocations( int output, int numThreads )
+{
+  NullAudioManager manager( TEST_CHANNELS );
+  manager.SetOutput( output );
+  manager.SetPacing( NULLAUDIO_PACING_MANUAL );
+  if( numThreads > 1 )
+  {
+      manager.SetMixThreads( numThreads, 1 );
+  }
+  CHECK( manager.Init() );
+  int channel;
+  for( channel = 0; channel < TEST_CHANNELS; channel++ )
+  {
+      manager.SetSampleRate( channel, ( channel % 3 == 0 ) ? 22050 : ( channel % 3 == 1 ) ? 44100 : 48000 );
+      if( channel % 2 == 1 )
+      {
+          manager.SetChannelCount( channel, STEREO );
+      }
+      manager.SetVolume( channel, -600 );
+      manager.SetPan( channel, ( channel - TEST_CHANNELS / 2 ) * 1000 );
+  }
+  manager.Play();
+  // The first blocks apply the setup commands and settle the mixer.
+  manager.RenderBlocks( 4 );
+
+  allocations = 0;
+  int block;
+  for( block = 0; block < TEST_BLOCKS; block++ )
+  {
+      for( channel = 0; channel < TEST_CHANNELS; channel++ )
+      {
+          int length = TONE_FRAMES * BYTES_PER_WORD * manager.GetChannelCount( channel );
+          if( manager.GetWriteBytesAvailable( channel ) >= length )
+          {
+              manager.FillBuffer( channel, (unsigned char *)tone, length, manager.GetSampleRate( channel ) );
+          }
+      }
+      counting = true;
+      manager.RenderBlocks( 1 );
+      counting = false;
+      if( output == NULLAUDIO_OUTPUT_MEMORY && block % 16 == 15 )
+      {
+          manager.TakeRenderedData();
+      }
+  }
+  printf( "output %d, %d mix threads: %lld allocations in %d blocks\n", output, numThreads, allocations.load(), TEST_BLOCKS );
+  CHECK( allocations.load() == 0 );
+  CHECK( manager.GetMasterPeak() > 0 );
+  manager.UnInit();
+}
+
+int main()
+{
+  int frame;
+  for( frame = 0; frame < TONE_FRAMES * STEREO; frame++ )
+  {
+      tone[frame] = (short)( 8000.0 * sin( frame * 0.0627 ) );
+  }
+  CheckMixAllocations( NULLAUDIO_OUTPUT_NONE, 1 );
+  CheckMixAllocations( NULLAUDIO_OUTPUT_MEMORY, 1 );
+  CheckMixAllocations( NULLAUDIO_OUTPUT_NONE, 4 );
+  return testFailures;
+}
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "WavWriter.h"
+#include "TestCheck.h"
+
+#define TEST_FILE "TestWavWriter.wav"
+
+static unsigned long long GetLittleEndian( const unsigned char* source, int numBytes )
+{
+  unsigned long long value = 0;
+  int count;
+  for( count = numBytes - 1; count >= 0; count-- )
+  {
+      value = ( value << 8 ) | source[count];
+  }
+  return value;
+}
+
+static std::vector<unsigned char> ReadTestFile()
+{
+  std::vector<unsigned char> contents;
+  FILE* file = fopen( TEST_FILE, "rb" );
+  if( file == NULL )
+  {
+      return contents;
+  }
+  unsigned char buffer[4096];
+  size_t length;
+  while( ( length = fread( buffer, 1, sizeof( buffer ), file ) ) > 0 )
+  {
+      contents.insert( contents.end(), buffer, buffer + length );
+  }
+  fclose( file );
+  return contents;
+}
+
+/**
+ @brief  Finds a chunk by its tag, walking the chunks from the start of the RIFF body.
+ @return
+ The offset of the chunk's header, or -1 if it isn't there.
+*/
+static int FindChunk( const std::vector<unsigned char>& contents, const char* tag )
+{
+  size_t pos = 12;
+  while( pos + 8 <= contents.size() )
+  {
+      if( memcmp( &contents[pos], tag, 4 ) == 0 )
+      {
+          return (int)pos;
+      }
+      unsigned long long size = GetLittleEndian( &contents[pos + 4], 4 );
+      pos += 8 + size + ( size & 1 );
+  }
+  return -1;
+}
+
+/**
+ @brief  Writes a short file and checks every header field a reader would look at.
+*/
+static void CheckHeader( int flags, int expectedHeaderLength )
+{
+  unsigned char data[1001];
+  int count;
+  for( count = 0; count < (int)sizeof( data ); count++ )
+  {
+      data[count] = (unsigned char)count;
+  }
+  int bitsPerSample = ( flags & WAV_FLAG_FLOAT ) ? 32 : 16;
+  WavWriter writer;
+  CHECK( writer.Open( TEST_FILE, 48000, 2, bitsPerSample, flags ) );
+  CHECK( writer.GetHeaderLength() == expectedHeaderLength );
+  CHECK( writer.Write( data, 500 ) );
+  CHECK( writer.UpdateHeader() );
+
+  // Mid-recording the header already describes what has been written.
+  std::vector<unsigned char> contents = ReadTestFile();
+  int dataChunk = FindChunk( contents, "data" );
+  CHECK( dataChunk == expectedHeaderLength - 8 );
+  if( dataChunk >= 0 )
+  {
+      CHECK( GetLittleEndian( &contents[dataChunk + 4], 4 ) == 500 );
+  }
+
+  CHECK( writer.Write( data + 500, 501 ) );
+  CHECK( writer.GetDataLength() == 1001 );
+  CHECK( writer.Close() );
+  CHECK( !writer.IsOpen() );
+
+  contents = ReadTestFile();
+  // The odd-length data chunk gets a pad byte.
+  CHECK( contents.size() == (size_t)expectedHeaderLength + 1002 );
+  if( contents.size() != (size_t)expectedHeaderLength + 1002 )
+  {
+      return;
+  }
+  CHECK( memcmp( &contents[0], "RIFF", 4 ) == 0 );
+  CHECK( GetLittleEndian( &contents[4], 4 ) == contents.size() - 8 );
+  CHECK( memcmp( &contents[8], "WAVE", 4 ) == 0 );
+
+  int format = FindChunk( contents, "fmt " );
+  CHECK( format >= 0 );
+  if( format >= 0 )
+  {
+      CHECK( GetLittleEndian( &contents[format + 4], 4 ) == 16 );
+      CHECK( GetLittleEndian( &contents[format + 8], 2 ) == ( ( flags & WAV_FLAG_FLOAT ) ? 3U : 1U ) );
+      CHECK( GetLittleEndian( &contents[format + 10], 2 ) == 2 );
+      CHECK( GetLittleEndian( &contents[format + 12], 4 ) == 48000 );
+      CHECK( GetLittleEndian( &contents[format + 16], 4 ) == 48000U * 2 * bitsPerSample / 8 );
+      CHECK( GetLittleEndian( &contents[format + 20], 2 ) == 2U * bitsPerSample / 8 );
+      CHECK( GetLittleEndian( &contents[format + 22], 2 ) == (unsigned long long)bitsPerSample );
+  }
+  if( flags & WAV_FLAG_RF64 )
+  {
+      // Small files keep the ds64 space as a JUNK chunk until they need it.
+      CHECK( memcmp( &contents[12], "JUNK", 4 ) == 0 );
+      CHECK( GetLittleEndian( &contents[16], 4 ) == 28 );
+  }
+
+  dataChunk = FindChunk( contents, "data" );
+  CHECK( dataChunk == expectedHeaderLength - 8 );
+  if( dataChunk >= 0 )
+  {
+      CHECK( GetLittleEndian( &contents[dataChunk + 4], 4 ) == 1001 );
+      CHECK( memcmp( &contents[expectedHeaderLength], data, 1001 ) == 0 );
+      CHECK( contents[expectedHeaderLength + 1001] == 0 );
+  }
+}
+
+int main()
+{
+  CheckHeader( 0, 44 );
+  CheckHeader( WAV_FLAG_FLOAT, 44 );
+  CheckHeader( WAV_FLAG_RF64, 80 );
+  CheckHeader( WAV_FLAG_ALIGNED, WAV_DATA_ALIGNMENT );
+
+  WavWriter writer;
+  CHECK( !writer.Open( TEST_FILE, 48000, 0, 16 ) );
+  CHECK( !writer.Open( TEST_FILE, 48000, 2, 12 ) );
+  CHECK( !writer.Write( (const unsigned char *)"x", 1 ) );
+  remove( TEST_FILE );
+  return testFailures;
+}